@@ -0,0 +1,786 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef AIO_C
+#define AIO_C
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <linux/io_uring.h>
+
+/**
+  * the i/o of the files and of the local sockets, the static methods of myjvm/io/NativeIO:
+  *
+  *     int open(String path, int mode)         0 read, 1 write (created, truncated), 2 append, 3 read and write
+  *     int read(int fd, byte[] b, int off, int len)                    -1 at the end
+  *     int write(int fd, byte[] b, int off, int len)
+  *     int pread(int fd, byte[] b, int off, int len, long position)
+  *     int pwrite(int fd, byte[] b, int off, int len, long position)
+  *     long size(int fd)
+  *     long transfer(int in, long position, long count, int out)      from a file, in the kernel
+  *     int listen(String path), int accept(int fd), int connect(String path)    unix domain sockets
+  *     void close(int fd)
+  *
+  * the kernel reads and writes the elements of the byte[] itself, there is no buffer in between: the heap
+  * never moves a block, and the array of an i/o in flight is a root of gc.c.
+  * a virtual thread does not block its carrier: a socket is tried without waiting first, then the virtual
+  * thread leaves its carrier (see virtualThreadIoWait) and the poller thread waits for the socket to be
+  * ready, does the i/o and queues the virtual thread again, the result in its operand stack. a file (any fd
+  * that is not a socket) is read and written by io_uring. the poller uses io_uring, epoll if the kernel has
+  * none or with -Xaio:epoll, and then the files are read on the carrier. the platform threads and the
+  * pinned virtual threads block in the system call.
+  * an i/o error ends the process like the other java exceptions. an i/o waiting on a socket closed by
+  * another thread returns -1, close() waits for the i/o of the fd to end
+  */
+
+#define AIO_READ   0
+#define AIO_WRITE  1
+#define AIO_ACCEPT 2
+
+/* the kinds of the fds, cached in aio_fd_kinds */
+#define AIO_FD_UNKNOWN 0
+#define AIO_FD_FILE    1
+#define AIO_FD_SOCKET  2
+#define AIO_MAX_FDS    4096
+
+#define AIO_RING_ENTRIES 256
+
+typedef struct _AioOp {
+    int kind;
+    int fd;
+    CArray_char *array; // the elements are read or written
+    int off;
+    int len;
+    long position; // of pread and pwrite, -1 for the position of the fd
+    int socket;
+    int closed; // the fd is closed by another thread, the i/o returns -1
+    int wait_fd; // the dup of fd in the epoll set, -1 if none
+    VirtualThread *vt; // waiting for the i/o off its carrier, NULL if the thread blocks
+    int *result; // the slot of the result in the operand stack of vt
+    struct _AioOp *prev;
+    struct _AioOp *next;
+} AioOp;
+
+/* -Xaio:epoll, see main.c */
+int aio_use_epoll = 0;
+
+/* the i/o in flight, linked in aio_ops */
+static pthread_mutex_t aio_lock = PTHREAD_MUTEX_INITIALIZER;
+/* broadcast when an i/o ends, close() waits for those of its fd */
+static pthread_cond_t aio_done_cond = PTHREAD_COND_INITIALIZER;
+static AioOp *aio_ops = NULL;
+static int aio_started = 0;
+static int aio_epoll_fd = -1;
+static unsigned char aio_fd_kinds[AIO_MAX_FDS];
+
+/* the io_uring, the rings are mapped from the kernel. the submission queue is filled under aio_sq_lock,
+ * the completion queue is emptied by the poller only */
+static int aio_ring_fd = -1;
+static pthread_mutex_t aio_sq_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct io_uring_params aio_ring_params;
+static void *aio_sq_ring = NULL, *aio_cq_ring = NULL;
+static struct io_uring_sqe *aio_sqes = NULL;
+static unsigned *aio_sq_head, *aio_sq_tail, *aio_sq_mask, *aio_sq_array;
+static unsigned *aio_cq_head, *aio_cq_tail, *aio_cq_mask;
+static struct io_uring_cqe *aio_cqes;
+
+static void aioError(const char *what, int err)
+{
+    printf("Error: java.io.IOException: %s: %s\n", what, strerror(err));
+    exit(1);
+}
+
+static const char* aioOpName(AioOp *op)
+{
+    return AIO_READ == op->kind ? "read" : AIO_WRITE == op->kind ? "write" : "accept";
+}
+
+static void aioSetFdKind(int fd, int kind)
+{
+    if (fd >= 0 && fd < AIO_MAX_FDS) {
+        __atomic_store_n(&aio_fd_kinds[fd], kind, __ATOMIC_RELAXED);
+    }
+}
+
+static int aioIsSocket(int fd)
+{
+    struct stat st;
+    int kind = fd >= 0 && fd < AIO_MAX_FDS ? __atomic_load_n(&aio_fd_kinds[fd], __ATOMIC_RELAXED) : AIO_FD_UNKNOWN;
+
+    if (AIO_FD_UNKNOWN == kind) {
+        if (fstat(fd, &st) < 0) {
+            aioError("fstat", errno);
+        }
+        kind = S_ISSOCK(st.st_mode) ? AIO_FD_SOCKET : AIO_FD_FILE;
+        aioSetFdKind(fd, kind);
+    }
+    return AIO_FD_SOCKET == kind;
+}
+
+/**
+ * @brief aioResult the value returned to java for the result of the system call, a negative errno on error
+ */
+static int aioResult(AioOp *op, int res)
+{
+    if (res >= 0) {
+        if (AIO_ACCEPT == op->kind) {
+            aioSetFdKind(res, AIO_FD_SOCKET);
+        }
+        return AIO_READ == op->kind && 0 == res && op->len > 0 ? -1 : res;
+    }
+    if (__atomic_load_n(&op->closed, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+    aioError(aioOpName(op), -res);
+    return -1;
+}
+
+static void aioLink(AioOp *op)
+{
+    pthread_mutex_lock(&aio_lock);
+    op->prev = NULL;
+    op->next = aio_ops;
+    if (NULL != aio_ops) {
+        aio_ops->prev = op;
+    }
+    aio_ops = op;
+    pthread_mutex_unlock(&aio_lock);
+}
+
+/* called with aio_lock held */
+static void aioUnlink(AioOp *op)
+{
+    if (NULL != op->prev) {
+        op->prev->next = op->next;
+    } else {
+        aio_ops = op->next;
+    }
+    if (NULL != op->next) {
+        op->next->prev = op->prev;
+    }
+    pthread_cond_broadcast(&aio_done_cond);
+}
+
+/**
+ * @brief forEachAioRoot calls fn on the arrays of the i/o in flight, roots of gc.c
+ */
+void forEachAioRoot(void (*fn)(Object*, void*), void *arg)
+{
+    AioOp *op;
+
+    pthread_mutex_lock(&aio_lock);
+    for (op = aio_ops; NULL != op; op = op->next) {
+        if (NULL != op->array) {
+            fn((Object*)op->array, arg);
+        }
+    }
+    pthread_mutex_unlock(&aio_lock);
+}
+
+/** 1. the system calls **/
+
+/**
+ * @brief aioTry the i/o of a socket without waiting
+ * @return the result of the system call, -errno on error, -EAGAIN if it would wait
+ */
+static int aioTry(AioOp *op)
+{
+    char *buf = NULL == op->array ? NULL : op->array->elements + op->off;
+    int res;
+
+    do {
+        switch (op->kind) {
+        case AIO_READ:
+            res = recv(op->fd, buf, op->len, MSG_DONTWAIT);
+            break;
+        case AIO_WRITE:
+            res = send(op->fd, buf, op->len, MSG_DONTWAIT | MSG_NOSIGNAL);
+            break;
+        default:
+            // the listening sockets do not block, see listen()
+            res = accept(op->fd, NULL, NULL);
+            break;
+        }
+    } while (res < 0 && EINTR == errno);
+
+    return res < 0 ? -errno : res;
+}
+
+/**
+ * @brief aioSyscall the i/o in the current thread, it may block
+ * @return the result of the system call, -errno on error
+ */
+static int aioSyscall(AioOp *op)
+{
+    char *buf = NULL == op->array ? NULL : op->array->elements + op->off;
+    struct pollfd pfd;
+    int res;
+
+    for (;;) {
+        if (AIO_ACCEPT == op->kind) {
+            // a listening socket shut down stays readable, accept() fails with EAGAIN
+            if (__atomic_load_n(&op->closed, __ATOMIC_ACQUIRE)) {
+                return -EBADF;
+            }
+            if ((res = accept(op->fd, NULL, NULL)) < 0 && EAGAIN == errno) {
+                pfd.fd = op->fd;
+                pfd.events = POLLIN;
+                poll(&pfd, 1, -1);
+                continue;
+            }
+        } else if (op->socket) {
+            res = AIO_READ == op->kind ? recv(op->fd, buf, op->len, 0) : send(op->fd, buf, op->len, MSG_NOSIGNAL);
+        } else if (op->position < 0) {
+            res = AIO_READ == op->kind ? read(op->fd, buf, op->len) : write(op->fd, buf, op->len);
+        } else {
+            res = AIO_READ == op->kind ? pread(op->fd, buf, op->len, op->position) : pwrite(op->fd, buf, op->len, op->position);
+        }
+        if (res >= 0 || EINTR != errno) {
+            return res < 0 ? -errno : res;
+        }
+    }
+}
+
+/** 2. the poller **/
+
+static void aioComplete(AioOp *op, int res);
+
+/**
+ * @brief aioRingSubmit queues an entry in the submission queue of the io_uring and submits it
+ */
+static void aioRingSubmit(AioOp *op, int opcode, void *addr, unsigned len, unsigned long offset, unsigned events)
+{
+    struct io_uring_sqe *sqe;
+    unsigned tail, index;
+
+    pthread_mutex_lock(&aio_sq_lock);
+    tail = *aio_sq_tail;
+    index = tail & *aio_sq_mask;
+    sqe = &aio_sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->fd = op->fd;
+    sqe->addr = (unsigned long)addr;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->poll32_events = events;
+    sqe->user_data = (unsigned long)op;
+    aio_sq_array[index] = index;
+    __atomic_store_n(aio_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    // the entry is consumed by the call, the queue never fills up
+    while (syscall(__NR_io_uring_enter, aio_ring_fd, 1, 0, 0, NULL, 0) < 0) {
+        if (EINTR != errno && EAGAIN != errno && EBUSY != errno) {
+            aioError("io_uring_enter", errno);
+        }
+        sched_yield();
+    }
+    pthread_mutex_unlock(&aio_sq_lock);
+}
+
+/**
+ * @brief aioArm waits for the socket of the i/o to be ready, aioReady is called then
+ */
+static void aioArm(AioOp *op)
+{
+    struct epoll_event event;
+    unsigned events = AIO_WRITE == op->kind ? POLLOUT : POLLIN;
+
+    if (NULL != aio_sqes) {
+        aioRingSubmit(op, IORING_OP_POLL_ADD, NULL, 0, 0, events);
+        return;
+    }
+    // the epoll set has one entry per fd, an i/o has a fd of its own to wait with the others on the socket
+    event.events = (AIO_WRITE == op->kind ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+    event.data.ptr = op;
+    if (op->wait_fd < 0) {
+        if ((op->wait_fd = dup(op->fd)) < 0 || epoll_ctl(aio_epoll_fd, EPOLL_CTL_ADD, op->wait_fd, &event) < 0) {
+            aioError("epoll_ctl", errno);
+        }
+    } else if (epoll_ctl(aio_epoll_fd, EPOLL_CTL_MOD, op->wait_fd, &event) < 0) {
+        aioError("epoll_ctl", errno);
+    }
+}
+
+/**
+ * @brief aioReady the socket of the i/o is ready, or closed: the i/o is done or waits again
+ */
+static void aioReady(AioOp *op)
+{
+    int res = __atomic_load_n(&op->closed, __ATOMIC_ACQUIRE) ? -EBADF : aioTry(op);
+
+    if (-EAGAIN == res) {
+        aioArm(op);
+    } else {
+        aioComplete(op, res);
+    }
+}
+
+/**
+ * @brief aioComplete puts the result in the operand stack of the virtual thread and queues it
+ */
+static void aioComplete(AioOp *op, int res)
+{
+    VirtualThread *vt = op->vt;
+
+    if (op->wait_fd >= 0) {
+        epoll_ctl(aio_epoll_fd, EPOLL_CTL_DEL, op->wait_fd, NULL);
+        close(op->wait_fd);
+    }
+    *op->result = aioResult(op, res);
+    pthread_mutex_lock(&aio_lock);
+    aioUnlink(op);
+    pthread_mutex_unlock(&aio_lock);
+    free(op);
+    virtualThreadIoDone(vt);
+}
+
+static void* aioRingPoller(void *arg)
+{
+    struct io_uring_cqe *cqe;
+    AioOp *op;
+    unsigned head, tail;
+
+    for (;;) {
+        if (syscall(__NR_io_uring_enter, aio_ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && EINTR != errno) {
+            aioError("io_uring_enter", errno);
+        }
+        head = *aio_cq_head;
+        tail = __atomic_load_n(aio_cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            cqe = &aio_cqes[head & *aio_cq_mask];
+            op = (AioOp*)cqe->user_data;
+            // a socket was polled, a file read or written
+            if (op->socket && cqe->res >= 0) {
+                aioReady(op);
+            } else {
+                aioComplete(op, cqe->res);
+            }
+        }
+        __atomic_store_n(aio_cq_head, head, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static void* aioEpollPoller(void *arg)
+{
+    struct epoll_event events[64];
+    int i, n;
+
+    for (;;) {
+        if ((n = epoll_wait(aio_epoll_fd, events, 64, -1)) < 0) {
+            if (EINTR != errno) {
+                aioError("epoll_wait", errno);
+            }
+            continue;
+        }
+        for (i = 0; i < n; i++) {
+            aioReady((AioOp*)events[i].data.ptr);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief aioSetupRing maps the rings of a new io_uring
+ * @return 0 if the kernel has no io_uring, or one too old to read a file at its position
+ */
+static int aioSetupRing()
+{
+    struct io_uring_params *p = &aio_ring_params;
+    size_t sq_size, cq_size;
+
+    memset(p, 0, sizeof(struct io_uring_params));
+    if ((aio_ring_fd = syscall(__NR_io_uring_setup, AIO_RING_ENTRIES, p)) < 0) {
+        return 0;
+    }
+    sq_size = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    cq_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    if (0 == (p->features & IORING_FEAT_RW_CUR_POS) ||
+            MAP_FAILED == (aio_sq_ring = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, aio_ring_fd, IORING_OFF_SQ_RING)) ||
+            MAP_FAILED == (aio_cq_ring = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, aio_ring_fd, IORING_OFF_CQ_RING)) ||
+            MAP_FAILED == (aio_sqes = mmap(NULL, p->sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_POPULATE, aio_ring_fd, IORING_OFF_SQES))) {
+        // the process exits soon or forks a child, the mappings left are not unmapped
+        close(aio_ring_fd);
+        aio_ring_fd = -1;
+        aio_sqes = NULL;
+        return 0;
+    }
+    aio_sq_head = (unsigned*)((char*)aio_sq_ring + p->sq_off.head);
+    aio_sq_tail = (unsigned*)((char*)aio_sq_ring + p->sq_off.tail);
+    aio_sq_mask = (unsigned*)((char*)aio_sq_ring + p->sq_off.ring_mask);
+    aio_sq_array = (unsigned*)((char*)aio_sq_ring + p->sq_off.array);
+    aio_cq_head = (unsigned*)((char*)aio_cq_ring + p->cq_off.head);
+    aio_cq_tail = (unsigned*)((char*)aio_cq_ring + p->cq_off.tail);
+    aio_cq_mask = (unsigned*)((char*)aio_cq_ring + p->cq_off.ring_mask);
+    aio_cqes = (struct io_uring_cqe*)((char*)aio_cq_ring + p->cq_off.cqes);
+    return 1;
+}
+
+/**
+ * @brief aioStartPoller sets up the io_uring or the epoll set and starts the poller, once
+ */
+static void aioStartPoller()
+{
+    pthread_t tid;
+
+    pthread_mutex_lock(&aio_lock);
+    if (!aio_started) {
+        if ((aio_use_epoll || !aioSetupRing()) && (aio_epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+            aioError("epoll_create", errno);
+        }
+        if (0 != pthread_create(&tid, NULL, NULL != aio_sqes ? aioRingPoller : aioEpollPoller, NULL)) {
+            printf("Error: java.lang.OutOfMemoryError: unable to create new native thread\n");
+            exit(1);
+        }
+        pthread_detach(tid);
+        __atomic_store_n(&aio_started, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&aio_lock);
+}
+
+/* the poller is not in a child of fork, nor the i/o of the other threads: the child makes its own */
+static void aioPrepareFork()
+{
+    pthread_mutex_lock(&aio_lock);
+    pthread_mutex_lock(&aio_sq_lock);
+}
+
+static void aioParentAfterFork()
+{
+    pthread_mutex_unlock(&aio_sq_lock);
+    pthread_mutex_unlock(&aio_lock);
+}
+
+static void aioChildAfterFork()
+{
+    if (aio_ring_fd >= 0) {
+        munmap(aio_sq_ring, aio_ring_params.sq_off.array + aio_ring_params.sq_entries * sizeof(unsigned));
+        munmap(aio_cq_ring, aio_ring_params.cq_off.cqes + aio_ring_params.cq_entries * sizeof(struct io_uring_cqe));
+        munmap(aio_sqes, aio_ring_params.sq_entries * sizeof(struct io_uring_sqe));
+        close(aio_ring_fd);
+        aio_ring_fd = -1;
+        aio_sqes = NULL;
+    }
+    if (aio_epoll_fd >= 0) {
+        close(aio_epoll_fd);
+        aio_epoll_fd = -1;
+    }
+    aio_ops = NULL;
+    aio_started = 0;
+    pthread_cond_init(&aio_done_cond, NULL);
+    pthread_mutex_unlock(&aio_sq_lock);
+    pthread_mutex_unlock(&aio_lock);
+}
+
+__attribute__((constructor)) static void initAio()
+{
+    pthread_atfork(aioPrepareFork, aioParentAfterFork, aioChildAfterFork);
+}
+
+/** 3. the intrinsics **/
+
+/**
+ * @brief aioRun does the i/o and pushes its result. a virtual thread leaves its carrier if the i/o has to wait,
+ * the result is put in the slot pushed now by aioComplete
+ */
+static void aioRun(OPENV *env, AioOp *op)
+{
+    VirtualThread *vt;
+    AioOp *async;
+    int res;
+
+    op->socket = aioIsSocket(op->fd);
+    op->wait_fd = -1;
+    if (op->socket && op->position < 0 && -EAGAIN != (res = aioTry(op))) {
+        PUSH_STACK(env->current_stack, aioResult(op, res), int);
+        return;
+    }
+    if (NULL != vt_self && !__atomic_load_n(&aio_started, __ATOMIC_ACQUIRE)) {
+        aioStartPoller();
+    }
+    // a positioned i/o of a socket fails in the system call
+    if ((op->socket && op->position >= 0) || (!op->socket && NULL == aio_sqes) || NULL == (vt = virtualThreadIoWait(env))) {
+        aioLink(op);
+        enterNative();
+        res = aioSyscall(op);
+        leaveNative();
+        pthread_mutex_lock(&aio_lock);
+        aioUnlink(op);
+        pthread_mutex_unlock(&aio_lock);
+        PUSH_STACK(env->current_stack, aioResult(op, res), int);
+        return;
+    }
+
+    async = (AioOp*)malloc(sizeof(AioOp));
+    memcpy(async, op, sizeof(AioOp));
+    async->vt = vt;
+    PUSH_STACK(env->current_stack, 0, int);
+    async->result = (int*)(env->current_stack->sp - SZ_INT);
+    aioLink(async);
+    if (async->socket) {
+        aioArm(async);
+    } else {
+        aioRingSubmit(async, AIO_READ == async->kind ? IORING_OP_READ : IORING_OP_WRITE, async->array->elements + async->off,
+                      async->len, async->position < 0 ? (unsigned long)-1 : (unsigned long)async->position, 0);
+    }
+}
+
+static char* aioPath(Object *str, const char *method)
+{
+    CArray_char *value;
+    char *path;
+    int n;
+
+    if (NULL == str) {
+        printf("Error: java.lang.NullPointerException in NativeIO.%s\n", method);
+        exit(1);
+    }
+    value = STRING_VALUE(str);
+    path = (char*)malloc(encodeUTF8(value, NULL) + 1);
+    n = encodeUTF8(value, path);
+    path[n] = '\0';
+    return path;
+}
+
+static void aioReadWrite(OPENV *env, int kind, int positioned)
+{
+    AioOp op;
+
+    memset(&op, 0, sizeof(AioOp));
+    op.kind = kind;
+    op.position = -1;
+    if (positioned) {
+        GET_STACKL(env->current_stack, op.position, long);
+        if (op.position < 0) {
+            printf("Error: java.lang.IllegalArgumentException: negative position %ld\n", op.position);
+            exit(1);
+        }
+    }
+    GET_STACK(env->current_stack, op.len, int);
+    GET_STACK(env->current_stack, op.off, int);
+    GET_STACKR(env->current_stack, op.array, CArray_char*);
+    GET_STACK(env->current_stack, op.fd, int);
+    if (NULL == op.array) {
+        arrayNullPointer(AIO_READ == kind ? "NativeIO.read" : "NativeIO.write");
+    }
+    if (op.len < 0 || op.off < 0 || op.off > op.array->length - op.len) {
+        arrayIndexOutOfBounds(op.len < 0 ? op.len : op.off + op.len, op.array->length);
+    }
+    aioRun(env, &op);
+}
+
+void intrinsic_aio_read(OPENV *env)
+{
+    aioReadWrite(env, AIO_READ, 0);
+}
+
+void intrinsic_aio_write(OPENV *env)
+{
+    aioReadWrite(env, AIO_WRITE, 0);
+}
+
+void intrinsic_aio_pread(OPENV *env)
+{
+    aioReadWrite(env, AIO_READ, 1);
+}
+
+void intrinsic_aio_pwrite(OPENV *env)
+{
+    aioReadWrite(env, AIO_WRITE, 1);
+}
+
+void intrinsic_aio_accept(OPENV *env)
+{
+    AioOp op;
+
+    memset(&op, 0, sizeof(AioOp));
+    op.kind = AIO_ACCEPT;
+    op.position = -1;
+    GET_STACK(env->current_stack, op.fd, int);
+    aioRun(env, &op);
+}
+
+void intrinsic_aio_open(OPENV *env)
+{
+    static const int flags[] = {O_RDONLY, O_WRONLY | O_CREAT | O_TRUNC, O_WRONLY | O_CREAT | O_APPEND, O_RDWR | O_CREAT};
+    Object *str;
+    char *path;
+    int mode, fd;
+    GET_STACK(env->current_stack, mode, int);
+    GET_STACKR(env->current_stack, str, Reference);
+
+    if (mode < 0 || mode > 3) {
+        printf("Error: java.lang.IllegalArgumentException: open mode %d\n", mode);
+        exit(1);
+    }
+    path = aioPath(str, "open");
+    enterNative();
+    fd = open(path, flags[mode] | O_CLOEXEC, 0644);
+    leaveNative();
+    if (fd < 0) {
+        printf("Error: java.io.FileNotFoundException: %s (%s)\n", path, strerror(errno));
+        exit(1);
+    }
+    free(path);
+    aioSetFdKind(fd, AIO_FD_UNKNOWN);
+    PUSH_STACK(env->current_stack, fd, int);
+}
+
+void intrinsic_aio_close(OPENV *env)
+{
+    AioOp *op;
+    int fd;
+    GET_STACK(env->current_stack, fd, int);
+
+    // the i/o waiting on a socket ends now, a file ends its own
+    pthread_mutex_lock(&aio_lock);
+    for (op = aio_ops; NULL != op; op = op->next) {
+        if (op->fd == fd) {
+            __atomic_store_n(&op->closed, 1, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&aio_lock);
+    if (aioIsSocket(fd)) {
+        shutdown(fd, SHUT_RDWR);
+    }
+    enterNative();
+    pthread_mutex_lock(&aio_lock);
+    for (op = aio_ops; NULL != op; ) {
+        if (op->fd == fd) {
+            pthread_cond_wait(&aio_done_cond, &aio_lock);
+            op = aio_ops;
+        } else {
+            op = op->next;
+        }
+    }
+    pthread_mutex_unlock(&aio_lock);
+    leaveNative();
+    aioSetFdKind(fd, AIO_FD_UNKNOWN);
+    if (close(fd) < 0) {
+        aioError("close", errno);
+    }
+}
+
+void intrinsic_aio_size(OPENV *env)
+{
+    struct stat st;
+    int fd;
+    GET_STACK(env->current_stack, fd, int);
+
+    if (fstat(fd, &st) < 0) {
+        aioError("fstat", errno);
+    }
+    PUSH_STACKL(env->current_stack, (long)st.st_size, long);
+}
+
+void intrinsic_aio_transfer(OPENV *env)
+{
+    long position, count, total = 0;
+    off_t offset;
+    ssize_t n;
+    int in, out;
+    GET_STACK(env->current_stack, out, int);
+    GET_STACKL(env->current_stack, count, long);
+    GET_STACKL(env->current_stack, position, long);
+    GET_STACK(env->current_stack, in, int);
+
+    if (position < 0 || count < 0) {
+        printf("Error: java.lang.IllegalArgumentException: transfer position %ld, count %ld\n", position, count);
+        exit(1);
+    }
+    // the pages of the file go to out in the kernel, it may block the carrier of a virtual thread
+    offset = position;
+    enterNative();
+    while (total < count) {
+        if ((n = sendfile(out, in, &offset, count - total)) < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            aioError("transfer", errno);
+        }
+        if (0 == n) {
+            break;
+        }
+        total += n;
+    }
+    leaveNative();
+    PUSH_STACKL(env->current_stack, total, long);
+}
+
+/**
+ * @brief aioSocketAddress the address of a unix domain socket
+ */
+static socklen_t aioSocketAddress(struct sockaddr_un *addr, Object *str, const char *method)
+{
+    char *path = aioPath(str, method);
+
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        printf("Error: java.io.IOException: %s: path too long: %s\n", method, path);
+        exit(1);
+    }
+    strcpy(addr->sun_path, path);
+    free(path);
+    return sizeof(struct sockaddr_un);
+}
+
+void intrinsic_aio_listen(OPENV *env)
+{
+    struct sockaddr_un addr;
+    socklen_t len;
+    Object *str;
+    int fd;
+    GET_STACKR(env->current_stack, str, Reference);
+
+    len = aioSocketAddress(&addr, str, "listen");
+    // accept() waits for the socket with the poller or poll()
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+        aioError("socket", errno);
+    }
+    unlink(addr.sun_path);
+    if (bind(fd, (struct sockaddr*)&addr, len) < 0 || listen(fd, SOMAXCONN) < 0) {
+        aioError(addr.sun_path, errno);
+    }
+    aioSetFdKind(fd, AIO_FD_SOCKET);
+    PUSH_STACK(env->current_stack, fd, int);
+}
+
+void intrinsic_aio_connect(OPENV *env)
+{
+    struct sockaddr_un addr;
+    socklen_t len;
+    Object *str;
+    int fd, res;
+    GET_STACKR(env->current_stack, str, Reference);
+
+    len = aioSocketAddress(&addr, str, "connect");
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        aioError("socket", errno);
+    }
+    // a local connect only waits while the backlog of the listener is full
+    enterNative();
+    while ((res = connect(fd, (struct sockaddr*)&addr, len)) < 0 && EINTR == errno);
+    leaveNative();
+    if (res < 0) {
+        aioError(addr.sun_path, errno);
+    }
+    aioSetFdKind(fd, AIO_FD_SOCKET);
+    PUSH_STACK(env->current_stack, fd, int);
+}
+
+#endif // AIO_C
@@ -0,0 +1,288 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef ALLOC_PROFILE_C
+#define ALLOC_PROFILE_C
+
+#include <math.h>
+#include <signal.h>
+
+/**
+  * the allocation profiler, enabled by -Xallocprof. the instructions that allocate in the heap (new,
+  * newarray, anewarray, multianewarray, ldc of a string, invokedynamic and the invoke instructions whose
+  * native implementation makes a String) are wrapped by ALLOC_SITE_BEGIN/ALLOC_SITE_END, which measure the
+  * bytes the instruction took from the heap. the allocations are sampled: one is recorded on average
+  * every alloc_sample_interval bytes, at exponentially distributed distances so that the sizes are not
+  * biased, and a sample of size s is weighted by 1/(1-exp(-s/interval)) to estimate the real counts.
+  * the samples are kept per site (method, pc), the report sorted by bytes is written at exit and when
+  * the process gets SIGUSR2
+  */
+
+/* -Xallocprof[=interval] enables the profiler, 0 records every allocation */
+int alloc_profile = 0;
+long alloc_sample_interval = 64 * 1024;
+/* -Xallocprof:file=<path>, the report goes to stderr if NULL */
+const char *alloc_profile_file = NULL;
+
+typedef struct _AllocSite {
+    method_info *method; // NULL for an empty slot
+    Class *pclass;
+    int pc;
+    long samples;
+    double count; // estimated allocations
+    double bytes; // estimated bytes
+    char *name; // the site of a freed class, method is NULL then, see forgetAllocationSites
+} AllocSite;
+
+typedef struct _AllocMark {
+    size_t allocated;
+    size_t accounted;
+    method_info *method;
+    Class *pclass;
+    int pc;
+} AllocMark;
+
+static pthread_mutex_t alloc_profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static AllocSite *alloc_sites = NULL;
+static int alloc_sites_count = 0;
+static int alloc_sites_size = 0;
+/* the sites of the classes of the destroyed vms */
+static AllocSite *alloc_retired = NULL;
+static int alloc_retired_count = 0;
+/* the bytes attributed to a site, so an enclosing site (e.g. a `new` running a <clinit>) does not count them again */
+static __thread size_t alloc_accounted = 0;
+static long alloc_bytes_left = 0;
+static long alloc_total_samples = 0;
+static volatile sig_atomic_t alloc_dump_requested = 0;
+
+extern Instruction jvm_instructions[256];
+void dumpAllocationProfile();
+
+/* the bytes the instruction took from the heap in this thread, the sites it called are not counted */
+#define ALLOC_SITE_BEGIN(env) AllocMark alloc_mark; if (alloc_profile) markAllocationSite(env, &alloc_mark)
+#define ALLOC_SITE_END(env) if (alloc_profile) profileAllocation(&alloc_mark)
+
+/**
+ * @brief nextSampleDistance the distance to the next sample, exponentially distributed around the interval
+ */
+static long nextSampleDistance()
+{
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return (long)(-log(u) * alloc_sample_interval) + 1;
+}
+
+static void allocDumpSignal(int sig)
+{
+    alloc_dump_requested = 1;
+}
+
+/**
+ * @brief startAllocationProfile called once the options are parsed
+ */
+void startAllocationProfile()
+{
+    if (!alloc_profile) {
+        return;
+    }
+    alloc_bytes_left = alloc_sample_interval > 0 ? nextSampleDistance() : 0;
+    signal(SIGUSR2, allocDumpSignal);
+    atexit(dumpAllocationProfile);
+}
+
+/**
+ * @brief markAllocationSite remembers the site and the bytes the thread allocated before an instruction allocates
+ */
+static void markAllocationSite(OPENV *env, AllocMark *mark)
+{
+    mark->allocated = heap_thread_allocated;
+    mark->accounted = alloc_accounted;
+    mark->method = env->current_stack->method;
+    mark->pclass = env->current_class;
+    // the instructions are called with the pc after the opcode
+    mark->pc = (int)(env->pc - env->pc_start) - 1;
+}
+
+static void growAllocSites()
+{
+    AllocSite *old = alloc_sites;
+    int old_size = alloc_sites_size, i;
+    size_t h;
+
+    alloc_sites_size = old_size ? old_size << 1 : 256;
+    alloc_sites = (AllocSite*)calloc(alloc_sites_size, sizeof(AllocSite));
+    for (i = 0; i < old_size; i++) {
+        if (NULL != old[i].method) {
+            for (h = ((size_t)old[i].method >> 4) * 31 + old[i].pc; NULL != alloc_sites[h & (alloc_sites_size - 1)].method; h++);
+            alloc_sites[h & (alloc_sites_size - 1)] = old[i];
+        }
+    }
+    free(old);
+}
+
+/**
+ * @brief allocSiteName the class, the method, the pc and the instruction of a site
+ */
+static void allocSiteName(AllocSite *site, char *buf, size_t size)
+{
+    method_info *method = site->method;
+
+    snprintf(buf, size, "%s.%s%s #%d %s", get_this_class_name(site->pclass),
+             get_utf8(site->pclass->constant_pool[method->name_index]),
+             get_utf8(site->pclass->constant_pool[method->descriptor_index]), site->pc,
+             jvm_instructions[method->code_attribute_addr->code[site->pc]].code_name);
+}
+
+/**
+ * @brief forgetAllocationSites takes the sites of the classes of a destroyed vm out of the table before the
+ * classes are freed, they are reported by name
+ */
+void forgetAllocationSites(VM *vm)
+{
+    AllocSite *old;
+    char name[512];
+    int i, size;
+    size_t h;
+
+    pthread_mutex_lock(&alloc_profile_lock);
+    old = alloc_sites;
+    size = alloc_sites_size;
+    alloc_sites = size > 0 ? (AllocSite*)calloc(size, sizeof(AllocSite)) : NULL;
+    alloc_sites_count = 0;
+    for (i = 0; i < size; i++) {
+        if (NULL == old[i].method) {
+            continue;
+        }
+        if (old[i].pclass->vm == vm) {
+            allocSiteName(&old[i], name, sizeof(name));
+            alloc_retired = (AllocSite*)realloc(alloc_retired, sizeof(AllocSite) * (alloc_retired_count + 1));
+            alloc_retired[alloc_retired_count] = old[i];
+            alloc_retired[alloc_retired_count].method = NULL;
+            alloc_retired[alloc_retired_count].pclass = NULL;
+            alloc_retired[alloc_retired_count++].name = strdup(name);
+            continue;
+        }
+        for (h = ((size_t)old[i].method >> 4) * 31 + old[i].pc; NULL != alloc_sites[h & (size - 1)].method; h++);
+        alloc_sites[h & (size - 1)] = old[i];
+        alloc_sites_count++;
+    }
+    free(old);
+    pthread_mutex_unlock(&alloc_profile_lock);
+}
+
+static AllocSite* findAllocSite(AllocMark *mark)
+{
+    AllocSite *site;
+    size_t h;
+
+    if (alloc_sites_count >= alloc_sites_size >> 1) {
+        growAllocSites();
+    }
+    for (h = ((size_t)mark->method >> 4) * 31 + mark->pc; ; h++) {
+        site = &alloc_sites[h & (alloc_sites_size - 1)];
+        if (site->method == mark->method && site->pc == mark->pc) {
+            return site;
+        }
+        if (NULL == site->method) {
+            site->method = mark->method;
+            site->pclass = mark->pclass;
+            site->pc = mark->pc;
+            alloc_sites_count++;
+            return site;
+        }
+    }
+}
+
+/**
+ * @brief profileAllocation counts the bytes allocated since markAllocationSite and takes a sample when
+ * the distance to the next one is used up
+ */
+static void profileAllocation(AllocMark *mark)
+{
+    long size = (long)(heap_thread_allocated - mark->allocated) - (long)(alloc_accounted - mark->accounted);
+    AllocSite *site;
+    double weight = 1.0;
+
+    if (alloc_dump_requested) {
+        alloc_dump_requested = 0;
+        dumpAllocationProfile();
+    }
+    if (size <= 0) {
+        return;
+    }
+    alloc_accounted += size;
+    if (__atomic_sub_fetch(&alloc_bytes_left, size, __ATOMIC_RELAXED) > 0) {
+        return;
+    }
+    pthread_mutex_lock(&alloc_profile_lock);
+    if (alloc_sample_interval > 0) {
+        if (alloc_bytes_left <= 0) {
+            alloc_bytes_left = nextSampleDistance();
+        }
+        weight = 1.0 / (1.0 - exp(-(double)size / alloc_sample_interval));
+    }
+    site = findAllocSite(mark);
+    site->samples++;
+    site->count += weight;
+    site->bytes += weight * size;
+    alloc_total_samples++;
+    pthread_mutex_unlock(&alloc_profile_lock);
+}
+
+static int compareAllocSites(const void *a, const void *b)
+{
+    double d = ((AllocSite*)b)->bytes - ((AllocSite*)a)->bytes;
+    return d > 0 ? 1 : (d < 0 ? -1 : 0);
+}
+
+/**
+ * @brief dumpAllocationProfile writes the sites sorted by the estimated bytes
+ */
+void dumpAllocationProfile()
+{
+    FILE *fp = stderr;
+    AllocSite *sorted;
+    char name[512];
+    double total = 0;
+    int i, n = 0;
+
+    if (NULL != alloc_profile_file && NULL == (fp = fopen(alloc_profile_file, "w"))) {
+        printf("Cannot write the allocation profile: %s\n", alloc_profile_file);
+        return;
+    }
+    pthread_mutex_lock(&alloc_profile_lock);
+    sorted = (AllocSite*)malloc(sizeof(AllocSite) * (alloc_sites_count + alloc_retired_count + 1));
+    for (i = 0; i < alloc_sites_size; i++) {
+        if (NULL != alloc_sites[i].method) {
+            sorted[n++] = alloc_sites[i];
+            total += alloc_sites[i].bytes;
+        }
+    }
+    for (i = 0; i < alloc_retired_count; i++) {
+        sorted[n++] = alloc_retired[i];
+        total += alloc_retired[i].bytes;
+    }
+    qsort(sorted, n, sizeof(AllocSite), compareAllocSites);
+
+    fprintf(fp, "allocation profile: %ld samples, sample interval %ld bytes, %.0f bytes allocated\n",
+            alloc_total_samples, alloc_sample_interval, total);
+    fprintf(fp, "%14s %7s %12s %8s  %s\n", "bytes", "%", "objects", "samples", "site");
+    for (i = 0; i < n; i++) {
+        if (NULL != sorted[i].method) {
+            allocSiteName(&sorted[i], name, sizeof(name));
+        }
+        fprintf(fp, "%14.0f %6.2f%% %12.0f %8ld  %s\n", sorted[i].bytes, 100 * sorted[i].bytes / total,
+                sorted[i].count, sorted[i].samples, NULL != sorted[i].method ? name : sorted[i].name);
+    }
+    pthread_mutex_unlock(&alloc_profile_lock);
+    free(sorted);
+    if (stderr != fp) {
+        fclose(fp);
+    }
+}
+
+#endif // ALLOC_PROFILE_C
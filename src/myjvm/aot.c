@@ -0,0 +1,409 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef AOT_C
+#define AOT_C
+
+#include <dlfcn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "reg_ir.c"
+#include "class_hash.h"
+
+/**
+  * this file implements the ahead-of-time compilation.
+  * `-Xaot:emit=lib.so` writes the register code (see reg_ir.c) of every
+  * translatable method of the given classes as C functions, and compiles
+  * them into a shared object with the system compiler.
+  * `-Xaot:lib=lib.so` opens the shared object, and every loaded method
+  * whose compiled function is found is bound to it, the other methods are
+  * run by the interpreter.
+  */
+
+typedef void (*AotFunction)(int *args, int args_len, int *result);
+
+/* the shared object opened by -Xaot:lib */
+static void *aot_lib = NULL;
+
+#define AOT_HASH(h, v) ((h) = ((h) ^ (uint)(v)) * 16777619u)
+
+/**
+ * @brief aotCodeHash FNV-1a hash of the bytecode and of its register code, saved next to the compiled
+ * function so a class changed after the compilation is not bound to stale code. the register code holds
+ * the constants of ldc, a constant pool changed with the same bytecode changes the hash too
+ */
+uint aotCodeHash(Code_attribute *code_attr)
+{
+    RegCode *rc = code_attr->reg_code;
+    RegInsn *insn;
+    uint h = 2166136261u;
+    uint i, j;
+
+    for (i = 0; i < code_attr->code_length; i++) {
+        AOT_HASH(h, code_attr->code[i]);
+    }
+    for (i = 0; NULL != rc && i < rc->insn_count; i++) {
+        insn = rc->insns + i;
+        AOT_HASH(h, insn->op);
+        AOT_HASH(h, insn->dst);
+        AOT_HASH(h, insn->src1);
+        AOT_HASH(h, insn->src2);
+        AOT_HASH(h, insn->target);
+        // the immediate values written by aotEmitInsn, the others are not set
+        if (REG_CONSTL == insn->op) {
+            for (j = 0; j < sizeof(long); j++) {
+                AOT_HASH(h, (insn->k.l >> (j * 8)) & 0xff);
+            }
+        } else if (REG_CONST == insn->op || REG_IINC == insn->op) {
+            AOT_HASH(h, insn->k.i);
+        }
+    }
+    return h;
+}
+
+static void aotMangle(char *dest, const char *s)
+{
+    while (*s) {
+        if ((*s >= 'a' && *s <= 'z') || (*s >= 'A' && *s <= 'Z') || (*s >= '0' && *s <= '9')) {
+            *dest++ = *s;
+        } else {
+            dest += sprintf(dest, "_%02x", (uchar)*s);
+        }
+        s++;
+    }
+    *dest = 0;
+}
+
+#define AOT_SYMBOL_SIZE 1024
+
+/**
+ * @brief aotSymbolName the symbol name of a compiled method: aot_<class>__<name>__<descriptor>
+ * @param dest AOT_SYMBOL_SIZE bytes
+ * @return 0 if the name does not fit, the method is not compiled
+ */
+int aotSymbolName(char *dest, Class *pclass, method_info *method)
+{
+    const char *class_name = get_this_class_name(pclass);
+    const char *name = get_utf8(pclass->constant_pool[method->name_index]);
+    const char *descriptor = get_utf8(pclass->constant_pool[method->descriptor_index]);
+
+    // a mangled character takes up to 3 bytes
+    if (8 + 3 * (strlen(class_name) + strlen(name) + strlen(descriptor)) >= AOT_SYMBOL_SIZE) {
+        return 0;
+    }
+    strcpy(dest, "aot_");
+    dest += 4;
+    aotMangle(dest, class_name);
+    dest += strlen(dest);
+    strcpy(dest, "__");
+    aotMangle(dest+2, name);
+    dest += strlen(dest);
+    strcpy(dest, "__");
+    aotMangle(dest+2, descriptor);
+    return 1;
+}
+
+/* %D: dst register, %A: src1 register, %B: src2 register, %T: target label */
+static const char *aot_templates[] = {
+    "I(%D) = I(%A);",                                   // REG_MOV
+    "L(%D) = L(%A);",                                   // REG_MOVL
+    NULL,                                               // REG_CONST
+    NULL,                                               // REG_CONSTL
+    "I(%D) = (int)((uint)I(%A) + (uint)I(%B));",        // REG_IADD
+    "I(%D) = (int)((uint)I(%A) - (uint)I(%B));",        // REG_ISUB
+    "I(%D) = (int)((uint)I(%A) * (uint)I(%B));",        // REG_IMUL
+    "if (0 == I(%B)) aot_div0(); I(%D) = -1 == I(%B) ? (int)(0u - (uint)I(%A)) : I(%A) / I(%B);", // REG_IDIV
+    "if (0 == I(%B)) aot_div0(); I(%D) = -1 == I(%B) ? 0 : I(%A) % I(%B);",                       // REG_IREM
+    "I(%D) = (int)(0u - (uint)I(%A));",                 // REG_INEG
+    "I(%D) = (int)((uint)I(%A) << (I(%B) & 0x1f));",    // REG_ISHL
+    "I(%D) = I(%A) >> (I(%B) & 0x1f);",                 // REG_ISHR
+    "I(%D) = (int)((uint)I(%A) >> (I(%B) & 0x1f));",    // REG_IUSHR
+    "I(%D) = I(%A) & I(%B);",                           // REG_IAND
+    "I(%D) = I(%A) | I(%B);",                           // REG_IOR
+    "I(%D) = I(%A) ^ I(%B);",                           // REG_IXOR
+    NULL,                                               // REG_IINC
+    "L(%D) = (long)((ulong)L(%A) + (ulong)L(%B));",     // REG_LADD
+    "L(%D) = (long)((ulong)L(%A) - (ulong)L(%B));",     // REG_LSUB
+    "L(%D) = (long)((ulong)L(%A) * (ulong)L(%B));",     // REG_LMUL
+    "if (0 == L(%B)) aot_div0(); L(%D) = -1 == L(%B) ? (long)(0ul - (ulong)L(%A)) : L(%A) / L(%B);", // REG_LDIV
+    "if (0 == L(%B)) aot_div0(); L(%D) = -1 == L(%B) ? 0 : L(%A) % L(%B);",                          // REG_LREM
+    "L(%D) = (long)(0ul - (ulong)L(%A));",              // REG_LNEG
+    "L(%D) = (long)((ulong)L(%A) << (I(%B) & 0x3f));",  // REG_LSHL
+    "L(%D) = L(%A) >> (I(%B) & 0x3f);",                 // REG_LSHR
+    "L(%D) = (long)((ulong)L(%A) >> (I(%B) & 0x3f));",  // REG_LUSHR
+    "L(%D) = L(%A) & L(%B);",                           // REG_LAND
+    "L(%D) = L(%A) | L(%B);",                           // REG_LOR
+    "L(%D) = L(%A) ^ L(%B);",                           // REG_LXOR
+    "F(%D) = F(%A) + F(%B);",                           // REG_FADD
+    "F(%D) = F(%A) - F(%B);",                           // REG_FSUB
+    "F(%D) = F(%A) * F(%B);",                           // REG_FMUL
+    "F(%D) = F(%A) / F(%B);",                           // REG_FDIV
+    "F(%D) = -F(%A);",                                  // REG_FNEG
+    "D(%D) = D(%A) + D(%B);",                           // REG_DADD
+    "D(%D) = D(%A) - D(%B);",                           // REG_DSUB
+    "D(%D) = D(%A) * D(%B);",                           // REG_DMUL
+    "D(%D) = D(%A) / D(%B);",                           // REG_DDIV
+    "D(%D) = -D(%A);",                                  // REG_DNEG
+    "L(%D) = (long)I(%A);",                             // REG_I2L
+    "F(%D) = (float)I(%A);",                            // REG_I2F
+    "D(%D) = (double)I(%A);",                           // REG_I2D
+    "I(%D) = (int)L(%A);",                              // REG_L2I
+    "F(%D) = (float)L(%A);",                            // REG_L2F
+    "D(%D) = (double)L(%A);",                           // REG_L2D
+    "I(%D) = aot_f2i(F(%A));",                          // REG_F2I
+    "L(%D) = aot_f2l(F(%A));",                          // REG_F2L
+    "D(%D) = (double)F(%A);",                           // REG_F2D
+    "I(%D) = aot_f2i(D(%A));",                          // REG_D2I
+    "L(%D) = aot_f2l(D(%A));",                          // REG_D2L
+    "F(%D) = (float)D(%A);",                            // REG_D2F
+    "I(%D) = (signed char)I(%A);",                      // REG_I2B
+    "I(%D) = (ushort)I(%A);",                           // REG_I2C
+    "I(%D) = (short)I(%A);",                            // REG_I2S
+    "I(%D) = L(%A) > L(%B) ? 1 : (L(%A) == L(%B) ? 0 : -1);", // REG_LCMP
+    "I(%D) = AOT_FCMP(F(%A), F(%B), -1);",              // REG_FCMPL
+    "I(%D) = AOT_FCMP(F(%A), F(%B), 1);",               // REG_FCMPG
+    "I(%D) = AOT_FCMP(D(%A), D(%B), -1);",              // REG_DCMPL
+    "I(%D) = AOT_FCMP(D(%A), D(%B), 1);",               // REG_DCMPG
+    "I(%D) = I(%A) < 0 ? (int)(0u - (uint)I(%A)) : I(%A);",     // REG_IABS
+    "L(%D) = L(%A) < 0 ? (long)(0ul - (ulong)L(%A)) : L(%A);",  // REG_LABS
+    "F(%D) = __builtin_fabsf(F(%A));",                  // REG_FABS
+    "D(%D) = __builtin_fabs(D(%A));",                   // REG_DABS
+    "D(%D) = __builtin_sqrt(D(%A));",                   // REG_DSQRT
+    "I(%D) = I(%A) > I(%B) ? I(%A) : I(%B);",           // REG_IMAX
+    "I(%D) = I(%A) < I(%B) ? I(%A) : I(%B);",           // REG_IMIN
+    "L(%D) = L(%A) > L(%B) ? L(%A) : L(%B);",           // REG_LMAX
+    "L(%D) = L(%A) < L(%B) ? L(%A) : L(%B);",           // REG_LMIN
+    "if (I(%A) == 0) goto L%T;",                        // REG_IFEQ
+    "if (I(%A) != 0) goto L%T;",                        // REG_IFNE
+    "if (I(%A) < 0) goto L%T;",                         // REG_IFLT
+    "if (I(%A) >= 0) goto L%T;",                        // REG_IFGE
+    "if (I(%A) > 0) goto L%T;",                         // REG_IFGT
+    "if (I(%A) <= 0) goto L%T;",                        // REG_IFLE
+    "if (I(%A) == I(%B)) goto L%T;",                    // REG_IF_ICMPEQ
+    "if (I(%A) != I(%B)) goto L%T;",                    // REG_IF_ICMPNE
+    "if (I(%A) < I(%B)) goto L%T;",                     // REG_IF_ICMPLT
+    "if (I(%A) >= I(%B)) goto L%T;",                    // REG_IF_ICMPGE
+    "if (I(%A) > I(%B)) goto L%T;",                     // REG_IF_ICMPGT
+    "if (I(%A) <= I(%B)) goto L%T;",                    // REG_IF_ICMPLE
+    "goto L%T;",                                        // REG_GOTO
+    "result[0] = I(%A); return;",                       // REG_RET
+    "result[0] = I(%A); result[1] = I(%A+1); return;",  // REG_RETL
+    "return;"                                           // REG_RETV
+};
+
+static const char *aot_prelude =
+    "/* generated by myjvm -Xaot:emit, do not edit */\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "#include <limits.h>\n\n"
+    "typedef unsigned int uint;\n"
+    "typedef unsigned short ushort;\n"
+    "typedef unsigned long ulong;\n\n"
+    "#define I(r) (regs[r])\n"
+    "#define F(r) (*(float*)(regs+(r)))\n"
+    "#define L(r) (*(long*)(regs+(r)))\n"
+    "#define D(r) (*(double*)(regs+(r)))\n"
+    "#define AOT_FCMP(v1, v2, nan) ((v1) > (v2) ? 1 : ((v1) == (v2) ? 0 : ((v1) < (v2) ? -1 : (nan))))\n\n"
+    "static void aot_div0(void)\n{\n    printf(\"Error: java.lang.ArithmeticException: / by zero\\n\");\n    exit(1);\n}\n"
+    "static int aot_f2i(double v)\n{\n    return v != v ? 0 : (v >= (double)INT_MAX ? INT_MAX : (v <= (double)INT_MIN ? INT_MIN : (int)v));\n}\n"
+    "static long aot_f2l(double v)\n{\n    return v != v ? 0 : (v >= (double)LONG_MAX ? LONG_MAX : (v <= (double)LONG_MIN ? LONG_MIN : (long)v));\n}\n";
+
+static void aotEmitInsn(FILE *fp, RegInsn *insn)
+{
+    const char *t = aot_templates[insn->op];
+
+    switch (insn->op) {
+        case REG_CONST:
+            fprintf(fp, "I(%d) = (int)0x%08x;", insn->dst, (uint)insn->k.i);
+            return;
+        case REG_CONSTL:
+            fprintf(fp, "L(%d) = (long)0x%016lxul;", insn->dst, (unsigned long)insn->k.l);
+            return;
+        case REG_IINC:
+            fprintf(fp, "I(%d) = (int)((uint)I(%d) + (uint)%d);", insn->dst, insn->src1, insn->k.i);
+            return;
+        default:
+            break;
+    }
+
+    for (; *t; t++) {
+        if (*t != '%') {
+            fputc(*t, fp);
+            continue;
+        }
+        t++;
+        switch (*t) {
+            case 'D': fprintf(fp, "%d", insn->dst); break;
+            case 'A': fprintf(fp, "%d", insn->src1); break;
+            case 'B': fprintf(fp, "%d", insn->src2); break;
+            case 'T': fprintf(fp, "%d", insn->target); break;
+            default: fputc(*t, fp); break;
+        }
+    }
+}
+
+/**
+ * @brief aotEmitMethod writes the C function of a method translated to register code
+ * @return 0 if the method is not written
+ */
+int aotEmitMethod(FILE *fp, Class *pclass, method_info *method)
+{
+    char symbol[AOT_SYMBOL_SIZE];
+    Code_attribute *code_attr = method->code_attribute_addr;
+    RegCode *rc = code_attr->reg_code;
+    uchar *is_target;
+    int i;
+
+    if (!aotSymbolName(symbol, pclass, method)) {
+        return 0;
+    }
+    is_target = (uchar*)malloc(rc->insn_count);
+    memset(is_target, 0, rc->insn_count);
+    for (i = 0; i < rc->insn_count; i++) {
+        if (rc->insns[i].op >= REG_IFEQ && rc->insns[i].op <= REG_GOTO) {
+            is_target[rc->insns[i].target] = 1;
+        }
+    }
+
+    fprintf(fp, "\n/* %s.%s%s */\n", get_this_class_name(pclass), get_utf8(pclass->constant_pool[method->name_index]),
+            get_utf8(pclass->constant_pool[method->descriptor_index]));
+    fprintf(fp, "const uint %s_hash = 0x%08xu;\n", symbol, aotCodeHash(code_attr));
+    fprintf(fp, "void %s(int *args, int args_len, int *result)\n{\n", symbol);
+    fprintf(fp, "    int regs[%d];\n    memcpy(regs, args, args_len);\n", rc->nregs);
+    for (i = 0; i < rc->insn_count; i++) {
+        if (is_target[i]) {
+            fprintf(fp, "L%d:\n", i);
+        }
+        fprintf(fp, "    ");
+        aotEmitInsn(fp, rc->insns + i);
+        fprintf(fp, "\n");
+    }
+    fprintf(fp, "}\n");
+
+    free(is_target);
+    return 1;
+}
+
+/**
+ * @brief aotCompileLoadedClasses compiles the methods of every loaded class into a shared object
+ * @param so_name the shared object to be created, the C file is written next to it
+ * @return 0 on success
+ */
+int aotCompileLoadedClasses(const char *so_name)
+{
+    char c_name[512];
+    char *argv[] = {"cc", "-O2", "-shared", "-fPIC", "-o", (char*)so_name, c_name, "-lm", NULL};
+    FILE *fp;
+    ClassEntry *entry;
+    Class *pclass;
+    method_info *method;
+    size_t len = strlen(so_name);
+    pid_t pid;
+    int i, j, status, count = 0;
+
+    if (len > 3 && strcmp(so_name + len - 3, ".so") == 0) {
+        len -= 3;
+    }
+    if (len + 3 > sizeof(c_name)) {
+        printf("aot: file name too long: %s\n", so_name);
+        return 1;
+    }
+    snprintf(c_name, sizeof(c_name), "%.*s.c", (int)len, so_name);
+
+    fp = fopen(c_name, "w");
+    if (!fp) {
+        printf("Cannot open: %s\n", c_name);
+        printf("errno:%d, errstr:%s\n", errno, strerror(errno));
+        return 1;
+    }
+    fprintf(fp, "%s", aot_prelude);
+
+    for (i = 0; i < current_vm->class_table->hash_size; i++) {
+        for (entry = current_vm->class_table->class_array[i]; NULL != entry; entry = entry->next) {
+            pclass = entry->pclass;
+            for (j = 0; j < pclass->methods_count; j++) {
+                method = pclass->methods[j];
+                if (NULL != method->code_attribute_addr && NULL != method->code_attribute_addr->reg_code) {
+                    count += aotEmitMethod(fp, pclass, method);
+                }
+            }
+        }
+    }
+    fclose(fp);
+    printf("aot: %d methods written to %s\n", count, c_name);
+
+    // the compiler gets the names as arguments, there is no shell to quote them for
+    printf("aot: cc -O2 -shared -fPIC -o %s %s -lm\n", so_name, c_name);
+    fflush(stdout);
+    if ((pid = fork()) < 0) {
+        printf("aot: cannot fork: %s\n", strerror(errno));
+        return 1;
+    }
+    if (0 == pid) {
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    while (waitpid(pid, &status, 0) < 0) {
+        if (EINTR != errno) {
+            return 1;
+        }
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+/**
+ * @brief openAotLibrary opens the shared object created by -Xaot:emit
+ * @return 0 on success
+ */
+int openAotLibrary(const char *so_name)
+{
+    aot_lib = dlopen(so_name, RTLD_NOW | RTLD_LOCAL);
+    if (NULL == aot_lib) {
+        printf("Cannot open aot library: %s\n", dlerror());
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief bindAotMethods binds the methods of a newly loaded class to their compiled code
+ * @param pclass
+ */
+void bindAotMethods(Class *pclass)
+{
+    char symbol[AOT_SYMBOL_SIZE], hash_symbol[AOT_SYMBOL_SIZE + 8];
+    uint *hash;
+    method_info *method;
+    int i;
+
+    if (NULL == aot_lib) {
+        return;
+    }
+    for (i = 0; i < pclass->methods_count; i++) {
+        method = pclass->methods[i];
+        if (NULL == method->code_attribute_addr || NULL == method->code_attribute_addr->reg_code) {
+            continue;
+        }
+        if (!aotSymbolName(symbol, pclass, method)) {
+            continue;
+        }
+        snprintf(hash_symbol, sizeof(hash_symbol), "%s_hash", symbol);
+        method->aot_code = dlsym(aot_lib, symbol);
+        hash = (uint*)dlsym(aot_lib, hash_symbol);
+        if (NULL == hash || *hash != aotCodeHash(method->code_attribute_addr)) {
+            method->aot_code = NULL;
+        }
+        if (NULL != method->aot_code) {
+            debug("aot: bind %s", symbol);
+        }
+    }
+}
+
+#endif // AOT_C
@@ -0,0 +1,277 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef ARRAYS_C
+#define ARRAYS_C
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "op_core.h"
+
+/**
+  * this file implements the bulk array operations: System.arraycopy,
+  * Arrays.fill and Arrays.equals. They work on the bytes of the elements,
+  * the element size is found by the atype of the array (see generalNewArray),
+  * so one kernel serves every CArray_* type.
+  */
+
+/**
+ * @brief arrayElementSize size of one element of an array
+ * @param arr any CArray_*, the arrays of arrays and of references hold compressed references
+ */
+int arrayElementSize(CArray_char *arr)
+{
+    if (arr->dimensions > 1 || ATYPE_REFERENCE == arr->atype) {
+        return sizeof(NarrowRef);
+    }
+    if (arr->atype < 4 || arr->atype > 11) {
+        printf("Illegal array type: %d\n", arr->atype);
+        exit(1);
+    }
+    return atype_element_sizes[arr->atype];
+}
+
+#define IS_REFERENCE_ARRAY(arr) ((arr)->dimensions > 1 || ATYPE_REFERENCE == (arr)->atype)
+
+/**
+ * @brief fillKernel fills count elements of esize bytes with pattern, the low esize bytes of pattern
+ */
+static void fillKernel(char *dst, int count, int esize, unsigned long pattern)
+{
+    size_t nbytes = (size_t)count * esize;
+
+    if (1 == esize || 0 == pattern) {
+        memset(dst, (int)(pattern & 0xff), nbytes);
+        return;
+    }
+    // repeat the element in 8 bytes, nbytes is a multiple of esize so any tail is whole elements
+    if (2 == esize) {
+        pattern = (pattern & 0xffff) * 0x0001000100010001ul;
+    } else if (4 == esize) {
+        pattern = (pattern & 0xffffffff) * 0x0000000100000001ul;
+    }
+
+#if defined(__AVX2__)
+    __m256i v = _mm256_set1_epi64x((long long)pattern);
+    for (; nbytes >= 32; nbytes -= 32, dst += 32) {
+        _mm256_storeu_si256((__m256i*)dst, v);
+    }
+#elif defined(__SSE2__)
+    __m128i v = _mm_set1_epi64x((long long)pattern);
+    for (; nbytes >= 16; nbytes -= 16, dst += 16) {
+        _mm_storeu_si128((__m128i*)dst, v);
+    }
+#endif
+    for (; nbytes >= 8; nbytes -= 8, dst += 8) {
+        memcpy(dst, &pattern, 8);
+    }
+    memcpy(dst, &pattern, nbytes);
+}
+
+static void arrayIndexOutOfBounds(int index, int length)
+{
+    printf("Error: java.lang.ArrayIndexOutOfBoundsException: %d, length=%d\n", index, length);
+    exit(1);
+}
+
+static void arrayNullPointer(const char *method)
+{
+    printf("Error: java.lang.NullPointerException in %s\n", method);
+    exit(1);
+}
+
+/**
+ * @brief arrayElementStorable whether an array may be stored in the array of arrays dest, by the atypes and the
+ * dimensions. an array of anewarray keeps no element class, it is an array of references of one dimension
+ * whatever the type of its elements
+ */
+static int arrayElementStorable(CArray_char *e, CArray_char *dest)
+{
+    int dims = dest->dimensions - 1; // of the element type of dest
+
+    if (ATYPE_REFERENCE == e->atype && 1 == e->dimensions) {
+        return ATYPE_REFERENCE == dest->atype || dims > 1;
+    }
+    if (ATYPE_REFERENCE != dest->atype) {
+        return e->atype == dest->atype && e->dimensions == dims;
+    }
+    // the class of the elements of dest is not known, an array deeper than its element type is an Object[]
+    return ATYPE_REFERENCE == e->atype ? e->dimensions >= dims : e->dimensions > dims;
+}
+
+/**
+ * @brief arrayStoreCheck the elements copied to an array of arrays must be arrays of its element type
+ */
+static void arrayStoreCheck(CArray_NarrowRef *src, int src_pos, CArray_char *dest, int length)
+{
+    CArray_char *e;
+    NarrowRef ref;
+    int i;
+
+    for (i = 0; i < length; i++) {
+        if (0 == (ref = src->elements[src_pos + i])) {
+            continue;
+        }
+        e = (CArray_char*)decodeRef(ref);
+        if (!TEST_HEAP_BIT(heap_array_bits, HEAP_GRANULE(e)) || !arrayElementStorable(e, dest)) {
+            printf("Error: java.lang.ArrayStoreException: arraycopy: element %d is not of the destination element type\n", src_pos + i);
+            exit(1);
+        }
+    }
+}
+
+/**
+ * @brief arrayCopy implements System.arraycopy, the ranges may overlap
+ */
+void arrayCopy(CArray_char *src, int src_pos, CArray_char *dest, int dest_pos, int length)
+{
+    int esize;
+
+    if (NULL == src || NULL == dest) {
+        arrayNullPointer("arraycopy");
+    }
+    if (IS_REFERENCE_ARRAY(src) != IS_REFERENCE_ARRAY(dest) || (!IS_REFERENCE_ARRAY(src) && src->atype != dest->atype)) {
+        printf("Error: java.lang.ArrayStoreException: arraycopy: type mismatch, %d and %d\n", src->atype, dest->atype);
+        exit(1);
+    }
+    if (length < 0 || src_pos < 0 || src_pos > src->length - length) {
+        arrayIndexOutOfBounds(length < 0 ? length : src_pos + length, src->length);
+    }
+    if (dest_pos < 0 || dest_pos > dest->length - length) {
+        arrayIndexOutOfBounds(dest_pos + length, dest->length);
+    }
+
+    esize = arrayElementSize(src);
+    // an array of the same type holds only what dest may hold
+    if (dest->dimensions > 1 && (src->atype != dest->atype || src->dimensions != dest->dimensions)) {
+        arrayStoreCheck((CArray_NarrowRef*)src, src_pos, dest, length);
+    }
+    if (IS_REFERENCE_ARRAY(dest)) {
+        gcArrayPreWrite((CArray_NarrowRef*)dest, dest_pos, length);
+    }
+    // memmove copies an overlapping range correctly, and uses the widest vector moves of the cpu
+    memmove(dest->elements + (size_t)dest_pos * esize, src->elements + (size_t)src_pos * esize, (size_t)length * esize);
+}
+
+/**
+ * @brief arrayFill implements Arrays.fill, elements [from, to) are set to the low bytes of value
+ */
+void arrayFill(CArray_char *arr, int from, int to, unsigned long value)
+{
+    if (NULL == arr) {
+        arrayNullPointer("Arrays.fill");
+    }
+    if (from > to) {
+        printf("Error: java.lang.IllegalArgumentException: fromIndex(%d) > toIndex(%d)\n", from, to);
+        exit(1);
+    }
+    if (from < 0) {
+        arrayIndexOutOfBounds(from, arr->length);
+    }
+    if (to > arr->length) {
+        arrayIndexOutOfBounds(to, arr->length);
+    }
+
+    if (IS_REFERENCE_ARRAY(arr)) {
+        gcArrayPreWrite((CArray_NarrowRef*)arr, from, to - from);
+    }
+    fillKernel(arr->elements + (size_t)from * arrayElementSize(arr), to - from, arrayElementSize(arr), value);
+}
+
+/**
+ * @brief arrayEquals implements Arrays.equals, the floats are compared like Float.floatToIntBits,
+ * so the NaNs are equal to each other and 0.0 is not equal to -0.0
+ */
+int arrayEquals(CArray_char *a, CArray_char *b)
+{
+    int i, esize;
+
+    if (a == b) {
+        return 1;
+    }
+    if (NULL == a || NULL == b || a->length != b->length) {
+        return 0;
+    }
+    esize = arrayElementSize(a);
+    // memcmp is vectorized by the c library
+    if (memcmp(a->elements, b->elements, (size_t)a->length * esize) == 0) {
+        return 1;
+    }
+    // only NaNs of different bits may still be equal
+    if (6 == a->atype) {
+        for (i = 0; i < a->length; i++) {
+            float x = ((float*)a->elements)[i], y = ((float*)b->elements)[i];
+            if (!(x != x && y != y) && memcmp(&x, &y, sizeof(float)) != 0) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    if (7 == a->atype) {
+        for (i = 0; i < a->length; i++) {
+            double x = ((double*)a->elements)[i], y = ((double*)b->elements)[i];
+            if (!(x != x && y != y) && memcmp(&x, &y, sizeof(double)) != 0) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/** the intrinsics of the bulk operations, see intrinsics.c **/
+void intrinsic_arraycopy(OPENV *env)
+{
+    int length, destPos, srcPos;
+    CArray_char *arr1, *arr2;
+    GET_STACK(env->current_stack, length, int);
+    GET_STACK(env->current_stack, destPos, int);
+    GET_STACKR(env->current_stack, arr2, CArray_char*);
+    GET_STACK(env->current_stack, srcPos, int);
+    GET_STACKR(env->current_stack, arr1, CArray_char*);
+
+    arrayCopy(arr1, srcPos, arr2, destPos, length);
+}
+
+#define ARRAYS_FILL_INTRINSIC(name, xtype, GET) void intrinsic_arrays_fill_##name(OPENV *env) {\
+    xtype v;\
+    CArray_char *arr;\
+    GET(env->current_stack, v, xtype);\
+    GET_STACKR(env->current_stack, arr, CArray_char*);\
+    arrayFill(arr, 0, NULL == arr ? 0 : arr->length, (unsigned long)v);\
+}
+#define ARRAYS_FILL_RANGE_INTRINSIC(name, xtype, GET) void intrinsic_arrays_fill_range_##name(OPENV *env) {\
+    xtype v;\
+    int from, to;\
+    CArray_char *arr;\
+    GET(env->current_stack, v, xtype);\
+    GET_STACK(env->current_stack, to, int);\
+    GET_STACK(env->current_stack, from, int);\
+    GET_STACKR(env->current_stack, arr, CArray_char*);\
+    arrayFill(arr, from, to, (unsigned long)v);\
+}
+
+/* the values are read as 8 bytes, only the low bytes are used, a reference is filled compressed */
+ARRAYS_FILL_INTRINSIC(i, long, GET_STACK)
+ARRAYS_FILL_INTRINSIC(l, long, GET_STACKL)
+ARRAYS_FILL_INTRINSIC(r, long, GET_STACK)
+ARRAYS_FILL_RANGE_INTRINSIC(i, long, GET_STACK)
+ARRAYS_FILL_RANGE_INTRINSIC(l, long, GET_STACKL)
+ARRAYS_FILL_RANGE_INTRINSIC(r, long, GET_STACK)
+
+void intrinsic_arrays_equals(OPENV *env)
+{
+    CArray_char *a, *b;
+    GET_STACKR(env->current_stack, b, CArray_char*);
+    GET_STACKR(env->current_stack, a, CArray_char*);
+    PUSH_STACK(env->current_stack, arrayEquals(a, b), int);
+}
+
+#endif // ARRAYS_C
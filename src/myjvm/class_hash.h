@@ -9,6 +9,14 @@
 #ifndef CLASS_HASH_H
 #define CLASS_HASH_H
 
+/**
+  * the loaded classes by name. the readers never block: a bucket is a list the writers only prepend to,
+  * with a release store of the head, and a table that gets too full is replaced by a larger copy. the
+  * replaced tables are kept, a reader may still walk them, until the vm is destroyed.
+  * each vm has its table, current_vm->class_table, the writers are serialized by its class_table_lock
+  */
+
+/* the sizes of the table follow the fibonacci numbers from these */
 static int last_hash_size = 144;
 static int hash_size=233;
 
@@ -27,10 +35,9 @@ typedef struct _classHashTable {
     int hash_size;
     int used_slots;
     ClassEntry **class_array;
+    struct _classHashTable *retired; // the table replaced by this one
 } ClassHashTable;
 
-static ClassHashTable *loadedClassTable;
-
 ClassHashTable* newClassHashTable(int size)
 {
     int total_size = sizeof(ClassHashTable)+(sizeof(ClassEntry*) * size);
@@ -44,9 +51,30 @@ ClassHashTable* newClassHashTable(int size)
     return classTable;
 }
 
-void newLoadedClassTable()
+ClassHashTable* newLoadedClassTable()
 {
-    loadedClassTable = newClassHashTable(hash_size);
+    return newClassHashTable(hash_size);
+}
+
+/**
+ * @brief freeLoadedClassTable frees the table, its entries and the tables it replaced, when its vm is destroyed
+ */
+void freeLoadedClassTable(ClassHashTable *table)
+{
+    ClassHashTable *retired;
+    ClassEntry *entry, *next;
+    int i;
+
+    for (; NULL != table; table = retired) {
+        for (i = 0; i < table->hash_size; i++) {
+            for (entry = table->class_array[i]; NULL != entry; entry = next) {
+                next = entry->next;
+                free(entry);
+            }
+        }
+        retired = table->retired;
+        free(table);
+    }
 }
 
 unsigned int hash(const char* s, int hash_size)
@@ -61,9 +89,10 @@ Class* findLoadedClass(const char* class_name, const int class_name_len)
 {
     Class* pclass = NULL;
     ClassEntry* entry;
-    unsigned int index = hash(class_name, hash_size);
+    ClassHashTable *table = __atomic_load_n(&current_vm->class_table, __ATOMIC_ACQUIRE);
+    unsigned int index = hash(class_name, table->hash_size);
 
-    if (NULL == (entry = loadedClassTable->class_array[index])) {
+    if (NULL == (entry = __atomic_load_n(&table->class_array[index], __ATOMIC_ACQUIRE))) {
         return pclass;
     }
 
@@ -79,49 +108,97 @@ Class* findLoadedClass(const char* class_name, const int class_name_len)
     return pclass;
 }
 
+/**
+ * @brief insertClassEntry prepends the entry to its bucket, with class_table_lock held. the entry is filled
+ * before the head is set, a reader sees the bucket without or with it
+ */
+static void insertClassEntry(ClassHashTable *table, ClassEntry *entry)
+{
+    ClassEntry **bucket = &table->class_array[hash(entry->class_name, table->hash_size)];
+
+    if (NULL == *bucket) {
+        table->used_slots++;
+    }
+    entry->next = *bucket;
+    __atomic_store_n(bucket, entry, __ATOMIC_RELEASE);
+    table->class_num++;
+}
+
+/**
+ * @brief growLoadedClassTable replaces the table by a larger copy, with class_table_lock held. the entries
+ * are copied, the readers of the old table go on walking the old lists
+ */
+static void growLoadedClassTable(VM *vm)
+{
+    ClassHashTable *table = vm->class_table, *larger;
+    ClassEntry *entry, *copy;
+    int i, size = table->hash_size + (NULL != table->retired ? table->retired->hash_size : last_hash_size);
+
+    larger = newClassHashTable(size);
+    for (i = 0; i < table->hash_size; i++) {
+        for (entry = table->class_array[i]; NULL != entry; entry = entry->next) {
+            copy = (ClassEntry*)malloc(sizeof(ClassEntry));
+            memcpy(copy, entry, sizeof(ClassEntry));
+            insertClassEntry(larger, copy);
+        }
+    }
+    larger->retired = table;
+    __atomic_store_n(&vm->class_table, larger, __ATOMIC_RELEASE);
+}
+
 int storeLoadedClass(Class* pclass)
 {
-    int index;
     CONSTANT_Utf8_info* utf8_info;
     CONSTANT_Class_info* class_info;
-    ClassEntry* entry;
     ClassEntry* thisClassEntry = (ClassEntry*)malloc(sizeof(ClassEntry));
     class_info = (CONSTANT_Class_info*)(pclass->constant_pool[pclass->this_class]);
     utf8_info = (CONSTANT_Utf8_info*)(pclass->constant_pool[class_info->name_index]);
     thisClassEntry->name_len = utf8_info->length;
     thisClassEntry->class_name = utf8_info->bytes;
+    thisClassEntry->parent_class = pclass->parent_class;
     thisClassEntry->pclass = pclass;
     thisClassEntry->next = NULL;
 
-    index = hash(utf8_info->bytes, hash_size);
-    if (NULL == loadedClassTable->class_array[index]) {
-        loadedClassTable->class_array[index] = thisClassEntry;
-        loadedClassTable->class_num++;
-        loadedClassTable->used_slots++;
-        return 0;
-    }
-
-    entry = loadedClassTable->class_array[index];
-    while (entry->next != NULL) {
-        entry = entry->next;
+    pthread_mutex_lock(&current_vm->class_table_lock);
+    if (current_vm->class_table->class_num >= current_vm->class_table->hash_size) {
+        growLoadedClassTable(current_vm);
     }
-    entry->next = thisClassEntry;
-    loadedClassTable->class_num++;
+    insertClassEntry(current_vm->class_table, thisClassEntry);
+    pthread_mutex_unlock(&current_vm->class_table_lock);
 
     return 0;
 }
 
+/**
+ * @brief forEachLoadedClass calls fn on each class loaded by the vm, the classes stored meanwhile may be missed
+ */
+void forEachLoadedClass(VM *vm, void (*fn)(Class*, void*), void *arg)
+{
+    ClassHashTable *table = __atomic_load_n(&vm->class_table, __ATOMIC_ACQUIRE);
+    ClassEntry* entry;
+    int i;
+
+    if (NULL == table) {
+        return;
+    }
+    for (i = 0; i < table->hash_size; i++) {
+        for (entry = __atomic_load_n(&table->class_array[i], __ATOMIC_ACQUIRE); NULL != entry; entry = entry->next) {
+            fn(entry->pclass, arg);
+        }
+    }
+}
+
 void displayLoadedClass()
 {
      int i = 0;
      ClassEntry* entry;
 
-     printf("loadedClassTable: class_num=%d, hash_size=%d, used_slots=%d\n", loadedClassTable->class_num, loadedClassTable->hash_size, loadedClassTable->used_slots);
+     printf("loadedClassTable: class_num=%d, hash_size=%d, used_slots=%d\n", current_vm->class_table->class_num, current_vm->class_table->hash_size, current_vm->class_table->used_slots);
 
-     for (; i < hash_size; i++) {
-         if (loadedClassTable->class_array[i] != NULL) {
+     for (; i < current_vm->class_table->hash_size; i++) {
+         if (current_vm->class_table->class_array[i] != NULL) {
              printf("#%d ", i);
-             entry = loadedClassTable->class_array[i];
+             entry = current_vm->class_table->class_array[i];
              while (entry != NULL) {
                  printf("%s ", entry->class_name);
                  entry = entry->next;
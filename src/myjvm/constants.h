@@ -32,6 +32,7 @@
 #define ACC_STATIC 0x0008
 #define ACC_FINAL 0x0010
 #define ACC_SUPER 0x0020
+#define ACC_SYNCHRONIZED 0x0020 // of a method, ACC_SUPER of a class
 #define ACC_BRIDGE 0x0040
 #define ACC_VARARGS 0x0080
 #define ACC_NATIVE 0x0100
@@ -102,9 +103,10 @@ char *accFlagMap[] = {
     "ACC_ENUM"
 };
 
+/* the flags are formatted into a buffer of the thread, valid until the next call */
 char* formatAccessFlag(ushort accFlag)
 {
-    char *accFlagStr = (char*)malloc(sizeof(char)*255);
+    static __thread char accFlagStr[255];
     int i;
     int len = sizeof(accFlagInt)/sizeof(short int);
     memset(accFlagStr, 0, 255);
@@ -0,0 +1,100 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef DEQUE_H
+#define DEQUE_H
+
+/**
+  * the Chase-Lev work stealing deque of the workers of gc.c (the blocks to scan) and of forkjoin.c (the
+  * tasks). the owner pushes and pops at the bottom, the thieves take at the top; the slots are a ring,
+  * a push to a full deque fails and the owner does the work itself
+  */
+
+#define WORK_DEQUE_SIZE (1 << 14)
+
+typedef struct _WorkDeque {
+    long top;
+    long bottom;
+    void *slots[WORK_DEQUE_SIZE];
+} WorkDeque;
+
+#define WORK_DEQUE_SLOT(d, i) ((d)->slots[(i) & (WORK_DEQUE_SIZE - 1)])
+
+/**
+ * @brief workDequePush pushes p at the bottom, by the owner only
+ * @return 0 if the deque is full
+ */
+static inline int workDequePush(WorkDeque *d, void *p)
+{
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED), t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+
+    if (b - t >= WORK_DEQUE_SIZE) {
+        return 0;
+    }
+    __atomic_store_n(&WORK_DEQUE_SLOT(d, b), p, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/**
+ * @brief workDequePop takes from the bottom, by the owner only
+ * @return NULL if the deque is empty or a thief took the last one
+ */
+static inline void* workDequePop(WorkDeque *d)
+{
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1, t;
+    void *p;
+
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    if (t > b) {
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    p = __atomic_load_n(&WORK_DEQUE_SLOT(d, b), __ATOMIC_RELAXED);
+    if (t == b) {
+        // the last one, a thief may take it too
+        if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            p = NULL;
+        }
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return p;
+}
+
+/**
+ * @brief workDequeSteal takes from the top, by any thread
+ * @return NULL if the deque is empty or another thread took it first
+ */
+static inline void* workDequeSteal(WorkDeque *d)
+{
+    long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE), b;
+    void *p;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) {
+        return NULL;
+    }
+    p = __atomic_load_n(&WORK_DEQUE_SLOT(d, t), __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    return p;
+}
+
+/**
+ * @brief workDequeIsEmpty may be stale by the time it returns, for the idle checks
+ */
+static inline int workDequeIsEmpty(WorkDeque *d)
+{
+    return __atomic_load_n(&d->top, __ATOMIC_ACQUIRE) >= __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+}
+
+#endif // DEQUE_H
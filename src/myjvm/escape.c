@@ -0,0 +1,534 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef ESCAPE_C
+#define ESCAPE_C
+
+#include "opcode.h"
+#include "op_core.h"
+
+/**
+  * this file implements the escape analysis and the scalar replacement.
+  * When a method is loaded, analyseEscape looks for the allocation sites
+  *     new C; dup; <argument>...; invokespecial C.<init>; astore n
+  * where the local n is not an argument, is stored only there and is only used as `aload n; getfield C.f` or
+  * `aload n; <push>; putfield C.f`, so the object never leaves the method.
+  * The class C is usually not loaded yet, so the rest is done by scalarReplace when the method is
+  * entered again after C has been loaded and initialized: the <init> of C must only call Object.<init>
+  * and copy its parameters into fields of C. Then every field of the object gets a local of its own, the
+  * getfield/putfield become xload/xstore of that local, and the allocation becomes the private
+  * instruction scalar_init, which zeroes the field locals and stores the arguments as <init> would.
+  * The rewritten code has the same length and offsets, so branches, exception tables and line
+  * numbers are kept. It is a copy: frames already running the old code go on with it and their
+  * smaller frames, only the frames made after the rewrite use the new code. Nothing is assumed at
+  * run time, so no deoptimization is needed; a site that cannot be proven is left alone.
+  */
+
+#ifndef get_class_name
+#define get_class_name(pools, index) get_utf8(pools[(((CONSTANT_Class_info*)(pools[index]))->name_index)])
+#endif
+
+/* -Xescape:off disables the analysis, see main.c */
+int escape_analysis = 1;
+
+/* taken to rewrite a method, the threads entering it at the same time wait for the rewrite */
+static pthread_mutex_t escape_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the method entries to wait for the classes of the sites to be loaded */
+#define ESCAPE_TRIES 8
+#define MAX_SCALAR_CANDIDATES 16
+/* the field locals are accessed by the one byte index of xload/xstore */
+#define MAX_SCALAR_LOCALS 256
+
+/**
+ * @brief localAccess finds the local variable accessed by an instruction
+ * @return 1 if the instruction loads, 2 if it stores, 0 if it does not access a local
+ */
+static int localAccess(uchar *code, int pc, int *index, int *width)
+{
+    uchar op = code[pc];
+
+    if (op >= OPC_ILOAD && op <= OPC_ALOAD) {
+        *index = code[pc + 1];
+        *width = (OPC_LLOAD == op || OPC_DLOAD == op) ? 2 : 1;
+        return 1;
+    }
+    if (op >= OPC_ILOAD_0 && op <= OPC_ALOAD_3) {
+        *index = (op - OPC_ILOAD_0) & 3;
+        *width = ((op - OPC_ILOAD_0) >> 2) == 1 || ((op - OPC_ILOAD_0) >> 2) == 3 ? 2 : 1;
+        return 1;
+    }
+    if (op >= OPC_ISTORE && op <= OPC_ASTORE) {
+        *index = code[pc + 1];
+        *width = (OPC_LSTORE == op || OPC_DSTORE == op) ? 2 : 1;
+        return 2;
+    }
+    if (op >= OPC_ISTORE_0 && op <= OPC_ASTORE_3) {
+        *index = (op - OPC_ISTORE_0) & 3;
+        *width = ((op - OPC_ISTORE_0) >> 2) == 1 || ((op - OPC_ISTORE_0) >> 2) == 3 ? 2 : 1;
+        return 2;
+    }
+    if (OPC_IINC == op) {
+        *index = code[pc + 1];
+        *width = 1;
+        return 2;
+    }
+    return 0;
+}
+
+/**
+ * @brief simplePushLength the length of an instruction pushing one value without side effect
+ * @return 0 if the instruction is not such one
+ */
+static int simplePushLength(uchar *code, int pc)
+{
+    uchar op = code[pc];
+
+    if (op >= OPC_ACONST_NULL && op <= OPC_DCONST_1) {
+        return 1;
+    }
+    if (OPC_BIPUSH == op || OPC_LDC == op || (op >= OPC_ILOAD && op <= OPC_ALOAD)) {
+        return 2;
+    }
+    if (OPC_SIPUSH == op || OPC_LDC_W == op || OPC_LDC2_W == op) {
+        return 3;
+    }
+    if (op >= OPC_ILOAD_0 && op <= OPC_ALOAD_3) {
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief argumentLength the length of an instruction computing the arguments of a candidate's <init>, a
+ * simple push or an arithmetic or conversion instruction that cannot throw
+ */
+static int argumentLength(uchar *code, int pc)
+{
+    uchar op = code[pc];
+
+    if ((op >= OPC_IADD && op <= OPC_DNEG && (op < OPC_IDIV || op > OPC_LREM)) || (op >= OPC_I2L && op <= OPC_I2S)) {
+        return 1;
+    }
+    return simplePushLength(code, pc);
+}
+
+static int isLoadOfLocal(uchar *code, int pc, int local)
+{
+    int index, width;
+    return 1 == localAccess(code, pc, &index, &width) && index <= local && local < index + width;
+}
+
+/**
+ * @brief findScalarUses checks the accesses of the local of a candidate, every one must be its store or
+ * a field access of the object
+ * @return 1 if the object does not escape
+ */
+static int findScalarUses(Code_attribute *code_attr, uchar *insn_start, uchar *targets, ScalarCandidate *cand)
+{
+    uchar *code = code_attr->code;
+    ScalarUse uses[256];
+    int pc, next, index, width, access, push;
+
+    cand->use_count = 0;
+    for (pc = 0; pc < code_attr->code_length; pc++) {
+        if (!insn_start[pc] || 0 == (access = localAccess(code, pc, &index, &width)) ||
+                cand->local < index || cand->local >= index + width) {
+            continue;
+        }
+        if (pc == cand->store_pc) {
+            continue;
+        }
+        if (2 == access || (OPC_ALOAD != code[pc] && (code[pc] < OPC_ALOAD_0 || code[pc] > OPC_ALOAD_3))) {
+            return 0;
+        }
+        next = pc + (OPC_ALOAD == code[pc] ? 2 : 1);
+        if (OPC_GETFIELD == code[next] && !targets[next]) {
+            uses[cand->use_count].load_pc = pc;
+            uses[cand->use_count].field_pc = next;
+        } else if ((push = simplePushLength(code, next)) && !isLoadOfLocal(code, next, cand->local) &&
+                   OPC_PUTFIELD == code[next + push] && !targets[next] && !targets[next + push]) {
+            uses[cand->use_count].load_pc = pc;
+            uses[cand->use_count].field_pc = next + push;
+        } else {
+            return 0;
+        }
+        if (++cand->use_count >= 256) {
+            return 0;
+        }
+    }
+    cand->uses = (ScalarUse*)malloc(sizeof(ScalarUse) * (cand->use_count + 1));
+    memcpy(cand->uses, uses, sizeof(ScalarUse) * cand->use_count);
+
+    return 1;
+}
+
+/**
+ * @brief analyseEscape finds the allocation sites of a method whose object does not escape, called when
+ * the method is loaded. the methods with a subroutine, a switch or a wide instruction are not analysed
+ * @param pclass
+ * @param code_attr
+ * @param insn_start insn_start[pc] is not 0 if an instruction begins at pc, recorded by the pre_action walk
+ * @param arg_slots the locals holding `this` and the arguments, they have a value before any astore so a
+ * site stored into one of them is not a candidate
+ */
+void analyseEscape(Class *pclass, Code_attribute *code_attr, uchar *insn_start, int arg_slots)
+{
+    ScalarCandidate cands[MAX_SCALAR_CANDIDATES], *cand;
+    uchar *code = code_attr->code, *targets, op;
+    int pc, p, count = 0, has_new = 0, i;
+
+    code_attr->escape = NULL;
+    if (!escape_analysis) {
+        return;
+    }
+    for (pc = 0; pc < code_attr->code_length; pc++) {
+        if (!insn_start[pc]) {
+            continue;
+        }
+        op = code[pc];
+        if (OPC_JSR == op || OPC_RET == op || OPC_TABLESWITCH == op || OPC_LOOKUPSWITCH == op ||
+                OPC_WIDE == op || OPC_JSR_W == op) {
+            return;
+        }
+        has_new |= OPC_NEW == op;
+    }
+    if (!has_new) {
+        return;
+    }
+
+    // the branch targets, an instruction to be rewritten must not be one
+    targets = (uchar*)calloc(code_attr->code_length + 1, 1);
+    for (pc = 0; pc < code_attr->code_length; pc++) {
+        op = code[pc];
+        if (insn_start[pc] && ((op >= OPC_IFEQ && op <= OPC_GOTO) || OPC_IFNULL == op || OPC_IFNONNULL == op)) {
+            p = pc + TO_SHORT(code + pc + 1);
+        } else if (insn_start[pc] && OPC_GOTO_W == op) {
+            p = pc + TO_INT(code + pc + 1);
+        } else {
+            continue;
+        }
+        if (p >= 0 && p < code_attr->code_length) {
+            targets[p] = 1;
+        }
+    }
+    for (i = 0; i < code_attr->exception_table_length; i++) {
+        targets[code_attr->exceptions[i].handler_pc] = 1;
+        targets[code_attr->exceptions[i].start_pc] = 1;
+    }
+
+    for (pc = 0; pc < code_attr->code_length && count < MAX_SCALAR_CANDIDATES; pc++) {
+        if (!insn_start[pc] || OPC_NEW != code[pc] || OPC_DUP != code[pc + 3] || targets[pc + 3]) {
+            continue;
+        }
+        cand = &cands[count];
+        cand->new_pc = pc;
+        for (p = pc + 4; argumentLength(code, p) && !targets[p]; p += argumentLength(code, p));
+        if (OPC_INVOKESPECIAL != code[p] || targets[p]) {
+            continue;
+        }
+        cand->init_pc = p;
+        p += 3;
+        if (targets[p]) {
+            continue;
+        }
+        if (OPC_ASTORE == code[p]) {
+            cand->local = code[p + 1];
+        } else if (code[p] >= OPC_ASTORE_0 && code[p] <= OPC_ASTORE_3) {
+            cand->local = code[p] - OPC_ASTORE_0;
+        } else {
+            continue;
+        }
+        if (cand->local < arg_slots) {
+            continue;
+        }
+        cand->store_pc = p;
+        if (findScalarUses(code_attr, insn_start, targets, cand)) {
+            debug("escape: new at %d does not escape, local=%d, uses=%d", pc, cand->local, cand->use_count);
+            count++;
+        }
+    }
+    free(targets);
+
+    if (count > 0) {
+        code_attr->escape = (EscapeInfo*)malloc(sizeof(EscapeInfo));
+        memset(code_attr->escape, 0, sizeof(EscapeInfo));
+        code_attr->escape->pclass = pclass;
+        code_attr->escape->candidate_count = count;
+        code_attr->escape->candidates = (ScalarCandidate*)malloc(sizeof(ScalarCandidate) * count);
+        memcpy(code_attr->escape->candidates, cands, sizeof(ScalarCandidate) * count);
+    }
+}
+
+/**
+ * @brief declaredFieldIndex the index of an instance field declared by pclass, -1 if there is none
+ */
+static int declaredFieldIndex(Class *pclass, const char *name)
+{
+    int i;
+    for (i = 0; i < pclass->fields_count; i++) {
+        if (NOT_ACC_STATIC(pclass->fields[i]->access_flags) &&
+                strcmp(get_utf8(pclass->constant_pool[pclass->fields[i]->name_index]), name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief refFieldIndex the declared field of a fieldref of the caller if it is a field of pclass
+ */
+static int refFieldIndex(Class *caller, ushort fref_index, Class *pclass)
+{
+    CONSTANT_Fieldref_info *fref = (CONSTANT_Fieldref_info*)(caller->constant_pool[fref_index]);
+    CONSTANT_NameAndType_info *nt = (CONSTANT_NameAndType_info*)(caller->constant_pool[fref->name_and_type_index]);
+
+    if (strcmp(get_class_name(caller->constant_pool, fref->class_index), get_this_class_name(pclass)) != 0) {
+        return -1;
+    }
+    return declaredFieldIndex(pclass, get_utf8(caller->constant_pool[nt->name_index]));
+}
+
+/**
+ * @brief proveTrivialInit checks that the <init> of pclass only calls Object.<init> and copies its
+ * parameters into fields, and fills how scalar_init does the same
+ * @param pclass
+ * @param descriptor the descriptor of the <init>
+ * @param field_locals the local of every field of pclass
+ * @param site
+ * @return 1 if proven
+ */
+static int proveTrivialInit(Class *pclass, const char *descriptor, short *field_locals, ScalarSite *site)
+{
+    method_info *method = NULL;
+    Code_attribute *init_code;
+    CONSTANT_Methodref_info *mref;
+    uchar *code, param_of_slot[256];
+    const char *d;
+    int i, pc, slot = 1, index, width, field;
+
+    if (strcmp(get_super_class_name(pclass), "java/lang/Object") != 0) {
+        return 0;
+    }
+    for (i = 0; i < pclass->methods_count; i++) {
+        if (strcmp(get_utf8(pclass->constant_pool[pclass->methods[i]->name_index]), "<init>") == 0 &&
+                strcmp(get_utf8(pclass->constant_pool[pclass->methods[i]->descriptor_index]), descriptor) == 0) {
+            method = pclass->methods[i];
+        }
+    }
+    if (NULL == method || NULL == (init_code = method->code_attribute_addr)) {
+        return 0;
+    }
+
+    // the parameters and their slots, `this` is slot 0
+    memset(param_of_slot, 0xff, sizeof(param_of_slot));
+    site->param_count = 0;
+    site->args_len = 0;
+    for (d = descriptor + 1; ')' != *d; d++) {
+        if (site->param_count >= 16) {
+            return 0;
+        }
+        param_of_slot[slot] = site->param_count;
+        site->params[site->param_count].size = ('J' == *d || 'D' == *d) ? 2 : 1;
+        site->params[site->param_count].local = -1;
+        slot += site->params[site->param_count].size;
+        site->args_len += site->params[site->param_count++].size << 2;
+        while ('[' == *d) {
+            d++;
+        }
+        if ('L' == *d) {
+            while (';' != *d) {
+                d++;
+            }
+        }
+    }
+
+    // aload_0; invokespecial Object.<init>()V
+    code = init_code->code;
+    if (init_code->code_length < 5 || OPC_ALOAD_0 != code[0] || OPC_INVOKESPECIAL != code[1]) {
+        return 0;
+    }
+    mref = (CONSTANT_Methodref_info*)(pclass->constant_pool[(ushort)TO_SHORT(code + 2)]);
+    if (strcmp(get_class_name(pclass->constant_pool, mref->class_index), "java/lang/Object") != 0) {
+        return 0;
+    }
+    // (aload_0; xload <param>; putfield <field>)...; return
+    for (pc = 4; OPC_RETURN != code[pc]; pc += 3) {
+        if (OPC_ALOAD_0 != code[pc] || 1 != localAccess(code, pc + 1, &index, &width) ||
+                0xff == param_of_slot[index] || site->params[param_of_slot[index]].size != width) {
+            return 0;
+        }
+        pc += OPC_ILOAD_0 <= code[pc + 1] ? 2 : 3;
+        if (OPC_PUTFIELD != code[pc] || (field = refFieldIndex(pclass, (ushort)TO_SHORT(code + pc + 1), pclass)) < 0 ||
+                site->params[param_of_slot[index]].local >= 0) {
+            return 0;
+        }
+        site->params[param_of_slot[index]].local = field_locals[field];
+    }
+    return pc == init_code->code_length - 1;
+}
+
+static uchar fieldLoadOp(char ftype)
+{
+    switch (ftype) {
+        case 'J': return OPC_LLOAD;
+        case 'F': return OPC_FLOAD;
+        case 'D': return OPC_DLOAD;
+        case 'L':
+        case '[': return OPC_ALOAD;
+        default: return OPC_ILOAD;
+    }
+}
+
+/**
+ * @brief rewriteCandidate rewrites a proven site and its uses in the copy of the code
+ */
+static void rewriteCandidate(Class *caller, uchar *code, ScalarCandidate *cand, Class *pclass, short *field_locals, ushort site_index)
+{
+    ScalarUse *use;
+    int i, field, end;
+    char ftype;
+    uchar op;
+
+    memset(code + cand->new_pc, OPC_NOP, 4); // new; dup
+    code[cand->init_pc] = OPC_SCALAR_INIT;
+    *(short*)(code + cand->init_pc + 1) = site_index;
+    memset(code + cand->store_pc, OPC_NOP, OPC_ASTORE == code[cand->store_pc] ? 2 : 1);
+
+    for (i = 0; i < cand->use_count; i++) {
+        use = &cand->uses[i];
+        field = refFieldIndex(caller, (ushort)TO_SHORT(code + use->field_pc + 1), pclass);
+        ftype = get_utf8(pclass->constant_pool[pclass->fields[field]->descriptor_index])[0];
+        op = fieldLoadOp(ftype);
+        if (OPC_GETFIELD == code[use->field_pc]) {
+            end = use->field_pc + 3;
+            code[use->load_pc] = op;
+            code[use->load_pc + 1] = (uchar)field_locals[field];
+            memset(code + use->load_pc + 2, OPC_NOP, end - use->load_pc - 2);
+        } else {
+            memset(code + use->load_pc, OPC_NOP, OPC_ALOAD == code[use->load_pc] ? 2 : 1);
+            code[use->field_pc] = op + (OPC_ISTORE - OPC_ILOAD);
+            code[use->field_pc + 1] = (uchar)field_locals[field];
+            code[use->field_pc + 2] = OPC_NOP;
+        }
+    }
+}
+
+/**
+ * @brief siteClass the class allocated by a candidate once it is initialized, NULL before. a class resolved
+ * by an ldc or a checkcast may not be initialized yet, the `new` must not be removed then as it runs the <clinit>
+ */
+static Class* siteClass(Class *caller, Code_attribute *code_attr, ScalarCandidate *cand)
+{
+    ushort index = (ushort)TO_SHORT(code_attr->code + cand->new_pc + 1);
+    Class *pclass;
+
+    if (index == caller->this_class) {
+        // a method of the class runs, so its <clinit> has run or is running in this thread
+        return caller;
+    }
+    pclass = CP_RESOLVED(((CONSTANT_Class_info*)(caller->constant_pool[index]))->pclass);
+    if (NULL == pclass || !__atomic_load_n(&pclass->clinit_runned, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return pclass;
+}
+
+/**
+ * @brief scalarReplace proves the candidates of a method whose classes are loaded and rewrites the
+ * method, called before a frame of the method is made
+ * @param code_attr
+ */
+void scalarReplace(Code_attribute *code_attr)
+{
+    EscapeInfo *escape = code_attr->escape;
+    Class *caller = escape->pclass, *pclass;
+    CONSTANT_Methodref_info *mref;
+    ScalarCandidate *cand;
+    ScalarSite sites[MAX_SCALAR_CANDIDATES];
+    short field_locals[MAX_SCALAR_CANDIDATES][MAX_SCALAR_LOCALS];
+    Class *classes[MAX_SCALAR_CANDIDATES];
+    ScalarCandidate *proven[MAX_SCALAR_CANDIDATES];
+    uchar *code;
+    int i, j, field, max_locals = code_attr->max_locals, ok;
+    char ftype;
+
+    pthread_mutex_lock(&escape_lock);
+    if (NULL == escape->candidates) {
+        pthread_mutex_unlock(&escape_lock);
+        return;
+    }
+    // wait for the classes of all the sites, but not for ever as some sites may never run
+    for (i = 0; i < escape->candidate_count; i++) {
+        if (NULL == siteClass(caller, code_attr, &escape->candidates[i]) && escape->tries++ < ESCAPE_TRIES) {
+            pthread_mutex_unlock(&escape_lock);
+            return;
+        }
+    }
+
+    escape->site_count = 0;
+    for (i = 0; i < escape->candidate_count; i++) {
+        cand = &escape->candidates[i];
+        pclass = siteClass(caller, code_attr, cand);
+        mref = (CONSTANT_Methodref_info*)(caller->constant_pool[(ushort)TO_SHORT(code_attr->code + cand->init_pc + 1)]);
+        if (NULL == pclass || strcmp(get_class_name(caller->constant_pool, mref->class_index), get_this_class_name(pclass)) != 0) {
+            continue;
+        }
+
+        // a local for every field of the class
+        sites[escape->site_count].first_local = max_locals;
+        for (j = 0, field = max_locals; j < pclass->fields_count && j < MAX_SCALAR_LOCALS; j++) {
+            if (NOT_ACC_STATIC(pclass->fields[j]->access_flags)) {
+                ftype = get_utf8(pclass->constant_pool[pclass->fields[j]->descriptor_index])[0];
+                field_locals[escape->site_count][j] = field;
+                field += ('J' == ftype || 'D' == ftype) ? 2 : 1;
+            }
+        }
+        if (field > MAX_SCALAR_LOCALS || j < pclass->fields_count) {
+            continue;
+        }
+        ok = proveTrivialInit(pclass, get_utf8(caller->constant_pool[((CONSTANT_NameAndType_info*)(caller->constant_pool[mref->name_and_type_index]))->descriptor_index]),
+                              field_locals[escape->site_count], &sites[escape->site_count]);
+        for (j = 0; ok && j < cand->use_count; j++) {
+            ok = refFieldIndex(caller, (ushort)TO_SHORT(code_attr->code + cand->uses[j].field_pc + 1), pclass) >= 0;
+        }
+        if (!ok) {
+            continue;
+        }
+        sites[escape->site_count].local_count = field - max_locals;
+        max_locals = field;
+        classes[escape->site_count] = pclass;
+        proven[escape->site_count++] = cand;
+    }
+
+    if (escape->site_count > 0) {
+        code = (uchar*)malloc(code_attr->code_length);
+        memcpy(code, code_attr->code, code_attr->code_length);
+        for (i = 0; i < escape->site_count; i++) {
+            debug("escape: scalar replaced new at %d, %d field locals from %d", proven[i]->new_pc,
+                  sites[i].local_count, sites[i].first_local);
+            rewriteCandidate(caller, code, proven[i], classes[i], field_locals[i], i);
+        }
+        escape->sites = (ScalarSite*)malloc(sizeof(ScalarSite) * escape->site_count);
+        memcpy(escape->sites, sites, sizeof(ScalarSite) * escape->site_count);
+        code_attr->max_locals = max_locals;
+        code_attr->frame_size = sizeof(StackFrame) + ((code_attr->max_locals + code_attr->max_stack + 4) << 2);
+        // the frames running the old code keep it, so it is freed with the class. the locals are published
+        // before the code, see newStackFrame
+        escape->replaced_code = code_attr->code;
+        __atomic_store_n(&code_attr->code, code, __ATOMIC_RELEASE);
+    }
+    for (i = 0; i < escape->candidate_count; i++) {
+        free(escape->candidates[i].uses);
+    }
+    free(escape->candidates);
+    escape->candidates = NULL;
+    pthread_mutex_unlock(&escape_lock);
+}
+
+#endif // ESCAPE_C
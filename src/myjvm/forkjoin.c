@@ -0,0 +1,785 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef FORKJOIN_C
+#define FORKJOIN_C
+
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "deque.h"
+
+/**
+  * java.util.concurrent.ForkJoinPool on a work stealing scheduler. the methods of ForkJoinPool and
+  * ForkJoinTask are intrinsics: a pool has a worker thread per cpu (or its parallelism), each with an
+  * OPENV, a java stack and a Chase-Lev deque of its own. fork() pushes the task at the bottom of the deque
+  * of the worker, the worker pops from the bottom and an idle worker steals from the top of another deque.
+  * join() runs the task in the current thread if no one has taken it yet, otherwise it runs the other
+  * tasks it can find until the task is done. a thread that is not a worker forks to the common pool and
+  * waits for the tasks it joins.
+  * the compute() of the task, ()V of a RecursiveAction or ()Ljava/lang/Object; of a RecursiveTask, is run
+  * in a nested interpreter loop like a <clinit>. the state of a task is kept in ForkJoinTask.status and the
+  * value of a RecursiveTask in RecursiveTask.result. the tasks in the deques are roots of gc.c.
+  * shutdown() and close() stop the pool: the workers run the tasks left and exit, close() waits for them.
+  * a pool whose object is garbage is shut down by gc.c, and freed once its workers have exited, see
+  * sweepForkJoinPools; the common pool lives as long as its vm
+  */
+
+/* the bits of ForkJoinTask.status */
+#define FJ_RUNNING 1
+#define FJ_DONE 2
+#define FJ_SIGNAL 4 // a thread that is not a worker waits for the task
+
+/* the states of a pool */
+#define FJ_POOL_RUNNING  0
+#define FJ_POOL_SHUTDOWN 1 // the workers exit when they find no task
+#define FJ_POOL_STOP     2 // the vm is destroyed, the workers exit at once
+
+typedef struct _FjWorker {
+    struct _FjPool *pool;
+    int id;
+    unsigned int seed;
+    pthread_t tid;
+    OPENV env;
+    WorkDeque deque; // the tasks forked, see deque.h
+} FjWorker;
+
+typedef struct _FjPool {
+    Object *pool; // the java.util.concurrent.ForkJoinPool object
+    VM *vm;
+    int parallelism;
+    FjWorker **workers;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond; // signaled when a task is pushed and a worker is idle
+    pthread_cond_t exit_cond; // signaled when the last worker exits
+    int idle;
+    int shutdown; // FJ_POOL_RUNNING, SHUTDOWN or STOP
+    int workers_alive;
+    // the tasks forked or invoked by the threads that are not workers, guarded by lock
+    Object **submissions;
+    long submission_count;
+    long submission_size;
+    struct _FjPool *next;
+} FjPool;
+
+/* the compute() of the last class of task run by the thread */
+typedef struct _FjCompute {
+    Class *pclass;
+    Class *declaring;
+    method_info *method;
+    int returns_object;
+    long vms_freed; // the class may be freed and its address reused, see vm.h
+} FjCompute;
+
+/* the offsets are the same in every vm, set once the first task is seen */
+static int fj_status_offset = -1;
+static int fj_result_offset = -1;
+
+/* the frame the compute() returns to */
+static Code_attribute fj_host_code = {.max_stack = 2};
+
+/* the worker the current thread is, NULL if it is not a worker */
+static __thread FjWorker *fj_self = NULL;
+static __thread FjCompute fj_compute_cache;
+
+/* the threads that are not workers wait here for the tasks they join */
+static pthread_mutex_t fj_join_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fj_join_cond = PTHREAD_COND_INITIALIZER;
+
+#define FJ_STATUS(task) ((int*)GET_FIELD_ADDR(task, fj_status_offset))
+#define FJ_IS_DONE(task) (__atomic_load_n(FJ_STATUS(task), __ATOMIC_ACQUIRE) & FJ_DONE)
+
+/** 1. running a task **/
+
+/**
+ * @brief fjLinkTask finds ForkJoinTask.status, pclass is the linked class of a task
+ */
+static void fjLinkTask(Class *pclass)
+{
+    field_info *field;
+
+    if (__atomic_load_n(&fj_status_offset, __ATOMIC_ACQUIRE) >= 0) {
+        return;
+    }
+    for (; NULL != pclass; pclass = pclass->parent_class) {
+        if (strcmp(get_this_class_name(pclass), "java/util/concurrent/ForkJoinTask") == 0) {
+            break;
+        }
+    }
+    if (NULL == pclass || NULL == (field = findInstanceField(pclass, "status"))) {
+        printf("Error: java.lang.ClassCastException: not a java.util.concurrent.ForkJoinTask\n");
+        exit(1);
+    }
+    __atomic_store_n(&fj_status_offset, field->findex, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief fjFindCompute looks up compute() from the class of the task to its parents, the last class
+ * looked up is cached by the thread
+ */
+static FjCompute* fjFindCompute(Class *task_class)
+{
+    FjCompute *c = &fj_compute_cache;
+    method_info *method;
+    Class *pclass;
+    const char *descriptor;
+    field_info *field;
+    int i;
+
+    if (c->pclass == task_class && c->vms_freed == __atomic_load_n(&vms_freed, __ATOMIC_ACQUIRE)) {
+        return c;
+    }
+    c->pclass = NULL;
+    c->vms_freed = __atomic_load_n(&vms_freed, __ATOMIC_ACQUIRE);
+    for (pclass = task_class; NULL != pclass; pclass = pclass->parent_class) {
+        for (i = 0; i < pclass->methods_count; i++) {
+            method = pclass->methods[i];
+            if (NULL == method || IS_ACC_STATIC(method->access_flags) || NULL == method->code_attribute_addr ||
+                    strcmp(get_utf8(pclass->constant_pool[method->name_index]), "compute") != 0) {
+                continue;
+            }
+            descriptor = get_utf8(pclass->constant_pool[method->descriptor_index]);
+            if (strcmp(descriptor, "()V") == 0 || strcmp(descriptor, "()Ljava/lang/Object;") == 0) {
+                c->declaring = pclass;
+                c->method = method;
+                c->returns_object = 'V' != descriptor[2];
+                c->pclass = task_class;
+                break;
+            }
+        }
+        if (c->pclass == task_class) {
+            break;
+        }
+    }
+    if (c->pclass != task_class) {
+        printf("Error: java.lang.AbstractMethodError: %s.compute()\n", get_this_class_name(task_class));
+        exit(1);
+    }
+    // the value of a RecursiveTask, the field of the jdk class and not one of the subclass
+    if (c->returns_object && __atomic_load_n(&fj_result_offset, __ATOMIC_ACQUIRE) < 0) {
+        for (pclass = task_class; NULL != pclass; pclass = pclass->parent_class) {
+            if (strcmp(get_this_class_name(pclass), "java/util/concurrent/RecursiveTask") == 0 &&
+                    NULL != (field = findInstanceField(pclass, "result"))) {
+                __atomic_store_n(&fj_result_offset, field->findex, __ATOMIC_RELEASE);
+                break;
+            }
+        }
+    }
+    return c;
+}
+
+/**
+ * @brief fjCompute runs compute() of the task in an env of its own, the value of a RecursiveTask is saved in
+ * the task
+ */
+static void fjCompute(OPENV *current_env, Object *task)
+{
+    FjCompute *c = fjFindCompute(task->pclass);
+    Code_attribute *code_attr = (Code_attribute*)(c->method->code_attribute_addr);
+    int returns_object = c->returns_object;
+    StackFrame *host, *stf;
+    Object *result;
+    OPENV env;
+
+    host = newStackFrame(NULL, &fj_host_code);
+    stf = newStackFrame(host, code_attr);
+    *(NarrowRef*)(stf->localvars) = encodeRef(task);
+    stf->method = c->method;
+
+    memset(&env, 0, sizeof(OPENV));
+    env.pc = env.pc_start = stf->code;
+    env.pc_end = stf->code + code_attr->code_length;
+    env.current_stack = stf;
+    env.current_class = c->declaring;
+    env.current_obj = task;
+    env.method = c->method;
+    env.outer = current_env;
+#ifdef DEBUG
+    env.dbg = newDebugType(code_attr->max_locals, STACK_FRAME_SIZE);
+#endif
+
+    setThreadEnv(&env);
+    enterSynchronizedMethod(stf, c->method);
+    // the method returns to the host frame, its last_pc is NULL
+    runUntilReturn(&env, NULL);
+    if (returns_object && fj_result_offset >= 0) {
+        GET_STACKR(host, result, Reference);
+        PUT_FIELD_REF(task, fj_result_offset, result);
+    }
+    setThreadEnv(current_env);
+
+    free(env.leaf_frame);
+    free(host);
+}
+
+/**
+ * @brief fjTryRun runs the task if no thread has taken it
+ * @return 1 if the task was run by this thread
+ */
+static int fjTryRun(OPENV *env, Object *task)
+{
+    int *status = FJ_STATUS(task);
+    int s = __atomic_load_n(status, __ATOMIC_RELAXED);
+
+    do {
+        if (s & (FJ_RUNNING | FJ_DONE)) {
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(status, &s, s | FJ_RUNNING, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    fjCompute(env, task);
+
+    if (__atomic_fetch_or(status, FJ_DONE, __ATOMIC_ACQ_REL) & FJ_SIGNAL) {
+        pthread_mutex_lock(&fj_join_lock);
+        pthread_cond_broadcast(&fj_join_cond);
+        pthread_mutex_unlock(&fj_join_lock);
+    }
+    return 1;
+}
+
+/** 2. the pools **/
+
+static int fjHasWork(FjPool *pool)
+{
+    int i;
+
+    for (i = 0; i < pool->parallelism; i++) {
+        if (!workDequeIsEmpty(&pool->workers[i]->deque)) {
+            return 1;
+        }
+    }
+    return __atomic_load_n(&pool->submission_count, __ATOMIC_ACQUIRE) > 0;
+}
+
+/**
+ * @brief fjSignalWork wakes an idle worker after a push, the worker counts itself idle before it looks for work
+ */
+static void fjSignalWork(FjPool *pool)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->idle, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->work_cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static void fjSubmit(FjPool *pool, Object *task)
+{
+    pthread_mutex_lock(&pool->lock);
+    if (pool->submission_count == pool->submission_size) {
+        pool->submission_size = pool->submission_size ? pool->submission_size << 1 : 64;
+        pool->submissions = (Object**)realloc(pool->submissions, pool->submission_size * sizeof(Object*));
+    }
+    pool->submissions[pool->submission_count] = task;
+    __atomic_store_n(&pool->submission_count, pool->submission_count + 1, __ATOMIC_RELEASE);
+    pthread_cond_signal(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief fjFindWork a task of the deque of the worker, of another deque or of the submissions
+ */
+static Object* fjFindWork(FjWorker *w)
+{
+    FjPool *pool = w->pool;
+    Object *task = NULL;
+    int i, victim;
+
+    if (NULL != (task = (Object*)workDequePop(&w->deque))) {
+        return task;
+    }
+    for (i = 1; i < pool->parallelism; i++) {
+        victim = (w->id + i + rand_r(&w->seed) % pool->parallelism) % pool->parallelism;
+        if (victim != w->id && NULL != (task = (Object*)workDequeSteal(&pool->workers[victim]->deque))) {
+            return task;
+        }
+    }
+    if (__atomic_load_n(&pool->submission_count, __ATOMIC_ACQUIRE) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        if (pool->submission_count > 0) {
+            task = pool->submissions[pool->submission_count - 1];
+            __atomic_store_n(&pool->submission_count, pool->submission_count - 1, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return task;
+}
+
+static void* fjWorkerMain(void *arg)
+{
+    FjWorker *w = (FjWorker*)arg;
+    FjPool *pool = w->pool;
+    StackFrame *host = newStackFrame(NULL, &fj_host_code);
+    Object *task;
+
+    current_vm = pool->vm;
+    fj_self = w;
+    w->env.current_stack = host;
+    w->env.is_thread = 1;
+#ifdef DEBUG
+    w->env.dbg = newDebugType(0, STACK_FRAME_SIZE);
+#endif
+    attachSafepointThread(&w->env);
+    while (FJ_POOL_STOP != __atomic_load_n(&pool->shutdown, __ATOMIC_ACQUIRE)) {
+        if (NULL != (task = fjFindWork(w))) {
+            fjTryRun(&w->env, task);
+            continue;
+        }
+        if (FJ_POOL_RUNNING != __atomic_load_n(&pool->shutdown, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        // idle: counted before the deques are looked at again, see fjSignalWork
+        enterNative();
+        pthread_mutex_lock(&pool->lock);
+        __atomic_add_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+        if (!pool->shutdown && !fjHasWork(pool)) {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        }
+        __atomic_sub_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pool->lock);
+        leaveNative();
+    }
+    detachSafepointThread();
+    free(host);
+
+    pthread_mutex_lock(&pool->lock);
+    if (0 == --pool->workers_alive) {
+        pthread_cond_broadcast(&pool->exit_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/**
+ * @brief fjNewPool starts the workers of a pool of the java object and registers it in current_vm
+ */
+static FjPool* fjNewPool(Object *obj, int parallelism)
+{
+    FjPool *pool = (FjPool*)calloc(1, sizeof(FjPool));
+    FjWorker *w;
+    int i;
+
+    pool->pool = obj;
+    pool->vm = current_vm;
+    pool->parallelism = parallelism;
+    pool->workers = (FjWorker**)calloc(parallelism, sizeof(FjWorker*));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->exit_cond, NULL);
+    pool->workers_alive = parallelism;
+    for (i = 0; i < parallelism; i++) {
+        w = pool->workers[i] = (FjWorker*)calloc(1, sizeof(FjWorker));
+        w->pool = pool;
+        w->id = i;
+        w->seed = i + 1;
+    }
+    pthread_mutex_lock(&current_vm->threads_lock);
+    pool->next = current_vm->fj_pools;
+    current_vm->fj_pools = pool;
+    pthread_mutex_unlock(&current_vm->threads_lock);
+
+    for (i = 0; i < parallelism; i++) {
+        if (0 != pthread_create(&pool->workers[i]->tid, NULL, fjWorkerMain, pool->workers[i])) {
+            printf("Error: java.lang.OutOfMemoryError: unable to create new native thread\n");
+            exit(1);
+        }
+    }
+    return pool;
+}
+
+static FjPool* fjFindPool(Object *obj)
+{
+    FjPool *pool;
+
+    pthread_mutex_lock(&current_vm->threads_lock);
+    for (pool = current_vm->fj_pools; NULL != pool && pool->pool != obj; pool = pool->next);
+    pthread_mutex_unlock(&current_vm->threads_lock);
+    if (NULL == pool) {
+        printf("Error: java.lang.IllegalStateException: pool not constructed\n");
+        exit(1);
+    }
+    return pool;
+}
+
+/**
+ * @brief fjShutdown stops the pool, state is FJ_POOL_SHUTDOWN or FJ_POOL_STOP
+ */
+static void fjShutdown(FjPool *pool, int state)
+{
+    pthread_mutex_lock(&pool->lock);
+    if (pool->shutdown < state) {
+        __atomic_store_n(&pool->shutdown, state, __ATOMIC_RELEASE);
+    }
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief fjFreePool joins the workers of a pool that is shut down and frees it
+ */
+static void fjFreePool(FjPool *pool)
+{
+    int i;
+
+    for (i = 0; i < pool->parallelism; i++) {
+        pthread_join(pool->workers[i]->tid, NULL);
+        free(pool->workers[i]);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->exit_cond);
+    free(pool->workers);
+    free(pool->submissions);
+    free(pool);
+}
+
+static int fjDefaultParallelism()
+{
+    int n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : n;
+}
+
+/**
+ * @brief fjCommonPool the common pool of current_vm, created on first use
+ */
+static FjPool* fjCommonPool(OPENV *env)
+{
+    CONSTANT_Utf8_info utf8_info;
+    Class *pclass;
+    Object *obj;
+    FjPool *pool;
+
+    if (NULL != (pool = __atomic_load_n(&current_vm->fj_common_pool, __ATOMIC_ACQUIRE))) {
+        return pool;
+    }
+    utf8_info.tag = CONSTANT_Utf8;
+    utf8_info.bytes = "java/util/concurrent/ForkJoinPool";
+    utf8_info.length = strlen(utf8_info.bytes);
+    pclass = systemLoadClassRecursive(env, &utf8_info);
+    linkClassFields(env, pclass);
+    // allocated before the lock is taken, allocating may collect and the collector takes threads_lock
+    obj = allocObject(pclass);
+
+    pthread_mutex_lock(&fj_join_lock);
+    if (NULL == (pool = current_vm->fj_common_pool)) {
+        pool = fjNewPool(obj, fjDefaultParallelism());
+        __atomic_store_n(&current_vm->fj_common_pool, pool, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&fj_join_lock);
+
+    return pool;
+}
+
+/**
+ * @brief fjJoin waits for the task: a worker runs it if no one has taken it or helps with the other tasks,
+ * another thread waits for a worker to end it
+ */
+static void fjJoin(OPENV *env, Object *task)
+{
+    int *status = FJ_STATUS(task), s, spins = 0;
+    struct timespec ts = {0, 50000};
+    Object *other;
+
+    if (FJ_IS_DONE(task)) {
+        return;
+    }
+    if (NULL != fj_self) {
+        if (fjTryRun(env, task)) {
+            return;
+        }
+        while (!FJ_IS_DONE(task)) {
+            if (NULL != (other = fjFindWork(fj_self))) {
+                fjTryRun(env, other);
+                spins = 0;
+                continue;
+            }
+            enterNative();
+            if (++spins < 64) {
+                sched_yield();
+            } else {
+                nanosleep(&ts, NULL);
+            }
+            leaveNative();
+        }
+        return;
+    }
+
+    enterNative();
+    pthread_mutex_lock(&fj_join_lock);
+    while (!((s = __atomic_load_n(status, __ATOMIC_ACQUIRE)) & FJ_DONE)) {
+        if (!(s & FJ_SIGNAL)) {
+            __atomic_compare_exchange_n(status, &s, s | FJ_SIGNAL, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+            continue;
+        }
+        pthread_cond_wait(&fj_join_cond, &fj_join_lock);
+    }
+    pthread_mutex_unlock(&fj_join_lock);
+    leaveNative();
+}
+
+/**
+ * @brief fjFork pushes the task to the deque of the worker, or submits it to the common pool
+ */
+static void fjFork(OPENV *env, Object *task)
+{
+    if (NULL == fj_self) {
+        fjSubmit(fjCommonPool(env), task);
+    } else if (workDequePush(&fj_self->deque, task)) {
+        fjSignalWork(fj_self->pool);
+    } else {
+        // the deque is full, the task is run at once
+        fjTryRun(env, task);
+    }
+}
+
+static Object* fjResult(Object *task)
+{
+    if (!fjFindCompute(task->pclass)->returns_object || fj_result_offset < 0) {
+        return NULL;
+    }
+    return GET_FIELD_REF(task, fj_result_offset, Object*);
+}
+
+static void fjForEachTask(FjPool *pool, void (*fn)(Object*, void*), void *arg)
+{
+    WorkDeque *d;
+    long t;
+    int i;
+
+    for (i = 0; i < pool->parallelism; i++) {
+        d = &pool->workers[i]->deque;
+        for (t = d->top; t < d->bottom; t++) {
+            fn((Object*)WORK_DEQUE_SLOT(d, t), arg);
+        }
+    }
+    pthread_mutex_lock(&pool->lock);
+    for (t = 0; t < pool->submission_count; t++) {
+        fn(pool->submissions[t], arg);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief forEachForkJoinRoot calls fn on the common pool and on the tasks waiting in the deques and submissions
+ * of the pools, the retired ones included, called by gc.c while the java threads are stopped
+ */
+void forEachForkJoinRoot(VM *vm, void (*fn)(Object*, void*), void *arg)
+{
+    FjPool *pool;
+
+    pthread_mutex_lock(&vm->threads_lock);
+    if (NULL != vm->fj_common_pool) {
+        fn(vm->fj_common_pool->pool, arg);
+    }
+    for (pool = vm->fj_pools; NULL != pool; pool = pool->next) {
+        fjForEachTask(pool, fn, arg);
+    }
+    for (pool = vm->fj_retired_pools; NULL != pool; pool = pool->next) {
+        fjForEachTask(pool, fn, arg);
+    }
+    pthread_mutex_unlock(&vm->threads_lock);
+}
+
+/**
+ * @brief sweepForkJoinPools frees the retired pools whose workers have exited and retires the pools whose object
+ * is not live: they are shut down, their workers run the tasks left and exit. called by gc.c before the sweep
+ * while the java threads are stopped
+ */
+void sweepForkJoinPools(VM *vm, int (*is_live)(Object*))
+{
+    FjPool **ppool, *pool;
+
+    pthread_mutex_lock(&vm->threads_lock);
+    for (ppool = &vm->fj_retired_pools; NULL != (pool = *ppool); ) {
+        if (0 == __atomic_load_n(&pool->workers_alive, __ATOMIC_ACQUIRE)) {
+            *ppool = pool->next;
+            fjFreePool(pool);
+        } else {
+            ppool = &pool->next;
+        }
+    }
+    for (ppool = &vm->fj_pools; NULL != (pool = *ppool); ) {
+        if (pool != vm->fj_common_pool && !is_live(pool->pool)) {
+            *ppool = pool->next;
+            pool->pool = NULL;
+            fjShutdown(pool, FJ_POOL_SHUTDOWN);
+            pool->next = vm->fj_retired_pools;
+            vm->fj_retired_pools = pool;
+        } else {
+            ppool = &pool->next;
+        }
+    }
+    pthread_mutex_unlock(&vm->threads_lock);
+}
+
+/**
+ * @brief freeForkJoinPools stops the workers of the pools of a destroyed vm and frees the pools
+ */
+void freeForkJoinPools(VM *vm)
+{
+    FjPool *pool, *next;
+
+    for (pool = vm->fj_pools; NULL != pool; pool = pool->next) {
+        fjShutdown(pool, FJ_POOL_STOP);
+    }
+    for (pool = vm->fj_retired_pools; NULL != pool; pool = pool->next) {
+        fjShutdown(pool, FJ_POOL_STOP);
+    }
+    for (pool = vm->fj_pools; NULL != pool; pool = next) {
+        next = pool->next;
+        fjFreePool(pool);
+    }
+    for (pool = vm->fj_retired_pools; NULL != pool; pool = next) {
+        next = pool->next;
+        fjFreePool(pool);
+    }
+    vm->fj_pools = NULL;
+    vm->fj_retired_pools = NULL;
+    vm->fj_common_pool = NULL;
+}
+
+/** 3. the intrinsics **/
+
+void intrinsic_fj_pool_init(OPENV *env)
+{
+    Object *obj;
+    GET_STACKR(env->current_stack, obj, Reference);
+    fjNewPool(obj, fjDefaultParallelism());
+}
+
+void intrinsic_fj_pool_init_parallelism(OPENV *env)
+{
+    Object *obj;
+    int parallelism;
+    GET_STACK(env->current_stack, parallelism, int);
+    GET_STACKR(env->current_stack, obj, Reference);
+    if (parallelism <= 0) {
+        printf("Error: java.lang.IllegalArgumentException: parallelism %d\n", parallelism);
+        exit(1);
+    }
+    fjNewPool(obj, parallelism);
+}
+
+void intrinsic_fj_pool_common(OPENV *env)
+{
+    PUSH_STACKR(env->current_stack, fjCommonPool(env)->pool, Reference);
+}
+
+void intrinsic_fj_pool_invoke(OPENV *env)
+{
+    Object *obj, *task;
+    FjPool *pool;
+    GET_STACKR(env->current_stack, task, Reference);
+    GET_STACKR(env->current_stack, obj, Reference);
+
+    pool = fjFindPool(obj);
+    if (FJ_POOL_RUNNING != __atomic_load_n(&pool->shutdown, __ATOMIC_ACQUIRE)) {
+        printf("Error: java.util.concurrent.RejectedExecutionException: the pool is shut down\n");
+        exit(1);
+    }
+    fjLinkTask(task->pclass);
+    // a worker of the pool runs the task itself, the other threads hand it to the workers
+    if (NULL == fj_self || fj_self->pool != pool) {
+        fjSubmit(pool, task);
+    }
+    fjJoin(env, task);
+    PUSH_STACKR(env->current_stack, fjResult(task), Reference);
+}
+
+void intrinsic_fj_pool_getParallelism(OPENV *env)
+{
+    Object *obj;
+    GET_STACKR(env->current_stack, obj, Reference);
+    PUSH_STACK(env->current_stack, fjFindPool(obj)->parallelism, int);
+}
+
+/**
+ * @brief intrinsic_fj_pool_shutdown ForkJoinPool.shutdown, the tasks submitted are still run, no effect on the
+ * common pool
+ */
+void intrinsic_fj_pool_shutdown(OPENV *env)
+{
+    Object *obj;
+    FjPool *pool;
+    GET_STACKR(env->current_stack, obj, Reference);
+
+    pool = fjFindPool(obj);
+    if (pool != current_vm->fj_common_pool) {
+        fjShutdown(pool, FJ_POOL_SHUTDOWN);
+    }
+}
+
+/**
+ * @brief intrinsic_fj_pool_close ForkJoinPool.close, shuts the pool down and waits for its workers to exit, a
+ * worker of the pool does not wait for itself
+ */
+void intrinsic_fj_pool_close(OPENV *env)
+{
+    Object *obj;
+    FjPool *pool;
+    GET_STACKR(env->current_stack, obj, Reference);
+
+    pool = fjFindPool(obj);
+    if (pool == current_vm->fj_common_pool) {
+        return;
+    }
+    fjShutdown(pool, FJ_POOL_SHUTDOWN);
+    if (NULL != fj_self && fj_self->pool == pool) {
+        return;
+    }
+    enterNative();
+    pthread_mutex_lock(&pool->lock);
+    while (pool->workers_alive > 0) {
+        pthread_cond_wait(&pool->exit_cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    leaveNative();
+}
+
+void intrinsic_fj_task_fork(OPENV *env)
+{
+    Object *task;
+    GET_STACKR(env->current_stack, task, Reference);
+    fjLinkTask(task->pclass);
+    fjFork(env, task);
+    PUSH_STACKR(env->current_stack, task, Reference);
+}
+
+void intrinsic_fj_task_join(OPENV *env)
+{
+    Object *task;
+    GET_STACKR(env->current_stack, task, Reference);
+    fjLinkTask(task->pclass);
+    fjJoin(env, task);
+    PUSH_STACKR(env->current_stack, fjResult(task), Reference);
+}
+
+void intrinsic_fj_task_invoke(OPENV *env)
+{
+    Object *task;
+    GET_STACKR(env->current_stack, task, Reference);
+    fjLinkTask(task->pclass);
+    // invoke() runs the task in the current thread, a worker or not
+    if (!fjTryRun(env, task)) {
+        fjJoin(env, task);
+    }
+    PUSH_STACKR(env->current_stack, fjResult(task), Reference);
+}
+
+void intrinsic_fj_task_isDone(OPENV *env)
+{
+    Object *task;
+    GET_STACKR(env->current_stack, task, Reference);
+    fjLinkTask(task->pclass);
+    PUSH_STACK(env->current_stack, 0 != FJ_IS_DONE(task), int);
+}
+
+#endif // FORKJOIN_C
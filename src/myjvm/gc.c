@@ -0,0 +1,1058 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef GC_C
+#define GC_C
+
+#include <sched.h>
+#include <unistd.h>
+
+#include "deque.h"
+
+/**
+  * the garbage collector, a parallel mark and sweep of the heap run by gc_threads workers. the operand
+  * stacks and the local variables are not typed and the native code keeps raw pointers to objects across
+  * an allocation, so the roots are scanned conservatively: a slot of a java frame that is the reference
+  * of an object or an array, or a word of the C stack of a thread that points into a block, keeps the
+  * block alive. the blocks are therefore never moved, the gaps between the live blocks become the regions
+  * the heap allocates in (see heap.c).
+  *   marking: each worker has a work stealing deque of blocks to scan, it pops from its own end and an idle
+  *   worker steals from the other end of another deque. the fields of an object are found by the ref_map of
+  *   its class, the elements of the arrays of references are scanned, a block of newMultiArray holds all
+  *   its arrays. marking ends when every worker is idle and no deque holds a block.
+  *   sweeping: the heap is cut in chunks the workers take in turn, a dead block is zeroed and its bits are
+  *   cleared, then the gaps between the live blocks of all the chunks are linked in address order.
+  * a collection runs in a safepoint when the heap used reaches twice the live bytes of the last one or the
+  * heap is full. with -Xgc:concurrent a thread of the collector marks while the java threads run, between
+  * an initial mark pause that scans the threads and a remark pause that finishes the marking and sweeps:
+  * the blocks allocated meanwhile are marked already, and the reference stores log the reference they
+  * overwrite (GC_PRE_WRITE_BARRIER), so every object reachable when the marking started is marked (SATB)
+  */
+
+/* -Xgc:threads=<n>, the number of cpus if 0 */
+int gc_threads = 0;
+/* -Xgc:concurrent */
+int gc_concurrent = 0;
+/* -Xlog:gc */
+int gc_log = 0;
+/* the collections done */
+long gc_count = 0;
+
+#define GC_PHASE_MARK 1
+#define GC_PHASE_SWEEP 2
+#define GC_SATB_BATCH 256
+/* granules of a chunk of the sweep, 256KB */
+#define GC_SWEEP_CHUNK (1ul << 15)
+
+#define GC_NO_SANITIZE __attribute__((no_sanitize_address, no_sanitize_thread))
+
+typedef struct _GcWorker {
+    int id;
+    pthread_t tid;
+    long scanned;
+    long steals;
+    unsigned int seed;
+    WorkDeque deque; // the blocks to scan, see deque.h
+} GcWorker;
+
+typedef struct _GcSweepChunk {
+    char *first_live; // the first live block starting in the chunk
+    char *last_end; // the end of the last live block starting in the chunk
+    HeapRegion *gaps; // the gaps between the live blocks of the chunk
+    int gap_count;
+    int gap_size;
+    size_t live;
+    size_t freed;
+} GcSweepChunk;
+
+static GcWorker **gc_workers = NULL;
+static int gc_worker_count = 0;
+static pthread_mutex_t gc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gc_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t gc_done_cond = PTHREAD_COND_INITIALIZER;
+static int gc_phase = 0;
+static long gc_phase_seq = 0;
+static int gc_workers_done = 0;
+static int gc_idle = 0;
+
+/* the blocks found by the coordinator in the roots, taken by the workers in batches */
+static char **gc_roots = NULL;
+static long gc_root_count = 0;
+static long gc_root_size = 0;
+static long gc_root_next = 0;
+/* the statics, the string pool and the thread objects, scanned by one worker */
+static int gc_global_roots_pending = 0;
+
+/* the blocks pushed when a deque is full */
+static pthread_mutex_t gc_overflow_lock = PTHREAD_MUTEX_INITIALIZER;
+static char **gc_overflow = NULL;
+static long gc_overflow_count = 0;
+static long gc_overflow_size = 0;
+
+/* the references logged by the barrier, flushed from the buffers of the threads */
+static pthread_mutex_t gc_satb_lock = PTHREAD_MUTEX_INITIALIZER;
+static NarrowRef *gc_satb = NULL;
+static long gc_satb_count = 0;
+static long gc_satb_size = 0;
+
+static GcSweepChunk *gc_sweep_chunks = NULL;
+static long gc_sweep_chunk_count = 0;
+static long gc_sweep_next = 0;
+
+/* the concurrent cycle, requested by the heap and run by gcConcurrentMain */
+static pthread_mutex_t gc_cycle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gc_cycle_cond = PTHREAD_COND_INITIALIZER;
+static int gc_cycle_requested = 0;
+
+/* statistics */
+static double gc_pause_total = 0, gc_pause_max = 0;
+static size_t gc_live = 0, gc_freed = 0;
+
+void forEachLoadedClass(VM *vm, void (*fn)(Class*, void*), void *arg);
+void forEachJavaThreadObject(VM *vm, void (*fn)(Object*, void*), void *arg);
+void forEachForkJoinRoot(VM *vm, void (*fn)(Object*, void*), void *arg);
+void forEachVirtualThreadObject(VM *vm, void (*fn)(Object*, void*), void *arg);
+void forEachVirtualThreadEnv(VM *vm, void (*fn)(OPENV*));
+void sweepVirtualThreads(VM *vm, int (*is_live)(Object*));
+void sweepJavaThreads(VM *vm, int (*is_live)(Object*));
+void sweepForkJoinPools(VM *vm, int (*is_live)(Object*));
+void forEachAioRoot(void (*fn)(Object*, void*), void *arg);
+
+/** 1. the blocks **/
+
+/**
+ * @brief gcNextBit the first bit set in [from, to), to if none
+ */
+static size_t gcNextBit(unsigned long *bits, size_t from, size_t to)
+{
+    size_t w = from >> 6;
+    unsigned long word;
+
+    if (from >= to) {
+        return to;
+    }
+    word = __atomic_load_n(&bits[w], __ATOMIC_RELAXED) & (~0ul << (from & 63));
+    while (0 == word) {
+        if (++w << 6 >= to) {
+            return to;
+        }
+        word = __atomic_load_n(&bits[w], __ATOMIC_RELAXED);
+    }
+    from = (w << 6) + __builtin_ctzl(word);
+    return from < to ? from : to;
+}
+
+/**
+ * @brief gcBlockEnd the granule after the block starting at granule g
+ */
+static inline size_t gcBlockEnd(size_t g)
+{
+    size_t w = g >> 6;
+    unsigned long word = __atomic_load_n(&heap_end_bits[w], __ATOMIC_RELAXED) & (~0ul << (g & 63));
+
+    while (0 == word) {
+        word = __atomic_load_n(&heap_end_bits[++w], __ATOMIC_RELAXED);
+    }
+    return (w << 6) + __builtin_ctzl(word) + 1;
+}
+
+/**
+ * @brief gcFindBlock the block holding addr, NULL if addr is not in a block
+ * @param exact addr is a reference: the start of a block or of an array of a block
+ */
+static char* gcFindBlock(char *addr, int exact)
+{
+    size_t g, w;
+    unsigned long word;
+
+    if (addr < heap_base + HEAP_ALIGN || addr >= __atomic_load_n(&heap_top, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    g = HEAP_GRANULE(addr);
+    if (exact && ((size_t)addr & (HEAP_ALIGN - 1))) {
+        return NULL;
+    }
+    if (TEST_HEAP_BIT(heap_start_bits, g)) {
+        return HEAP_GRANULE_ADDR(g);
+    }
+    if (exact && !TEST_HEAP_BIT(heap_array_bits, g)) {
+        return NULL;
+    }
+    // inside a block: the last start before addr, if the block reaches it
+    w = g >> 6;
+    word = __atomic_load_n(&heap_start_bits[w], __ATOMIC_RELAXED) & (~0ul >> (63 - (g & 63)));
+    while (0 == word) {
+        if (0 == w) {
+            return NULL;
+        }
+        word = __atomic_load_n(&heap_start_bits[--w], __ATOMIC_RELAXED);
+    }
+    w = (w << 6) + 63 - __builtin_clzl(word);
+    return gcBlockEnd(w) > g ? HEAP_GRANULE_ADDR(w) : NULL;
+}
+
+/** 2. the deques, see deque.h **/
+
+static void growArray(void **array, long *size, size_t esize)
+{
+    *size = *size ? *size << 1 : 1024;
+    *array = realloc(*array, *size * esize);
+}
+
+static void gcPush(GcWorker *w, char *p)
+{
+    if (workDequePush(&w->deque, p)) {
+        return;
+    }
+    pthread_mutex_lock(&gc_overflow_lock);
+    if (gc_overflow_count == gc_overflow_size) {
+        growArray((void**)&gc_overflow, &gc_overflow_size, sizeof(char*));
+    }
+    gc_overflow[gc_overflow_count] = p;
+    __atomic_store_n(&gc_overflow_count, gc_overflow_count + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&gc_overflow_lock);
+}
+
+/** 3. marking **/
+
+/**
+ * @brief gcMarkAddress marks the block holding addr, a block marked for the first time is pushed to the
+ * deque of the worker, or added to the roots if w is NULL
+ */
+static void gcMarkAddress(GcWorker *w, char *addr, int exact)
+{
+    char *block = gcFindBlock(addr, exact);
+    size_t g;
+
+    if (NULL == block) {
+        return;
+    }
+    g = HEAP_GRANULE(block);
+    if (TEST_HEAP_BIT(heap_mark_bits, g) || ((SET_HEAP_BIT(heap_mark_bits, g) >> (g & 63)) & 1)) {
+        return;
+    }
+    if (NULL != w) {
+        gcPush(w, block);
+        return;
+    }
+    if (gc_root_count == gc_root_size) {
+        growArray((void**)&gc_roots, &gc_root_size, sizeof(char*));
+    }
+    gc_roots[gc_root_count++] = block;
+}
+
+#define gcMarkRef(w, ref) if (0 != (ref)) {\
+        gcMarkAddress(w, heap_base + ((size_t)(ref) << HEAP_ALIGN_SHIFT), 1);\
+    }
+
+/**
+ * @brief gcScanBlock marks the blocks referenced by a marked block
+ */
+static void gcScanBlock(GcWorker *w, char *block)
+{
+    size_t g = HEAP_GRANULE(block), end, a;
+    Class *pclass;
+    CArray_NarrowRef *arr;
+    uint map;
+    NarrowRef ref;
+    char *p, *block_end;
+    int i, n;
+
+    w->scanned++;
+    if (!TEST_HEAP_BIT(heap_array_bits, g)) {
+        pclass = __atomic_load_n(&((Object*)block)->pclass, __ATOMIC_RELAXED);
+        if (NULL == pclass || NULL == pclass->ref_map) {
+            return;
+        }
+        n = REF_MAP_WORDS(pclass->instance_size);
+        for (i = 0; i < n; i++) {
+            for (map = pclass->ref_map[i]; 0 != map; map &= map - 1) {
+                ref = __atomic_load_n((NarrowRef*)block + (i << 5) + __builtin_ctz(map), __ATOMIC_RELAXED);
+                gcMarkRef(w, ref);
+            }
+        }
+        return;
+    }
+
+    // every array of the block, the references between the arrays of a block of newMultiArray are skipped
+    end = gcBlockEnd(g);
+    block_end = HEAP_GRANULE_ADDR(end);
+    for (a = g; a < end; a = gcNextBit(heap_array_bits, a + 1, end)) {
+        arr = (CArray_NarrowRef*)HEAP_GRANULE_ADDR(a);
+        if (arr->dimensions <= 1 && ATYPE_REFERENCE != arr->atype) {
+            continue;
+        }
+        for (i = 0; i < arr->length; i++) {
+            ref = __atomic_load_n(&arr->elements[i], __ATOMIC_RELAXED);
+            if (0 != ref) {
+                p = heap_base + ((size_t)ref << HEAP_ALIGN_SHIFT);
+                if (p < block || p >= block_end) {
+                    gcMarkAddress(w, p, 1);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief gcTakeSatb marks the references logged by the barrier, a batch at a time
+ * @return 1 if any was taken
+ */
+static int gcTakeSatb(GcWorker *w)
+{
+    NarrowRef batch[GC_SATB_BATCH];
+    int i, n = 0;
+
+    if (0 == __atomic_load_n(&gc_satb_count, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    pthread_mutex_lock(&gc_satb_lock);
+    for (; n < GC_SATB_BATCH && gc_satb_count > n; n++) {
+        batch[n] = gc_satb[gc_satb_count - 1 - n];
+    }
+    __atomic_store_n(&gc_satb_count, gc_satb_count - n, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&gc_satb_lock);
+    for (i = 0; i < n; i++) {
+        gcMarkRef(w, batch[i]);
+    }
+    return n > 0;
+}
+
+/**
+ * @brief gcSteal a block of another worker or of the overflow list
+ */
+static char* gcSteal(GcWorker *w)
+{
+    char *p = NULL;
+    int i, victim;
+
+    for (i = 1; i < gc_worker_count; i++) {
+        victim = (w->id + i + rand_r(&w->seed) % gc_worker_count) % gc_worker_count;
+        if (victim != w->id && NULL != (p = workDequeSteal(&gc_workers[victim]->deque))) {
+            w->steals++;
+            return p;
+        }
+    }
+    if (__atomic_load_n(&gc_overflow_count, __ATOMIC_RELAXED) > 0) {
+        pthread_mutex_lock(&gc_overflow_lock);
+        if (gc_overflow_count > 0) {
+            p = gc_overflow[gc_overflow_count - 1];
+            __atomic_store_n(&gc_overflow_count, gc_overflow_count - 1, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&gc_overflow_lock);
+    }
+    return p;
+}
+
+static int gcWorkLeft()
+{
+    int i;
+
+    for (i = 0; i < gc_worker_count; i++) {
+        if (!workDequeIsEmpty(&gc_workers[i]->deque)) {
+            return 1;
+        }
+    }
+    return __atomic_load_n(&gc_overflow_count, __ATOMIC_RELAXED) > 0 || __atomic_load_n(&gc_satb_count, __ATOMIC_RELAXED) > 0;
+}
+
+static void gcScanClassStatics(Class *pclass, void *arg)
+{
+    field_info *field;
+    NarrowRef ref;
+    int i;
+
+    if (NULL == pclass->static_fields) {
+        return;
+    }
+    for (i = 0; i < pclass->fields_count; i++) {
+        field = pclass->fields[i];
+        if (IS_ACC_STATIC(field->access_flags) && ('L' == field->ftype || '[' == field->ftype)) {
+            ref = __atomic_load_n((NarrowRef*)(pclass->static_fields + (field->findex << 2)), __ATOMIC_RELAXED);
+            gcMarkRef((GcWorker*)arg, ref);
+        }
+    }
+}
+
+static void gcScanJavaThreadObject(Object *obj, void *arg)
+{
+    gcMarkAddress((GcWorker*)arg, (char*)obj, 1);
+}
+
+/**
+ * @brief gcScanGlobalRoots the static fields of the classes, the string pool and the java.lang.Thread objects
+ * of every vm
+ */
+static void gcScanGlobalRoots(GcWorker *w)
+{
+    InternEntry *entry;
+    StringPool *pool;
+    VM *vm;
+    int i;
+
+    pthread_mutex_lock(&vms_lock);
+    for (vm = vms; NULL != vm; vm = vm->next) {
+        forEachLoadedClass(vm, gcScanClassStatics, w);
+        pool = vm->string_pool;
+        pthread_mutex_lock(&pool->lock);
+        for (i = 0; i < pool->size; i++) {
+            for (entry = pool->buckets[i]; NULL != entry; entry = entry->next) {
+                gcMarkRef(w, entry->str);
+            }
+        }
+        pthread_mutex_unlock(&pool->lock);
+        forEachJavaThreadObject(vm, gcScanJavaThreadObject, w);
+        forEachVirtualThreadObject(vm, gcScanJavaThreadObject, w);
+    }
+    pthread_mutex_unlock(&vms_lock);
+}
+
+/**
+ * @brief gcMarkPhase the roots are shared out, then each worker drains its deque and steals until no work is left
+ */
+static void gcMarkPhase(GcWorker *w)
+{
+    long i, n;
+    char *p;
+
+    while ((i = __atomic_fetch_add(&gc_root_next, 64, __ATOMIC_RELAXED)) < gc_root_count) {
+        for (n = i + 64 < gc_root_count ? i + 64 : gc_root_count; i < n; i++) {
+            gcPush(w, gc_roots[i]);
+        }
+    }
+    if (__atomic_load_n(&gc_global_roots_pending, __ATOMIC_RELAXED) &&
+            __atomic_compare_exchange_n(&gc_global_roots_pending, &(int){1}, 0, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        gcScanGlobalRoots(w);
+    }
+
+    for (;;) {
+        while (NULL != (p = workDequePop(&w->deque)) || NULL != (p = gcSteal(w)) || gcTakeSatb(w)) {
+            if (NULL != p) {
+                gcScanBlock(w, p);
+            }
+        }
+        // idle: marking ends when all the workers are idle with no work left
+        __atomic_add_fetch(&gc_idle, 1, __ATOMIC_SEQ_CST);
+        for (;;) {
+            if (__atomic_load_n(&gc_idle, __ATOMIC_SEQ_CST) == gc_worker_count) {
+                return;
+            }
+            if (gcWorkLeft()) {
+                __atomic_sub_fetch(&gc_idle, 1, __ATOMIC_SEQ_CST);
+                break;
+            }
+            sched_yield();
+        }
+    }
+}
+
+/** 4. the roots of the threads **/
+
+/**
+ * @brief gcScanFrames the slots of the java frames of the envs of a thread, a slot is taken for a reference
+ * if it is the start of an object or of an array
+ */
+static void gcScanFrames(OPENV *env)
+{
+    StackFrame *stf;
+    char *p;
+
+    for (; NULL != env; env = env->outer) {
+        gcMarkAddress(NULL, (char*)env->current_obj, 1);
+        for (stf = env->current_stack; NULL != stf; stf = stf->prev) {
+            for (p = stf->localvars; p + sizeof(NarrowRef) <= stf->sp; p += sizeof(NarrowRef)) {
+                gcMarkRef(NULL, *(NarrowRef*)p);
+            }
+            if (NULL != stf->sync_mark) {
+                gcMarkAddress(NULL, (char*)stf->sync_mark, 0);
+            }
+        }
+    }
+}
+
+/**
+ * @brief gcScanCStack the registers and the C stack a thread recorded when it stopped, any word pointing
+ * into a block keeps it
+ */
+static void GC_NO_SANITIZE gcScanCStack(SafepointThread *t)
+{
+    char **p;
+
+    for (p = (char**)t->regs; p < (char**)(t->regs + SAVED_REGS); p++) {
+        gcMarkAddress(NULL, *p, 0);
+    }
+    for (p = (char**)ALIGN_UP((size_t)t->stack_top, sizeof(char*)); p < (char**)t->stack_base; p++) {
+        gcMarkAddress(NULL, *p, 0);
+    }
+}
+
+/* a root held by a thread out of its frames: a task in a fork/join deque, the array of an i/o in flight */
+static void gcScanThreadRoot(Object *obj, void *arg)
+{
+    gcMarkAddress(NULL, (char*)obj, 1);
+}
+
+/**
+ * @brief gcScanThreads the roots of the java threads, called in a safepoint by the thread running it. the
+ * tasks waiting in the deques of the fork/join pools are taken with them, a worker may pop a task in a
+ * frame after the marking has started, and so are the frames of the virtual threads, mounted or not, and
+ * the arrays of the i/o in flight (see aio.c)
+ */
+static void gcScanThreads()
+{
+    SafepointThread *t, self;
+    VM *vm;
+
+    gc_root_count = 0;
+    gc_root_next = 0;
+    pthread_mutex_lock(&safepoint_lock);
+    for (t = safepoint_threads; NULL != t; t = t->next) {
+        gcScanFrames(t->env);
+        gcScanCStack(t);
+    }
+    pthread_mutex_unlock(&safepoint_lock);
+    pthread_mutex_lock(&vms_lock);
+    for (vm = vms; NULL != vm; vm = vm->next) {
+        forEachForkJoinRoot(vm, gcScanThreadRoot, NULL);
+        forEachVirtualThreadEnv(vm, gcScanFrames);
+    }
+    pthread_mutex_unlock(&vms_lock);
+    forEachAioRoot(gcScanThreadRoot, NULL);
+    // a thread that is not attached allocates before the java code runs, its C stack still counts
+    if (NULL == safepoint_self) {
+        self.stack_base = threadStackBase();
+        saveThreadStack(&self);
+        gcScanCStack(&self);
+    }
+}
+
+/** 5. sweeping **/
+
+static void gcAddGap(GcSweepChunk *chunk, char *start, char *end)
+{
+    if (end - start < HEAP_MIN_RANGE) {
+        return;
+    }
+    if (chunk->gap_count == chunk->gap_size) {
+        chunk->gap_size = chunk->gap_size ? chunk->gap_size << 1 : 16;
+        chunk->gaps = (HeapRegion*)realloc(chunk->gaps, sizeof(HeapRegion) * chunk->gap_size);
+    }
+    chunk->gaps[chunk->gap_count].top = start;
+    chunk->gaps[chunk->gap_count].end = end;
+    chunk->gap_count++;
+}
+
+/**
+ * @brief gcZero zeroes a dead block, the whole pages are given back to the system and read as zero again
+ */
+static void gcZero(char *p, size_t size)
+{
+    long page = 4096;
+    char *from = (char*)ALIGN_UP((size_t)p, (size_t)page), *to = (char*)((size_t)(p + size) & ~(page - 1));
+
+    if (to - from >= 16 * page) {
+        memset(p, 0, from - p);
+        madvise(from, to - from, MADV_DONTNEED);
+        memset(to, 0, p + size - to);
+    } else {
+        memset(p, 0, size);
+    }
+}
+
+static void gcClearBits(unsigned long *bits, size_t from, size_t to)
+{
+    for (from = gcNextBit(bits, from, to); from < to; from = gcNextBit(bits, from + 1, to)) {
+        CLEAR_HEAP_BIT(bits, from);
+    }
+}
+
+static void gcSweepChunk(GcSweepChunk *chunk, size_t from, size_t to)
+{
+    size_t g, end;
+    char *p, *q;
+
+    memset(chunk, 0, sizeof(GcSweepChunk));
+    for (g = gcNextBit(heap_start_bits, from, to); g < to; g = gcNextBit(heap_start_bits, g + 1, to)) {
+        end = gcBlockEnd(g);
+        p = HEAP_GRANULE_ADDR(g);
+        q = HEAP_GRANULE_ADDR(end);
+        if (TEST_HEAP_BIT(heap_mark_bits, g)) {
+            CLEAR_HEAP_BIT(heap_mark_bits, g);
+            if (NULL == chunk->first_live) {
+                chunk->first_live = p;
+            } else {
+                gcAddGap(chunk, chunk->last_end, p);
+            }
+            chunk->last_end = q;
+            chunk->live += q - p;
+        } else {
+            CLEAR_HEAP_BIT(heap_start_bits, g);
+            CLEAR_HEAP_BIT(heap_end_bits, end - 1);
+            gcClearBits(heap_array_bits, g, end);
+            gcZero(p, q - p);
+            chunk->freed += q - p;
+        }
+    }
+}
+
+static void gcSweepPhase(GcWorker *w)
+{
+    long c;
+    size_t to = HEAP_GRANULE(heap_top);
+
+    while ((c = __atomic_fetch_add(&gc_sweep_next, 1, __ATOMIC_RELAXED)) < gc_sweep_chunk_count) {
+        gcSweepChunk(&gc_sweep_chunks[c], c * GC_SWEEP_CHUNK, (c + 1) * GC_SWEEP_CHUNK < to ? (c + 1) * GC_SWEEP_CHUNK : to);
+    }
+}
+
+/** 6. the workers **/
+
+static void* gcWorkerMain(void *arg)
+{
+    GcWorker *w = (GcWorker*)arg;
+    long seen = 0;
+    int phase;
+
+    for (;;) {
+        pthread_mutex_lock(&gc_lock);
+        while (gc_phase_seq == seen) {
+            pthread_cond_wait(&gc_work_cond, &gc_lock);
+        }
+        seen = gc_phase_seq;
+        phase = gc_phase;
+        pthread_mutex_unlock(&gc_lock);
+
+        if (GC_PHASE_MARK == phase) {
+            gcMarkPhase(w);
+        } else {
+            gcSweepPhase(w);
+        }
+
+        pthread_mutex_lock(&gc_lock);
+        if (++gc_workers_done == gc_worker_count) {
+            pthread_cond_signal(&gc_done_cond);
+        }
+        pthread_mutex_unlock(&gc_lock);
+    }
+    return NULL;
+}
+
+static void gcStartWorkers()
+{
+    GcWorker *w;
+    int i, n = gc_threads > 0 ? gc_threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (NULL != gc_workers) {
+        return;
+    }
+    n = n < 1 ? 1 : (n > 64 ? 64 : n);
+    gc_workers = (GcWorker**)calloc(n, sizeof(GcWorker*));
+    for (i = 0; i < n; i++) {
+        w = gc_workers[i] = (GcWorker*)calloc(1, sizeof(GcWorker));
+        w->id = i;
+        w->seed = i + 1;
+    }
+    gc_worker_count = n;
+    for (i = 0; i < n; i++) {
+        if (0 != pthread_create(&gc_workers[i]->tid, NULL, gcWorkerMain, gc_workers[i])) {
+            printf("Error: cannot create the gc worker threads\n");
+            exit(1);
+        }
+        pthread_detach(gc_workers[i]->tid);
+    }
+}
+
+/**
+ * @brief gcRunPhase runs a phase on all the workers and waits for them to end it
+ */
+static void gcRunPhase(int phase)
+{
+    gcStartWorkers();
+    pthread_mutex_lock(&gc_lock);
+    gc_phase = phase;
+    gc_idle = 0;
+    gc_workers_done = 0;
+    gc_phase_seq++;
+    pthread_cond_broadcast(&gc_work_cond);
+    while (gc_workers_done < gc_worker_count) {
+        pthread_cond_wait(&gc_done_cond, &gc_lock);
+    }
+    pthread_mutex_unlock(&gc_lock);
+}
+
+static int gcIsMarked(Object *obj)
+{
+    return TEST_HEAP_BIT(heap_mark_bits, HEAP_GRANULE(obj));
+}
+
+/* the monitors of the objects out of the heap are left alone */
+static int gcIsLiveObject(Object *obj)
+{
+    return (char*)obj < heap_base || (char*)obj >= heap_top || gcIsMarked(obj);
+}
+
+/**
+ * @brief gcSweepThreads drops the ended threads and virtual threads whose thread object is garbage and retires the
+ * fork/join pools whose object is, the marks are still set
+ */
+static void gcSweepThreads()
+{
+    VM *vm;
+
+    pthread_mutex_lock(&vms_lock);
+    for (vm = vms; NULL != vm; vm = vm->next) {
+        sweepJavaThreads(vm, gcIsMarked);
+        sweepVirtualThreads(vm, gcIsMarked);
+        sweepForkJoinPools(vm, gcIsMarked);
+    }
+    pthread_mutex_unlock(&vms_lock);
+}
+
+/**
+ * @brief gcSweep sweeps the heap in parallel, then gives the gaps between the live blocks to the allocator
+ */
+static void gcSweep()
+{
+    GcSweepChunk *chunk;
+    HeapRegion *ranges = NULL;
+    long c, count = 0, size = 0;
+    char *cursor = heap_base + HEAP_ALIGN;
+    size_t live = 0, freed = 0;
+
+    gc_sweep_chunk_count = (HEAP_GRANULE(heap_top) + GC_SWEEP_CHUNK - 1) / GC_SWEEP_CHUNK;
+    gc_sweep_chunks = (GcSweepChunk*)realloc(gc_sweep_chunks, sizeof(GcSweepChunk) * (gc_sweep_chunk_count + 1));
+    gc_sweep_next = 0;
+    gcSweepThreads();
+    deflateMonitors(gcIsLiveObject);
+    gcRunPhase(GC_PHASE_SWEEP);
+
+    for (c = 0; c <= gc_sweep_chunk_count; c++) {
+        if (count + 2 >= size) {
+            growArray((void**)&ranges, &size, sizeof(HeapRegion));
+        }
+        if (c == gc_sweep_chunk_count) {
+            // the rest of the heap
+            ranges[count].top = cursor;
+            ranges[count++].end = heap_end;
+            break;
+        }
+        chunk = &gc_sweep_chunks[c];
+        live += chunk->live;
+        freed += chunk->freed;
+        if (NULL == chunk->first_live) {
+            continue;
+        }
+        if (chunk->first_live - cursor >= HEAP_MIN_RANGE) {
+            ranges[count].top = cursor;
+            ranges[count++].end = chunk->first_live;
+        }
+        while (count + chunk->gap_count + 2 >= size) {
+            growArray((void**)&ranges, &size, sizeof(HeapRegion));
+        }
+        memcpy(ranges + count, chunk->gaps, sizeof(HeapRegion) * chunk->gap_count);
+        count += chunk->gap_count;
+        free(chunk->gaps);
+        if (chunk->last_end > cursor) {
+            cursor = chunk->last_end;
+        }
+    }
+    __atomic_store_n(&heap_top, cursor, __ATOMIC_RELAXED);
+    setHeapRegions(ranges, count);
+    free(ranges);
+
+    heap_used = live;
+    heap_gc_trigger = live << 1;
+    if (heap_gc_trigger < ((heap_end - heap_base) >> 2 < (64l << 20) ? (heap_end - heap_base) >> 2 : (64l << 20))) {
+        heap_gc_trigger = (heap_end - heap_base) >> 2 < (64l << 20) ? (heap_end - heap_base) >> 2 : (64l << 20);
+    }
+    gc_live = live;
+    gc_freed = freed;
+}
+
+/** 7. the collections **/
+
+static long gcSteals()
+{
+    long steals = 0;
+    int i;
+
+    for (i = 0; i < gc_worker_count; i++) {
+        steals += gc_workers[i]->steals;
+        gc_workers[i]->steals = 0;
+    }
+    return steals;
+}
+
+static void gcRecordPause(double pause)
+{
+    gc_pause_total += pause;
+    if (pause > gc_pause_max) {
+        gc_pause_max = pause;
+    }
+}
+
+/**
+ * @brief gcStopTheWorld a collection while the java threads are stopped
+ */
+static void gcStopTheWorld(const char *reason)
+{
+    struct timespec start;
+    double mark;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    gcScanThreads();
+    gcScanGlobalRoots(NULL);
+    gcRunPhase(GC_PHASE_MARK);
+    mark = elapsedMillis(&start);
+    gcSweep();
+    gcRecordPause(elapsedMillis(&start));
+    __atomic_add_fetch(&gc_count, 1, __ATOMIC_RELEASE);
+    if (gc_log) {
+        fprintf(stderr, "gc #%ld %s: pause %.3f ms (mark %.3f ms), %d workers, %ld steals, live %lu bytes, freed %lu bytes\n",
+                gc_count, reason, elapsedMillis(&start), mark, gc_worker_count, gcSteals(), gc_live, gc_freed);
+    }
+}
+
+/**
+ * @brief gcFlushSatbBuffers moves the references logged by the threads to the global list, in a safepoint
+ */
+static void gcFlushSatbBuffers()
+{
+    SafepointThread *t;
+
+    pthread_mutex_lock(&safepoint_lock);
+    pthread_mutex_lock(&gc_satb_lock);
+    for (t = safepoint_threads; NULL != t; t = t->next) {
+        while (gc_satb_count + t->satb_count > gc_satb_size) {
+            growArray((void**)&gc_satb, &gc_satb_size, sizeof(NarrowRef));
+        }
+        memcpy(gc_satb + gc_satb_count, t->satb, sizeof(NarrowRef) * t->satb_count);
+        __atomic_store_n(&gc_satb_count, gc_satb_count + t->satb_count, __ATOMIC_RELAXED);
+        t->satb_count = 0;
+    }
+    pthread_mutex_unlock(&gc_satb_lock);
+    pthread_mutex_unlock(&safepoint_lock);
+}
+
+/**
+ * @brief gcConcurrentCycle initial mark pause, concurrent marking, remark and sweep pause
+ */
+static void gcConcurrentCycle()
+{
+    struct timespec start, concurrent;
+    double initial, remark, sweep;
+
+    safepointBegin("gc initial mark");
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    gcScanThreads();
+    gc_global_roots_pending = 1;
+    __atomic_store_n(&gc_marking, 1, __ATOMIC_SEQ_CST);
+    initial = elapsedMillis(&start);
+    safepointEnd();
+
+    clock_gettime(CLOCK_MONOTONIC, &concurrent);
+    gcRunPhase(GC_PHASE_MARK);
+
+    safepointBegin("gc remark");
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    gcFlushSatbBuffers();
+    gcScanThreads();
+    gcRunPhase(GC_PHASE_MARK);
+    __atomic_store_n(&gc_marking, 0, __ATOMIC_SEQ_CST);
+    remark = elapsedMillis(&start);
+    gcSweep();
+    sweep = elapsedMillis(&start) - remark;
+    gcRecordPause(initial + elapsedMillis(&start));
+    __atomic_add_fetch(&gc_count, 1, __ATOMIC_RELEASE);
+    if (gc_log) {
+        fprintf(stderr, "gc #%ld concurrent: initial mark %.3f ms, concurrent mark %.3f ms, remark %.3f ms, sweep %.3f ms, "
+                "%d workers, %ld steals, live %lu bytes, freed %lu bytes\n", gc_count, initial,
+                elapsedMillis(&concurrent) - remark - sweep, remark, sweep, gc_worker_count, gcSteals(), gc_live, gc_freed);
+    }
+    safepointEnd();
+}
+
+static void* gcConcurrentMain(void *arg)
+{
+    for (;;) {
+        pthread_mutex_lock(&gc_cycle_lock);
+        while (!gc_cycle_requested) {
+            pthread_cond_wait(&gc_cycle_cond, &gc_cycle_lock);
+        }
+        pthread_mutex_unlock(&gc_cycle_lock);
+
+        gcConcurrentCycle();
+
+        pthread_mutex_lock(&gc_cycle_lock);
+        gc_cycle_requested = 0;
+        pthread_cond_broadcast(&gc_cycle_cond);
+        pthread_mutex_unlock(&gc_cycle_lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief gcStartConcurrentCycle asks for a concurrent cycle, called by the heap with heap_lock held
+ */
+void gcStartConcurrentCycle()
+{
+    pthread_mutex_lock(&gc_cycle_lock);
+    if (!gc_cycle_requested) {
+        gc_cycle_requested = 1;
+        pthread_cond_broadcast(&gc_cycle_cond);
+    }
+    pthread_mutex_unlock(&gc_cycle_lock);
+}
+
+/**
+ * @brief gcCollect called by the heap when a collection is due, a collection is run in a safepoint unless
+ * another thread has run one since gc_count was seen_count
+ * @param full the heap is full: the concurrent cycle going on is waited for
+ */
+void gcCollect(long seen_count, int full)
+{
+    if (gc_concurrent) {
+        enterNative();
+        pthread_mutex_lock(&gc_cycle_lock);
+        while (gc_cycle_requested) {
+            pthread_cond_wait(&gc_cycle_cond, &gc_cycle_lock);
+        }
+        pthread_mutex_unlock(&gc_cycle_lock);
+        leaveNative();
+        if (__atomic_load_n(&gc_count, __ATOMIC_ACQUIRE) != seen_count) {
+            return;
+        }
+    }
+    safepointBegin("gc");
+    if (__atomic_load_n(&gc_count, __ATOMIC_ACQUIRE) == seen_count) {
+        gcStopTheWorld(full ? "heap full" : "heap used");
+    }
+    safepointEnd();
+}
+
+/**
+ * @brief gcWaitForCollection waits for the collection going on, called once a vm is unlinked: the collector
+ * does not read the objects of the vm and their classes after it returns
+ */
+void gcWaitForCollection()
+{
+    pthread_mutex_lock(&gc_cycle_lock);
+    while (gc_cycle_requested) {
+        pthread_cond_wait(&gc_cycle_cond, &gc_cycle_lock);
+    }
+    pthread_mutex_unlock(&gc_cycle_lock);
+    // a stop the world collection runs in a safepoint, it holds safepoint_op_lock
+    pthread_mutex_lock(&safepoint_op_lock);
+    pthread_mutex_unlock(&safepoint_op_lock);
+}
+
+/**
+ * @brief gcSatbEnqueue the slow path of GC_PRE_WRITE_BARRIER, the reference goes to the buffer of the thread
+ */
+void gcSatbEnqueue(NarrowRef ref)
+{
+    SafepointThread *t = safepoint_self;
+    long n;
+
+    if (0 == ref) {
+        return;
+    }
+    if (NULL != t && t->satb_count < SATB_BUFFER_SIZE) {
+        t->satb[t->satb_count++] = ref;
+        return;
+    }
+    pthread_mutex_lock(&gc_satb_lock);
+    while (gc_satb_count + SATB_BUFFER_SIZE + 1 > gc_satb_size) {
+        growArray((void**)&gc_satb, &gc_satb_size, sizeof(NarrowRef));
+    }
+    n = gc_satb_count;
+    if (NULL != t) {
+        memcpy(gc_satb + n, t->satb, sizeof(NarrowRef) * t->satb_count);
+        n += t->satb_count;
+        t->satb_count = 0;
+    }
+    gc_satb[n] = ref;
+    __atomic_store_n(&gc_satb_count, n + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&gc_satb_lock);
+}
+
+/**
+ * @brief gcArrayPreWrite logs the references of an array about to be overwritten in bulk
+ */
+static inline void gcArrayPreWrite(CArray_NarrowRef *arr, int from, int count)
+{
+    int i;
+
+    if (__builtin_expect(__atomic_load_n(&gc_marking, __ATOMIC_RELAXED), 0)) {
+        for (i = from; i < from + count; i++) {
+            gcSatbEnqueue(arr->elements[i]);
+        }
+    }
+}
+
+static void dumpGcStat()
+{
+    fprintf(stderr, "gc: %ld collections, pause total %.3f ms max %.3f ms\n", gc_count, gc_pause_total, gc_pause_max);
+}
+
+/**
+ * @brief startConcurrentCollector starts the thread of the concurrent cycles with -Xgc:concurrent
+ */
+void startConcurrentCollector()
+{
+    pthread_t tid;
+
+    if (gc_concurrent) {
+        if (0 != pthread_create(&tid, NULL, gcConcurrentMain, NULL)) {
+            printf("Error: cannot create the concurrent gc thread\n");
+            exit(1);
+        }
+        pthread_detach(tid);
+    }
+}
+
+/* fork keeps the calling thread only: the workers, waiting for a phase, are not in the child */
+static void gcPrepareFork()
+{
+    pthread_mutex_lock(&gc_lock);
+}
+
+static void gcParentAfterFork()
+{
+    pthread_mutex_unlock(&gc_lock);
+}
+
+static void gcChildAfterFork()
+{
+    int i;
+
+    for (i = 0; i < gc_worker_count; i++) {
+        free(gc_workers[i]);
+    }
+    free(gc_workers);
+    gc_workers = NULL;
+    gc_worker_count = 0;
+    // the conditions may still count the waiters that are gone
+    pthread_cond_init(&gc_work_cond, NULL);
+    pthread_cond_init(&gc_done_cond, NULL);
+    pthread_mutex_unlock(&gc_lock);
+}
+
+/**
+ * @brief startGarbageCollector called once the options are parsed
+ */
+void startGarbageCollector()
+{
+    if (gc_log) {
+        atexit(dumpGcStat);
+    }
+    pthread_atfork(gcPrepareFork, gcParentAfterFork, gcChildAfterFork);
+    startConcurrentCollector();
+}
+
+#endif // GC_C
@@ -0,0 +1,378 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef HEAP_C
+#define HEAP_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <pthread.h>
+
+#include "my_types.h"
+
+/**
+  * the managed heap. it is one contiguous region reserved at start up, the objects and the arrays are
+  * allocated in it by bumping a pointer. a reference is kept in the fields, the array elements, the local
+  * variables and the operand stack as a NarrowRef: the offset from the heap base scaled by the alignment,
+  * so it fits a 4-byte slot and the heap can be up to 32GB. 0 is null, nothing is allocated at the base.
+  * the heap is handed out in regions of at most HEAP_REGION_SIZE bytes, the threads bump the top of the
+  * current region with a compare-and-swap and take the next region under heap_lock when it is full; a block
+  * larger than a region takes a run of adjacent regions. the regions are the free gaps left by the last
+  * collection (see gc.c), the bitmaps below record where each block starts and ends for the collector.
+  * the heap must be reserved before the threads start
+  */
+
+typedef uint NarrowRef;
+
+#define HEAP_ALIGN_SHIFT 3
+#define HEAP_ALIGN (1 << HEAP_ALIGN_SHIFT)
+#define HEAP_MAX_SIZE (32ul << 30)
+#define HEAP_DEFAULT_SIZE (1ul << 30)
+#define HEAP_REGION_SIZE (1ul << 20)
+/* a smaller gap between the live blocks is not reused */
+#define HEAP_MIN_RANGE 64
+
+#define ALIGN_UP(n, align) (((n) + (align) - 1) & ~((align) - 1))
+
+/* the bitmaps have one bit per HEAP_ALIGN bytes of the heap, a granule */
+#define HEAP_GRANULE(p) ((size_t)((char*)(p) - heap_base) >> HEAP_ALIGN_SHIFT)
+#define HEAP_GRANULE_ADDR(g) (heap_base + ((size_t)(g) << HEAP_ALIGN_SHIFT))
+#define TEST_HEAP_BIT(bits, g) ((__atomic_load_n(&(bits)[(g) >> 6], __ATOMIC_RELAXED) >> ((g) & 63)) & 1)
+#define SET_HEAP_BIT(bits, g) __atomic_fetch_or(&(bits)[(g) >> 6], 1ul << ((g) & 63), __ATOMIC_RELAXED)
+#define CLEAR_HEAP_BIT(bits, g) __atomic_fetch_and(&(bits)[(g) >> 6], ~(1ul << ((g) & 63)), __ATOMIC_RELAXED)
+
+typedef struct _HeapRegion {
+    char *top;
+    char *end;
+} HeapRegion;
+
+char *heap_base = NULL;
+/* the end of the regions handed out so far, nothing is allocated above it */
+char *heap_top = NULL;
+char *heap_end = NULL;
+/* the first granule of each block, its last granule, the blocks that are arrays, and the marks of the collector */
+unsigned long *heap_start_bits = NULL;
+unsigned long *heap_end_bits = NULL;
+unsigned long *heap_array_bits = NULL;
+unsigned long *heap_mark_bits = NULL;
+/* the bytes allocated by the current thread, see alloc_profile.c */
+__thread size_t heap_thread_allocated = 0;
+
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+/* the regions in address order, set by initHeap and by each collection */
+static HeapRegion *heap_regions = NULL;
+static int heap_region_count = 0;
+static int heap_region_next = 0;
+/* the region the threads allocate in */
+static HeapRegion *heap_region = NULL;
+/* the live bytes of the last collection plus the regions handed out since, a collection is run past heap_gc_trigger */
+static size_t heap_used = 0;
+static size_t heap_gc_trigger = 0;
+
+/* set while the concurrent collector marks: the new blocks are allocated marked and the reference
+ * stores log the value they overwrite (GC_PRE_WRITE_BARRIER), see gc.c */
+int gc_marking = 0;
+void gcSatbEnqueue(NarrowRef ref);
+#define GC_PRE_WRITE_BARRIER(field) if (__builtin_expect(__atomic_load_n(&gc_marking, __ATOMIC_RELAXED), 0)) {\
+        gcSatbEnqueue(*(NarrowRef*)(field));\
+    }
+/* a reference store, the concurrent collector reads the slot meanwhile */
+#define GC_STORE_REF(field, ref) __atomic_store_n((NarrowRef*)(field), (ref), __ATOMIC_RELAXED)
+
+#define HEAP_OK 0
+#define HEAP_COLLECT 1
+#define HEAP_FULL 2
+void gcCollect(long seen_count, int full);
+void gcStartConcurrentCycle();
+extern long gc_count;
+extern int gc_concurrent;
+
+static void* reserveMemory(size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (MAP_FAILED == p) {
+        printf("Cannot reserve the heap of %lu bytes\n", size);
+        exit(1);
+    }
+    return p;
+}
+
+/**
+ * @brief setHeapRegions replaces the regions by the ranges [start, end) cut in HEAP_REGION_SIZE pieces,
+ * the ranges are in address order and their memory is zeroed. called by initHeap, and by the collector
+ * while the java threads are stopped
+ */
+void setHeapRegions(HeapRegion *ranges, int count)
+{
+    HeapRegion *regions;
+    int i, n = 0;
+    char *p;
+
+    for (i = 0; i < count; i++) {
+        n += (ranges[i].end - ranges[i].top + HEAP_REGION_SIZE - 1) / HEAP_REGION_SIZE;
+    }
+    regions = (HeapRegion*)malloc(sizeof(HeapRegion) * (n + 1));
+    n = 0;
+    for (i = 0; i < count; i++) {
+        for (p = ranges[i].top; p < ranges[i].end; p += HEAP_REGION_SIZE) {
+            regions[n].top = p;
+            regions[n].end = ranges[i].end - p > HEAP_REGION_SIZE ? p + HEAP_REGION_SIZE : ranges[i].end;
+            n++;
+        }
+    }
+    free(heap_regions);
+    heap_regions = regions;
+    heap_region_count = n;
+    heap_region_next = 0;
+    __atomic_store_n(&heap_region, NULL, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief initHeap reserves the heap and its bitmaps, the pages are only backed by memory once they are used
+ * @param size size of the heap in bytes, at most HEAP_MAX_SIZE
+ */
+void initHeap(size_t size)
+{
+    HeapRegion all;
+    size_t bitmap_size;
+
+    if (size > HEAP_MAX_SIZE) {
+        printf("Heap too large: %lu, the maximum is %lu\n", size, HEAP_MAX_SIZE);
+        exit(1);
+    }
+    size = ALIGN_UP(size, HEAP_REGION_SIZE);
+    heap_base = (char*)reserveMemory(size);
+    heap_top = heap_base + HEAP_ALIGN;
+    heap_end = heap_base + size;
+    bitmap_size = ALIGN_UP(size >> (HEAP_ALIGN_SHIFT + 3), sizeof(unsigned long));
+    heap_start_bits = (unsigned long*)reserveMemory(bitmap_size);
+    heap_end_bits = (unsigned long*)reserveMemory(bitmap_size);
+    heap_array_bits = (unsigned long*)reserveMemory(bitmap_size);
+    heap_mark_bits = (unsigned long*)reserveMemory(bitmap_size);
+
+    all.top = heap_base + HEAP_ALIGN;
+    all.end = heap_end;
+    setHeapRegions(&all, 1);
+    heap_gc_trigger = size >> 2 < (64ul << 20) ? size >> 2 : (64ul << 20);
+}
+
+/**
+ * @brief parseHeapSize parses the size of -Xmx, the suffix k, m or g is allowed
+ */
+size_t parseHeapSize(const char *arg)
+{
+    char *end;
+    size_t size = strtoul(arg, &end, 10);
+
+    switch (*end) {
+        case 'g':
+        case 'G': size <<= 10; // fall through
+        case 'm':
+        case 'M': size <<= 10; // fall through
+        case 'k':
+        case 'K': size <<= 10;
+        default: break;
+    }
+    return size;
+}
+
+/**
+ * @brief regionAlloc bumps the top of a region, NULL if the block does not fit
+ */
+static inline char* regionAlloc(HeapRegion *region, size_t size, size_t align, size_t offset)
+{
+    char *p, *top = __atomic_load_n(&region->top, __ATOMIC_RELAXED);
+
+    do {
+        // the base is page aligned, so an offset from it is aligned as the address is
+        p = heap_base + ALIGN_UP((size_t)(top - heap_base) + offset, align) - offset;
+        if (p + size > region->end) {
+            return NULL;
+        }
+    } while (!__atomic_compare_exchange_n(&region->top, &top, p + size, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    heap_thread_allocated += p + size - top;
+
+    return p;
+}
+
+/**
+ * @brief allocLarge allocates a block larger than a region in a run of adjacent regions not handed out
+ * yet, called with heap_lock held
+ */
+static char* allocLarge(size_t size, size_t align, size_t offset)
+{
+    int i, j;
+    char *p;
+
+    for (i = heap_region_next; i < heap_region_count; i++) {
+        p = heap_base + ALIGN_UP((size_t)(heap_regions[i].top - heap_base) + offset, align) - offset;
+        for (j = i; j < heap_region_count && p + size > heap_regions[j].end; j++) {
+            if (j + 1 < heap_region_count && heap_regions[j + 1].top != heap_regions[j].end) {
+                break;
+            }
+        }
+        if (j < heap_region_count && p + size <= heap_regions[j].end) {
+            for (; i < j; i++) {
+                heap_regions[i].top = heap_regions[i].end;
+            }
+            heap_regions[j].top = p + size;
+            if (p + size > heap_top) {
+                __atomic_store_n(&heap_top, p + size, __ATOMIC_RELAXED);
+            }
+            heap_used += size;
+            heap_thread_allocated += size;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief heapRefill allocates when the current region is full: the next region that fits is handed out
+ * @param seen the region that was full
+ * @param status set to HEAP_COLLECT when a collection is due, HEAP_FULL when no region fits
+ */
+static char* heapRefill(HeapRegion *seen, size_t size, size_t align, size_t offset, int *status)
+{
+    HeapRegion *region;
+    char *p = NULL;
+
+    pthread_mutex_lock(&heap_lock);
+    *status = HEAP_OK;
+    region = heap_region;
+    if (region != seen && NULL != region && NULL != (p = regionAlloc(region, size, align, offset))) {
+        pthread_mutex_unlock(&heap_lock);
+        return p;
+    }
+    if (heap_used >= heap_gc_trigger) {
+        if (!gc_concurrent) {
+            *status = HEAP_COLLECT;
+            pthread_mutex_unlock(&heap_lock);
+            return NULL;
+        }
+        gcStartConcurrentCycle();
+    }
+    if (size + align > HEAP_REGION_SIZE / 2) {
+        p = allocLarge(size, align, offset);
+    } else {
+        for (; heap_region_next < heap_region_count; heap_region_next++) {
+            region = &heap_regions[heap_region_next];
+            if (region->end - region->top >= size + align) {
+                break;
+            }
+        }
+        if (heap_region_next < heap_region_count) {
+            heap_used += region->end - region->top;
+            if (region->end > heap_top) {
+                __atomic_store_n(&heap_top, region->end, __ATOMIC_RELAXED);
+            }
+            p = regionAlloc(region, size, align, offset);
+            heap_region_next++;
+            __atomic_store_n(&heap_region, region, __ATOMIC_RELEASE);
+        }
+    }
+    if (NULL == p) {
+        *status = HEAP_FULL;
+    }
+    pthread_mutex_unlock(&heap_lock);
+
+    return p;
+}
+
+/**
+ * @brief heapAllocBlock allocates size bytes in the heap so that the address plus offset is aligned,
+ * the memory is zeroed. a collection is run when the heap is used up to the trigger or is full
+ * @param size
+ * @param align a power of 2, at least HEAP_ALIGN
+ * @param offset
+ * @param is_array the block holds arrays, see newMultiArray
+ * @return
+ */
+static void* heapAllocBlock(size_t size, size_t align, size_t offset, int is_array)
+{
+    HeapRegion *region;
+    char *p;
+    size_t g;
+    long seen_count;
+    int status, collections = 0;
+
+    if (NULL == heap_base) {
+        initHeap(HEAP_DEFAULT_SIZE);
+    }
+    size = ALIGN_UP(size, (size_t)HEAP_ALIGN);
+    for (;;) {
+        seen_count = __atomic_load_n(&gc_count, __ATOMIC_ACQUIRE);
+        region = __atomic_load_n(&heap_region, __ATOMIC_ACQUIRE);
+        if (NULL != region && NULL != (p = regionAlloc(region, size, align, offset))) {
+            break;
+        }
+        if (NULL != (p = heapRefill(region, size, align, offset, &status))) {
+            break;
+        }
+        if (HEAP_FULL == status && ++collections > 2) {
+            printf("Error: java.lang.OutOfMemoryError: Java heap space\n");
+            exit(1);
+        }
+        gcCollect(seen_count, HEAP_FULL == status);
+    }
+
+    g = HEAP_GRANULE(p);
+    SET_HEAP_BIT(heap_start_bits, g);
+    SET_HEAP_BIT(heap_end_bits, g + (size >> HEAP_ALIGN_SHIFT) - 1);
+    if (is_array) {
+        SET_HEAP_BIT(heap_array_bits, g);
+    }
+    // allocated black while the concurrent collector marks
+    if (__atomic_load_n(&gc_marking, __ATOMIC_RELAXED)) {
+        SET_HEAP_BIT(heap_mark_bits, g);
+    }
+
+    return p;
+}
+
+/**
+ * @brief heapAlloc allocates an object of size bytes in the heap, the memory is zeroed
+ * @param size
+ * @return
+ */
+void* heapAlloc(size_t size)
+{
+    return heapAllocBlock(size, HEAP_ALIGN, 0, 0);
+}
+
+/**
+ * @brief heapAllocArray allocates a block of arrays, the elements of the first one are aligned to align
+ * @param size
+ * @param align a power of 2, at least HEAP_ALIGN
+ * @param offset the size of the array header
+ * @return
+ */
+void* heapAllocArray(size_t size, size_t align, size_t offset)
+{
+    return heapAllocBlock(size, align, offset, 1);
+}
+
+/**
+ * @brief encodeRef compresses a pointer into the heap
+ */
+static inline NarrowRef encodeRef(void *p)
+{
+    return NULL == p ? 0 : (NarrowRef)(((char*)p - heap_base) >> HEAP_ALIGN_SHIFT);
+}
+
+/**
+ * @brief decodeRef the pointer of a compressed reference, a shift and an add
+ */
+static inline void* decodeRef(NarrowRef ref)
+{
+    return 0 == ref ? NULL : heap_base + ((size_t)ref << HEAP_ALIGN_SHIFT);
+}
+
+#endif // HEAP_C
@@ -0,0 +1,456 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef INTRINSICS_C
+#define INTRINSICS_C
+
+#include <math.h>
+
+#include "reg_ir.c"
+#include "arrays.c"
+#include "string_concat.c"
+#include "threads.c"
+#include "vthreads.c"
+#include "forkjoin.c"
+#include "aio.c"
+
+/**
+  * this file implements the intrinsics, native C implementations of hot
+  * JDK methods. A method is looked up in the registry by the (class, name,
+  * descriptor) of the methodref when the methodref is resolved, and the
+  * implementation is saved in the methodref, so the later calls do not load
+  * nor interpret the JDK bytecode.
+  * An intrinsic with a reg_op is also translated into a single register
+  * instruction by the register translator (see reg_ir.c), so the register
+  * engine and the aot code run it without any call.
+  */
+
+typedef void (*IntrinsicFunction)(OPENV *env);
+
+typedef struct _Intrinsic {
+    const char *class_name;
+    const char *name;
+    const char *descriptor;
+    IntrinsicFunction function;
+    uchar reg_op; // register instruction of the intrinsic, NO_REG_OP if none
+} Intrinsic;
+
+
+/** 1. java/lang/System and java/util/Arrays, see arrays.c, java/lang/StringBuilder, see string_concat.c,
+       java/lang/Thread, see threads.c, the virtual threads and java/util/concurrent/locks/LockSupport, see
+       vthreads.c, java/util/concurrent/ForkJoinPool and ForkJoinTask, see forkjoin.c, myjvm/io/NativeIO,
+       see aio.c **/
+
+/** 2. java/lang/Math **/
+#define MATH_UNARY_INTRINSIC(name, xtype, expr, GET, PUSH) void intrinsic_math_##name(OPENV *env) {\
+    xtype a;\
+    GET(env->current_stack, a, xtype);\
+    PUSH(env->current_stack, (expr), xtype);\
+}
+#define MATH_BINARY_INTRINSIC(name, xtype, expr, GET, PUSH) void intrinsic_math_##name(OPENV *env) {\
+    xtype a, b;\
+    GET(env->current_stack, b, xtype);\
+    GET(env->current_stack, a, xtype);\
+    PUSH(env->current_stack, (expr), xtype);\
+}
+
+MATH_UNARY_INTRINSIC(iabs, int, a < 0 ? (int)(0u - (uint)a) : a, GET_STACK, PUSH_STACK)
+MATH_UNARY_INTRINSIC(labs, long, a < 0 ? (long)(0ul - (unsigned long)a) : a, GET_STACKL, PUSH_STACKL)
+MATH_UNARY_INTRINSIC(fabs, float, fabsf(a), GET_STACK, PUSH_STACK)
+MATH_UNARY_INTRINSIC(dabs, double, fabs(a), GET_STACKL, PUSH_STACKL)
+MATH_UNARY_INTRINSIC(dsqrt, double, sqrt(a), GET_STACKL, PUSH_STACKL)
+MATH_BINARY_INTRINSIC(imax, int, a > b ? a : b, GET_STACK, PUSH_STACK)
+MATH_BINARY_INTRINSIC(imin, int, a < b ? a : b, GET_STACK, PUSH_STACK)
+MATH_BINARY_INTRINSIC(lmax, long, a > b ? a : b, GET_STACKL, PUSH_STACKL)
+MATH_BINARY_INTRINSIC(lmin, long, a < b ? a : b, GET_STACKL, PUSH_STACKL)
+
+/** 3. java/lang/String, the kernels are in strings.c **/
+static void stringNullPointer(const char *method)
+{
+    printf("Error: java.lang.NullPointerException in String.%s\n", method);
+    exit(1);
+}
+
+void intrinsic_string_length(OPENV *env)
+{
+    Object *obj;
+    GET_STACKR(env->current_stack, obj, Reference);
+    PUSH_STACK(env->current_stack, STRING_VALUE(obj)->length, int);
+}
+
+void intrinsic_string_isEmpty(OPENV *env)
+{
+    Object *obj;
+    GET_STACKR(env->current_stack, obj, Reference);
+    PUSH_STACK(env->current_stack, 0 == STRING_VALUE(obj)->length, int);
+}
+
+void intrinsic_string_charAt(OPENV *env)
+{
+    int index;
+    Object *obj;
+    CArray_char *value;
+    GET_STACK(env->current_stack, index, int);
+    GET_STACKR(env->current_stack, obj, Reference);
+    value = STRING_VALUE(obj);
+    CHECK_ARRAY_INDEX(value, index);
+    PUSH_STACK(env->current_stack, (int)STRING_CHAR_AT(value, index), int);
+}
+
+void intrinsic_string_equals(OPENV *env)
+{
+    Object *obj, *other;
+    int equals;
+    GET_STACKR(env->current_stack, other, Reference);
+    GET_STACKR(env->current_stack, obj, Reference);
+
+    if (obj == other) {
+        equals = 1;
+    } else if (NULL == other || other->pclass != obj->pclass) {
+        equals = 0;
+    } else {
+        equals = stringEquals(STRING_VALUE(obj), STRING_VALUE(other));
+    }
+    PUSH_STACK(env->current_stack, equals, int);
+}
+
+void intrinsic_string_compareTo(OPENV *env)
+{
+    Object *obj, *other;
+    GET_STACKR(env->current_stack, other, Reference);
+    GET_STACKR(env->current_stack, obj, Reference);
+    if (NULL == other) {
+        stringNullPointer("compareTo");
+    }
+    PUSH_STACK(env->current_stack, stringCompare(STRING_VALUE(obj), STRING_VALUE(other)), int);
+}
+
+void intrinsic_string_indexOf(OPENV *env)
+{
+    Object *obj;
+    int ch;
+    GET_STACK(env->current_stack, ch, int);
+    GET_STACKR(env->current_stack, obj, Reference);
+    PUSH_STACK(env->current_stack, stringIndexOf(STRING_VALUE(obj), ch, 0), int);
+}
+
+void intrinsic_string_indexOf_from(OPENV *env)
+{
+    Object *obj;
+    int ch, from;
+    GET_STACK(env->current_stack, from, int);
+    GET_STACK(env->current_stack, ch, int);
+    GET_STACKR(env->current_stack, obj, Reference);
+    PUSH_STACK(env->current_stack, stringIndexOf(STRING_VALUE(obj), ch, from), int);
+}
+
+void intrinsic_string_hashCode(OPENV *env)
+{
+    Object *obj;
+    GET_STACKR(env->current_stack, obj, Reference);
+    PUSH_STACK(env->current_stack, stringHashCode(obj), int);
+}
+
+/* the default charset is taken as UTF-8 */
+void intrinsic_string_getBytes(OPENV *env)
+{
+    Object *obj;
+    CArray_char *value, *bytes;
+    GET_STACKR(env->current_stack, obj, Reference);
+    value = STRING_VALUE(obj);
+    bytes = newCArray_char(encodeUTF8(value, NULL), 8, 1);
+    encodeUTF8(value, bytes->elements);
+    PUSH_STACKR(env->current_stack, bytes, Reference);
+}
+
+/* new String(byte[]), the object made by new is filled in place */
+void intrinsic_string_init_bytes(OPENV *env)
+{
+    Object *obj;
+    CArray_char *bytes;
+    ushort *chars;
+    int n;
+    GET_STACKR(env->current_stack, bytes, Reference);
+    GET_STACKR(env->current_stack, obj, Reference);
+    if (NULL == bytes) {
+        stringNullPointer("<init>");
+    }
+    chars = (ushort*)malloc(sizeof(ushort) * (bytes->length + 1));
+    n = decodeUTF8((const uchar*)bytes->elements, bytes->length, chars);
+    PUT_FIELD_REF(obj, string_value_offset, newStringValue(chars, n));
+    if (string_coder_offset >= 0) {
+        PUT_FIELD(obj, string_coder_offset, IS_LATIN1(STRING_VALUE(obj)) ? STRING_LATIN1 : STRING_UTF16, char);
+    }
+    free(chars);
+}
+
+void intrinsic_string_intern(OPENV *env)
+{
+    Object *obj;
+    GET_STACKR(env->current_stack, obj, Reference);
+    PUSH_STACKR(env->current_stack, internString(env, obj), Reference);
+}
+
+/** 4. java/lang/Object, the monitors are in monitor.c **/
+static Object* monitorReceiver(OPENV *env, const char *method)
+{
+    Object *obj;
+    GET_STACKR(env->current_stack, obj, Reference);
+    if (NULL == obj) {
+        printf("Error: java.lang.NullPointerException in Object.%s\n", method);
+        exit(1);
+    }
+    return obj;
+}
+
+void intrinsic_object_wait(OPENV *env)
+{
+    Object *obj = monitorReceiver(env, "wait");
+    monitorWait(&obj->mark, obj->pclass, 0);
+}
+
+void intrinsic_object_wait_timeout(OPENV *env)
+{
+    long millis;
+    Object *obj;
+    GET_STACKL(env->current_stack, millis, long);
+    obj = monitorReceiver(env, "wait");
+    monitorWait(&obj->mark, obj->pclass, millis);
+}
+
+void intrinsic_object_notify(OPENV *env)
+{
+    Object *obj = monitorReceiver(env, "notify");
+    monitorNotify(&obj->mark, obj->pclass, 0);
+}
+
+void intrinsic_object_notifyAll(OPENV *env)
+{
+    Object *obj = monitorReceiver(env, "notifyAll");
+    monitorNotify(&obj->mark, obj->pclass, 1);
+}
+
+/* only the methods of final classes are registered, so an invokevirtual can be bound by the methodref,
+   a constructor is bound by the methodref of its invokespecial */
+static Intrinsic intrinsics[] = {
+    {"java/lang/System", "arraycopy", "(Ljava/lang/Object;ILjava/lang/Object;II)V", intrinsic_arraycopy, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([ZZ)V", intrinsic_arrays_fill_i, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([ZIIZ)V", intrinsic_arrays_fill_range_i, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([BB)V", intrinsic_arrays_fill_i, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([BIIB)V", intrinsic_arrays_fill_range_i, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([CC)V", intrinsic_arrays_fill_i, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([CIIC)V", intrinsic_arrays_fill_range_i, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([SS)V", intrinsic_arrays_fill_i, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([SIIS)V", intrinsic_arrays_fill_range_i, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([II)V", intrinsic_arrays_fill_i, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([IIII)V", intrinsic_arrays_fill_range_i, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([FF)V", intrinsic_arrays_fill_i, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([FIIF)V", intrinsic_arrays_fill_range_i, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([JJ)V", intrinsic_arrays_fill_l, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([JIIJ)V", intrinsic_arrays_fill_range_l, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([DD)V", intrinsic_arrays_fill_l, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([DIID)V", intrinsic_arrays_fill_range_l, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([Ljava/lang/Object;Ljava/lang/Object;)V", intrinsic_arrays_fill_r, NO_REG_OP},
+    {"java/util/Arrays", "fill", "([Ljava/lang/Object;IILjava/lang/Object;)V", intrinsic_arrays_fill_range_r, NO_REG_OP},
+    {"java/util/Arrays", "equals", "([Z[Z)Z", intrinsic_arrays_equals, NO_REG_OP},
+    {"java/util/Arrays", "equals", "([B[B)Z", intrinsic_arrays_equals, NO_REG_OP},
+    {"java/util/Arrays", "equals", "([C[C)Z", intrinsic_arrays_equals, NO_REG_OP},
+    {"java/util/Arrays", "equals", "([S[S)Z", intrinsic_arrays_equals, NO_REG_OP},
+    {"java/util/Arrays", "equals", "([I[I)Z", intrinsic_arrays_equals, NO_REG_OP},
+    {"java/util/Arrays", "equals", "([J[J)Z", intrinsic_arrays_equals, NO_REG_OP},
+    {"java/util/Arrays", "equals", "([F[F)Z", intrinsic_arrays_equals, NO_REG_OP},
+    {"java/util/Arrays", "equals", "([D[D)Z", intrinsic_arrays_equals, NO_REG_OP},
+    {"java/lang/Math", "abs", "(I)I", intrinsic_math_iabs, REG_IABS},
+    {"java/lang/Math", "abs", "(J)J", intrinsic_math_labs, REG_LABS},
+    {"java/lang/Math", "abs", "(F)F", intrinsic_math_fabs, REG_FABS},
+    {"java/lang/Math", "abs", "(D)D", intrinsic_math_dabs, REG_DABS},
+    {"java/lang/Math", "sqrt", "(D)D", intrinsic_math_dsqrt, REG_DSQRT},
+    {"java/lang/Math", "max", "(II)I", intrinsic_math_imax, REG_IMAX},
+    {"java/lang/Math", "min", "(II)I", intrinsic_math_imin, REG_IMIN},
+    {"java/lang/Math", "max", "(JJ)J", intrinsic_math_lmax, REG_LMAX},
+    {"java/lang/Math", "min", "(JJ)J", intrinsic_math_lmin, REG_LMIN},
+    {"java/lang/String", "length", "()I", intrinsic_string_length, NO_REG_OP},
+    {"java/lang/String", "charAt", "(I)C", intrinsic_string_charAt, NO_REG_OP},
+    {"java/lang/String", "equals", "(Ljava/lang/Object;)Z", intrinsic_string_equals, NO_REG_OP},
+    {"java/lang/String", "isEmpty", "()Z", intrinsic_string_isEmpty, NO_REG_OP},
+    {"java/lang/String", "compareTo", "(Ljava/lang/String;)I", intrinsic_string_compareTo, NO_REG_OP},
+    {"java/lang/String", "indexOf", "(I)I", intrinsic_string_indexOf, NO_REG_OP},
+    {"java/lang/String", "indexOf", "(II)I", intrinsic_string_indexOf_from, NO_REG_OP},
+    {"java/lang/String", "hashCode", "()I", intrinsic_string_hashCode, NO_REG_OP},
+    {"java/lang/String", "getBytes", "()[B", intrinsic_string_getBytes, NO_REG_OP},
+    {"java/lang/String", "<init>", "([B)V", intrinsic_string_init_bytes, NO_REG_OP},
+    {"java/lang/StringBuilder", "<init>", "()V", intrinsic_builder_init, NO_REG_OP},
+    {"java/lang/StringBuilder", "<init>", "(I)V", intrinsic_builder_init_capacity, NO_REG_OP},
+    {"java/lang/StringBuilder", "<init>", "(Ljava/lang/String;)V", intrinsic_builder_init_string, NO_REG_OP},
+    {"java/lang/StringBuilder", "append", "(Ljava/lang/String;)Ljava/lang/StringBuilder;", intrinsic_builder_append_object, NO_REG_OP},
+    {"java/lang/StringBuilder", "append", "(Ljava/lang/Object;)Ljava/lang/StringBuilder;", intrinsic_builder_append_object, NO_REG_OP},
+    {"java/lang/StringBuilder", "append", "(Ljava/lang/CharSequence;)Ljava/lang/StringBuilder;", intrinsic_builder_append_object, NO_REG_OP},
+    {"java/lang/StringBuilder", "append", "(I)Ljava/lang/StringBuilder;", intrinsic_builder_append_int, NO_REG_OP},
+    {"java/lang/StringBuilder", "append", "(J)Ljava/lang/StringBuilder;", intrinsic_builder_append_long, NO_REG_OP},
+    {"java/lang/StringBuilder", "append", "(C)Ljava/lang/StringBuilder;", intrinsic_builder_append_char, NO_REG_OP},
+    {"java/lang/StringBuilder", "append", "(Z)Ljava/lang/StringBuilder;", intrinsic_builder_append_boolean, NO_REG_OP},
+    {"java/lang/StringBuilder", "append", "(F)Ljava/lang/StringBuilder;", intrinsic_builder_append_float, NO_REG_OP},
+    {"java/lang/StringBuilder", "append", "(D)Ljava/lang/StringBuilder;", intrinsic_builder_append_double, NO_REG_OP},
+    {"java/lang/StringBuilder", "length", "()I", intrinsic_builder_length, NO_REG_OP},
+    {"java/lang/StringBuilder", "charAt", "(I)C", intrinsic_builder_charAt, NO_REG_OP},
+    {"java/lang/StringBuilder", "toString", "()Ljava/lang/String;", intrinsic_builder_toString, NO_REG_OP},
+    {"java/lang/String", "intern", "()Ljava/lang/String;", intrinsic_string_intern, NO_REG_OP},
+    {"java/lang/Thread", "<init>", "()V", intrinsic_thread_init, NO_REG_OP},
+    {"java/lang/Thread", "<init>", "(Ljava/lang/Runnable;)V", intrinsic_thread_init_target, NO_REG_OP},
+    {"java/lang/Thread", "sleep", "(J)V", intrinsic_thread_sleep, NO_REG_OP},
+    {"java/lang/Thread", "yield", "()V", intrinsic_thread_yield, NO_REG_OP},
+    {"java/lang/Thread", "startVirtualThread", "(Ljava/lang/Runnable;)Ljava/lang/Thread;", intrinsic_thread_startVirtualThread, NO_REG_OP},
+    {"java/util/concurrent/locks/LockSupport", "park", "()V", intrinsic_locksupport_park, NO_REG_OP},
+    {"java/util/concurrent/locks/LockSupport", "parkNanos", "(J)V", intrinsic_locksupport_parkNanos, NO_REG_OP},
+    {"java/util/concurrent/locks/LockSupport", "unpark", "(Ljava/lang/Thread;)V", intrinsic_locksupport_unpark, NO_REG_OP},
+    {"java/util/concurrent/ForkJoinPool", "<init>", "()V", intrinsic_fj_pool_init, NO_REG_OP},
+    {"java/util/concurrent/ForkJoinPool", "<init>", "(I)V", intrinsic_fj_pool_init_parallelism, NO_REG_OP},
+    {"java/util/concurrent/ForkJoinPool", "commonPool", "()Ljava/util/concurrent/ForkJoinPool;", intrinsic_fj_pool_common, NO_REG_OP},
+    {"myjvm/io/NativeIO", "open", "(Ljava/lang/String;I)I", intrinsic_aio_open, NO_REG_OP},
+    {"myjvm/io/NativeIO", "close", "(I)V", intrinsic_aio_close, NO_REG_OP},
+    {"myjvm/io/NativeIO", "read", "(I[BII)I", intrinsic_aio_read, NO_REG_OP},
+    {"myjvm/io/NativeIO", "write", "(I[BII)I", intrinsic_aio_write, NO_REG_OP},
+    {"myjvm/io/NativeIO", "pread", "(I[BIIJ)I", intrinsic_aio_pread, NO_REG_OP},
+    {"myjvm/io/NativeIO", "pwrite", "(I[BIIJ)I", intrinsic_aio_pwrite, NO_REG_OP},
+    {"myjvm/io/NativeIO", "size", "(I)J", intrinsic_aio_size, NO_REG_OP},
+    {"myjvm/io/NativeIO", "transfer", "(IJJI)J", intrinsic_aio_transfer, NO_REG_OP},
+    {"myjvm/io/NativeIO", "listen", "(Ljava/lang/String;)I", intrinsic_aio_listen, NO_REG_OP},
+    {"myjvm/io/NativeIO", "accept", "(I)I", intrinsic_aio_accept, NO_REG_OP},
+    {"myjvm/io/NativeIO", "connect", "(Ljava/lang/String;)I", intrinsic_aio_connect, NO_REG_OP},
+    {NULL, NULL, NULL, NULL, NO_REG_OP}
+};
+
+/* the final methods of java/lang/Object, bound by name and descriptor whatever the class of the methodref,
+   as no class can declare another method with the same signature */
+static Intrinsic object_intrinsics[] = {
+    {"java/lang/Object", "wait", "()V", intrinsic_object_wait, NO_REG_OP},
+    {"java/lang/Object", "wait", "(J)V", intrinsic_object_wait_timeout, NO_REG_OP},
+    {"java/lang/Object", "notify", "()V", intrinsic_object_notify, NO_REG_OP},
+    {"java/lang/Object", "notifyAll", "()V", intrinsic_object_notifyAll, NO_REG_OP},
+    {NULL, NULL, NULL, NULL, NO_REG_OP}
+};
+
+/* the methods of classes that may be extended, bound by the class that declares the method the
+   invokevirtual resolves to, see resolveClassVirtualMethod */
+static Intrinsic virtual_intrinsics[] = {
+    {"java/lang/Thread", "start", "()V", intrinsic_thread_start, NO_REG_OP},
+    {"java/lang/Thread", "join", "()V", intrinsic_thread_join, NO_REG_OP},
+    {"java/lang/Thread", "isAlive", "()Z", intrinsic_thread_isAlive, NO_REG_OP},
+    {"java/lang/Thread", "setDaemon", "(Z)V", intrinsic_thread_setDaemon, NO_REG_OP},
+    {"java/lang/Thread", "isVirtual", "()Z", intrinsic_thread_isVirtual, NO_REG_OP},
+    {"java/util/concurrent/ForkJoinPool", "invoke", "(Ljava/util/concurrent/ForkJoinTask;)Ljava/lang/Object;", intrinsic_fj_pool_invoke, NO_REG_OP},
+    {"java/util/concurrent/ForkJoinPool", "getParallelism", "()I", intrinsic_fj_pool_getParallelism, NO_REG_OP},
+    {"java/util/concurrent/ForkJoinPool", "shutdown", "()V", intrinsic_fj_pool_shutdown, NO_REG_OP},
+    {"java/util/concurrent/ForkJoinPool", "close", "()V", intrinsic_fj_pool_close, NO_REG_OP},
+    {"java/util/concurrent/ForkJoinTask", "fork", "()Ljava/util/concurrent/ForkJoinTask;", intrinsic_fj_task_fork, NO_REG_OP},
+    {"java/util/concurrent/ForkJoinTask", "join", "()Ljava/lang/Object;", intrinsic_fj_task_join, NO_REG_OP},
+    {"java/util/concurrent/ForkJoinTask", "invoke", "()Ljava/lang/Object;", intrinsic_fj_task_invoke, NO_REG_OP},
+    {"java/util/concurrent/ForkJoinTask", "isDone", "()Z", intrinsic_fj_task_isDone, NO_REG_OP},
+    {NULL, NULL, NULL, NULL, NO_REG_OP}
+};
+
+/**
+ * @brief findIntrinsic looks up the registry
+ * @return the intrinsic, NULL if the method has no intrinsic
+ */
+Intrinsic* findIntrinsic(const char *class_name, const char *name, const char *descriptor)
+{
+    Intrinsic *p;
+    for (p = intrinsics; NULL != p->class_name; p++) {
+        if (strcmp(p->name, name) == 0 && strcmp(p->descriptor, descriptor) == 0 && strcmp(p->class_name, class_name) == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief findMethodrefIntrinsic looks up the registry by a methodref in the constant pool of pclass
+ */
+Intrinsic* findMethodrefIntrinsic(Class *pclass, CONSTANT_Methodref_info *method_ref)
+{
+    cp_info cp = pclass->constant_pool;
+    CONSTANT_Class_info *class_info = (CONSTANT_Class_info*)(cp[method_ref->class_index]);
+    CONSTANT_NameAndType_info *nt_info = (CONSTANT_NameAndType_info*)(cp[method_ref->name_and_type_index]);
+
+    return findIntrinsic(get_utf8(cp[class_info->name_index]), get_utf8(cp[nt_info->name_index]), get_utf8(cp[nt_info->descriptor_index]));
+}
+
+/**
+ * @brief findObjectIntrinsic looks up the final methods of java/lang/Object by a methodref in the constant pool of pclass
+ */
+Intrinsic* findObjectIntrinsic(Class *pclass, CONSTANT_Methodref_info *method_ref)
+{
+    cp_info cp = pclass->constant_pool;
+    CONSTANT_NameAndType_info *nt_info = (CONSTANT_NameAndType_info*)(cp[method_ref->name_and_type_index]);
+    const char *name = get_utf8(cp[nt_info->name_index]);
+    const char *descriptor = get_utf8(cp[nt_info->descriptor_index]);
+    Intrinsic *p;
+
+    for (p = object_intrinsics; NULL != p->class_name; p++) {
+        if (strcmp(p->name, name) == 0 && strcmp(p->descriptor, descriptor) == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief findVirtualIntrinsic the intrinsic of a method of pclass called by invokevirtual
+ * @return the function, NULL if the method has no intrinsic
+ */
+IntrinsicFunction findVirtualIntrinsic(Class *pclass, method_info *method)
+{
+    Intrinsic *p;
+    const char *class_name = get_this_class_name(pclass);
+    const char *name = get_utf8(pclass->constant_pool[method->name_index]);
+    const char *descriptor = get_utf8(pclass->constant_pool[method->descriptor_index]);
+
+    for (p = virtual_intrinsics; NULL != p->class_name; p++) {
+        if (strcmp(p->name, name) == 0 && strcmp(p->descriptor, descriptor) == 0 && strcmp(p->class_name, class_name) == 0) {
+            return p->function;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief bindIntrinsic saves the intrinsic of the method in the methodref, called when the methodref is resolved
+ * @return 1 if the method has an intrinsic
+ */
+int bindIntrinsic(Class *caller_class, CONSTANT_Methodref_info *method_ref)
+{
+    Intrinsic *intrinsic = findMethodrefIntrinsic(caller_class, method_ref);
+    if (NULL == intrinsic && NULL == (intrinsic = findObjectIntrinsic(caller_class, method_ref))) {
+        return 0;
+    }
+    debug("bind intrinsic: %s.%s%s", intrinsic->class_name, intrinsic->name, intrinsic->descriptor);
+    CP_PUBLISH(method_ref->intrinsic, intrinsic->function);
+    return 1;
+}
+
+/**
+ * @brief findIntrinsicRegOp the register instruction of an invokestatic, used by the register translator
+ * @return the register instruction, NO_REG_OP if the method cannot be translated
+ */
+int findIntrinsicRegOp(Class *pclass, ushort mindex)
+{
+    Intrinsic *intrinsic;
+    CONSTANT_Methodref_info *method_ref;
+
+    if (NULL == pclass || NULL == pclass->constant_pool[mindex] ||
+            CONSTANT_Methodref != *(uchar*)(pclass->constant_pool[mindex])) {
+        return NO_REG_OP;
+    }
+    method_ref = (CONSTANT_Methodref_info*)(pclass->constant_pool[mindex]);
+    intrinsic = findMethodrefIntrinsic(pclass, method_ref);
+
+    return NULL == intrinsic ? NO_REG_OP : intrinsic->reg_op;
+}
+
+#endif // INTRINSICS_C
@@ -0,0 +1,34 @@
+package myjvm.io;
+
+// the declarations of the intrinsics of aio.c, to compile the programs using them; myjvm runs the methods
+// without loading this class
+public final class NativeIO {
+	private NativeIO() {
+	}
+
+	// 0 read, 1 write (created, truncated), 2 append, 3 read and write
+	public static native int open(String path, int mode);
+
+	// -1 at the end
+	public static native int read(int fd, byte[] b, int off, int len);
+
+	public static native int write(int fd, byte[] b, int off, int len);
+
+	public static native int pread(int fd, byte[] b, int off, int len, long position);
+
+	public static native int pwrite(int fd, byte[] b, int off, int len, long position);
+
+	public static native long size(int fd);
+
+	// from a file, in the kernel
+	public static native long transfer(int in, long position, long count, int out);
+
+	// unix domain sockets
+	public static native int listen(String path);
+
+	public static native int accept(int fd);
+
+	public static native int connect(String path);
+
+	public static native void close(int fd);
+}
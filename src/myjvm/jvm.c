@@ -13,6 +13,7 @@
 #include "parse_class.c"
 
 void displayStaticFields(Class *pclass);
+void callLeafMethod(OPENV *env, Class *pclass, method_info *method, int real_args_len, int has_this);
 
 /**
  * @brief runMethod instruction execute loop, simulate the instruction execute model of CPU
@@ -34,6 +35,24 @@ void runMethod(OPENV *env)
     } while(1);
 }
 
+/**
+ * @brief runUntilReturn executes the instructions until the method returns to a frame without code,
+ * whose last_pc is NULL. it is the loop of the threads, the virtual threads, the fork/join tasks and
+ * the embedding api, so it prints nothing
+ * @param env
+ * @param stop NULL, or a flag of the thread ending the loop after the instruction setting it
+ */
+void runUntilReturn(OPENV *env, const int *stop)
+{
+    uchar op;
+
+    do {
+        op = *(env->pc);
+        env->pc = env->pc + 1;
+        jvm_instructions[op].action(env);
+    } while (env->pc != NULL && (NULL == stop || 0 == *stop));
+}
+
 /**
  * @brief internalRunClinitMethod specially executes the instructions in the <clinit> method
  * @param env
@@ -89,7 +108,9 @@ method_info* findClinitMethod(Class *pclass)
 }
 
 /**
- * @brief runClinitMethod run <clinit> method
+ * @brief runClinitMethod run <clinit> method. the init_lock of the class is held while it runs, so the
+ * other threads wait for it to end; the thread running it gets the lock again and returns at once when
+ * the <clinit> uses its own class
  * @param current_env
  * @param clinit_class
  * @param method
@@ -100,9 +121,20 @@ void runClinitMethod(OPENV *current_env, Class *clinit_class, method_info* metho
     StackFrame* stf;
     Code_attribute* code_attr;
 
-    if (clinit_class->clinit_runned) {
+    if (__atomic_load_n(&clinit_class->clinit_runned, __ATOMIC_ACQUIRE)) {
         return;
     }
+    if (0 != pthread_mutex_trylock(&clinit_class->init_lock)) {
+        // another thread runs the <clinit>, wait for it in native state
+        enterNative();
+        pthread_mutex_lock(&clinit_class->init_lock);
+        leaveNative();
+    }
+    if (clinit_class->clinit_runned || clinit_class->clinit_running) {
+        pthread_mutex_unlock(&clinit_class->init_lock);
+        return;
+    }
+    clinit_class->clinit_running = 1;
 
     debug("before call, current_class=%s", get_class_name(current_env->current_class->constant_pool, current_env->current_class->this_class));
 
@@ -111,21 +143,29 @@ void runClinitMethod(OPENV *current_env, Class *clinit_class, method_info* metho
     stf = newStackFrame(NULL, code_attr);
 
     // 4. set new environment
-    clinitEnv.pc = clinitEnv.pc_start = code_attr->code;
-    clinitEnv.pc_end = code_attr->code + code_attr->code_length;
+    clinitEnv.pc = clinitEnv.pc_start = stf->code;
+    clinitEnv.pc_end = stf->code + code_attr->code_length;
     clinitEnv.current_stack = stf;
     clinitEnv.current_class = clinit_class;
     clinitEnv.method = method;
     clinitEnv.is_clinit = 1;
     clinitEnv.call_depth = 0;
+    clinitEnv.leaf_frame = NULL;
+    clinitEnv.is_thread = 0;
+    clinitEnv.current_obj = NULL;
+    clinitEnv.outer = current_env;
     stf->method = method;
 
     #ifdef DEBUG
         clinitEnv.dbg = newDebugType(code_attr->max_locals, STACK_FRAME_SIZE);
     #endif
     debug("real class name = %s", get_class_name(current_env->current_class->constant_pool, current_env->current_class->this_class));
+    setThreadEnv(&clinitEnv);
     internalRunClinitMethod(&clinitEnv);
-    clinit_class->clinit_runned = 1;
+    setThreadEnv(current_env);
+    clinit_class->clinit_running = 0;
+    __atomic_store_n(&clinit_class->clinit_runned, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&clinit_class->init_lock);
     displayStaticFields(clinit_class);
 }
 
@@ -155,14 +195,19 @@ void runMainMethod(Class *pclass)
 
     mainEnv.current_class = pclass;
     mainEnv.current_stack = mainStack;
-    mainEnv.pc = mainCode_attr->code;
-    mainEnv.pc_end = mainCode_attr->code + mainCode_attr->code_length;
-    mainEnv.pc_start = mainCode_attr->code;
+    mainEnv.pc = mainStack->code;
+    mainEnv.pc_end = mainStack->code + mainCode_attr->code_length;
+    mainEnv.pc_start = mainStack->code;
     mainEnv.method = mainMethod;
     mainEnv.call_depth = 0;
     mainEnv.is_clinit = 0;
+    mainEnv.leaf_frame = NULL;
+    mainEnv.is_thread = 0;
+    mainEnv.current_obj = NULL;
+    mainEnv.outer = NULL;
 
     mainStack->method = mainMethod;
+    attachSafepointThread(&mainEnv);
 
 #ifdef DEBUG
     mainEnv.dbg = newDebugType(mainCode_attr->max_locals, STACK_FRAME_SIZE);
@@ -176,7 +221,7 @@ void runMainMethod(Class *pclass)
         printf("**********run super class's clinit method\n");
         class_info = (CONSTANT_Class_info*)(pclass->constant_pool[pclass->super_class]);
         class_utf8_info = (CONSTANT_Utf8_info*)(pclass->constant_pool[class_info->name_index]);
-        parent_class = loadClassFromDiskRecursive(&mainEnv, class_utf8_info->bytes);
+        parent_class = systemLoadClassRecursive(&mainEnv, class_utf8_info);
         class_info->pclass = parent_class;
         pclass->parent_class = parent_class;
     }
@@ -186,6 +231,8 @@ void runMainMethod(Class *pclass)
     if (clinitMethod = findClinitMethod(pclass)) {
         printf("*********run this class's clinit method\n");
         runClinitMethod(&mainEnv, pclass, clinitMethod);
+    } else {
+        __atomic_store_n(&pclass->clinit_runned, 1, __ATOMIC_RELEASE);
     }
 
     printf("class name=%s", get_this_class_name(pclass));
@@ -205,6 +252,12 @@ void callResolvedClassVirtualMethod(OPENV* current_env, CONSTANT_Methodref_info*
     Code_attribute* code_attr;
     int real_args_len =0;
 
+    method = mentry->method; //(method_info*)(method_ref->ref_addr);
+    if (CALL_NORMAL != ((Code_attribute*)(method->code_attribute_addr))->call_kind) {
+        callLeafMethod(current_env, mentry->pclass, method, method->args_len + SZ_REF, 1);
+        return;
+    }
+
     debug("before call, current_class=%s", get_class_name(current_env->current_class->constant_pool, current_env->current_class->this_class));
     if (current_env->current_class->super_class) {
         debug("super_class=%s", get_class_name(current_env->current_class->constant_pool, current_env->current_class->super_class));
@@ -214,7 +267,6 @@ void callResolvedClassVirtualMethod(OPENV* current_env, CONSTANT_Methodref_info*
 
     last_stack= current_env->current_stack;
     // 1. create new stack frame
-    method = mentry->method; //(method_info*)(method_ref->ref_addr);
     code_attr = (Code_attribute*)(method->code_attribute_addr);
     debug("code_attr=%p", code_attr);
     stf = newStackFrame(last_stack, code_attr);
@@ -224,10 +276,11 @@ void callResolvedClassVirtualMethod(OPENV* current_env, CONSTANT_Methodref_info*
     real_args_len = method->args_len + SZ_REF;
     last_stack->sp -= real_args_len;
     memcpy(stf->localvars, last_stack->sp, real_args_len);
-    obj = *(Object**)(stf->localvars);
+    obj = (Object*)decodeRef(*(NarrowRef*)(stf->localvars));
     current_env->current_obj = obj;
     debug("args_len=%d", real_args_len);
-    debug("last_stack=%p, localvar[0]=%p", PICK_STACKC(last_stack, Reference), obj);
+    debug("last_stack=%p, localvar[0]=%p", last_stack, obj);
+    enterSynchronizedMethod(stf, method);
 
     // 3. save current environment
     stf->last_pc = current_env->pc;
@@ -239,8 +292,8 @@ void callResolvedClassVirtualMethod(OPENV* current_env, CONSTANT_Methodref_info*
 
     // 4. set new environment
     //class_info = (CONSTANT_Class_info*)(current_env->current_class->constant_pool[method_ref->class_index]);
-    current_env->pc = current_env->pc_start = code_attr->code;
-    current_env->pc_end = code_attr->code + code_attr->code_length;
+    current_env->pc = current_env->pc_start = stf->code;
+    current_env->pc_end = stf->code + code_attr->code_length;
     current_env->current_class = mentry->pclass; //method_ref->pclass;
     current_env->current_stack = stf;
     current_env->call_depth++;
@@ -284,10 +337,10 @@ MethodEntry* resolveClassVirtualMethod(Class* caller_class, CONSTANT_Methodref_i
                     debug("resolve method success, class=%s", get_class_name(callee_cp, callee_class->this_class));
 
                     mentry = newMethodEntry(callee_class, method);
+                    mentry->intrinsic = findVirtualIntrinsic(callee_class, method);
+                    mentry = addMethodEntry(method_ref->mtable, mentry);
                     debug("mentry: pclass=%p, method=%p", mentry->pclass, mentry->method);
 
-                    addMethodEntry(method_ref->mtable, mentry);
-
                     found = 1;
 
                     break;
@@ -317,28 +370,58 @@ void callClassVirtualMethod(OPENV *current_env, int mindex)
     cp_info cp = current_class->constant_pool;
     CONSTANT_Methodref_info* method_ref = (CONSTANT_Methodref_info*)(current_class->constant_pool[mindex]);
     CONSTANT_NameAndType_info *nt_info = (CONSTANT_NameAndType_info*)(current_class->constant_pool[method_ref->name_and_type_index]);
+    MethodTable *mtable = CP_RESOLVED(method_ref->mtable);
 
-    if (NULL == method_ref->mtable) {
-        method_ref->args_len = getMethodrefArgsLen(current_class, nt_info->descriptor_index);
-        method_ref->mtable = newMethodTable();
+    if (NULL == mtable) {
+        // the other threads take the methodref as resolved once mtable is set, so it is published last
+        bindIntrinsic(current_class, method_ref);
+        publishMethodTable(&method_ref->mtable, getMethodrefArgsLen(current_class, nt_info->descriptor_index));
+        mtable = method_ref->mtable;
     }
 
-    caller_obj = *(Reference*)(current_env->current_stack->sp - ((method_ref->args_len+4)));
+    if (NULL != method_ref->intrinsic) {
+        ((IntrinsicFunction)method_ref->intrinsic)(current_env);
+        return;
+    }
+
+    caller_obj = (Reference)decodeRef(*(NarrowRef*)(current_env->current_stack->sp - ((mtable->args_len+SZ_REF))));
     printf("%p\n", caller_obj);
     debug("caller_obj=%p, class=%s", caller_obj, get_this_class_name(caller_obj->pclass));
     debug("current_class=%s", get_utf8(current_class->constant_pool[((CONSTANT_Class_info*)(current_class->constant_pool[current_class->this_class]))->name_index]));
     debug("method class index=%d", method_ref->class_index);
 
-    if(NULL == (mentry = findMethodEntry(method_ref->mtable, caller_obj->pclass))) {
-        debug("method_ref=%p, mtable=%p", method_ref, method_ref->mtable);
+    if(NULL == (mentry = findMethodEntry(mtable, caller_obj->pclass))) {
+        debug("method_ref=%p, mtable=%p", method_ref, mtable);
         debug("name_index=%d,%p, desc_index=%d\n", nt_info->name_index, (CONSTANT_Utf8_info*)(cp[nt_info->name_index]), nt_info->descriptor_index);
         mentry = resolveClassVirtualMethod(caller_obj->pclass, &method_ref, (CONSTANT_Utf8_info*)(cp[nt_info->name_index]), (CONSTANT_Utf8_info*)(cp[nt_info->descriptor_index]));
     }
     printf("caller_obj=%p, caller_obj_class=%s\n", caller_obj, get_this_class_name(mentry->pclass));
 
+    if (NULL != mentry->intrinsic) {
+        ((IntrinsicFunction)mentry->intrinsic)(current_env);
+        return;
+    }
     callResolvedClassVirtualMethod(current_env, method_ref, mentry);
 }
 
+/**
+ * @brief publishFieldref saves the resolved field in the fieldref. findex and ftype are two stores: the
+ * thread claiming the fieldref writes findex and then ftype with release, the others wait for these stores
+ */
+static void publishFieldref(CONSTANT_Fieldref_info *field_ref, field_info *field)
+{
+    uchar unresolved = 0;
+
+    if (__atomic_compare_exchange_n(&field_ref->ftype, &unresolved, FIELDREF_RESOLVING, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        field_ref->findex = field->findex;
+        __atomic_store_n(&field_ref->ftype, field->ftype, __ATOMIC_RELEASE);
+        return;
+    }
+    while (!FIELDREF_RESOLVED(field_ref)) {
+        sched_yield();
+    }
+}
+
 void resolveClassStaticField(Class* caller_class, CONSTANT_Fieldref_info **pfield_ref)
 {
     Class* callee_class;
@@ -352,9 +435,15 @@ void resolveClassStaticField(Class* caller_class, CONSTANT_Fieldref_info **pfiel
 
     caller_cp = caller_class->constant_pool;
     field_ref_class_info = (CONSTANT_Class_info*)(caller_cp[field_ref->class_index]);
-    callee_class = field_ref_class_info->pclass;
+    callee_class = CP_RESOLVED(field_ref_class_info->pclass);
     if (NULL == callee_class) {
-        printf("NULL class");exit(1);
+        // a class initialized already, the caller may not have resolved it by a new or an invoke
+        field_name_utf8 = (CONSTANT_Utf8_info*)(caller_cp[field_ref_class_info->name_index]);
+        if (NULL == (callee_class = findLoadedClass(field_name_utf8->bytes, field_name_utf8->length)) ||
+                !__atomic_load_n(&callee_class->clinit_runned, __ATOMIC_ACQUIRE)) {
+            printf("NULL class");exit(1);
+        }
+        CP_PUBLISH(field_ref_class_info->pclass, callee_class);
     }
 
     field_nt_info = (CONSTANT_NameAndType_info*)(caller_cp[field_ref->name_and_type_index]);
@@ -374,8 +463,7 @@ void resolveClassStaticField(Class* caller_class, CONSTANT_Fieldref_info **pfiel
                 tmp_field_descriptor_utf8 = (CONSTANT_Utf8_info*)(callee_cp[field->descriptor_index]);
                 if (field_descriptor_utf8->length == tmp_field_descriptor_utf8->length &&
                     strcmp(field_descriptor_utf8->bytes, tmp_field_descriptor_utf8->bytes) == 0) {
-                    field_ref->ftype = field->ftype;
-                    field_ref->findex = field->findex;
+                    publishFieldref(field_ref, field);
                     found = 1;
 
                     debug("field resolve success, class=%s", get_class_name(callee_cp, callee_class->this_class));
@@ -396,37 +484,22 @@ void resolveClassStaticField(Class* caller_class, CONSTANT_Fieldref_info **pfiel
         exit(1);
     }
 }
-void do_arraycopy(OPENV *env)
-{
-    int i;
-    int length, destPos, srcPos;
-    CArray_char *arr1, *arr2;
-    GET_STACK(env->current_stack, length, int);
-    GET_STACK(env->current_stack, destPos, int);
-    GET_STACK(env->current_stack, arr2, CArray_char*);
-    GET_STACK(env->current_stack, srcPos, int);
-    GET_STACK(env->current_stack, arr1, CArray_char*);
-
-    memcpy(arr2->elements+destPos, arr1->elements+srcPos, length);
-}
-
 int callNativeMethod(const char* method_name, OPENV *env)
 {
     Object *obj;
     CArray_char* arr_ref;
+    char *utf8;
     int i=0;
     if (strcmp(method_name, "writeString") == 0) {
         obj = GET_STACKR(env->current_stack, obj, Reference);
         debug("obj=%p", obj);
         if (NULL != obj) {
-            arr_ref = GET_FIELD(obj, 0, CArray_char*);
+            arr_ref = STRING_VALUE(obj);
             printf("type=%d, length=%d\n", arr_ref->atype, arr_ref->length);
-            printf("[OUT]: ");
-            while(i<arr_ref->length) {
-                putchar(arr_ref->elements[i]);
-                i++;
-            }
-            printf("\n");
+            utf8 = (char*)malloc(encodeUTF8(arr_ref, NULL) + 1);
+            i = encodeUTF8(arr_ref, utf8);
+            printf("[OUT]: %.*s\n", i, utf8);
+            free(utf8);
         }
     }
     return 0;
@@ -445,11 +518,18 @@ int resolveStaticClassMethod(Class* caller_class, CONSTANT_Methodref_info **pmet
 
     caller_cp = caller_class->constant_pool;
 
+    // the methods having an intrinsic are run without loading the class
+    if (bindIntrinsic(caller_class, method_ref)) {
+        ((IntrinsicFunction)method_ref->intrinsic)(env);
+        return 0;
+    }
+
     method_ref_class_info = (CONSTANT_Class_info*)(caller_cp[method_ref->class_index]);
-    callee_class = method_ref_class_info->pclass;
+    callee_class = CP_RESOLVED(method_ref_class_info->pclass);
 
     if (NULL == callee_class) {
-        callee_class = method_ref_class_info->pclass = systemLoadClassRecursive(env, (CONSTANT_Utf8_info*)(caller_cp[method_ref_class_info->name_index]));
+        callee_class = systemLoadClassRecursive(env, (CONSTANT_Utf8_info*)(caller_cp[method_ref_class_info->name_index]));
+        CP_PUBLISH(method_ref_class_info->pclass, callee_class);
     }
 
     method_nt_info = (CONSTANT_NameAndType_info*)(caller_cp[method_ref->name_and_type_index]);
@@ -471,11 +551,7 @@ int resolveStaticClassMethod(Class* caller_class, CONSTANT_Methodref_info **pmet
                 if (method_descriptor_utf8->length == tmp_method_descriptor_utf8->length &&
                     strcmp(method_descriptor_utf8->bytes, tmp_method_descriptor_utf8->bytes) == 0) {
                     if (IS_ACC_NATIVE(method->access_flags)) {
-                        if (strcmp(method_name_utf8->bytes, "arraycopy") == 0) {
-                            debug("arraycopy: found %s method", method_name_utf8->bytes);
-                            do_arraycopy(env);
-                            return 0;
-                        } else if (strcmp(get_this_class_name(callee_class), "test/IOUtil") == 0) {
+                        if (strcmp(get_this_class_name(callee_class), "test/IOUtil") == 0) {
                             printf("find self defined native class");
                             return callNativeMethod(method_name_utf8->bytes, env);
 
@@ -488,8 +564,8 @@ int resolveStaticClassMethod(Class* caller_class, CONSTANT_Methodref_info **pmet
                         }
                     }
 
-                    method_ref->ref_addr = method;
-                    method_ref->args_len = method->args_len;
+                    // the other threads take ref_addr as resolved, so it is published last
+                    CP_PUBLISH(method_ref->ref_addr, method);
                     found = 1;
 
                     debug("resolve method success, class=%s", get_class_name(callee_cp, callee_class->this_class));
@@ -521,6 +597,13 @@ void callResolvedStaticClassMethod(OPENV* current_env, CONSTANT_Methodref_info*
     Code_attribute* code_attr;
     int real_args_len =0;
 
+    method = (method_info*)(method_ref->ref_addr);
+    if (CALL_NORMAL != ((Code_attribute*)(method->code_attribute_addr))->call_kind) {
+        class_info = (CONSTANT_Class_info*)(current_env->current_class->constant_pool[method_ref->class_index]);
+        callLeafMethod(current_env, class_info->pclass, method, method->args_len, 0);
+        return;
+    }
+
     debug("before call, current_class=%s", get_class_name(current_env->current_class->constant_pool, current_env->current_class->this_class));
     if (current_env->current_class->super_class) {
         debug("super_class=%s", get_class_name(current_env->current_class->constant_pool, current_env->current_class->super_class));
@@ -542,6 +625,7 @@ void callResolvedStaticClassMethod(OPENV* current_env, CONSTANT_Methodref_info*
         memcpy(stf->localvars, last_stack->sp, real_args_len);
         debug("args_len=%d", real_args_len);
     }
+    enterSynchronizedMethod(stf, method);
 
     // 3. save current environment
     stf->last_pc = current_env->pc;
@@ -554,8 +638,8 @@ void callResolvedStaticClassMethod(OPENV* current_env, CONSTANT_Methodref_info*
 
     // 4. set new environment
     class_info = (CONSTANT_Class_info*)(current_env->current_class->constant_pool[method_ref->class_index]);
-    current_env->pc = current_env->pc_start = code_attr->code;
-    current_env->pc_end = code_attr->code + code_attr->code_length;
+    current_env->pc = current_env->pc_start = stf->code;
+    current_env->pc_end = stf->code + code_attr->code_length;
     current_env->current_class = class_info->pclass;
     current_env->current_stack = stf;
     current_env->call_depth++;
@@ -589,12 +673,23 @@ void callStaticClassMethod(OPENV* current_env, int mindex)
     debug("current_class=%s", get_utf8(current_class->constant_pool[((CONSTANT_Class_info*)(current_class->constant_pool[current_class->this_class]))->name_index]));
     debug("method class index=%d", method_ref->class_index);
 
-    if (NULL == method_ref->ref_addr) {
+    if (NULL != CP_RESOLVED(method_ref->intrinsic)) {
+        ((IntrinsicFunction)method_ref->intrinsic)(current_env);
+        return;
+    }
+
+    if (NULL == CP_RESOLVED(method_ref->ref_addr)) {
         if (0 == resolveStaticClassMethod(current_class, &method_ref, current_env)) {
             return;
         }
     }
 
+    if (NULL != ((method_info*)method_ref->ref_addr)->aot_code ||
+            (ENGINE_REGISTER == jvm_engine && NULL != (GET_CODE_FROM_METHOD(((method_info*)method_ref->ref_addr)))->reg_code)) {
+        callRegisterMethod(current_env, (method_info*)(method_ref->ref_addr));
+        return;
+    }
+
     callResolvedStaticClassMethod(current_env, method_ref);
 }
 
@@ -611,10 +706,17 @@ void resolveClassInstanceField(Class* caller_class, CONSTANT_Fieldref_info **pfi
 
     caller_cp = caller_class->constant_pool;
     field_ref_class_info = (CONSTANT_Class_info*)(caller_cp[field_ref->class_index]);
-    callee_class = field_ref_class_info->pclass;
+    callee_class = CP_RESOLVED(field_ref_class_info->pclass);
     if (NULL == callee_class) {
-        printf("NULL class");exit(1);
+        // the class of the object is loaded, the caller may not have resolved it by a new or an invoke
+        field_name_utf8 = (CONSTANT_Utf8_info*)(caller_cp[field_ref_class_info->name_index]);
+        if (NULL == (callee_class = findLoadedClass(field_name_utf8->bytes, field_name_utf8->length))) {
+            printf("NULL class");exit(1);
+        }
+        CP_PUBLISH(field_ref_class_info->pclass, callee_class);
     }
+    // the offsets of the fields are known once the class is linked
+    linkClassFields(NULL, callee_class);
 
     field_nt_info = (CONSTANT_NameAndType_info*)(caller_cp[field_ref->name_and_type_index]);
     field_name_utf8 = (CONSTANT_Utf8_info*)(caller_cp[field_nt_info->name_index]);
@@ -632,8 +734,7 @@ void resolveClassInstanceField(Class* caller_class, CONSTANT_Fieldref_info **pfi
                 tmp_field_descriptor_utf8 = (CONSTANT_Utf8_info*)(callee_cp[field->descriptor_index]);
                 if (field_descriptor_utf8->length == tmp_field_descriptor_utf8->length &&
                     strcmp(field_descriptor_utf8->bytes, tmp_field_descriptor_utf8->bytes) == 0) {
-                    field_ref->ftype = field->ftype;
-                    field_ref->findex = field->findex;
+                    publishFieldref(field_ref, field);
                     found = 1;
 
                     debug("field resolve success, class=%s", get_class_name(callee_cp, callee_class->this_class));
@@ -656,6 +757,107 @@ void resolveClassInstanceField(Class* caller_class, CONSTANT_Fieldref_info **pfi
     }
 }
 
+/**
+ * @brief callAccessorMethod runs a getter or a setter on the operand stack of the caller, no stack frame is created
+ * @param env
+ * @param pclass the class of the accessor
+ * @param method
+ * @param real_args_len length of the arguments, `this` included
+ */
+void callAccessorMethod(OPENV *env, Class *pclass, method_info *method, int real_args_len)
+{
+    Code_attribute *code_attr = (Code_attribute*)(method->code_attribute_addr);
+    CONSTANT_Fieldref_info *fieldref = (CONSTANT_Fieldref_info*)(pclass->constant_pool[code_attr->accessor_field]);
+    char *value;
+    Object *obj;
+
+    if (!FIELDREF_RESOLVED(fieldref)) {
+        resolveClassInstanceField(pclass, &fieldref);
+    }
+
+    env->current_stack->sp -= real_args_len;
+    obj = (Object*)decodeRef(*(NarrowRef*)(env->current_stack->sp));
+
+    if (CALL_GETTER == code_attr->call_kind) {
+        switch (fieldref->ftype) {
+            case 'B': OP_GET_FIELDI(obj, fieldref->findex, byte); break;
+            case 'C':
+            case 'Z': OP_GET_FIELDI(obj, fieldref->findex, char); break;
+            case 'S': OP_GET_FIELDI(obj, fieldref->findex, short); break;
+            case 'I': OP_GET_FIELDI(obj, fieldref->findex, int); break;
+            case 'F': OP_GET_FIELDF(obj, fieldref->findex, float); break;
+            case '[':
+            case 'L': OP_GET_FIELDR(obj, fieldref->findex, Reference); break;
+            case 'J': OP_GET_FIELDL(obj, fieldref->findex, long); break;
+            case 'D': OP_GET_FIELDL(obj, fieldref->findex, double); break;
+            default:
+                printf("Error: getter, ftype=%d\n", fieldref->ftype);
+                exit(1);
+        }
+        return;
+    }
+
+    // the value is local variable 1 of the setter
+    value = env->current_stack->sp + GET_LV_OFFSET(1);
+    switch (fieldref->ftype) {
+        case 'B': PUT_FIELD(obj, fieldref->findex, *(int*)value, byte); break;
+        case 'C':
+        case 'Z': PUT_FIELD(obj, fieldref->findex, *(int*)value, char); break;
+        case 'S': PUT_FIELD(obj, fieldref->findex, *(int*)value, short); break;
+        case 'I': PUT_FIELD(obj, fieldref->findex, *(int*)value, int); break;
+        case 'F': PUT_FIELD(obj, fieldref->findex, *(float*)value, float); break;
+        case '[':
+        case 'L':
+            GC_PRE_WRITE_BARRIER(GET_FIELD_ADDR(obj, fieldref->findex));
+            GC_STORE_REF(GET_FIELD_ADDR(obj, fieldref->findex), *(NarrowRef*)value);
+            break;
+        case 'J': PUT_FIELD(obj, fieldref->findex, *(long*)value, long); break;
+        case 'D': PUT_FIELD(obj, fieldref->findex, *(double*)value, double); break;
+        default:
+            printf("Error: setter, ftype=%d\n", fieldref->ftype);
+            exit(1);
+    }
+}
+
+/**
+ * @brief callLeafMethod fast invocation of the methods found by analyseCallKind: the accessors are run
+ * directly, the other leaf methods are run in the leaf frame of the env, no memory is allocated
+ * @param env
+ * @param pclass the class of the method
+ * @param method
+ * @param real_args_len length of the arguments, `this` included
+ * @param has_this 1 for the instance methods
+ */
+void callLeafMethod(OPENV *env, Class *pclass, method_info *method, int real_args_len, int has_this)
+{
+    Code_attribute *code_attr = (Code_attribute*)(method->code_attribute_addr);
+    StackFrame *stf, *last_stack = env->current_stack;
+
+    if (has_this && code_attr->call_kind >= CALL_GETTER) {
+        callAccessorMethod(env, pclass, method, real_args_len);
+        return;
+    }
+
+    stf = enterLeafFrame(env, code_attr);
+    last_stack->sp -= real_args_len;
+    memcpy(stf->localvars, last_stack->sp, real_args_len);
+    if (has_this) {
+        env->current_obj = (Object*)decodeRef(*(NarrowRef*)(stf->localvars));
+    }
+
+    stf->last_pc = env->pc;
+    stf->last_pc_end = env->pc_end;
+    stf->last_pc_start = env->pc_start;
+    stf->last_class = env->current_class;
+    stf->method = method;
+
+    env->pc = env->pc_start = code_attr->code;
+    env->pc_end = code_attr->code + code_attr->code_length;
+    env->current_class = pclass;
+    env->current_stack = stf;
+    env->call_depth++;
+}
+
 void resolveClassSpecialMethod(Class* caller_class, CONSTANT_Methodref_info **pmethod_ref)
 {
     Class* callee_class;
@@ -669,9 +871,10 @@ void resolveClassSpecialMethod(Class* caller_class, CONSTANT_Methodref_info **pm
 
     caller_cp = caller_class->constant_pool;
     method_ref_class_info = (CONSTANT_Class_info*)(caller_cp[method_ref->class_index]);
-    callee_class = method_ref_class_info->pclass;
+    callee_class = CP_RESOLVED(method_ref_class_info->pclass);
     if (NULL == callee_class) {
-        callee_class = method_ref_class_info->pclass = systemLoadClass((CONSTANT_Utf8_info*)(caller_cp[method_ref_class_info->name_index]));
+        callee_class = systemLoadClass((CONSTANT_Utf8_info*)(caller_cp[method_ref_class_info->name_index]));
+        CP_PUBLISH(method_ref_class_info->pclass, callee_class);
     }
 
     method_nt_info = (CONSTANT_NameAndType_info*)(caller_cp[method_ref->name_and_type_index]);
@@ -691,8 +894,7 @@ void resolveClassSpecialMethod(Class* caller_class, CONSTANT_Methodref_info **pm
                 tmp_method_descriptor_utf8 = (CONSTANT_Utf8_info*)(callee_cp[method->descriptor_index]);
                 if (method_descriptor_utf8->length == tmp_method_descriptor_utf8->length &&
                     strcmp(method_descriptor_utf8->bytes, tmp_method_descriptor_utf8->bytes) == 0) {
-                    method_ref->ref_addr = method;
-                    method_ref->args_len = method->args_len;
+                    CP_PUBLISH(method_ref->ref_addr, method);
 
                     found = 1;
 
@@ -726,6 +928,13 @@ void callResolvedClassSpecialMethod(OPENV* current_env, CONSTANT_Methodref_info*
     Code_attribute* code_attr;
     int real_args_len =0;
 
+    method = (method_info*)(method_ref->ref_addr);
+    if (CALL_NORMAL != ((Code_attribute*)(method->code_attribute_addr))->call_kind) {
+        class_info = (CONSTANT_Class_info*)(current_env->current_class->constant_pool[method_ref->class_index]);
+        callLeafMethod(current_env, class_info->pclass, method, method->args_len + SZ_REF, 1);
+        return;
+    }
+
     debug("before call, current_class=%s", get_class_name(current_env->current_class->constant_pool, current_env->current_class->this_class));
     if (current_env->current_class->super_class) {
         debug("super_class=%s", get_class_name(current_env->current_class->constant_pool, current_env->current_class->super_class));
@@ -744,8 +953,9 @@ void callResolvedClassSpecialMethod(OPENV* current_env, CONSTANT_Methodref_info*
     real_args_len = method->args_len + SZ_REF;
     last_stack->sp -= real_args_len;
     memcpy(stf->localvars, last_stack->sp, real_args_len);
-    obj = *(Object**)(stf->localvars);
+    obj = (Object*)decodeRef(*(NarrowRef*)(stf->localvars));
     current_env->current_obj = obj;
+    enterSynchronizedMethod(stf, method);
 
     // 3. save current environment
     stf->last_pc = current_env->pc;
@@ -756,8 +966,8 @@ void callResolvedClassSpecialMethod(OPENV* current_env, CONSTANT_Methodref_info*
 
     // 4. set new environment
     class_info = (CONSTANT_Class_info*)(current_env->current_class->constant_pool[method_ref->class_index]);
-    current_env->pc = current_env->pc_start = code_attr->code;
-    current_env->pc_end = code_attr->code + code_attr->code_length;
+    current_env->pc = current_env->pc_start = stf->code;
+    current_env->pc_end = stf->code + code_attr->code_length;
     current_env->current_class = class_info->pclass;
     current_env->current_stack = stf;
     current_env->call_depth++;
@@ -766,6 +976,43 @@ void callResolvedClassSpecialMethod(OPENV* current_env, CONSTANT_Methodref_info*
     debug("real class name = %s", get_class_name(current_env->current_class->constant_pool, current_env->current_class->this_class));
 }
 
+/**
+ * @brief callDynamicMethod runs an invokedynamic, the call site is linked on the first run. only the
+ * string concat of StringConcatFactory is supported (see string_concat.c)
+ * @param current_env
+ * @param index the CONSTANT_InvokeDynamic
+ */
+void callDynamicMethod(OPENV* current_env, int index)
+{
+    Class* current_class = current_env->current_class;
+    cp_info cp = current_class->constant_pool;
+    CONSTANT_InvokeDynamic_info *indy_info = (CONSTANT_InvokeDynamic_info*)(cp[index]);
+    CONSTANT_NameAndType_info *nt_info;
+    CONSTANT_MethodHandle_info *mh_info;
+    CONSTANT_Methodref_info *bsm_ref;
+    void *call_site = __atomic_load_n(&indy_info->call_site, __ATOMIC_ACQUIRE);
+    ushort *bsm_args;
+    int bsm_argc;
+    const char *bsm_class;
+
+    if (NULL == call_site) {
+        nt_info = (CONSTANT_NameAndType_info*)(cp[indy_info->name_and_type_index]);
+        mh_info = (CONSTANT_MethodHandle_info*)(cp[findBootstrapMethod(current_class, indy_info->bootstrap_method_attr_index, &bsm_argc, &bsm_args)]);
+        bsm_ref = (CONSTANT_Methodref_info*)(cp[mh_info->reference_index]);
+        bsm_class = get_class_name(cp, bsm_ref->class_index);
+        if (strcmp(bsm_class, "java/lang/invoke/StringConcatFactory") != 0) {
+            printf("Error: unsupported invokedynamic bootstrap: %s\n", bsm_class);
+            exit(1);
+        }
+        call_site = linkStringConcat(current_env, current_class, get_utf8(cp[nt_info->descriptor_index]),
+                get_utf8(cp[((CONSTANT_NameAndType_info*)(cp[bsm_ref->name_and_type_index]))->name_index]), bsm_args, bsm_argc);
+        free(bsm_args);
+        __atomic_store_n(&indy_info->call_site, call_site, __ATOMIC_RELEASE);
+    }
+
+    callStringConcat(current_env, (ConcatRecipe*)call_site);
+}
+
 void callClassSpecialMethod(OPENV* current_env, int mindex)
 {
     Class* current_class = current_env->current_class;
@@ -774,9 +1021,21 @@ void callClassSpecialMethod(OPENV* current_env, int mindex)
     debug("current_class=%s", get_utf8(current_class->constant_pool[((CONSTANT_Class_info*)(current_class->constant_pool[current_class->this_class]))->name_index]));
     debug("method class index=%d", method_ref->class_index);
 
-    if (NULL == method_ref->ref_addr) {
+    if (NULL != CP_RESOLVED(method_ref->intrinsic)) {
+        ((IntrinsicFunction)method_ref->intrinsic)(current_env);
+        return;
+    }
+
+    if (NULL == CP_RESOLVED(method_ref->ref_addr)) {
+        if (bindIntrinsic(current_class, method_ref)) {
+            ((IntrinsicFunction)method_ref->intrinsic)(current_env);
+            return;
+        }
         resolveClassSpecialMethod(current_class, &method_ref);
     }
 
     callResolvedClassSpecialMethod(current_env, method_ref);
 }
+
+#include "vm.c"
+#include "zygote.c"
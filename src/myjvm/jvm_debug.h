@@ -22,9 +22,13 @@
 
 #ifdef DEBUG
 
-#define DEBUG_SET_LV_TYPE(dbg, vindex, dtype) *(dbg->localvar_type+vindex)=dtype
-#define DEBUG_SET_SP_TYPE(dbg, dtype) *(dbg->spvar_type)=dtype;dbg->spvar_type+=1;
-#define DEBUG_CAST_SP_TYPE(dbg, dtype) *(dbg->spvar_type)=dtype
+// the invokes do not pop the arguments from the types, so a long run drifts; the types out of the block are not kept
+#define DEBUG_IN_LV(dbg, vindex) ((dbg)->localvar_type+(vindex) < (dbg)->spvar_base)
+#define DEBUG_IN_SP(dbg) ((dbg)->spvar_type >= (dbg)->spvar_base && (dbg)->spvar_type < (dbg)->spvar_end)
+
+#define DEBUG_SET_LV_TYPE(dbg, vindex, dtype) if (DEBUG_IN_LV(dbg, vindex)) {*(dbg->localvar_type+vindex)=dtype;}
+#define DEBUG_SET_SP_TYPE(dbg, dtype) if (DEBUG_IN_SP(dbg)) {*(dbg->spvar_type)=dtype;} dbg->spvar_type+=1;
+#define DEBUG_CAST_SP_TYPE(dbg, dtype) if (DEBUG_IN_SP(dbg)) {*(dbg->spvar_type)=dtype;}
 
 #define DEBUG_SP_UP(dbg) dbg->spvar_type+=1
 #define DEBUG_SP_DOWN(dbg) dbg->spvar_type-=1
@@ -35,8 +39,9 @@
 
 #else
 
-#define SET_DEBUG_LV_TYPE(dbg, vindex, dtype)
-#define SET_DEBUG_SP_TYPE(dbg, dtype)
+#define DEBUG_SET_LV_TYPE(dbg, vindex, dtype)
+#define DEBUG_SET_SP_TYPE(dbg, dtype)
+#define DEBUG_CAST_SP_TYPE(dbg, dtype)
 #define DEBUG_SP_UP(dbg)
 #define DEBUG_SP_DOWN(dbg)
 #define DEBUG_SP_UPL(dbg)
@@ -55,6 +60,7 @@ typedef struct _DebugType {
     char* localvar_base;
     char* spvar_type;
     char* spvar_base;
+    char* spvar_end;
 } DebugType;
 
 DebugType* newDebugType(ushort local_vars, int stack_size)
@@ -66,6 +72,7 @@ DebugType* newDebugType(ushort local_vars, int stack_size)
     dbg->localvar_base = dbg->localvar_type;
     dbg->spvar_type = dbg->localvar_type + local_vars+1;
     dbg->spvar_base = dbg->spvar_type;
+    dbg->spvar_end = dbg->spvar_base + stack_size;
     return dbg;
 }
 
@@ -6,6 +6,8 @@
  * +-----------------------------------------------------------------+
  */
 
+#define _GNU_SOURCE // pthread_getattr_np, see safepoint.c
+
 #include<stdio.h>
 #include<stdlib.h>
 
@@ -15,17 +17,105 @@
 #include "test_jvm_types.c"
 
 
-int main()
+int main(int argc, char *argv[])
 {
     // 0. specify the test class, the directory is specified in pass_class.c class_dir
     const char * testClassName = "test/TestStatic"; // the full qualified name of the class to be tested
     Class* pclass;
     CONSTANT_Utf8_info class_utf8_info;
+    const char * aotEmitName = NULL;
+    const char * zygoteListen = NULL, * zygoteConnectTo = NULL, * zygotePreloadFile = NULL;
+    int i;
+
+    // options: -Xengine:stack (default) or -Xengine:register, the other argument is the class to be tested
+    // -Xaot:emit=lib.so compiles the given classes into lib.so, -Xaot:lib=lib.so runs with the compiled methods
+    // -Xmx<size> reserves a heap of size bytes (k, m or g may follow), at most 32g
+    // -Xallocprof[=interval] samples the allocations every interval bytes on average (0: all of them) and
+    // reports the allocation sites at exit or on SIGUSR2, -Xallocprof:file=<path> writes the report to path
+    // -Xescape:off keeps the allocations the escape analysis would scalar replace
+    // -Xlockstat reports the inflated monitors, the most contended first, at exit
+    // -Xlog:safepoint logs the time to safepoint and the pause of each safepoint,
+    // -Xsafepoint:interval=<ms> runs a safepoint every interval
+    // -Xgc:threads=<n> collects with n threads (default: one per cpu), -Xgc:concurrent marks while the
+    // java threads run, -Xlog:gc logs each collection
+    // -Xvthreads:carriers=<n> runs the virtual threads on n carrier threads (default: one per cpu)
+    // -Xaio:epoll waits for the i/o of myjvm/io/NativeIO with epoll instead of io_uring (see aio.c)
+    // -Xzygote:listen=<socket> preloads the classes given and those of -Xzygote:preload=<file> and forks a
+    // child per request, -Xzygote:connect=<socket> runs the class in a child of the zygote (see zygote.c)
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-Xengine:register") == 0) {
+            jvm_engine = ENGINE_REGISTER;
+        } else if (strcmp(argv[i], "-Xengine:stack") == 0) {
+            jvm_engine = ENGINE_STACK;
+        } else if (strncmp(argv[i], "-Xaot:emit=", 11) == 0) {
+            aotEmitName = argv[i] + 11;
+        } else if (strncmp(argv[i], "-Xaot:lib=", 10) == 0) {
+            if (openAotLibrary(argv[i] + 10)) {
+                exit(1);
+            }
+        } else if (strncmp(argv[i], "-Xallocprof:file=", 17) == 0) {
+            alloc_profile_file = argv[i] + 17;
+        } else if (strncmp(argv[i], "-Xallocprof", 11) == 0) {
+            alloc_profile = 1;
+            if ('=' == argv[i][11]) {
+                alloc_sample_interval = atol(argv[i] + 12);
+            }
+        } else if (strcmp(argv[i], "-Xescape:off") == 0) {
+            escape_analysis = 0;
+        } else if (strcmp(argv[i], "-Xlockstat") == 0) {
+            lock_stat = 1;
+        } else if (strcmp(argv[i], "-Xlog:safepoint") == 0) {
+            safepoint_log = 1;
+        } else if (strncmp(argv[i], "-Xsafepoint:interval=", 21) == 0) {
+            safepoint_interval = atol(argv[i] + 21);
+        } else if (strncmp(argv[i], "-Xgc:threads=", 13) == 0) {
+            gc_threads = atoi(argv[i] + 13);
+        } else if (strcmp(argv[i], "-Xgc:concurrent") == 0) {
+            gc_concurrent = 1;
+        } else if (strcmp(argv[i], "-Xlog:gc") == 0) {
+            gc_log = 1;
+        } else if (strncmp(argv[i], "-Xvthreads:carriers=", 20) == 0) {
+            vthread_carriers = atoi(argv[i] + 20);
+        } else if (strcmp(argv[i], "-Xaio:epoll") == 0) {
+            aio_use_epoll = 1;
+        } else if (strncmp(argv[i], "-Xzygote:listen=", 16) == 0) {
+            zygoteListen = argv[i] + 16;
+        } else if (strncmp(argv[i], "-Xzygote:connect=", 17) == 0) {
+            zygoteConnectTo = argv[i] + 17;
+        } else if (strncmp(argv[i], "-Xzygote:preload=", 17) == 0) {
+            zygotePreloadFile = argv[i] + 17;
+        } else if (strncmp(argv[i], "-Xmx", 4) == 0) {
+            initHeap(parseHeapSize(argv[i] + 4));
+        } else {
+            testClassName = argv[i];
+        }
+    }
+
+    if (NULL != zygoteConnectTo) {
+        return zygoteConnect(zygoteConnectTo, testClassName);
+    }
+    if (NULL != zygoteListen) {
+        return runZygote(zygoteListen, zygotePreloadFile, argc, argv);
+    }
+
+    // the vm of the main thread, it starts the services of the options
+    current_vm = myjvm_create(NULL);
+
+    if (NULL != aotEmitName) {
+        for (i = 1; i < argc; i++) {
+            if (argv[i][0] != '-') {
+                class_utf8_info.bytes = argv[i];
+                class_utf8_info.length = strlen(argv[i]);
+                systemLoadClass(&class_utf8_info);
+            }
+        }
+        return aotCompileLoadedClasses(aotEmitName);
+    }
+
     class_utf8_info.bytes =  testClassName;
     class_utf8_info.length = strlen(testClassName);
 
-    // 1. initialize a new class table to store all loaded classes
-    newLoadedClassTable();
+    // 1. the classes are stored in the class table of the vm
     // 2. load the test class
     pclass = systemLoadClass(&class_utf8_info);
 
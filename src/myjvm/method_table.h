@@ -15,12 +15,13 @@
 typedef struct _MethodEntry {
     Class *pclass;
     method_info *method;
+    void *intrinsic; // native implementation of the method, see findVirtualIntrinsic, NULL if none
     struct _MethodEntry *next;
 } MethodEntry;
 
 typedef struct _MethodTable {
+    ushort args_len; // length of the arguments of the methodref, `this` excluded
     MethodEntry *head;
-    MethodEntry *tail;
 } MethodTable;
 
 MethodEntry* newMethodEntry(Class *pclass, method_info *method)
@@ -28,33 +29,40 @@ MethodEntry* newMethodEntry(Class *pclass, method_info *method)
     MethodEntry *mte = (MethodEntry*)malloc(sizeof(MethodEntry));
     mte->pclass = pclass;
     mte->method = method;
+    mte->intrinsic = NULL;
     mte->next   = NULL;
 
     return mte;
 }
 
-MethodTable* newMethodTable()
+MethodTable* newMethodTable(ushort args_len)
 {
     MethodTable* mtable = (MethodTable*)malloc(sizeof(MethodTable));
-    mtable->head = mtable->tail = NULL;
+    mtable->args_len = args_len;
+    mtable->head = NULL;
 
     return mtable;
 }
 
-void addMethodEntry(MethodTable *mtable, MethodEntry *mte)
+/**
+ * @brief publishMethodTable sets a new method table of the methodref, the table of another thread is
+ * kept if it was first
+ */
+void publishMethodTable(MethodTable **pmtable, ushort args_len)
 {
-    if (NULL == mtable->head) {
-        mtable->head = mte;
-        mtable->tail = mte;
-    } else {
-        mtable->tail->next = mte;
-        mtable->tail = mte;
+    MethodTable *mtable = newMethodTable(args_len);
+
+    if (!CP_PUBLISH(*pmtable, mtable)) {
+        free(mtable);
     }
 }
 
+/**
+ * @brief findMethodEntry looks up the entry of the class from the head, the list is only prepended to
+ */
 MethodEntry* findMethodEntry(MethodTable *mtable, Class *pclass)
 {
-    MethodEntry *mte = mtable->head;
+    MethodEntry *mte = __atomic_load_n(&mtable->head, __ATOMIC_ACQUIRE);
     while (mte != NULL) {
         if (mte->pclass == pclass) {
             break;
@@ -65,4 +73,26 @@ MethodEntry* findMethodEntry(MethodTable *mtable, Class *pclass)
     return mte;
 }
 
+/**
+ * @brief addMethodEntry prepends the entry, or returns the one another thread added for the same class.
+ * when another entry is prepended meanwhile, only the new entries are looked at again
+ */
+MethodEntry* addMethodEntry(MethodTable *mtable, MethodEntry *mte)
+{
+    MethodEntry *head = __atomic_load_n(&mtable->head, __ATOMIC_ACQUIRE), *seen = NULL, *found;
+
+    do {
+        for (found = head; found != seen; found = found->next) {
+            if (found->pclass == mte->pclass) {
+                free(mte);
+                return found;
+            }
+        }
+        seen = head;
+        mte->next = head;
+    } while (!__atomic_compare_exchange_n(&mtable->head, &head, mte, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+
+    return mte;
+}
+
 #endif // METHOD_TABLE_H
@@ -0,0 +1,652 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef MONITOR_C
+#define MONITOR_C
+
+#include <sched.h>
+#include <stddef.h>
+#include <time.h>
+
+/**
+  * the monitors of monitorenter/monitorexit, the synchronized methods and Object.wait/notify. the lock
+  * lives in the mark word of the object (the lock_mark of the class for a static synchronized method):
+  *
+  *   unlocked   0                                  the other bits are kept for the identity hash and gc
+  *   thin       owner(24) recursions(6) 01         taken and released by one compare-and-swap
+  *   inflated   monitor index(30) 10               a fat monitor, mutex and condition variables
+  *
+  * a thin lock is inflated when another thread still finds it taken after spinning, when the recursions
+  * overflow, when the owner calls wait() and when the other bits of the mark are in use. the collector
+  * deflates the idle monitors and frees those of the dead objects, see deflateMonitors; under -Xlockstat
+  * the live ones are kept inflated and the contended ones are reported at exit
+  */
+
+#define MARK_LOCK_MASK    3u
+#define MARK_UNLOCKED     0u
+#define MARK_THIN         1u
+#define MARK_INFLATED     2u
+#define THIN_RECURSION_ONE   (1u << 2)
+#define THIN_RECURSION_MASK  (63u << 2)
+#define THIN_OWNER_SHIFT  8
+#define THIN_OWNER_MASK   (~0u << THIN_OWNER_SHIFT)
+#define INFLATED_INDEX(mark) ((mark) >> 2)
+#define INFLATED_MARK(index) (((uint)(index) << 2) | MARK_INFLATED)
+
+/* times a thread rereads a thin lock held by another thread before inflating it */
+#define LOCK_SPINS 64
+
+#define MONITOR_CHUNK_BITS 10
+#define MONITOR_CHUNK_SIZE (1 << MONITOR_CHUNK_BITS)
+#define MONITOR_CHUNKS 4096
+
+typedef struct _Monitor {
+    pthread_mutex_t lock; // guards the fields below
+    pthread_cond_t entry_cond; // signaled when the monitor is released
+    pthread_cond_t wait_cond; // Object.wait/notify
+    uint index;
+    uint owner; // lock thread id of the owner, 0 if free
+    uint recursions; // times the owner entered again
+    uint displaced; // the mark of an unlocked object before inflation
+    uint waiters; // threads waiting to enter or in wait()
+    uint *mark; // NULL while the monitor is free
+    struct _Monitor *free_next;
+    Class *pclass; // class of the object, or the class itself for a static synchronized method
+    long entries;
+    long contended; // entries that waited for another thread
+    long waits;
+} Monitor;
+
+/* -Xlockstat */
+int lock_stat = 0;
+
+static pthread_mutex_t monitors_lock = PTHREAD_MUTEX_INITIALIZER;
+/* the monitors do not move, so a monitor is found by its index without locking */
+static Monitor *monitor_chunks[MONITOR_CHUNKS];
+static uint monitors_count = 0;
+/* the monitors deflated or freed, taken again by newMonitor */
+static Monitor *monitors_free = NULL;
+
+static uint lock_thread_next = 0;
+/* the ids of the ended threads and virtual threads, given again by newLockThreadId */
+static pthread_mutex_t lock_ids_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint *lock_ids_free = NULL;
+static long lock_ids_free_count = 0;
+static long lock_ids_free_size = 0;
+/* its destructor gives the id back when the thread exits */
+static pthread_key_t lock_id_key;
+static pthread_once_t lock_id_once = PTHREAD_ONCE_INIT;
+static __thread uint lock_thread_id = 0;
+/* the locks the thread holds, kept by a virtual thread while it is off its carrier, see vthreads.c */
+static __thread int monitors_held = 0;
+/* a monitor the thread allocated for an inflation another thread won */
+static __thread Monitor *spare_monitor = NULL;
+
+#define monitorAt(index) (&monitor_chunks[(index) >> MONITOR_CHUNK_BITS][(index) & (MONITOR_CHUNK_SIZE - 1)])
+
+static void illegalMonitorState(const char *action)
+{
+    printf("Error: java.lang.IllegalMonitorStateException: %s of a monitor the thread does not own\n", action);
+    exit(1);
+}
+
+/**
+ * @brief newLockThreadId an id for the thin locks of a thread, one of an ended thread if any
+ */
+static uint newLockThreadId()
+{
+    uint id;
+
+    pthread_mutex_lock(&lock_ids_lock);
+    if (lock_ids_free_count > 0) {
+        id = lock_ids_free[--lock_ids_free_count];
+        pthread_mutex_unlock(&lock_ids_lock);
+        return id;
+    }
+    pthread_mutex_unlock(&lock_ids_lock);
+    id = __atomic_add_fetch(&lock_thread_next, 1, __ATOMIC_RELAXED);
+    if (id >= (1u << (32 - THIN_OWNER_SHIFT))) {
+        printf("Error: too many threads for thin locks\n");
+        exit(1);
+    }
+    return id;
+}
+
+/**
+ * @brief freeLockThreadId the thread or virtual thread has ended holding no lock, no mark names it
+ */
+static void freeLockThreadId(uint id)
+{
+    pthread_mutex_lock(&lock_ids_lock);
+    if (lock_ids_free_count == lock_ids_free_size) {
+        lock_ids_free_size = lock_ids_free_size ? lock_ids_free_size << 1 : 64;
+        lock_ids_free = (uint*)realloc(lock_ids_free, sizeof(uint) * lock_ids_free_size);
+    }
+    lock_ids_free[lock_ids_free_count++] = id;
+    pthread_mutex_unlock(&lock_ids_lock);
+}
+
+static void freeMonitor(Monitor *m);
+
+/* the thread exits, its spare monitor is freed too */
+static void lockThreadExit(void *id)
+{
+    if (NULL != spare_monitor) {
+        pthread_mutex_lock(&monitors_lock);
+        freeMonitor(spare_monitor);
+        pthread_mutex_unlock(&monitors_lock);
+        spare_monitor = NULL;
+    }
+    if (0 == monitors_held) {
+        freeLockThreadId((uint)(long)id);
+    }
+}
+
+static void createLockIdKey()
+{
+    pthread_key_create(&lock_id_key, lockThreadExit);
+}
+
+static uint __attribute__((noinline)) assignLockThreadId()
+{
+    lock_thread_id = newLockThreadId();
+    pthread_once(&lock_id_once, createLockIdKey);
+    pthread_setspecific(lock_id_key, (void*)(long)lock_thread_id);
+    return lock_thread_id;
+}
+
+/**
+ * @brief lockThreadId the id of the thread in a thin lock, given on the first lock of the thread. a virtual
+ * thread has its own, given when it starts, see vthreads.c
+ */
+static inline uint lockThreadId()
+{
+    if (0 == lock_thread_id) {
+        return assignLockThreadId();
+    }
+    return lock_thread_id;
+}
+
+static Monitor* newMonitor()
+{
+    Monitor *m;
+    uint index;
+
+    if (NULL != spare_monitor) {
+        m = spare_monitor;
+        spare_monitor = NULL;
+        return m;
+    }
+    pthread_mutex_lock(&monitors_lock);
+    if (NULL != monitors_free) {
+        m = monitors_free;
+        monitors_free = m->free_next;
+        pthread_mutex_unlock(&monitors_lock);
+        return m;
+    }
+    index = monitors_count++;
+    if (index >= MONITOR_CHUNKS * MONITOR_CHUNK_SIZE) {
+        printf("Error: too many monitors\n");
+        exit(1);
+    }
+    if (NULL == monitor_chunks[index >> MONITOR_CHUNK_BITS]) {
+        monitor_chunks[index >> MONITOR_CHUNK_BITS] = (Monitor*)calloc(MONITOR_CHUNK_SIZE, sizeof(Monitor));
+    }
+    m = monitorAt(index);
+    pthread_mutex_init(&m->lock, NULL);
+    pthread_cond_init(&m->entry_cond, NULL);
+    pthread_cond_init(&m->wait_cond, NULL);
+    m->index = index;
+    pthread_mutex_unlock(&monitors_lock);
+
+    return m;
+}
+
+/**
+ * @brief freeMonitor gives the monitor back to newMonitor, monitors_lock is held
+ */
+static void freeMonitor(Monitor *m)
+{
+    m->mark = NULL;
+    m->free_next = monitors_free;
+    monitors_free = m;
+}
+
+/**
+ * @brief inflateMonitor replaces the mark `old` by a fat monitor holding the same state
+ * @return the monitor, NULL if the mark changed meanwhile, old is then set to the new mark
+ */
+static Monitor* inflateMonitor(uint *mark, uint *old, Class *pclass)
+{
+    Monitor *m = newMonitor();
+
+    m->mark = mark;
+    m->pclass = pclass;
+    m->entries = m->contended = m->waits = 0;
+    if (MARK_THIN == (*old & MARK_LOCK_MASK)) {
+        m->owner = *old >> THIN_OWNER_SHIFT;
+        m->recursions = (*old & THIN_RECURSION_MASK) >> 2;
+        m->displaced = MARK_UNLOCKED;
+        m->entries = 1;
+    } else {
+        m->owner = 0;
+        m->recursions = 0;
+        m->displaced = *old;
+    }
+    if (__atomic_compare_exchange_n(mark, old, INFLATED_MARK(m->index), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return m;
+    }
+    m->mark = NULL;
+    spare_monitor = m;
+    return NULL;
+}
+
+static void enterInflatedMonitor(Monitor *m, uint self)
+{
+    pthread_mutex_lock(&m->lock);
+    if (m->owner == self) {
+        m->recursions++;
+    } else {
+        if (0 != m->owner) {
+            m->contended++;
+            m->waiters++;
+            // safe while blocked, but m->lock is released before waiting for a safepoint to end
+            enterNative();
+            while (0 != m->owner) {
+                pthread_cond_wait(&m->entry_cond, &m->lock);
+            }
+            m->waiters--;
+            m->owner = self;
+            m->entries++;
+            pthread_mutex_unlock(&m->lock);
+            leaveNative();
+            return;
+        }
+        m->owner = self;
+    }
+    m->entries++;
+    pthread_mutex_unlock(&m->lock);
+}
+
+/**
+ * @brief monitorEnterSlow the lock is not free: a recursive enter, a contended or an inflated lock
+ * @param old the mark seen by monitorEnter
+ */
+static void monitorEnterSlow(uint *mark, Class *pclass, uint old)
+{
+    uint self = lockThreadId();
+    Monitor *m;
+    int spins = 0;
+
+    for (;;) {
+        switch (old & MARK_LOCK_MASK) {
+        case MARK_UNLOCKED:
+            if (MARK_UNLOCKED == old) {
+                if (__atomic_compare_exchange_n(mark, &old, (self << THIN_OWNER_SHIFT) | MARK_THIN, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+                    return;
+                }
+            } else if (NULL != (m = inflateMonitor(mark, &old, pclass))) {
+                enterInflatedMonitor(m, self);
+                return;
+            }
+            break;
+        case MARK_THIN:
+            if ((old >> THIN_OWNER_SHIFT) == self) {
+                if ((old & THIN_RECURSION_MASK) != THIN_RECURSION_MASK) {
+                    if (__atomic_compare_exchange_n(mark, &old, old + THIN_RECURSION_ONE, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+                        return;
+                    }
+                } else if (NULL != (m = inflateMonitor(mark, &old, pclass))) {
+                    enterInflatedMonitor(m, self);
+                    return;
+                }
+            } else if (spins++ < LOCK_SPINS) {
+                if (0 == (spins & 7)) {
+                    sched_yield();
+                }
+                old = __atomic_load_n(mark, __ATOMIC_ACQUIRE);
+            } else if (NULL != (m = inflateMonitor(mark, &old, pclass))) {
+                enterInflatedMonitor(m, self);
+                return;
+            }
+            break;
+        default:
+            enterInflatedMonitor(monitorAt(INFLATED_INDEX(old)), self);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief monitorEnter takes the lock in the mark word, a free lock costs one compare-and-swap
+ */
+static inline void monitorEnter(uint *mark, Class *pclass)
+{
+    uint old = MARK_UNLOCKED;
+
+    monitors_held++;
+    if (__atomic_compare_exchange_n(mark, &old, (lockThreadId() << THIN_OWNER_SHIFT) | MARK_THIN, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    monitorEnterSlow(mark, pclass, old);
+}
+
+/**
+ * @brief monitorTryEnter monitorEnter without blocking, for a virtual thread that leaves its carrier instead
+ * of blocking it, see virtualThreadMonitorEnter
+ * @return 0 if another thread holds the lock
+ */
+static int monitorTryEnter(uint *mark, Class *pclass)
+{
+    uint self = lockThreadId();
+    uint old = __atomic_load_n(mark, __ATOMIC_ACQUIRE);
+    Monitor *m;
+    int spins = 0;
+
+    for (;;) {
+        switch (old & MARK_LOCK_MASK) {
+        case MARK_UNLOCKED:
+            if (MARK_UNLOCKED == old) {
+                if (__atomic_compare_exchange_n(mark, &old, (self << THIN_OWNER_SHIFT) | MARK_THIN, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+                    monitors_held++;
+                    return 1;
+                }
+            } else if (NULL != (m = inflateMonitor(mark, &old, pclass))) {
+                old = INFLATED_MARK(m->index);
+            }
+            break;
+        case MARK_THIN:
+            if ((old >> THIN_OWNER_SHIFT) == self) {
+                if ((old & THIN_RECURSION_MASK) != THIN_RECURSION_MASK) {
+                    if (__atomic_compare_exchange_n(mark, &old, old + THIN_RECURSION_ONE, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+                        monitors_held++;
+                        return 1;
+                    }
+                } else if (NULL != (m = inflateMonitor(mark, &old, pclass))) {
+                    old = INFLATED_MARK(m->index);
+                }
+            } else if (spins++ < LOCK_SPINS) {
+                old = __atomic_load_n(mark, __ATOMIC_ACQUIRE);
+            } else {
+                return 0;
+            }
+            break;
+        default:
+            // the monitors are deflated at a safepoint, not while a java thread runs
+            m = monitorAt(INFLATED_INDEX(old));
+            pthread_mutex_lock(&m->lock);
+            if (m->owner == self) {
+                m->recursions++;
+            } else if (0 == m->owner) {
+                m->owner = self;
+            } else {
+                pthread_mutex_unlock(&m->lock);
+                return 0;
+            }
+            m->entries++;
+            pthread_mutex_unlock(&m->lock);
+            monitors_held++;
+            return 1;
+        }
+    }
+}
+
+static void exitInflatedMonitor(Monitor *m, uint self)
+{
+    pthread_mutex_lock(&m->lock);
+    if (m->owner != self) {
+        illegalMonitorState("monitorexit");
+    }
+    if (m->recursions > 0) {
+        m->recursions--;
+    } else {
+        m->owner = 0;
+        pthread_cond_signal(&m->entry_cond);
+    }
+    pthread_mutex_unlock(&m->lock);
+}
+
+/**
+ * @brief monitorExit releases the lock taken by monitorEnter
+ */
+static inline void monitorExit(uint *mark)
+{
+    uint self = lockThreadId();
+    uint old = __atomic_load_n(mark, __ATOMIC_ACQUIRE);
+
+    monitors_held--;
+    for (;;) {
+        if (MARK_INFLATED == (old & MARK_LOCK_MASK)) {
+            exitInflatedMonitor(monitorAt(INFLATED_INDEX(old)), self);
+            return;
+        }
+        if (MARK_THIN != (old & MARK_LOCK_MASK) || (old >> THIN_OWNER_SHIFT) != self) {
+            illegalMonitorState("monitorexit");
+        }
+        if (__atomic_compare_exchange_n(mark, &old, (old & THIN_RECURSION_MASK) ? old - THIN_RECURSION_ONE : MARK_UNLOCKED,
+                                        0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief ownedMonitor the fat monitor of a lock the thread holds, a thin lock is inflated for wait()
+ * @return the monitor, NULL if the lock is thin and inflate is 0
+ */
+static Monitor* ownedMonitor(uint *mark, Class *pclass, int inflate, const char *action)
+{
+    uint self = lockThreadId();
+    uint old = __atomic_load_n(mark, __ATOMIC_ACQUIRE);
+    Monitor *m;
+
+    for (;;) {
+        if (MARK_INFLATED == (old & MARK_LOCK_MASK)) {
+            m = monitorAt(INFLATED_INDEX(old));
+            if (m->owner != self) {
+                illegalMonitorState(action);
+            }
+            return m;
+        }
+        if (MARK_THIN != (old & MARK_LOCK_MASK) || (old >> THIN_OWNER_SHIFT) != self) {
+            illegalMonitorState(action);
+        }
+        if (!inflate) {
+            return NULL;
+        }
+        if (NULL != (m = inflateMonitor(mark, &old, pclass))) {
+            return m;
+        }
+    }
+}
+
+/**
+ * @brief monitorWait Object.wait, millis 0 waits until notified
+ */
+void monitorWait(uint *mark, Class *pclass, long millis)
+{
+    uint self = lockThreadId();
+    Monitor *m = ownedMonitor(mark, pclass, 1, "wait");
+    uint recursions;
+    struct timespec deadline;
+
+    if (millis < 0) {
+        printf("Error: java.lang.IllegalArgumentException: timeout value is negative\n");
+        exit(1);
+    }
+    if (millis > 0) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += millis / 1000;
+        deadline.tv_nsec += (millis % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    enterNative();
+    pthread_mutex_lock(&m->lock);
+    recursions = m->recursions;
+    m->owner = 0;
+    m->recursions = 0;
+    m->waits++;
+    m->waiters++;
+    pthread_cond_signal(&m->entry_cond);
+    if (millis > 0) {
+        pthread_cond_timedwait(&m->wait_cond, &m->lock, &deadline);
+    } else {
+        pthread_cond_wait(&m->wait_cond, &m->lock);
+    }
+    while (0 != m->owner) {
+        pthread_cond_wait(&m->entry_cond, &m->lock);
+    }
+    m->waiters--;
+    m->owner = self;
+    m->recursions = recursions;
+    pthread_mutex_unlock(&m->lock);
+    leaveNative();
+}
+
+/**
+ * @brief monitorNotify Object.notify and notifyAll, nobody waits on a thin lock
+ */
+void monitorNotify(uint *mark, Class *pclass, int all)
+{
+    Monitor *m = ownedMonitor(mark, pclass, 0, "notify");
+
+    if (NULL == m) {
+        return;
+    }
+    pthread_mutex_lock(&m->lock);
+    if (all) {
+        pthread_cond_broadcast(&m->wait_cond);
+    } else {
+        pthread_cond_signal(&m->wait_cond);
+    }
+    pthread_mutex_unlock(&m->lock);
+}
+
+/**
+ * @brief enterSynchronizedMethod locks the receiver, or the class of a static method, once the
+ * arguments are in the frame. the lock is released by FUNC_RETURN
+ */
+static inline void enterSynchronizedMethod(StackFrame *stf, method_info *method)
+{
+    Object *obj;
+
+    if (0 == (method->access_flags & ACC_SYNCHRONIZED)) {
+        return;
+    }
+    if (IS_ACC_STATIC(method->access_flags)) {
+        stf->sync_mark = &method->pclass->lock_mark;
+        monitorEnter(stf->sync_mark, method->pclass);
+    } else {
+        obj = (Object*)decodeRef(*(NarrowRef*)(stf->localvars));
+        stf->sync_mark = &obj->mark;
+        monitorEnter(stf->sync_mark, obj->pclass);
+    }
+}
+
+/**
+ * @brief forgetMonitors drops the monitors of the objects and the classes of a destroyed vm before its
+ * classes are freed, -Xlockstat does not report them
+ */
+void forgetMonitors(VM *vm)
+{
+    Monitor *m;
+    uint i;
+
+    pthread_mutex_lock(&monitors_lock);
+    for (i = 0; i < monitors_count; i++) {
+        m = monitorAt(i);
+        if (NULL != m->mark && m->pclass->vm == vm) {
+            freeMonitor(m);
+        }
+    }
+    pthread_mutex_unlock(&monitors_lock);
+}
+
+/**
+ * @brief deflateMonitors frees the monitors of the dead objects and puts the mark of an unlocked object nobody
+ * waits for back in its header, called by gc.c before the sweep while the java threads are stopped: a thread
+ * reads a monitor from the mark in java code only, or waits in it counted by waiters
+ * @param is_live the object is marked
+ */
+void deflateMonitors(int (*is_live)(Object*))
+{
+    Monitor *m;
+    uint i;
+
+    pthread_mutex_lock(&monitors_lock);
+    for (i = 0; i < monitors_count; i++) {
+        m = monitorAt(i);
+        if (NULL == m->mark) {
+            continue;
+        }
+        if (m->mark != &m->pclass->lock_mark && !is_live((Object*)((char*)m->mark - offsetof(Object, mark)))) {
+            freeMonitor(m);
+            continue;
+        }
+        if (lock_stat) {
+            continue;
+        }
+        pthread_mutex_lock(&m->lock);
+        if (0 == m->owner && 0 == m->waiters) {
+            __atomic_store_n(m->mark, m->displaced, __ATOMIC_RELEASE);
+            freeMonitor(m);
+        }
+        pthread_mutex_unlock(&m->lock);
+    }
+    pthread_mutex_unlock(&monitors_lock);
+}
+
+static int compareMonitors(const void *a, const void *b)
+{
+    long d = (*(Monitor**)b)->contended - (*(Monitor**)a)->contended;
+    return d > 0 ? 1 : (d < 0 ? -1 : 0);
+}
+
+/**
+ * @brief dumpLockStat writes the inflated monitors, the most contended first
+ */
+void dumpLockStat()
+{
+    Monitor **sorted;
+    Monitor *m;
+    uint i, n = 0, count = __atomic_load_n(&monitors_count, __ATOMIC_ACQUIRE);
+
+    sorted = (Monitor**)malloc(sizeof(Monitor*) * (count + 1));
+    for (i = 0; i < count; i++) {
+        m = monitorAt(i);
+        if (NULL != m->mark) {
+            sorted[n++] = m;
+        }
+    }
+    qsort(sorted, n, sizeof(Monitor*), compareMonitors);
+
+    fprintf(stderr, "lock statistics: %u monitors inflated\n", n);
+    fprintf(stderr, "%12s %12s %10s  %s\n", "contended", "entries", "waits", "monitor");
+    for (i = 0; i < n; i++) {
+        m = sorted[i];
+        fprintf(stderr, "%12ld %12ld %10ld  %s%s@%p\n", m->contended, m->entries, m->waits,
+                m->mark == &m->pclass->lock_mark ? "class " : "", get_this_class_name(m->pclass), (void*)m->mark);
+    }
+    free(sorted);
+}
+
+/**
+ * @brief startLockStat called once the options are parsed
+ */
+void startLockStat()
+{
+    if (lock_stat) {
+        atexit(dumpLockStat);
+    }
+}
+
+#endif // MONITOR_C
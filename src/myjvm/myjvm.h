@@ -0,0 +1,48 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef MYJVM_H
+#define MYJVM_H
+
+/**
+  * the embedding api, to run several isolated vms in a process, see vm.c.
+  * the vm is built as one translation unit from jvm.c, the host compiles it as main.c does
+  */
+
+typedef struct _VM MyJVM;
+typedef struct _ClassFile MyJVMClass;
+
+/**
+ * @brief myjvm_create a new vm loading its classes from class_dir, the default directory if NULL
+ * @return NULL if class_dir is too long for the paths of the classes
+ */
+MyJVM* myjvm_create(const char *class_dir);
+
+/**
+ * @brief myjvm_load_class loads a class and its parents in the vm, the <clinit> run on the first invoke
+ * @param class_name the binary name, like test/Point
+ */
+MyJVMClass* myjvm_load_class(MyJVM *vm, const char *class_name);
+
+/**
+ * @brief myjvm_invoke runs a static method of the class in the current thread, the method is looked up
+ * in the class and then in its parents
+ * @param args the arguments as the slots of a java frame, args_len bytes
+ * @param result the int, float, long or double returned, none if the method returns void
+ * @return 0, or -1 if there is no such method, the arguments do not fit it or it returns a reference
+ */
+int myjvm_invoke(MyJVM *vm, MyJVMClass *pclass, const char *name, const char *descriptor,
+                 const int *args, int args_len, int *result);
+
+/**
+ * @brief myjvm_destroy waits for the java threads of the vm to end and frees it with its classes, its
+ * objects are left to the collector
+ */
+void myjvm_destroy(MyJVM *vm);
+
+#endif // MYJVM_H
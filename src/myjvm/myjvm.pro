@@ -3,6 +3,8 @@ CONFIG += console
 CONFIG -= app_bundle
 CONFIG -= qt
 
+LIBS += -ldl -lm -lpthread
+
 SOURCES += \
     main.c
 
@@ -15,5 +17,9 @@ HEADERS += \
     my_types.h \
     op_core.h \
     class_hash.h \
-    method_table.h
+    method_table.h \
+    threads.h \
+    deque.h \
+    vm.h \
+    myjvm.h
 
@@ -16,6 +16,9 @@
 #include "structs.h"
 #include "jvm_debug.h"
 #include "opcode.h"
+#include "heap.c"
+#include "threads.h"
+#include "vm.h"
 
 
 /** float comparison precision **/
@@ -25,7 +28,7 @@
 #define STACK_FRAME_SIZE 256
 #define SZ_INT sizeof(int)
 #define SZ_LONG (sizeof(int)<<1)
-#define SZ_REF sizeof(int*)
+#define SZ_REF sizeof(NarrowRef)
 #define SP_STEP SZ_INT
 #define SP_STEP_LONG SZ_LONG
 #define SP_STEP_DLONG (SZ_LONG<<1)
@@ -53,13 +56,14 @@
 }
 #define PUSH_STACKL(stack, v, vtype) *((vtype*)(stack->sp)) = v;\
     SP_UPL(stack);SHOW_SP(stack)
-#define PUSH_STACKR(stack, v, vtype) *((vtype*)(stack->sp)) = v;\
+/* the references are compressed on the stack, see heap.c */
+#define PUSH_STACKR(stack, v, vtype) *((NarrowRef*)(stack->sp)) = encodeRef(v);\
     SP_UP(stack);SHOW_SP(stack);
 #define PICK_STACK(stack, vtype)  (*(vtype*)(stack->sp-SP_STEP))
 #define PICK_STACKL(stack, vtype) (*(vtype*)(stack->sp-SP_STEP_LONG))
 #define PICK_STACKIL(stack, vtype) (*(vtype*)(stack->sp-SP_STEP_ILONG))
 #define PICK_STACKDL(stack, vtype) (*(vtype*)(stack->sp-SP_STEP_DLONG))
-#define PICK_STACKR(stack, vtype) (*(vtype*)(stack->sp-SP_STEP))
+#define PICK_STACKR(stack, vtype) ((vtype)decodeRef(*(NarrowRef*)(stack->sp-SP_STEP)))
 #define PICK_STACKC(stack, vtype) (*(vtype*)(stack->sp))
 #define PICK_STACKU(stack, vtype) (*(vtype*)(stack->sp+SP_STEP))
 #define PICK_STACKUL(stack, vtype) (*(vtype*)(stack->sp+SP_STEP_LONG))
@@ -73,7 +77,7 @@
     result=PICK_STACKC(stack,vtype);\
     SHOW_SP(stack)
 #define GET_STACKR(stack,result,vtype) SP_DOWN(stack);\
-    result=PICK_STACKC(stack,vtype);\
+    result=(vtype)decodeRef(PICK_STACKC(stack,NarrowRef));\
     SHOW_SP(stack)
 
 #define STACK_EMPTY(stack) (stack->sp == stack->sp_base)
@@ -85,37 +89,45 @@
 #define GET_LOCAL(stack,vindex,vtype) *((vtype*)(stack->localvars + GET_LV_OFFSET(vindex)))
 
 /** object field manipulation **/
-#define GET_FIELD_OFFSET(index) ((index) << 2)
-#define GET_FIELD_ADDR(index) (obj->fields + GET_FIELD_OFFSET(findex))
-#define GET_FIELD(obj, findex, ftype) *((ftype*)(obj->fields + GET_FIELD_OFFSET(findex)))
-#define PUT_FIELD(obj, findex, fvalue, ftype) *((ftype*)(obj->fields + GET_FIELD_OFFSET(findex)))=fvalue
+/* the fields are addressed by their byte offset from the object, the offset of an instance field
+ * is set when its class is linked (see linkClassFields) */
+#define GET_FIELD_ADDR(obj, findex) ((char*)(obj) + (findex))
+#define GET_FIELD(obj, findex, ftype) *((ftype*)GET_FIELD_ADDR(obj, findex))
+#define PUT_FIELD(obj, findex, fvalue, ftype) *((ftype*)GET_FIELD_ADDR(obj, findex))=fvalue
 
 #define OP_GET_FIELDI(obj, findex, ftype) PUSH_STACK(env->current_stack, GET_FIELD(obj, findex, ftype), int)
 #define OP_GET_FIELDF(obj, findex, ftype) PUSH_STACK(env->current_stack, GET_FIELD(obj, findex, ftype), float)
 #define OP_GET_FIELDL(obj, findex, ftype) PUSH_STACKL(env->current_stack, GET_FIELD(obj, findex, ftype), ftype)
-#define OP_GET_FIELDR(obj, findex, ftype) PUSH_STACK(env->current_stack, GET_FIELD(obj, findex, ftype), Reference)
-
-#define OP_PUT_FIELDI(obj, findex, ftype) obj=PICK_STACKL(env->current_stack, Reference);\
+/* a reference field holds a NarrowRef, it is moved between the field and the stack as it is */
+#define OP_GET_FIELDR(obj, findex, ftype) PUSH_STACK(env->current_stack, GET_FIELD(obj, findex, NarrowRef), NarrowRef)
+#define GET_FIELD_REF(obj, findex, ftype) ((ftype)decodeRef(GET_FIELD(obj, findex, NarrowRef)))
+/* the value is computed before the barrier, computing it may allocate and start the concurrent marking */
+#define PUT_FIELD_REF(obj, findex, fvalue) {NarrowRef _ref = encodeRef(fvalue);\
+    GC_PRE_WRITE_BARRIER(GET_FIELD_ADDR(obj, findex));\
+    GC_STORE_REF(GET_FIELD_ADDR(obj, findex), _ref);}
+
+#define OP_PUT_FIELDI(obj, findex, ftype) obj=(Reference)decodeRef(PICK_STACKL(env->current_stack, NarrowRef));\
     SP_DOWNL(env->current_stack);\
     PUT_FIELD(obj, findex, PICK_STACKU(env->current_stack, ftype), int)
 
-#define OP_PUT_FIELDF(obj, findex, ftype) obj=PICK_STACKL(env->current_stack, Reference);\
+#define OP_PUT_FIELDF(obj, findex, ftype) obj=(Reference)decodeRef(PICK_STACKL(env->current_stack, NarrowRef));\
     SP_DOWNL(env->current_stack);\
     PUT_FIELD(obj, findex, PICK_STACKU(env->current_stack, ftype), float)
 
-#define OP_PUT_FIELDL(obj, findex, ftype) obj=PICK_STACKIL(env->current_stack, Reference);\
+#define OP_PUT_FIELDL(obj, findex, ftype) obj=(Reference)decodeRef(PICK_STACKIL(env->current_stack, NarrowRef));\
     SP_DOWNIL(env->current_stack);\
     PUT_FIELD(obj, findex, PICK_STACKU(env->current_stack, ftype), ftype)
 
-#define OP_PUT_FIELDR(obj, findex, ftype) obj=PICK_STACKL(env->current_stack, Reference);\
+#define OP_PUT_FIELDR(obj, findex, ftype) obj=(Reference)decodeRef(PICK_STACKL(env->current_stack, NarrowRef));\
     SP_DOWNL(env->current_stack);\
-    PUT_FIELD(obj, findex, PICK_STACKU(env->current_stack, ftype), Reference)
+    GC_PRE_WRITE_BARRIER(GET_FIELD_ADDR(obj, findex));\
+    GC_STORE_REF(GET_FIELD_ADDR(obj, findex), PICK_STACKU(env->current_stack, NarrowRef))
 
 #define GET_STATIC_FIELD(pclass, findex, ftype) *(ftype*)(pclass->static_fields+(findex<<2))
 #define OP_GET_STATIC_FIELDI(pclass, findex, ftype) PUSH_STACK(env->current_stack, GET_STATIC_FIELD(pclass, findex, ftype), int);
 #define OP_GET_STATIC_FIELDF(pclass, findex, ftype) PUSH_STACK(env->current_stack, GET_STATIC_FIELD(pclass, findex, ftype), float);
 #define OP_GET_STATIC_FIELDL(pclass, findex, ftype) PUSH_STACKL(env->current_stack, GET_STATIC_FIELD(pclass, findex, ftype), ftype);
-#define OP_GET_STATIC_FIELDR(pclass, findex, ftype) PUSH_STACK(env->current_stack, GET_STATIC_FIELD(pclass, findex, ftype), ftype);
+#define OP_GET_STATIC_FIELDR(pclass, findex, ftype) PUSH_STACK(env->current_stack, GET_STATIC_FIELD(pclass, findex, NarrowRef), NarrowRef);
 
 #define PUT_STATIC_FIELD(pclass, findex, fvalue, ftype) *(ftype*)(pclass->static_fields+(findex<<2))=fvalue
 #define OP_PUT_STATIC_FIELDI(pclass, findex, ftype) PUT_STATIC_FIELD(pclass, findex, PICK_STACK(env->current_stack, ftype), ftype);\
@@ -124,7 +136,8 @@
     SP_DOWN(env->current_stack)
 #define OP_PUT_STATIC_FIELDL(pclass, findex, ftype) PUT_STATIC_FIELD(pclass, findex, PICK_STACKL(env->current_stack, ftype), ftype);\
     SP_DOWNL(env->current_stack)
-#define OP_PUT_STATIC_FIELDR(pclass, findex, ftype) PUT_STATIC_FIELD(pclass, findex, PICK_STACK(env->current_stack, ftype), ftype);\
+#define OP_PUT_STATIC_FIELDR(pclass, findex, ftype) GC_PRE_WRITE_BARRIER(pclass->static_fields+(findex<<2));\
+    GC_STORE_REF(pclass->static_fields+(findex<<2), PICK_STACK(env->current_stack, NarrowRef));\
     SP_DOWN(env->current_stack)
 
 
@@ -132,7 +145,7 @@
 /** 1. xload **/
 #define XLOAD(env, index, xtype) PUSH_STACK(env->current_stack, GET_LOCAL(env->current_stack, index, xtype), xtype)
 #define XLOADL(env, index, xtype) PUSH_STACKL(env->current_stack, GET_LOCAL(env->current_stack, index, xtype), xtype)
-#define XLOADR(env, index, xtype) PUSH_STACKR(env->current_stack, GET_LOCAL(env->current_stack, index, xtype), xtype)
+#define XLOADR(env, index, xtype) PUSH_STACK(env->current_stack, GET_LOCAL(env->current_stack, index, NarrowRef), NarrowRef)
 
 #define ILOAD(env, index) XLOAD(env, index, int);\
     DEBUG_SET_SP_TYPE(env->dbg, debug_type_i);\
@@ -171,7 +184,7 @@
     debug("DSTORE: index=%d, value=%lf", index, GET_LOCAL(env->current_stack, index, double));\
     DEBUG_SET_LV_TYPE(env->dbg, index, debug_type_d);\
     DEBUG_SP_DOWN(env->dbg)
-#define ASTORE(env, index) XSTORE(env, index, Reference);\
+#define ASTORE(env, index) XSTORE(env, index, NarrowRef);\
     DEBUG_SET_LV_TYPE(env->dbg, index, debug_type_r);\
     DEBUG_SP_DOWN(env->dbg)
 
@@ -180,6 +193,7 @@
     CArray_##xtype *arr_ref;\
     GET_STACK(env->current_stack, index, int);\
     GET_STACKR(env->current_stack, arr_ref, CArray_##xtype*);\
+    CHECK_ARRAY_INDEX(arr_ref, index);\
     PUSH_STACK(env->current_stack, ARRAY_INDEX(arr_ref,index), xtype);\
     DEBUG_SP_DOWNL(env->dbg);\
     DEBUG_SET_SP_TYPE(env->dbg, debug_type_r);}
@@ -187,6 +201,7 @@
     CArray_##xtype *arr_ref;\
     GET_STACK(env->current_stack, index, int);\
     GET_STACKR(env->current_stack, arr_ref, CArray_##xtype*);\
+    CHECK_ARRAY_INDEX(arr_ref, index);\
     debug("XALOADI arr_ref=%p, index=%d", arr_ref, index);\
     PUSH_STACK(env->current_stack, ARRAY_INDEX(arr_ref,index), int);\
     DEBUG_SP_DOWNL(env->dbg);\
@@ -196,6 +211,7 @@
     CArray_##xtype *arr_ref;\
     GET_STACK(env->current_stack, index, int);\
     GET_STACKR(env->current_stack, arr_ref, CArray_##xtype*);\
+    CHECK_ARRAY_INDEX(arr_ref, index);\
     PUSH_STACKL(env->current_stack, ARRAY_INDEX(arr_ref,index), xtype);\
     DEBUG_SP_DOWNL(env->dbg);\
     DEBUG_SET_SP_TYPE(env->dbg, debug_type_r);}
@@ -206,17 +222,30 @@
     CArray_##xtype *arr_ref;\
     GET_STACK(env->current_stack, v, xtype);\
     GET_STACK(env->current_stack, index, int);\
-    GET_STACK(env->current_stack, arr_ref, CArray_##xtype*);\
+    GET_STACKR(env->current_stack, arr_ref, CArray_##xtype*);\
+    CHECK_ARRAY_INDEX(arr_ref, index);\
     ARRAY_INDEX(arr_ref,index) = v;\
     DEBUG_SP_DOWNT(env->dbg);}
 
+#define AASTORE(env) {NarrowRef v;\
+    int index;\
+    CArray_NarrowRef *arr_ref;\
+    GET_STACK(env->current_stack, v, NarrowRef);\
+    GET_STACK(env->current_stack, index, int);\
+    GET_STACKR(env->current_stack, arr_ref, CArray_NarrowRef*);\
+    CHECK_ARRAY_INDEX(arr_ref, index);\
+    GC_PRE_WRITE_BARRIER(&ARRAY_INDEX(arr_ref,index));\
+    GC_STORE_REF(&ARRAY_INDEX(arr_ref,index), v);\
+    DEBUG_SP_DOWNT(env->dbg);}
+
 #define IASTORE(env, xtype) {xtype v;\
     int index;\
     CArray_##xtype *arr_ref;\
     GET_STACK(env->current_stack, v, xtype);\
     GET_STACK(env->current_stack, index, int);\
-    GET_STACK(env->current_stack, arr_ref, CArray_int*);\
-    debug("arr_ref=%p,*arr_ref=%p, index=%d, v=%d", arr_ref, *arr_ref, index, v);\
+    GET_STACKR(env->current_stack, arr_ref, CArray_int*);\
+    debug("arr_ref=%p, index=%d, v=%d", arr_ref, index, v);\
+    CHECK_ARRAY_INDEX(arr_ref, index);\
     ARRAY_INDEX(arr_ref,index) = v;\
     DEBUG_SP_DOWNT(env->dbg);}
 
@@ -226,6 +255,7 @@
     GET_STACK(env->current_stack, v, xtype);\
     GET_STACK(env->current_stack, index, int);\
     GET_STACKR(env->current_stack, arr_ref, CArray_##xtype*);\
+    CHECK_ARRAY_INDEX(arr_ref, index);\
     ARRAY_INDEX(arr_ref,index) = v;\
     debug("CASTORE index=%d,c=%c, ->%c", index, v, ARRAY_INDEX(arr_ref, index));\
     DEBUG_SP_DOWNT(env->dbg);}
@@ -236,6 +266,7 @@
     GET_STACKL(env->current_stack, v, xtype);\
     GET_STACK(env->current_stack, index, int);\
     GET_STACKR(env->current_stack, arr_ref, CArray_##xtype*);\
+    CHECK_ARRAY_INDEX(arr_ref, index);\
     ARRAY_INDEX(arr_ref,index) = v;\
     DEBUG_SP_DOWNT(env->dbg);}
 
@@ -312,12 +343,12 @@
 #define LNEG(env) XNEGL(env, long)
 #define DNEG(env) XNEGL(env, double)
 
-#define IAND(env) XOP(env, int, &&)
-#define IOR(env)  XOP(env, int, ||)
+#define IAND(env) XOP(env, int, &)
+#define IOR(env)  XOP(env, int, |)
 #define IXOR(env) XOP(env, int, ^)
 
-#define LAND(env) XOPL(env, long, &&)
-#define LOR(env)  XOPL(env, long, ||)
+#define LAND(env) XOPL(env, long, &)
+#define LOR(env)  XOPL(env, long, |)
 #define LXOR(env) XOPL(env, long, ^)
 
 #define IINC(env) GET_LOCAL(env->current_stack, TO_CHAR(env->pc), int)+=(TO_BYTE(env->pc+1));\
@@ -391,11 +422,15 @@
 #define D2F(env) type1l_2_type2i(env, double, float);\
     DEBUG_CAST_SP_TYPE(env->dbg, debug_type_f)
 
-#define I2B(env) type1i_2_type2i(env, int, char);\
+/* the narrowed value is pushed back as an int, sign extended, zero extended for a char */
+#define type1i_narrow(env, type2) SP_DOWN(env->current_stack);\
+    PUSH_STACK(env->current_stack, (int)(type2)(PICK_STACKC(env->current_stack, int)), int)
+
+#define I2B(env) type1i_narrow(env, signed char);\
     DEBUG_CAST_SP_TYPE(env->dbg, debug_type_c)
-#define I2C(env) type1i_2_type2i(env, int, char);\
+#define I2C(env) type1i_narrow(env, ushort);\
     DEBUG_CAST_SP_TYPE(env->dbg, debug_type_c)
-#define I2S(env) type1i_2_type2i(env, int, short);\
+#define I2S(env) type1i_narrow(env, short);\
     DEBUG_CAST_SP_TYPE(env->dbg, debug_type_s)
 
 /** 7. comparisons **/
@@ -450,6 +485,7 @@
     if (v OP 0) {\
         offset = TO_SHORT(env->pc);\
         env->pc+=(offset-1);\
+        SAFEPOINT_BACKEDGE(env, offset);\
     } else {\
         INC2_PC(env->pc);\
     }
@@ -470,6 +506,7 @@
     if (v1 OP v2) {\
         offset = TO_SHORT(env->pc);\
         env->pc+=(offset-1);\
+        SAFEPOINT_BACKEDGE(env, offset);\
         debug("goto %d", env->pc-env->pc_start);;\
         system("pause");\
     } else {\
@@ -493,6 +530,7 @@
     if (ref1 OP ref2) {\
         offset = TO_SHORT(env->pc);\
         env->pc+=(offset-1);\
+        SAFEPOINT_BACKEDGE(env, offset);\
     } else {\
         INC2_PC(env->pc);\
     }
@@ -501,34 +539,52 @@
 #define ACMPNE(env) ACMPXEQ(env, !=)
 
 /** 9. control **/
+void waitJavaThreads();
+static inline void monitorExit(uint *mark);
+
 #define FUNC_RETURN(env) StackFrame* stf = env->current_stack;\
+    if (NULL != stf->sync_mark) {\
+        monitorExit(stf->sync_mark);\
+    }\
     env->current_stack = stf->prev;\
     env->pc = stf->last_pc;\
     env->pc_end = stf->last_pc_end;\
     env->pc_start = stf->last_pc_start;\
     env->current_class = stf->last_class;\
     debug("back: stack=%p, sp=%p, pc=%p", stf, stf->sp, env->pc);\
-    free(stf);\
+    if (stf != env->leaf_frame) {\
+        free(stf);\
+    }\
     env->call_depth--;\
     if (env->current_stack == NULL) {\
         debug("END:%p", env->current_stack);\
-        if (env->is_clinit) {\
+        if (env->is_clinit || env->is_thread) {\
             return ;\
         } else { \
+            waitJavaThreads();\
             exit(0);\
         }\
     }
 
 /** End of operations **/
 
+/**
+ * header of an object, the fields follow it in the same block of memory
+ */
 typedef struct _Object {
     Class* pclass;
-    int length;
-    char* fields;
+    uint mark; // identity hash, lock and gc bits
 } Object;
 
+#define OBJECT_HEADER_SIZE sizeof(Object)
+
 typedef Object* Reference;
 
+/* the reference map of a class, one bit per reference sized word of an object */
+#define REF_MAP_WORDS(size) (((size) / sizeof(NarrowRef) + 31) >> 5)
+#define SET_REF_FIELD(pclass, offset) (pclass)->ref_map[((offset) / sizeof(NarrowRef)) >> 5] |= 1u << (((offset) / sizeof(NarrowRef)) & 31)
+#define IS_REF_FIELD(pclass, offset) (((pclass)->ref_map[((offset) / sizeof(NarrowRef)) >> 5] >> (((offset) / sizeof(NarrowRef)) & 31)) & 1)
+
 typedef uchar* PC;
 typedef struct _StackFrame {
     struct _StackFrame *prev;
@@ -543,6 +599,8 @@ typedef struct _StackFrame {
     char* sp;
     char* sp_base;
     char* sp_max;
+    PC code; // the code run by the frame, see newStackFrame
+    uint *sync_mark; // the lock held by a synchronized method, released by FUNC_RETURN, see monitor.c
 } StackFrame;
 
 typedef struct _OPENV {
@@ -556,6 +614,9 @@ typedef struct _OPENV {
     DebugType* dbg;
     int call_depth;
     int is_clinit;
+    StackFrame *leaf_frame; // reused by every call of a leaf method, see enterLeafFrame
+    int is_thread; // runs the run() of a started java.lang.Thread, see threads.c
+    struct _OPENV *outer; // the env that runs a <clinit> in this one, see runClinitMethod
 } OPENV;
 
 typedef void Opreturn;
@@ -569,11 +630,13 @@ typedef struct _Instruction {
 typedef char boolean;
 typedef char byte;
 
+/* an array is a header and the elements right after it, in one block of the heap */
 #define DEF_CARRAY(xtype) typedef struct _CArray_##xtype {\
     int length;\
     int atype;\
     int dimensions;\
-    xtype* elements;\
+    int padding;\
+    xtype elements[];\
 } CArray_##xtype
 
 
@@ -587,100 +650,78 @@ DEF_CARRAY(int);
 DEF_CARRAY(float);
 DEF_CARRAY(long);
 DEF_CARRAY(double);
-DEF_CARRAY(Reference);
+DEF_CARRAY(NarrowRef);
 
+/* the arrays of references and of arrays hold compressed references */
+typedef CArray_NarrowRef CArray_Reference;
 typedef CArray_int* ArrayRef;
-DEF_CARRAY(ArrayRef);
+typedef CArray_NarrowRef CArray_ArrayRef;
 
 #define ARRAY_INDEX(arr,index) (arr->elements[index])
 #define ARRAY_LENGTH(arr) ((arr)->length)
 #define OP_ARRAY_LENGTH(env) {ArrayRef arr_ref;\
-    GET_STACK(env->current_stack, arr_ref, ArrayRef);\
+    GET_STACKR(env->current_stack, arr_ref, ArrayRef);\
     PUSH_STACK(env->current_stack, ARRAY_LENGTH(arr_ref), int);}
-#define CHECK_ARRAY_INDEX(arr, index) if(index<0 || index>=ARRAY_LENGTH(arr)) {\
-    printf("Invalid array index: %d\n", index);\
+/* one unsigned compare catches the negative index too, the branch is hinted as not taken */
+#define CHECK_ARRAY_INDEX(arr, index) if(__builtin_expect((uint)(index) >= (uint)ARRAY_LENGTH(arr), 0)) {\
+    printf("Error: java.lang.ArrayIndexOutOfBoundsException: %d, length=%d\n", index, ARRAY_LENGTH(arr));\
     exit(1);\
     }
 
-//typedef struct _CArray_ArrayRef {\
-//    int length;\
-//    int atype;\
-//    int dimensions;\
-//    struct _CArray_ArrayRef* elements;\
-//} CArray_ArrayRef;
+/* the elements are aligned to 16 bytes for SSE, those of a large array to 32 bytes for AVX */
+#define ARRAY_HEADER_SIZE sizeof(CArray_int)
+#define ARRAY_ALIGN 16
+#define ARRAY_ALIGN_LARGE 32
+#define ARRAY_LARGE_SIZE 256
+#define ARRAY_BLOCK_SIZE(length, esize) ALIGN_UP(ARRAY_HEADER_SIZE + (size_t)(length) * (esize), ARRAY_ALIGN)
+
+/**
+ * @brief allocArray allocates an array of length elements of esize bytes, the elements are zeroed
+ */
+void* allocArray(int length, int esize)
+{
+    size_t size = (size_t)length * esize;
+    return heapAllocArray(ARRAY_HEADER_SIZE + size, size >= ARRAY_LARGE_SIZE ? ARRAY_ALIGN_LARGE : ARRAY_ALIGN, ARRAY_HEADER_SIZE);
+}
 
 #define NEW_CARRAY(xtype) CArray_##xtype* newCArray_##xtype(int length, int atype, int dimensions){\
-    CArray_##xtype* arr_ref = (CArray_##xtype*)malloc(sizeof(CArray_##xtype) + sizeof(xtype)*length);\
+    CArray_##xtype* arr_ref = (CArray_##xtype*)allocArray(length, sizeof(xtype));\
     arr_ref->length = length;\
     arr_ref->atype  = atype;\
     arr_ref->dimensions = dimensions;\
-    arr_ref->elements = (xtype*)(arr_ref+1);\
     return arr_ref;\
 }
 
 NEW_CARRAY(boolean)
 NEW_CARRAY(byte)
-//NEW_CARRAY(char)
+NEW_CARRAY(char)
 NEW_CARRAY(ushort)
 NEW_CARRAY(short)
 NEW_CARRAY(int)
 NEW_CARRAY(float)
 NEW_CARRAY(long)
 NEW_CARRAY(double)
-NEW_CARRAY(Reference)
+NEW_CARRAY(NarrowRef)
 
 extern Class* systemLoadClass(CONSTANT_Utf8_info* class_utf8_info);
 extern Class* systemLoadClassRecursive(OPENV *env, CONSTANT_Utf8_info* class_utf8_info);
 void printCurrentEnv(OPENV*, const char*);
 
-CArray_char* newCArray_char(int length, int atype, int dimensions)
-{
-    CArray_char* arr_ref = (CArray_char*)malloc(sizeof(CArray_char));
-    arr_ref->length = length;
-    arr_ref->atype = atype;
-    arr_ref->dimensions = dimensions;
-    arr_ref->elements = (char*)malloc(sizeof(char)*length);
-    return arr_ref;
-}
-
-CArray_char* newCArray_char_fromConstStr(Class *pclass, int string_info_index)
-{
-    cp_info cp = pclass->constant_pool;
-    CONSTANT_String_info* str_info = (CONSTANT_String_info*)(cp[string_info_index]);
-    CONSTANT_Utf8_info * utf8_info = (CONSTANT_Utf8_info*)(cp[str_info->string_index]);
-    CArray_char* arr_ref = (CArray_char*)malloc(sizeof(CArray_char));
-    arr_ref->dimensions = 1;
-    arr_ref->atype = 5;
-    arr_ref->length = utf8_info->length;
-    arr_ref->elements = utf8_info->bytes;
-
-    return arr_ref;
-}
-
 extern Class* loadClass(const char*);
 
-Object* newConstString(OPENV *env, CArray_char* char_arr)
-{
-    const char* string_class = "java/lang/String.class";
-    CONSTANT_Utf8_info *utf8_info =(CONSTANT_Utf8_info*)malloc(sizeof(CONSTANT_Utf8_info));
-    int total_size = 4;
-    Object *obj;
-    obj = (Object*)malloc(sizeof(Object) + ((total_size+1)<<2));
+void linkClassFields(OPENV *env, Class *pclass);
+Object* allocObject(Class *pclass);
+field_info* findInstanceField(Class *pclass, const char *name);
 
-    PUSH_STACKR(env->current_stack, obj, Reference);
+/* offset of String.value, a byte[] of Latin-1 chars or a char[] of UTF-16 chars, see strings.c */
+int string_value_offset = OBJECT_HEADER_SIZE;
+#define STRING_VALUE(obj) GET_FIELD_REF(obj, string_value_offset, CArray_char*)
 
-    obj->fields = (char*)(obj+1);
-    utf8_info->bytes = "java/lang/String";
-    utf8_info->length = strlen(utf8_info->bytes);
-    utf8_info->tag = CONSTANT_Utf8;
-    obj->pclass = systemLoadClassRecursive(env, utf8_info);
+#include "strings.c"
+#include "string_pool.c"
 
-    obj->length = (total_size+1) << 2;
-    PUT_FIELD(obj, 0, char_arr, CArray_char*);
-    PUT_FIELD(obj, 1, 0, int);
-
-    return obj;
-}
+/* atype of the arrays of references, the primitive atypes are those of newarray: 4..11 */
+#define ATYPE_REFERENCE 12
 
 typedef void* (*ArrayConstructor)(int,int,int);
 
@@ -705,69 +746,39 @@ void* generalNewArray(int arr_type, int length)
         printf("Illegal array type: %d\n", arr_type);
         exit(1);
     }
-    if (length<=0) {
-        printf("Illegal array length: %d\n", length);
+    if (length<0) {
+        printf("Error: java.lang.NegativeArraySizeException: %d\n", length);
         exit(1);
     }
     arr_con = array_constructors[arr_type];
     return arr_con(length, arr_type, 1);
 }
 
-#define MULTI_ANEWARRAY_CALLBACK(xtype) void multianewarray_callback_##xtype(CArray_ArrayRef *sub_arr, CArray_ArrayRef **p, int ele_num, int last_dimension, int atype) {\
-        CArray_##xtype* xtype##_arr;\
-        int i;\
-        xtype##_arr = *(CArray_##xtype**)(&sub_arr);\
-        for(i=0; i<ele_num; i++) {\
-            xtype##_arr->length = last_dimension;\
-            xtype##_arr->elements = p;\
-            xtype##_arr->dimensions = 1;\
-            xtype##_arr->atype = atype;\
-            p += last_dimension;\
-            xtype##_arr++;\
-        }\
-    }
+/* element size by atype, the atypes of newarray are 4..11, ATYPE_REFERENCE is 12 */
+static const int atype_element_sizes[13] = {0, 0, 0, 0, 1, 2, 4, 8, 1, 2, 4, 8, sizeof(NarrowRef)};
 
-MULTI_ANEWARRAY_CALLBACK(boolean)
-MULTI_ANEWARRAY_CALLBACK(byte)
-MULTI_ANEWARRAY_CALLBACK(char)
-MULTI_ANEWARRAY_CALLBACK(ushort)
-MULTI_ANEWARRAY_CALLBACK(short)
-MULTI_ANEWARRAY_CALLBACK(int)
-MULTI_ANEWARRAY_CALLBACK(float)
-MULTI_ANEWARRAY_CALLBACK(long)
-MULTI_ANEWARRAY_CALLBACK(double)
-
-void multianewarray_callback_Reference(CArray_ArrayRef *sub_arr, CArray_ArrayRef **p, int ele_num, int last_dimension, int atype) {
-    CArray_Reference* Reference_arr;
-    int i,j;
-    Reference_arr = *(CArray_Reference**)(&sub_arr);
-    for(i=0; i<ele_num; i++) {
-        Reference_arr->length = last_dimension;
-        Reference_arr->elements = p;
-        Reference_arr->atype = atype;
-        p += last_dimension;
-        Reference_arr++;
+/**
+ * @brief descriptorAtype atype of the elements of an array by the element type of its descriptor
+ */
+int descriptorAtype(char ftype)
+{
+    switch (ftype) {
+        case 'Z': return 4;
+        case 'C': return 5;
+        case 'F': return 6;
+        case 'D': return 7;
+        case 'B': return 8;
+        case 'S': return 9;
+        case 'I': return 10;
+        case 'J': return 11;
+        case 'L': return ATYPE_REFERENCE;
+        default:
+            printf("Illegal array element type: %c\n", ftype);
+            exit(1);
     }
 }
 
-typedef void (*multianewarray_callback_func)(CArray_ArrayRef*, CArray_ArrayRef**, int, int, int);
-typedef struct _multianewarray_callback {
-    int ele_size;
-    multianewarray_callback_func callback;
-} MultiAnewArrayCallback;
-
-MultiAnewArrayCallback mAnewCallaback[10] = {
-  {sizeof(boolean), multianewarray_callback_boolean}, // 0
-  {sizeof(byte), multianewarray_callback_byte},       // 1
-  {sizeof(char), multianewarray_callback_char},       // 2
-  {sizeof(ushort), multianewarray_callback_ushort},   // 3
-  {sizeof(short), multianewarray_callback_short},     // 4
-  {sizeof(int), multianewarray_callback_int},         // 5
-  {sizeof(float), multianewarray_callback_float},     // 6
-  {sizeof(long), multianewarray_callback_long},       // 7
-  {sizeof(double), multianewarray_callback_double},   // 8
-  {sizeof(Reference), multianewarray_callback_Reference} // 9
-};
+void scalarReplace(Code_attribute *code_attr);
 
 /**
  * @brief newStackFrame create a new stack frame to invoke a method
@@ -777,8 +788,18 @@ MultiAnewArrayCallback mAnewCallaback[10] = {
  */
 StackFrame* newStackFrame(StackFrame* current_frame, Code_attribute *code_attr)
 {
-    size_t total_size = sizeof(StackFrame) + ((code_attr->max_locals + code_attr->max_stack + 4) << 2);
-    StackFrame* stf = (StackFrame*)malloc(total_size);
+    size_t total_size;
+    StackFrame* stf;
+    PC code;
+
+    // the code is rewritten before total_size, the field locals of a scalar replaced object enlarge the frame
+    if (NULL != code_attr->escape && NULL != code_attr->escape->candidates) {
+        scalarReplace(code_attr);
+    }
+    // the code is read first: if another thread rewrites it meanwhile, the frame only gets more locals than it uses
+    code = __atomic_load_n(&code_attr->code, __ATOMIC_ACQUIRE);
+    total_size = sizeof(StackFrame) + ((code_attr->max_locals + code_attr->max_stack + 4) << 2);
+    stf = (StackFrame*)malloc(total_size);
     memset(stf, 0, total_size);
 
     stf->prev = current_frame;
@@ -787,6 +808,38 @@ StackFrame* newStackFrame(StackFrame* current_frame, Code_attribute *code_attr)
     stf->sp = stf->localvars + ((code_attr->max_locals+1) << 2);
     stf->sp_base = stf->sp;
     stf->sp_max = (char*)stf + total_size;
+    stf->code = code;
+
+    return stf;
+}
+
+/* size of the leaf frame, the leaf methods with a larger frame are called as usual */
+#define LEAF_FRAME_SIZE 1024
+/* code length of a small method */
+#define LEAF_CODE_LENGTH 128
+
+/**
+ * @brief enterLeafFrame sets up the leaf frame of the env to invoke a leaf method. a leaf method
+ * invokes no other method, so one frame per env is enough and no memory is allocated
+ * @param env
+ * @param code_attr code attribute of the leaf method
+ * @return
+ */
+StackFrame* enterLeafFrame(OPENV *env, Code_attribute *code_attr)
+{
+    StackFrame* stf = env->leaf_frame;
+
+    if (NULL == stf) {
+        stf = env->leaf_frame = (StackFrame*)malloc(LEAF_FRAME_SIZE);
+    }
+
+    stf->prev = env->current_stack;
+    stf->local_vars_count = code_attr->max_locals;
+    stf->localvars = (char*)(stf + 1);
+    stf->sp = stf->localvars + ((code_attr->max_locals+1) << 2);
+    stf->sp_base = stf->sp;
+    stf->sp_max = (char*)stf + code_attr->frame_size;
+    stf->sync_mark = NULL; // a synchronized method is never a leaf
 
     return stf;
 }
@@ -812,77 +865,195 @@ StackFrame* newTestStackFrame(StackFrame* current_frame, int max_locals, int max
     return stf;
 }
 
-int getClassFieldsSize(Class *pclass) {
-    int i=0;
-    if (pclass->parent_fields_size >= 0) {
-        return pclass->parent_fields_size + pclass->fields_size;
-    } else if (pclass->parent_class == NULL) {
-        pclass->parent_fields_size = 0;
-        printf("top: parent_fields_size=%d, fields_size=%d\n", 0, pclass->fields_size);
-        return pclass->fields_size;
-    } else {
-        pclass->parent_fields_size = getClassFieldsSize(pclass->parent_class);
-        for(i=0; i<pclass->fields_count; i++) {
-            if (NOT_ACC_STATIC((pclass->fields[i])->access_flags)) {
-                (pclass->fields[i])->findex += pclass->parent_fields_size;
-            }
-        }
-        printf("parent_fields_size=%d, fields_size=%d\n", pclass->parent_fields_size, pclass->fields_size);
-
-        return pclass->parent_fields_size + pclass->fields_size;
-    }
-}
-
 void displayThisClassFieldIndex(Class *pclass);
 method_info* findClinitMethod(Class *pclass);
 void runClinitMethod(OPENV *env, Class *clinit_class, method_info* method);
+void initializeClass(OPENV *env, Class *pclass);
+void runUntilReturn(OPENV *env, const int *stop);
 
 #define get_utf8(pool) ((CONSTANT_Utf8_info*)(pool))->bytes
 #define get_this_class_name(pclass) get_utf8(pclass->constant_pool[((CONSTANT_Class_info*)(pclass->constant_pool[pclass->this_class]))->name_index])
 #define get_super_class_name(pclass) get_utf8(pclass->constant_pool[((CONSTANT_Class_info*)(pclass->constant_pool[pclass->super_class]))->name_index])
 
+#include "safepoint.c"
+#include "alloc_profile.c"
+#include "monitor.c"
+#include "gc.c"
+
 /**
- * @brief newObject implements the `new` instruction
+ * @brief fieldSize size of a field in an object, by the first char of its descriptor
+ */
+static int fieldSize(char ftype)
+{
+    switch (ftype) {
+        case 'J':
+        case 'D': return 8;
+        case 'L':
+        case '[': return sizeof(NarrowRef);
+        case 'I':
+        case 'F': return 4;
+        case 'C':
+        case 'S': return 2;
+        default: return 1;
+    }
+}
+
+/**
+ * @brief addFieldHole remembers the bytes [offset, offset+size) left unused by the alignment of a field,
+ * the holes are filled by the smaller fields of the class and its subclasses. a hole is lost if the list is full
+ */
+static void addFieldHole(Class *pclass, int offset, int size)
+{
+    if (size > 0 && pclass->field_hole_count < MAX_FIELD_HOLES) {
+        pclass->field_holes[pclass->field_hole_count].offset = offset;
+        pclass->field_holes[pclass->field_hole_count].size = size;
+        pclass->field_hole_count++;
+    }
+}
+
+/**
+ * @brief takeFieldHole finds a hole for a field of fsize bytes, naturally aligned
+ * @return the offset of the field, -1 if no hole fits
+ */
+static int takeFieldHole(Class *pclass, int fsize)
+{
+    int i, offset, end;
+    FieldHole hole;
+
+    for (i = 0; i < pclass->field_hole_count; i++) {
+        hole = pclass->field_holes[i];
+        offset = ALIGN_UP(hole.offset, fsize);
+        end = hole.offset + hole.size;
+        if (offset + fsize <= end) {
+            pclass->field_holes[i] = pclass->field_holes[--pclass->field_hole_count];
+            addFieldHole(pclass, hole.offset, offset - hole.offset);
+            addFieldHole(pclass, offset + fsize, end - offset - fsize);
+            return offset;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief linkClassFields lays out the instance fields of a class after those of its parents, the
+ * findex of each instance field becomes its byte offset from the object. the parents are loaded if needed.
+ * the fields are placed from the largest to the smallest so that each is naturally aligned, the bytes
+ * left by the alignment, in this class or in its parents, are filled by the smaller fields. the references
+ * are marked in the ref_map of the class for the collector
  * @param env
  * @param pclass
- * @return
  */
-Object* newObject(OPENV *env, Class* pclass) {
+void linkClassFields(OPENV *env, Class *pclass)
+{
     CONSTANT_Class_info* parent_class_info;
-    Object *obj;
-    Class *tmp_class;
-    int i = 0, total_size = 0;
-
-    tmp_class = pclass;
-    while (tmp_class->super_class) {
-        parent_class_info = (CONSTANT_Class_info*)(tmp_class->constant_pool[tmp_class->super_class]);
-        if (NULL == parent_class_info->pclass) {
-            parent_class_info->pclass = systemLoadClassRecursive(env, (CONSTANT_Utf8_info*)(tmp_class->constant_pool[parent_class_info->name_index]));
-            tmp_class->parent_class = parent_class_info->pclass;
-        }
-        tmp_class = tmp_class->parent_class;
+    field_info *field;
+    int i, fsize, offset, end, map_words, parent_end;
+
+    if (__atomic_load_n(&pclass->parent_fields_size, __ATOMIC_ACQUIRE) >= 0) {
+        return;
     }
 
-    if (pclass->parent_fields_size == -1) {
-        if (pclass->parent_class == NULL) {
-            pclass->parent_fields_size = 0;
-        } else {
-            pclass->parent_fields_size = getClassFieldsSize(pclass->parent_class);
+    // the parent is loaded and linked before vm_lock is taken, loading it may run a <clinit>
+    if (pclass->super_class && NULL == CP_RESOLVED(pclass->parent_class)) {
+        parent_class_info = (CONSTANT_Class_info*)(pclass->constant_pool[pclass->super_class]);
+        if (NULL == CP_RESOLVED(parent_class_info->pclass)) {
+            CP_PUBLISH(parent_class_info->pclass, systemLoadClassRecursive(env, (CONSTANT_Utf8_info*)(pclass->constant_pool[parent_class_info->name_index])));
         }
+        CP_PUBLISH(pclass->parent_class, parent_class_info->pclass);
+    }
+    if (NULL != pclass->parent_class) {
+        linkClassFields(env, pclass->parent_class);
+    }
+    pthread_mutex_lock(&vm_lock);
+    if (pclass->parent_fields_size >= 0) {
+        pthread_mutex_unlock(&vm_lock);
+        return;
+    }
+
+    // the largest object is 8 bytes per field after the parent
+    end = OBJECT_HEADER_SIZE;
+    pclass->field_hole_count = 0;
+    if (NULL != pclass->parent_class) {
+        end = pclass->parent_class->instance_size;
+        pclass->field_hole_count = pclass->parent_class->field_hole_count;
+        memcpy(pclass->field_holes, pclass->parent_class->field_holes, sizeof(FieldHole) * pclass->field_hole_count);
+    }
+    map_words = REF_MAP_WORDS(end + 8 * pclass->fields_size);
+    pclass->ref_map = (uint*)calloc(map_words, sizeof(uint));
+    if (NULL != pclass->parent_class) {
+        memcpy(pclass->ref_map, pclass->parent_class->ref_map, sizeof(uint) * REF_MAP_WORDS(end));
+    }
+    parent_end = end;
+
+    for (fsize = 8; fsize > 0; fsize >>= 1) {
         for(i=0; i<pclass->fields_count; i++) {
-            if (NOT_ACC_STATIC((pclass->fields[i])->access_flags)) {
-                (pclass->fields[i])->findex += pclass->parent_fields_size;
+            field = pclass->fields[i];
+            if (IS_ACC_STATIC(field->access_flags) || fieldSize(field->ftype) != fsize) {
+                continue;
+            }
+            if ((offset = takeFieldHole(pclass, fsize)) < 0) {
+                offset = ALIGN_UP(end, fsize);
+                addFieldHole(pclass, end, offset - end);
+                end = offset + fsize;
+            }
+            field->findex = offset;
+            if ('L' == field->ftype || '[' == field->ftype) {
+                SET_REF_FIELD(pclass, offset);
             }
         }
     }
+    pclass->instance_size = end;
+    // the class is linked once parent_fields_size is set, the other threads read the layout after it
+    __atomic_store_n(&pclass->parent_fields_size, parent_end, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&vm_lock);
+}
 
-    total_size = pclass->parent_fields_size  + pclass->fields_size;
+/**
+ * @brief findInstanceField finds an instance field by name in a class or its parents
+ * @return the field, NULL if not found
+ */
+field_info* findInstanceField(Class *pclass, const char *name)
+{
+    int i;
+    field_info *field;
+
+    for (; NULL != pclass; pclass = pclass->parent_class) {
+        for (i = 0; i < pclass->fields_count; i++) {
+            field = pclass->fields[i];
+            if (NOT_ACC_STATIC(field->access_flags) && strcmp(get_utf8(pclass->constant_pool[field->name_index]), name) == 0) {
+                return field;
+            }
+        }
+    }
+    return NULL;
+}
 
-    obj = (Object*)malloc(sizeof(Object) + ((total_size+1)<<2));
+/**
+ * @brief allocObject allocates an object of a linked class, the fields are zeroed
+ * @param pclass
+ * @return
+ */
+Object* allocObject(Class *pclass)
+{
+    Object *obj = (Object*)heapAlloc(pclass->instance_size);
 
-    obj->fields = (char*)(obj+1);
     obj->pclass = pclass;
-    obj->length = (total_size+1) << 2;
+    obj->mark = 0;
+
+    return obj;
+}
+
+/**
+ * @brief newObject implements the `new` instruction
+ * @param env
+ * @param pclass
+ * @return
+ */
+Object* newObject(OPENV *env, Class* pclass) {
+    Object *obj;
+
+    linkClassFields(env, pclass);
+    obj = allocObject(pclass);
 
     displayThisClassFieldIndex(pclass);
 
@@ -925,9 +1096,9 @@ void display_arr(CArray_ArrayRef *arr)
     printf("dimensions=%d\n", arr->dimensions);
     for(i=0;i<arr->length;i++) {
         if (arr->dimensions > 2) {
-            display_arr(arr->elements[i]);
+            display_arr((CArray_ArrayRef*)decodeRef(arr->elements[i]));
         } else {
-            arr_int = arr->elements[i];
+            arr_int = (CArray_int*)decodeRef(arr->elements[i]);
             print_indent(arr_int->dimensions+1);
             printf("dimensions=%d\n", arr_int->dimensions);
             for(j=0;j<arr_int->length;j++) {
@@ -939,78 +1110,60 @@ void display_arr(CArray_ArrayRef *arr)
 }
 
 /**
- * @brief newMultiArray implements the `multianewarray` instruction
+ * @brief newMultiArray implements the `multianewarray` instruction. all the arrays are allocated in one block,
+ * level by level in row-major order, each with its elements inline. the sub arrays of an array are next to each
+ * other, so walking a[i][j] in order walks the block in order, the data of the last level is dense but for the array headers
  * @param dimensions array of each dimension size, we can borrow from the operand stack to avoid copy
- * @param dcount number of dimensions
- * @param atype type of the array
- * @param manew_arr_c callback function @see MULTI_ANEWARRAY_CALLBACK
+ * @param dcount number of dimensions to create
+ * @param ndims number of dimensions of the array type, if more than dcount the last arrays created hold null references
+ * @param atype atype of the elements of the array type
  * @return the pointer to the new allocated array
  */
-CArray_ArrayRef* newMultiArray(int dimensions[], int dcount, int atype, MultiAnewArrayCallback manew_arr_c)
+CArray_ArrayRef* newMultiArray(int dimensions[], int dcount, int ndims, int atype)
 {
-    CArray_ArrayRef **p_base,**p;
-    CArray_ArrayRef *arr,  *sub_arr;
-    int last_dimension = dimensions[dcount-1];
-    int i=0, j=0, k=0;
-    int pointer_size = 0, total_size = 0;
-    int SZ_ARR = sizeof(CArray_ArrayRef);
-    int arr_offset = 1;
-    int ele_num=0;
-    int sub_dim = dcount;
+    CArray_ArrayRef *arr, *parent;
+    char *block, *p, *level_start, *parent_start = NULL;
+    size_t total_size = 0, arr_size, parent_size = 0;
+    int level, i, count;
+    int leaf_size = (ndims > dcount) ? sizeof(NarrowRef) : atype_element_sizes[atype];
+
     // 0. calculate size
-    if (last_dimension <= 0) {
-        printf("Ilegal array size: %d\n", dimensions[i]);
-        exit(1);
-    }
-    for(i=dcount-2; i>=0; i--) {
-        if (dimensions[i] <= 0) {
-            printf("Ilegal array size: %d\n", dimensions[i]);
+    count = 1;
+    for (level = 0; level < dcount; level++) {
+        if (dimensions[level] < 0) {
+            printf("Error: java.lang.NegativeArraySizeException: %d\n", dimensions[level]);
             exit(1);
         }
-        pointer_size = (pointer_size + 1) * dimensions[i];
-    }
-
-    total_size = SZ_ARR*(pointer_size+1) + pointer_size*SZ_REF + pointer_size*last_dimension*manew_arr_c.ele_size;
-    arr = (CArray_ArrayRef*)malloc(total_size);
-    memset(arr, 0, total_size);
-    p_base = (CArray_ArrayRef*)(arr + pointer_size + 1);
-    p = p_base;
-
-    // 1.the first dimension
-    arr->length = dimensions[0];
-    arr->elements = p;
-    arr->dimensions = sub_dim;
-    arr->atype = atype;
-    for(i=0; i<dimensions[0]; i++) {
-        arr->elements[i] = arr + arr_offset++;
-        p++;
+        total_size += count * ARRAY_BLOCK_SIZE(dimensions[level], (level == dcount-1) ? leaf_size : sizeof(NarrowRef));
+        count *= dimensions[level];
     }
-
-    // 2.the rest diemension except the last
-    ele_num = 1;
-    sub_arr = arr+1;
-    for(i=0; i<dcount-2; i++) {
-        sub_dim--;
-        ele_num *= dimensions[i];
-        for(j=0; j<ele_num; j++) {
-            sub_arr->length = dimensions[i+1];
-            sub_arr->elements = p;
-            sub_arr->dimensions = sub_dim;
-            sub_arr->atype = atype;
-            for(k=0; k<sub_arr->length; k++) {
-                sub_arr->elements[k] = (arr + arr_offset++);
-                p++;
+    block = (char*)heapAllocArray(total_size, ARRAY_ALIGN, ARRAY_HEADER_SIZE);
+
+    // 1. the arrays of each level, count is the number of arrays of the level
+    p = block;
+    count = 1;
+    for (level = 0; level < dcount; level++) {
+        arr_size = ARRAY_BLOCK_SIZE(dimensions[level], (level == dcount-1) ? leaf_size : sizeof(NarrowRef));
+        level_start = p;
+        for (i = 0; i < count; i++) {
+            arr = (CArray_ArrayRef*)p;
+            arr->length = dimensions[level];
+            arr->atype = atype;
+            arr->dimensions = ndims - level;
+            if (level > 0) {
+                parent = (CArray_ArrayRef*)(parent_start + (i / dimensions[level-1]) * parent_size);
+                parent->elements[i % dimensions[level-1]] = encodeRef(arr);
+                // the collector finds the sub arrays of the block by these bits, see gc.c
+                SET_HEAP_BIT(heap_array_bits, HEAP_GRANULE(arr));
             }
-            sub_arr++;
+            p += arr_size;
         }
+        parent_start = level_start;
+        parent_size = arr_size;
+        count *= dimensions[level];
     }
 
-    // 3. the last dimension: data
-    ele_num *=dimensions[i];
-
-    manew_arr_c.callback(sub_arr, p, ele_num, last_dimension, atype);
-
-    return arr;
+    return (CArray_ArrayRef*)block;
 }
 
 /**
@@ -1097,11 +1250,11 @@ void showStackStatus(OPENV* env)
                 offset+=SZ_LONG;
                 break;
             case debug_type_a:
-                printf(" #%d[array]=%p", i, *(ArrayRef*)(stack->sp + offset));
+                printf(" #%d[array]=%p", i, decodeRef(*(NarrowRef*)(stack->sp + offset)));
                 offset+=SZ_REF;
                 break;
             case debug_type_r:
-                printf(" #%d[ref]=%p", i, *(Reference*)(stack->sp + offset));
+                printf(" #%d[ref]=%p", i, decodeRef(*(NarrowRef*)(stack->sp + offset)));
                 offset+=SZ_REF;
                 break;
             default:
@@ -1164,7 +1317,7 @@ void displayStaticFields(Class *pclass)
     }
     if (strcmp(get_this_class_name(pclass), "java/lang/Integer") == 0) {
         for(i=0;i<=6;i++) {
-            fprintf(fp, "static fields: i=%d, %p\n", i, *(ArrayRef*)(pclass->static_fields+(i<<2)));
+            fprintf(fp, "static fields: i=%d, %p\n", i, decodeRef(*(NarrowRef*)(pclass->static_fields+(i<<2))));
         }
     }
     fclose(fp);
@@ -215,7 +215,7 @@ Instruction jvm_instructions[256] = {
     {"goto_w", pre_goto_w, do_goto_w},
     {"jsr_w", pre_jsr_w, do_jsr_w},
     {"breakpoint", pre_breakpoint, do_breakpoint},
-    {"", NULL, NULL},
+    {"scalar_init", pre_scalar_init, do_scalar_init},
     {"", NULL, NULL},
     {"", NULL, NULL},
     {"", NULL, NULL},
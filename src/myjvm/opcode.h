@@ -33,6 +33,140 @@
     SWAP(p,2,5);\
     SWAP(p,3,4)
 
+/** opcode values used by the code translators, see jvm_instructions in opcode.c **/
+#define OPC_NOP         0x00
+#define OPC_ACONST_NULL 0x01
+#define OPC_ICONST_M1   0x02
+#define OPC_ICONST_5    0x08
+#define OPC_LCONST_0    0x09
+#define OPC_LCONST_1    0x0a
+#define OPC_FCONST_0    0x0b
+#define OPC_FCONST_2    0x0d
+#define OPC_DCONST_0    0x0e
+#define OPC_DCONST_1    0x0f
+#define OPC_BIPUSH      0x10
+#define OPC_SIPUSH      0x11
+#define OPC_LDC         0x12
+#define OPC_LDC_W       0x13
+#define OPC_LDC2_W      0x14
+#define OPC_ILOAD       0x15
+#define OPC_LLOAD       0x16
+#define OPC_FLOAD       0x17
+#define OPC_DLOAD       0x18
+#define OPC_ILOAD_0     0x1a
+#define OPC_LLOAD_0     0x1e
+#define OPC_FLOAD_0     0x22
+#define OPC_DLOAD_0     0x26
+#define OPC_ILOAD_1     0x1b
+#define OPC_LLOAD_1     0x1f
+#define OPC_FLOAD_1     0x23
+#define OPC_DLOAD_1     0x27
+#define OPC_ALOAD_0     0x2a
+#define OPC_ALOAD_1     0x2b
+#define OPC_ALOAD_3     0x2d
+#define OPC_ALOAD       0x19
+#define OPC_ASTORE      0x3a
+#define OPC_ASTORE_0    0x4b
+#define OPC_ASTORE_3    0x4e
+#define OPC_ISTORE      0x36
+#define OPC_LSTORE      0x37
+#define OPC_FSTORE      0x38
+#define OPC_DSTORE      0x39
+#define OPC_ISTORE_0    0x3b
+#define OPC_LSTORE_0    0x3f
+#define OPC_FSTORE_0    0x43
+#define OPC_DSTORE_0    0x47
+#define OPC_POP         0x57
+#define OPC_POP2        0x58
+#define OPC_DUP         0x59
+#define OPC_DUP2        0x5c
+#define OPC_IADD        0x60
+#define OPC_LADD        0x61
+#define OPC_FADD        0x62
+#define OPC_DADD        0x63
+#define OPC_ISUB        0x64
+#define OPC_LSUB        0x65
+#define OPC_FSUB        0x66
+#define OPC_DSUB        0x67
+#define OPC_IMUL        0x68
+#define OPC_LMUL        0x69
+#define OPC_FMUL        0x6a
+#define OPC_DMUL        0x6b
+#define OPC_IDIV        0x6c
+#define OPC_LDIV        0x6d
+#define OPC_FDIV        0x6e
+#define OPC_DDIV        0x6f
+#define OPC_IREM        0x70
+#define OPC_LREM        0x71
+#define OPC_INEG        0x74
+#define OPC_LNEG        0x75
+#define OPC_FNEG        0x76
+#define OPC_DNEG        0x77
+#define OPC_ISHL        0x78
+#define OPC_LSHL        0x79
+#define OPC_ISHR        0x7a
+#define OPC_LSHR        0x7b
+#define OPC_IUSHR       0x7c
+#define OPC_LUSHR       0x7d
+#define OPC_IAND        0x7e
+#define OPC_LAND        0x7f
+#define OPC_IOR         0x80
+#define OPC_LOR         0x81
+#define OPC_IXOR        0x82
+#define OPC_LXOR        0x83
+#define OPC_IINC        0x84
+#define OPC_I2L         0x85
+#define OPC_I2F         0x86
+#define OPC_I2D         0x87
+#define OPC_L2I         0x88
+#define OPC_L2F         0x89
+#define OPC_L2D         0x8a
+#define OPC_F2I         0x8b
+#define OPC_F2L         0x8c
+#define OPC_F2D         0x8d
+#define OPC_D2I         0x8e
+#define OPC_D2L         0x8f
+#define OPC_D2F         0x90
+#define OPC_I2B         0x91
+#define OPC_I2C         0x92
+#define OPC_I2S         0x93
+#define OPC_LCMP        0x94
+#define OPC_FCMPL       0x95
+#define OPC_FCMPG       0x96
+#define OPC_DCMPL       0x97
+#define OPC_DCMPG       0x98
+#define OPC_IFEQ        0x99
+#define OPC_IFLE        0x9e
+#define OPC_IF_ICMPEQ   0x9f
+#define OPC_IF_ICMPLE   0xa4
+#define OPC_IF_ACMPNE   0xa6
+#define OPC_GOTO        0xa7
+#define OPC_JSR         0xa8
+#define OPC_RET         0xa9
+#define OPC_TABLESWITCH 0xaa
+#define OPC_LOOKUPSWITCH 0xab
+#define OPC_IRETURN     0xac
+#define OPC_LRETURN     0xad
+#define OPC_FRETURN     0xae
+#define OPC_DRETURN     0xaf
+#define OPC_ARETURN     0xb0
+#define OPC_RETURN      0xb1
+#define OPC_GETFIELD    0xb4
+#define OPC_PUTFIELD    0xb5
+#define OPC_INVOKEVIRTUAL   0xb6
+#define OPC_INVOKESPECIAL   0xb7
+#define OPC_INVOKESTATIC    0xb8
+#define OPC_INVOKEDYNAMIC   0xba
+#define OPC_NEW         0xbb
+#define OPC_ATHROW      0xbf
+#define OPC_WIDE        0xc4
+#define OPC_IFNULL      0xc6
+#define OPC_IFNONNULL   0xc7
+#define OPC_GOTO_W      0xc8
+#define OPC_JSR_W       0xc9
+/* private instruction of the methods rewritten by the escape analysis, see escape.c */
+#define OPC_SCALAR_INIT 0xcb
+
 #define INC_PC(pc)  (pc)+=1
 #define INC2_PC(pc) (pc)+=2
 #define INC3_PC(pc) (pc)+=3
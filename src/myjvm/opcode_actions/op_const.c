@@ -126,10 +126,8 @@ Opreturn do_sipush(OPENV *env)
 }
 Opreturn do_ldc(OPENV *env)
 {
-    FILE *fp;
-    int i;
-    CArray_char* char_arr;
     Object *str_obj;
+    ALLOC_SITE_BEGIN(env);
     PRINTSD(TO_CHAR(env->pc));
     ushort index = (ushort)(TO_CHAR(env->pc));
     uchar tag;
@@ -146,23 +144,10 @@ Opreturn do_ldc(OPENV *env)
         DEBUG_SET_SP_TYPE(env->dbg, debug_type_f);
         break;
     case CONSTANT_String:
-        debug("this class = %s", get_this_class_name(env->current_class));
-        debug("ldc error: tag=%d, index=%d", tag, index);
-        printf("ldc: stack=%p, sp=%p, pc=%p\n", env->current_stack, env->current_stack->sp, env->pc);
-
-        // begin save to log
-        printCurrentEnv(env, "ldc");
-        // end save to log
-
-        char_arr = newCArray_char_fromConstStr(env->current_class, index);
-        str_obj = newConstString(env, char_arr);
-        //PUSH_STACKR(env->current_stack, str_obj, Reference);
-        printf("create const string success\n");
-        printf("ldcend: stack=%p, sp=%p, pc=%p\n", env->current_stack, env->current_stack->sp, env->pc);
-        // begin save to log
-        printCurrentEnv(env, "ldc end");
-        // end save to log
-        //exit(1);
+        str_obj = resolveConstString(env, env->current_class, index);
+        PUSH_STACKR(env->current_stack, str_obj, Reference);
+        DEBUG_SET_SP_TYPE(env->dbg, debug_type_r);
+        ALLOC_SITE_END(env);
         break;
     default:
         debug("ldc error: tag=%d, index=%d", tag, index);
@@ -173,6 +158,7 @@ Opreturn do_ldc(OPENV *env)
 }
 Opreturn do_ldc_w(OPENV *env)
 {
+    ALLOC_SITE_BEGIN(env);
     PRINTSD(TO_SHORT(env->pc));
     ushort index = (ushort)(TO_SHORT(env->pc));
     uchar tag;
@@ -183,6 +169,10 @@ Opreturn do_ldc_w(OPENV *env)
     } else if (tag == CONSTANT_Float) {
         PUSH_STACK(env->current_stack, ((CONSTANT_Float_info*)(env->current_class->constant_pool[index]))->value, float);
         DEBUG_SET_SP_TYPE(env->dbg, debug_type_f);
+    } else if (tag == CONSTANT_String) {
+        PUSH_STACKR(env->current_stack, resolveConstString(env, env->current_class, index), Reference);
+        DEBUG_SET_SP_TYPE(env->dbg, debug_type_r);
+        ALLOC_SITE_END(env);
     } else {
         debug("ldc_w error: tag=%d, index=%d", tag, index);
         exit(1);
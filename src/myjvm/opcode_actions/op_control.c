@@ -16,6 +16,7 @@ Opreturn do_goto(OPENV *env)
 {
     short offset = TO_SHORT(env->pc);
     env->pc+=(offset-1);
+    SAFEPOINT_BACKEDGE(env, offset);
 }
 Opreturn do_jsr(OPENV *env)
 {
@@ -136,10 +137,10 @@ Opreturn do_dreturn(OPENV *env)
 }
 Opreturn do_areturn(OPENV *env)
 {
-    Reference v;
-    GET_STACK(env->current_stack,v, Reference);
-    PUSH_STACK(env->current_stack->prev, v, Reference);
-    debug("method call end, returns: 0x%p", v);
+    NarrowRef v;
+    GET_STACK(env->current_stack,v, NarrowRef);
+    PUSH_STACK(env->current_stack->prev, v, NarrowRef);
+    debug("method call end, returns: 0x%p", decodeRef(v));
     FUNC_RETURN(env);
     RETURNV;
 }
@@ -20,11 +20,12 @@ Opreturn do_wide(OPENV *env)
 }
 Opreturn do_multianewarray(OPENV *env)
 {
+    ALLOC_SITE_BEGIN(env);
     PRINTD(TO_SHORT(env->pc));
     cp_info cp = env->current_class->constant_pool;
     char *arr_type_utf8;
     int arr_type_index = TO_SHORT(env->pc);
-    int dcount, callback_index;
+    int dcount, ndims = 0;
     int *parr_dims;
     CArray_ArrayRef *multi_arr_ref;
     INC2_PC(env->pc);
@@ -33,68 +34,42 @@ Opreturn do_multianewarray(OPENV *env)
 
     arr_type_utf8 = ((CONSTANT_Utf8_info*)(cp[((CONSTANT_Class_info*)(cp[arr_type_index]))->name_index]))->bytes;
     debug("arr_type_utf8=%s", arr_type_utf8);
-    while(*arr_type_utf8 == '[') arr_type_utf8++;
+    while(*arr_type_utf8 == '[') {
+        arr_type_utf8++;
+        ndims++;
+    }
     debug("arr_type=%s", arr_type_utf8);
 
     parr_dims = (int*)(env->current_stack->sp - SZ_INT*dcount);
     env->current_stack->sp = parr_dims;
 
-    switch (*arr_type_utf8) {
-    case 'B': // byte
-        callback_index = 1;
-        break;
-    case 'C': // char
-        callback_index = 2;
-        break;
-    case 'S': // short
-        callback_index = 2;
-        break;
-    case 'Z': // boolean
-        callback_index = 0;
-        break;
-    case 'I': // integer
-        callback_index = 5;
-        break;
-    case 'F':
-        callback_index = 6;
-        break;
-    case 'L':
-        callback_index = 9;
-        break;
-    case 'J':
-        callback_index = 7;
-        break;
-    case 'D':
-        callback_index = 8;
-        break;
-    default:
-        break;
-    }
-    multi_arr_ref = newMultiArray(parr_dims, dcount, arr_type_index & 0x10, mAnewCallaback[callback_index]);
-    PUSH_STACK(env->current_stack, multi_arr_ref, CArray_ArrayRef*);
-    //exit(1);
+    multi_arr_ref = newMultiArray(parr_dims, dcount, ndims, descriptorAtype(*arr_type_utf8));
+    PUSH_STACKR(env->current_stack, multi_arr_ref, CArray_ArrayRef*);
+    ALLOC_SITE_END(env);
 }
 
 Opreturn do_ifnull(OPENV *env)
 {
-    Reference ref;
+    NarrowRef ref;
     short offset;
-    GET_STACK(env->current_stack, ref, Reference);
-    if (NULL == ref) {
+    GET_STACK(env->current_stack, ref, NarrowRef);
+    if (0 == ref) {
         offset = TO_SHORT(env->pc);
         env->pc += (offset-1);
+        SAFEPOINT_BACKEDGE(env, offset);
     } else {
         INC2_PC(env->pc);
     }
 }
 Opreturn do_ifnonnull(OPENV *env)
 {
-    Reference ref;
+    NarrowRef ref;
     short offset;
-    GET_STACK(env->current_stack, ref, Reference);
-    if (NULL != ref) {
+    GET_STACK(env->current_stack, ref, NarrowRef);
+    if (0 != ref) {
         offset = TO_SHORT(env->pc);
         env->pc += (offset-1);
+        SAFEPOINT_BACKEDGE(env, offset);
     } else {
         INC2_PC(env->pc);
     }
@@ -104,6 +79,7 @@ Opreturn do_goto_w(OPENV *env)
 {
     int offset = TO_INT(env->pc);
     env->pc += (offset-1);
+    SAFEPOINT_BACKEDGE(env, offset);
 }
 
 Opreturn do_jsr_w(OPENV *env)
@@ -134,4 +110,24 @@ Opreturn do_impdep2(OPENV *env)
     exit(1);
     //INC_PC(env->pc);
 }
+/**
+ * @brief do_scalar_init the allocation of a scalar replaced object, see escape.c. the fields are
+ * zeroed and the arguments of <init> are stored into the field locals instead of a new object
+ */
+Opreturn do_scalar_init(OPENV *env)
+{
+    ScalarSite *site = &env->current_stack->method->code_attribute_addr->escape->sites[(ushort)TO_SHORT(env->pc)];
+    StackFrame *stf = env->current_stack;
+    char *arg;
+    int i;
+    INC2_PC(env->pc);
+
+    memset(stf->localvars + (site->first_local << 2), 0, site->local_count << 2);
+    stf->sp -= site->args_len;
+    for (i = 0, arg = stf->sp; i < site->param_count; arg += site->params[i++].size << 2) {
+        if (site->params[i].local >= 0) {
+            memcpy(stf->localvars + (site->params[i].local << 2), arg, site->params[i].size << 2);
+        }
+    }
+}
 #endif
@@ -172,7 +172,7 @@ Opreturn do_daload(OPENV *env)
 }
 Opreturn do_aaload(OPENV *env)
 {
-    XALOAD(env, Reference);
+    XALOAD(env, NarrowRef);
     RETURNV;
 }
 Opreturn do_baload(OPENV *env)
@@ -21,6 +21,8 @@ extern void resolveClassInstanceField(Class* caller_class, CONSTANT_Fieldref_inf
 extern void resolveClassMethod(Class* caller_class, CONSTANT_Methodref_info **pmethod_ref);
 extern void resolveClassSpecialMethod(Class* caller_class, CONSTANT_Methodref_info **pmethod_ref);
 extern void callClassSpecialMethod(OPENV *env, int mindex);
+extern void callDynamicMethod(OPENV *env, int index);
+extern int virtualThreadMonitorEnter(OPENV *env, Object *obj);
 
 Opreturn do_getstatic(OPENV *env)
 {
@@ -33,7 +35,7 @@ Opreturn do_getstatic(OPENV *env)
     cp = env->current_class->constant_pool;
     fieldref = (CONSTANT_Fieldref_info*)(cp[index]);
 
-    if (0 == fieldref->ftype) {
+    if (!FIELDREF_RESOLVED(fieldref)) {
         // TODO: resolve this fields
         resolveClassStaticField(env->current_class, &fieldref);
     }
@@ -60,7 +62,7 @@ Opreturn do_getstatic(OPENV *env)
             OP_GET_STATIC_FIELDF(pclass, fieldref->findex, float);
             break;
         case '[': // reference
-            arr_ref = *(ArrayRef*)(pclass->static_fields+(fieldref->findex<<2));
+            arr_ref = (ArrayRef)decodeRef(*(NarrowRef*)(pclass->static_fields+(fieldref->findex<<2)));
             displayStaticFields(pclass);
             OP_GET_STATIC_FIELDR(pclass, fieldref->findex, ArrayRef);
             break;
@@ -94,7 +96,7 @@ Opreturn do_putstatic(OPENV *env)
     fieldref = (CONSTANT_Fieldref_info*)(cp[index]);
 
 
-    if (0 == fieldref->ftype) {
+    if (!FIELDREF_RESOLVED(fieldref)) {
         // TODO: resolve this fields
         resolveClassStaticField(env->current_class, &fieldref);
     }
@@ -161,7 +163,7 @@ Opreturn do_getfield(OPENV *env)
     fieldref = (CONSTANT_Fieldref_info*)(cp[index]);
 
     GET_STACKR(env->current_stack, obj, Reference);
-    if (0 == fieldref->ftype) {
+    if (!FIELDREF_RESOLVED(fieldref)) {
         // TODO: resolve this field
         resolveClassInstanceField(env->current_class, &fieldref);
     }
@@ -195,7 +197,7 @@ Opreturn do_getfield(OPENV *env)
         case '[': // reference
         case 'L': // reference
             OP_GET_FIELDR(obj, fieldref->findex, Reference);
-            debug("get-field:value=%p, stackvalue=%p", GET_FIELD(obj, fieldref->findex, Reference), PICK_STACK(env->current_stack, Reference));
+            debug("get-field:value=%p, stackvalue=%p", GET_FIELD_REF(obj, fieldref->findex, Reference), PICK_STACKR(env->current_stack, Reference));
             break;
         case 'J': // long
             OP_GET_FIELDL(obj, fieldref->findex, long);
@@ -227,7 +229,7 @@ Opreturn do_putfield(OPENV *env)
     fieldref = (CONSTANT_Fieldref_info*)(cp[index]);
     class_info = (CONSTANT_Class_info*)(cp[fieldref->class_index]);
 
-    if (0 == fieldref->ftype) {
+    if (!FIELDREF_RESOLVED(fieldref)) {
         // TODO: resolve this field
         resolveClassInstanceField(env->current_class, &fieldref);
     }
@@ -272,26 +274,35 @@ Opreturn do_putfield(OPENV *env)
 }
 Opreturn do_invokevirtual(OPENV *env)
 {
+    SAFEPOINT_POLL(env);
+    ALLOC_SITE_BEGIN(env);
     PRINTSD(TO_SHORT(env->pc));
     short mindex = TO_SHORT(env->pc);
     INC2_PC(env->pc);
 
     callClassVirtualMethod(env, mindex);
+    ALLOC_SITE_END(env);
 }
 Opreturn do_invokespecial(OPENV *env)
 {
+    SAFEPOINT_POLL(env);
+    ALLOC_SITE_BEGIN(env);
     PRINTSD(TO_SHORT(env->pc));
     short mindex = TO_SHORT(env->pc);
     INC2_PC(env->pc);
 
     callClassSpecialMethod(env, mindex);
+    ALLOC_SITE_END(env);
 }
 Opreturn do_invokestatic(OPENV *env)
 {
+    SAFEPOINT_POLL(env);
+    ALLOC_SITE_BEGIN(env);
     PRINTSD(TO_SHORT(env->pc));
     short mindex = TO_SHORT(env->pc);
     INC2_PC(env->pc);
     callStaticClassMethod(env, mindex);
+    ALLOC_SITE_END(env);
 }
 Opreturn do_invokeinterface(OPENV *env)
 {
@@ -300,8 +311,15 @@ Opreturn do_invokeinterface(OPENV *env)
 }
 Opreturn do_invokedynamic(OPENV *env)
 {
+    SAFEPOINT_POLL(env);
+    ALLOC_SITE_BEGIN(env);
     PRINTSD(TO_SHORT(env->pc));
+    short index = TO_SHORT(env->pc);
+    INC2_PC(env->pc);
     INC2_PC(env->pc);
+
+    callDynamicMethod(env, index);
+    ALLOC_SITE_END(env);
 }
 Opreturn do_new(OPENV *env)
 {
@@ -311,6 +329,7 @@ Opreturn do_new(OPENV *env)
     PRINTSD(TO_SHORT(env->pc));
     short index = TO_SHORT(env->pc);
     Object *obj;
+    ALLOC_SITE_BEGIN(env);
     INC2_PC(env->pc);
 
     if (env->current_class->this_class == index) {
@@ -323,19 +342,19 @@ Opreturn do_new(OPENV *env)
         utf8_info = (CONSTANT_Utf8_info*)(env->current_class->constant_pool[env->current_stack->method->name_index]);
         printf("method = %s\n", utf8_info->bytes);
 
-        if (class_info->pclass == NULL) {
+        if (NULL == (pclass = CP_RESOLVED(class_info->pclass))) {
             debug("load pclass: %d", 2);
             utf8_info = (CONSTANT_Utf8_info*)(env->current_class->constant_pool[class_info->name_index]);
-            pclass = class_info->pclass = findLoadedClass(utf8_info->bytes, utf8_info->length);
+            pclass = findLoadedClass(utf8_info->bytes, utf8_info->length);
             debug("findLoadedClass pclass=%p", pclass);
-        } else {
-            pclass = class_info->pclass;
-        }
-
-        if (NULL == pclass) {
-            pclass = class_info->pclass = systemLoadClassRecursive(env, utf8_info);
-            debug("systemLoadClassRecursive pclass=%p", pclass);
+            if (NULL == pclass) {
+                pclass = systemLoadClassRecursive(env, utf8_info);
+                debug("systemLoadClassRecursive pclass=%p", pclass);
+            }
+            CP_PUBLISH(class_info->pclass, pclass);
         }
+        // the class may be loaded by another thread whose <clinit> has not ended
+        initializeClass(env, pclass);
     }
 
     debug("goto new Object: class_index=%d, %p", pclass->this_class, pclass);
@@ -346,17 +365,20 @@ Opreturn do_new(OPENV *env)
     debug("new: obj=%p,pc=%p,sp=%p\n", obj, env->pc,env->current_stack->sp);
     PUSH_STACKR(env->current_stack, obj, Reference);
     printCurrentEnv(env, "afrer push obj:");
+    ALLOC_SITE_END(env);
 }
 
 Opreturn do_newarray(OPENV *env)
 {
     int arr_count;
     char arr_type;
+    ALLOC_SITE_BEGIN(env);
     PRINTSD(TO_CHAR(env->pc));
     arr_type = TO_CHAR(env->pc);
     GET_STACK(env->current_stack, arr_count, int);
     char *sp_old = env->current_stack->sp;
     PUSH_STACKR(env->current_stack, generalNewArray(arr_type, arr_count), ArrayRef);
+    ALLOC_SITE_END(env);
 
     INC_PC(env->pc);
 }
@@ -364,9 +386,15 @@ Opreturn do_anewarray(OPENV *env)
 {
     int arr_count;
     int arr_type_index = TO_SHORT(env->pc);
+    ALLOC_SITE_BEGIN(env);
     PRINTSD(TO_SHORT(env->pc));
     GET_STACK(env->current_stack, arr_count, int);
-    PUSH_STACK(env->current_stack, newCArray_Reference(arr_type_index&0x10, arr_count, 1), ArrayRef);
+    if (arr_count < 0) {
+        printf("Illegal array length: %d\n", arr_count);
+        exit(1);
+    }
+    PUSH_STACKR(env->current_stack, newCArray_NarrowRef(arr_count, ATYPE_REFERENCE, 1), ArrayRef);
+    ALLOC_SITE_END(env);
 
     INC2_PC(env->pc);
 }
@@ -394,14 +422,27 @@ Opreturn do_instanceof(OPENV *env)
 }
 Opreturn do_monitorenter(OPENV *env)
 {
-    printf("[monitorenter] not implemented yet\n");
-    exit(1);
+    Object *obj;
+    GET_STACKR(env->current_stack, obj, Reference);
+    if (NULL == obj) {
+        printf("Error: java.lang.NullPointerException in monitorenter\n");
+        exit(1);
+    }
+    if (virtualThreadMonitorEnter(env, obj)) {
+        RETURNV;
+    }
+    monitorEnter(&obj->mark, obj->pclass);
     RETURNV;
 }
 Opreturn do_monitorexit(OPENV *env)
 {
-    printf("[monitorexit] not implemented yet\n");
-    exit(1);
+    Object *obj;
+    GET_STACKR(env->current_stack, obj, Reference);
+    if (NULL == obj) {
+        printf("Error: java.lang.NullPointerException in monitorexit\n");
+        exit(1);
+    }
+    monitorExit(&obj->mark);
     RETURNV;
 }
 
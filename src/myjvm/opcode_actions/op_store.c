@@ -174,7 +174,7 @@ Opreturn do_dastore(OPENV *env)
 }
 Opreturn do_aastore(OPENV *env)
 {
-    XASTORE(env, Reference);
+    AASTORE(env);
     RETURNV;
 }
 Opreturn do_bastore(OPENV *env)
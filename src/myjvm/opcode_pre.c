@@ -575,6 +575,8 @@ Opreturn pre_lxor(OPENV *env)
 }
 Opreturn pre_iinc(OPENV *env)
 {
+    PRINTSD(TO_CHAR(env->pc));
+    INC2_PC(env->pc);
     RETURNV;
 }
 Opreturn pre_i2l(OPENV *env)
@@ -891,6 +893,7 @@ Opreturn pre_invokedynamic(OPENV *env)
     BE2LE2(env->pc);
     PRINTSD(TO_SHORT(env->pc));
     INC2_PC(env->pc);
+    INC2_PC(env->pc); // two zero bytes
 }
 Opreturn pre_new(OPENV *env)
 {
@@ -985,4 +988,9 @@ Opreturn pre_impdep2(OPENV *env)
 {
     PRINTD(TO_CHAR(env->pc));
 }
+Opreturn pre_scalar_init(OPENV *env)
+{
+    PRINTD(TO_SHORT(env->pc));
+    INC2_PC(env->pc);
+}
 #endif
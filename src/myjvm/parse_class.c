@@ -15,9 +15,13 @@
 #include "utils.h"
 #include "op_core.h"
 #include "opcode.c"
+#include "reg_ir.c"
 #include "class_hash.h"
+#include "aot.c"
+#include "intrinsics.c"
+#include "escape.c"
 
-/* the directory to hold the test class and the class from jdk */
+/* the directory to hold the test class and the class from jdk, of the vms created without one */
 char *class_dir="E:/javaweb/test/src/";
 
 #define ATTR_CODE 0x0001
@@ -59,6 +63,8 @@ CONSTANT_InvokeDynamic_info *inv_info
 #define printf_ref_nt(index, tag, obj, pools) fprintf(stderr, "#%d\t%s\t #%d.#%d // %s.", index, cpTypeMap[tag], obj->class_index, obj->name_and_type_index, get_class_name(pools, obj->class_index))
 
 #define emalloc(TYPE, VARNAME) VARNAME = (TYPE*)malloc(sizeof(TYPE))
+/* the size of the path of a class file, see classPath */
+#define CLASS_PATH_SIZE 512
 #define IS_MAIN_METHOD(pclass, method) (strcmp(get_utf8(pclass->constant_pool[method->name_index]), "main") == 0)
 #define GET_FIELD_TYPE(pclass,fieldref) get_utf8(pclass->constant_pool[((CONSTANT_NameAndType_info*)(pclass->constant_pool[fieldref->name_and_type_index]))->descriptor_index])
 #define IS_CLINIT_METHOD(pclass, method) (strcmp(get_utf8(pclass->constant_pool[method->name_index]), "<clinit>") == 0)
@@ -70,7 +76,7 @@ void* readLineNumberTable(FILE *fp);
 void* readLocalVariableTable(FILE *fp);
 void* readLocalVariableTypeTable(FILE *fp);
 void setThisClassFieldIndex(Class *pclass);
-Code_attribute* parseCodeAttribute(FILE *fp, Class *pclass);
+Code_attribute* parseCodeAttribute(FILE *fp, Class *pclass, int arg_slots);
 
 void printMethodrefInfo(Class* pclass, CONSTANT_Methodref_info* method_ref)
 {
@@ -102,7 +108,7 @@ void parseConstantPool(FILE *fp, Class* pclass)
     printf("position: %d\n", ftell(fp));
     printf("constant_pool_count: %d\n", pclass->constant_pool_count);
 
-    memset(pclass->constant_pool, 0, (pool_count+1)*4);
+    memset(pclass->constant_pool, 0, sizeof(void*) * (pool_count+1));
 
     ushort index = 0;
     uchar utag;
@@ -167,6 +173,7 @@ void parseConstantPool(FILE *fp, Class* pclass)
                 emalloc(CONSTANT_String_info, str_info);
                 str_info->tag = tag;
                 str_info->string_index = readUShort(fp);
+                str_info->string_ref = 0;
                 pclass->constant_pool[index] = (void*)str_info;
 
                 break;
@@ -188,6 +195,7 @@ void parseConstantPool(FILE *fp, Class* pclass)
                 pclass->constant_pool[index] = (void*)m_info;
                 m_info->ref_addr = NULL;
                 m_info->mtable = NULL;
+                m_info->intrinsic = NULL;
 
                 break;
             case CONSTANT_InterfaceMethodref:
@@ -196,6 +204,9 @@ void parseConstantPool(FILE *fp, Class* pclass)
                 interm_info->class_index = readUShort(fp);
                 interm_info->name_and_type_index = readUShort(fp);
                 pclass->constant_pool[index] = (void*)interm_info;
+                interm_info->ref_addr = NULL;
+                interm_info->mtable = NULL;
+                interm_info->intrinsic = NULL;
 
                 break;
             case CONSTANT_NameAndType:
@@ -224,8 +235,9 @@ void parseConstantPool(FILE *fp, Class* pclass)
             case CONSTANT_InvokeDynamic:
                 emalloc(CONSTANT_InvokeDynamic_info, inv_info);
                 inv_info->tag = tag;
-                inv_info->name_and_type_index = readUShort(fp);
                 inv_info->bootstrap_method_attr_index = readUShort(fp);
+                inv_info->name_and_type_index = readUShort(fp);
+                inv_info->call_site = NULL;
                 pclass->constant_pool[index] = (void*)inv_info;
 
                 break;
@@ -244,8 +256,8 @@ void parseInterface(FILE *fp, Class *pclass)
     ushort index = 0;
     if (inter_count > 0) {
         pclass->interfaces = (ushort*)malloc(sizeof(ushort) * inter_count);
-        while (index++ < inter_count) {
-            pclass->interfaces[index] = readUShort(fp);
+        while (index < inter_count) {
+            pclass->interfaces[index++] = readUShort(fp);
         }
     } else {
         pclass->interfaces = NULL;
@@ -278,12 +290,9 @@ void parseFields(FILE *fp, Class *pclass)
             tmp_field->ftype = ftype;
 
             if (NOT_ACC_STATIC(tmp_field->access_flags)) {
-                tmp_field->findex = last_index;
-                if (ftype == 'J' || ftype == 'D') {
-                    last_index+=2;
-                } else {
-                    last_index+=1;
-                }
+                // the offset is found when the class is linked, see linkClassFields
+                tmp_field->findex = 0;
+                last_index++;
             } else {
                 tmp_field->findex = static_last_index;
                 if (ftype == 'J' || ftype == 'D') {
@@ -319,7 +328,8 @@ void parseFields(FILE *fp, Class *pclass)
     pclass->parent_fields_size = -1;
 
     pclass->static_field_size = static_last_index;
-    pclass->static_fields = (char*)malloc(sizeof(char) * ((static_last_index+1)<<2));
+    // the static fields start as zero and null, a class without <clinit> never writes them
+    pclass->static_fields = (char*)calloc((static_last_index+1)<<2, sizeof(char));
 }
 
 int parseMethodArgs(Class* pclass, ushort descriptor_index)
@@ -349,7 +359,7 @@ int parseMethodArgs(Class* pclass, ushort descriptor_index)
                 ++args_desc;
                 break;
             case 'L':
-                args_len+=SZ_INT;
+                args_len+=SZ_REF;
                 args_desc++;
                 while(*args_desc != ';') {
                     args_desc++;
@@ -358,7 +368,7 @@ int parseMethodArgs(Class* pclass, ushort descriptor_index)
                 args_count++;
                 break;
             case '[':
-                args_len+=SZ_INT;
+                args_len+=SZ_REF;
                 //args_desc++;
                 while(*args_desc == '[') {
                     args_desc++;
@@ -419,6 +429,9 @@ void parseMethods(FILE *fp, Class *pclass)
             fprintf(stderr, "method=%s", get_utf8(pclass->constant_pool[tmp_method->name_index]));
 
             tmp_method->args_len = parseMethodArgs(pclass, tmp_method->descriptor_index);
+            tmp_method->code_attribute_addr = NULL;
+            tmp_method->aot_code = NULL;
+            tmp_method->pclass = pclass;
 
             ushort aindex = 0;
             tmp_method->attributes = (attribute_info**)malloc(sizeof(attribute_info*) * tmp_method->attributes_count);
@@ -431,15 +444,20 @@ void parseMethods(FILE *fp, Class *pclass)
                 }
                 tmp_attr->attribute_name_index = readUShort(fp);
                 tmp_attr->attribute_length = readUInt(fp);
-                tmp_attr->info = (void*)malloc(sizeof(char)*tmp_attr->attribute_length);
 
                 if (strcmp(get_utf8(pclass->constant_pool[tmp_attr->attribute_name_index]), "Code") == 0) {
-                    tmp_attr->info = parseCodeAttribute(fp, pclass);
+                    tmp_attr->info = parseCodeAttribute(fp, pclass, (tmp_method->args_len + (tmp_method->access_flags & ACC_STATIC ? 0 : SZ_REF)) >> 2);
                     printf("errno=%d, errstr=%s\n", errno, strerror(errno));
                     printf("tmp_attr->info=%p, code_attribute_addr=%p\n", tmp_attr->info, tmp_method->code_attribute_addr);
                     tmp_method->code_attribute_addr = tmp_attr->info; // save code attribute address
+                    if (tmp_method->access_flags & ACC_SYNCHRONIZED) {
+                        // the lock is taken and released with the stack frame, see enterSynchronizedMethod
+                        tmp_method->code_attribute_addr->call_kind = CALL_NORMAL;
+                        tmp_method->code_attribute_addr->reg_code = NULL;
+                    }
                 } else {
                     printf("readBytes\n");
+                    tmp_attr->info = (void*)malloc(sizeof(char)*tmp_attr->attribute_length);
                     readBytes(fp, (char*)(tmp_attr->info), tmp_attr->attribute_length);
                 }
                 printf("tmp_method=%p\n", tmp_method);
@@ -474,7 +492,7 @@ void parseAttributes(FILE *fp, Class *pclass)
 
             tmp_attr->attribute_length = readUInt(fp);
             if (strcmp(get_utf8(pclass->constant_pool[tmp_attr->attribute_name_index]), "Code") == 0) {
-                code_attr = parseCodeAttribute(fp, pclass);
+                code_attr = parseCodeAttribute(fp, pclass, 0xffff); // not a method, nothing is scalar replaced
                 printf("tmp_attr->info=%p, code_attr=%p\n", tmp_attr->info, code_attr);
                 tmp_attr->info = (char*)code_attr;
                 printf("after read codeattr: errno=%d, errstr=%s\n", errno, strerror(errno));
@@ -491,6 +509,44 @@ void parseAttributes(FILE *fp, Class *pclass)
         }
     }
 }
+/**
+ * @brief findBootstrapMethod finds an entry of the BootstrapMethods attribute, which is kept as read
+ * @param pclass
+ * @param bsm_index
+ * @param bsm_argc set to the number of the static arguments
+ * @param bsm_args set to the constant pool indexes of the static arguments, malloced
+ * @return the index of the CONSTANT_MethodHandle of the bootstrap method
+ */
+ushort findBootstrapMethod(Class *pclass, ushort bsm_index, int *bsm_argc, ushort **bsm_args)
+{
+    uchar *p;
+    ushort i, j, count;
+
+    for (i = 0; i < pclass->attributes_count; i++) {
+        if (strcmp(get_utf8(pclass->constant_pool[pclass->attributes[i]->attribute_name_index]), "BootstrapMethods") != 0) {
+            continue;
+        }
+        p = pclass->attributes[i]->info;
+        count = (p[0] << 8) | p[1];
+        if (bsm_index >= count) {
+            break;
+        }
+        p += 2;
+        // the entries have variable length: method ref, argument count, arguments
+        for (j = 0; j < bsm_index; j++) {
+            p += 4 + (((p[2] << 8) | p[3]) << 1);
+        }
+        *bsm_argc = (p[2] << 8) | p[3];
+        *bsm_args = (ushort*)malloc(sizeof(ushort) * (*bsm_argc + 1));
+        for (j = 0; j < *bsm_argc; j++) {
+            (*bsm_args)[j] = (p[4 + (j << 1)] << 8) | p[5 + (j << 1)];
+        }
+        return (p[0] << 8) | p[1];
+    }
+    printf("Error: no bootstrap method #%d in %s\n", bsm_index, get_this_class_name(pclass));
+    exit(1);
+}
+
 void readOtherCodeAttribute(FILE *fp, Class *pclass)
 {
     int attr_len = readUInt(fp);
@@ -498,13 +554,47 @@ void readOtherCodeAttribute(FILE *fp, Class *pclass)
     fseek(fp, attr_len, SEEK_CUR);
 }
 
-Code_attribute* parseCodeAttribute(FILE *fp, Class *pclass)
+/**
+ * @brief analyseCallKind finds how a method can be invoked, the getters and setters are run without a
+ * stack frame, and the small methods calling nothing are run in the leaf frame of the env
+ * @param code_attr
+ * @param has_call the code has an invoke or athrow instruction
+ */
+void analyseCallKind(Code_attribute *code_attr, int has_call)
+{
+    uchar *code = code_attr->code;
+
+    code_attr->frame_size = sizeof(StackFrame) + ((code_attr->max_locals + code_attr->max_stack + 4) << 2);
+    code_attr->call_kind = CALL_NORMAL;
+    code_attr->accessor_field = 0;
+
+    if (has_call || code_attr->exception_table_length > 0 ||
+            code_attr->code_length > LEAF_CODE_LENGTH || code_attr->frame_size > LEAF_FRAME_SIZE) {
+        return;
+    }
+    code_attr->call_kind = CALL_LEAF;
+
+    if (5 == code_attr->code_length && OPC_ALOAD_0 == code[0] && OPC_GETFIELD == code[1] &&
+            code[4] >= OPC_IRETURN && code[4] <= OPC_ARETURN) {
+        code_attr->call_kind = CALL_GETTER;
+        code_attr->accessor_field = TO_SHORT(code + 2);
+    } else if (6 == code_attr->code_length && OPC_ALOAD_0 == code[0] && OPC_PUTFIELD == code[2] && OPC_RETURN == code[5] &&
+            (OPC_ILOAD_1 == code[1] || OPC_LLOAD_1 == code[1] || OPC_FLOAD_1 == code[1] ||
+             OPC_DLOAD_1 == code[1] || OPC_ALOAD_1 == code[1])) {
+        code_attr->call_kind = CALL_SETTER;
+        code_attr->accessor_field = TO_SHORT(code + 3);
+    }
+}
+
+Code_attribute* parseCodeAttribute(FILE *fp, Class *pclass, int arg_slots)
 {
     fprintf(stderr, "-----------code begin-----------------\n");
     Code_attribute *code_attr;
     uchar *pcode;
     uchar *pcode_end;
+    uchar *insn_start;
     uchar op;
+    int has_call = 0;
     OPENV env;
 
     emalloc(Code_attribute, code_attr);
@@ -521,9 +611,15 @@ Code_attribute* parseCodeAttribute(FILE *fp, Class *pclass)
     pcode_end = pcode + code_attr->code_length;
     env.pc = pcode;
     env.pc_start = pcode;
+    insn_start = (uchar*)malloc(code_attr->code_length + 1);
+    memset(insn_start, 0, code_attr->code_length + 1);
 
     while(env.pc < pcode_end) {
         op = env.pc[0];
+        insn_start[env.pc-pcode] = 1;
+        if ((op >= OPC_INVOKEVIRTUAL && op <= OPC_INVOKEDYNAMIC) || OPC_ATHROW == op) {
+            has_call = 1;
+        }
         fprintf(stderr, "%4d: %s ", env.pc-pcode, jvm_instructions[op].code_name);
         env.pc+=1;
 
@@ -546,6 +642,15 @@ Code_attribute* parseCodeAttribute(FILE *fp, Class *pclass)
         }
     }
 
+    // translate to register code, the methods with exception handlers are left to the stack interpreter
+    code_attr->reg_code = NULL;
+    if (0 == code_attr->exception_table_length) {
+        code_attr->reg_code = translateRegCode(pclass, code_attr, insn_start);
+    }
+    analyseEscape(pclass, code_attr, insn_start, arg_slots);
+    free(insn_start);
+    analyseCallKind(code_attr, has_call);
+
     code_attr->attributes_count = readUShort(fp);
     if (code_attr->attributes_count > 0) {
         code_attr->attributes = (attribute_info**)malloc(sizeof(attribute_info*) * code_attr->attributes_count);
@@ -562,6 +667,7 @@ Code_attribute* parseCodeAttribute(FILE *fp, Class *pclass)
             } else {
                 debug("skip read attribute: %s", attr_type_str);
                 printf("errno=%d, errorstr=%s", errno, strerror(errno));
+                code_attr->attributes[attr_index] = NULL;
 
                 readOtherCodeAttribute(fp, pclass);
                 printf("errno=%d, errorstr=%s", errno, strerror(errno));
@@ -665,9 +771,12 @@ Class* loadClass(const char *filename)
     strcpy(logfile, filename);
     logfile[fnamelen] = 0;
     strcpy(logfile + fnamelen - 5, "code");
+    free(logfile);
 
-    Class *pclass = (Class*)malloc(sizeof(Class));
+    // zeroed, the parts a class file does not have stay NULL for freeClass
+    Class *pclass = (Class*)calloc(1, sizeof(Class));
     pclass->parent_class = NULL;
+    pclass->vm = current_vm;
 
     // step 1: read magic number
     pclass->magic = readUInt(fp);
@@ -733,11 +842,15 @@ Class* loadClass(const char *filename)
     //setThisClassFieldIndex(pclass);
 
     ((CONSTANT_Class_info*)(pclass->constant_pool[pclass->this_class]))->pclass = pclass;
+    bindAotMethods(pclass);
 
     fclose(fp);
     printf("class_name=%s, addr=%p", filename, pclass);
 
     pclass->clinit_runned = 0;
+    pclass->clinit_running = 0;
+    pclass->lock_mark = 0;
+    initRecursiveMutex(&pclass->init_lock);
     return pclass;
 }
 
@@ -942,17 +1055,25 @@ void displayThisClassFieldIndex(Class *pclass)
     }
 }
 
+/**
+ * @brief classPath the file of a class in the class directory of the vm
+ * @param filename CLASS_PATH_SIZE bytes
+ */
+static void classPath(char *filename, const char *class_name)
+{
+    if (snprintf(filename, CLASS_PATH_SIZE, "%s%s.class", current_vm->class_dir, class_name) >= CLASS_PATH_SIZE) {
+        printf("Error: java.lang.NoClassDefFoundError: the path of %s is too long\n", class_name);
+        exit(1);
+    }
+}
+
 Class* loadClassFromDisk(const char* class_name)
 {
     CONSTANT_Class_info *class_info;
     Class *pclass = NULL;
-    char *class_dir="E:/javaweb/test/src/";
-    char *class_ext=".class";
-    char filename[512];
-    memset(filename, 0, 256);
-    strcpy(filename, class_dir);
-    strcat(filename, class_name);
-    strcat(filename, class_ext);
+    char filename[CLASS_PATH_SIZE];
+
+    classPath(filename, class_name);
 
     printf("%s\n", filename);
 
@@ -972,9 +1093,11 @@ Class* loadClassFromDisk(const char* class_name)
 Class* systemLoadClass(CONSTANT_Utf8_info* class_utf8_info)
 {
     Class* pclass = NULL;
+    pthread_mutex_lock(&vm_lock);
     if (NULL == (pclass = findLoadedClass(class_utf8_info->bytes, class_utf8_info->length))) {
         pclass = loadClassFromDisk(class_utf8_info->bytes);
     }
+    pthread_mutex_unlock(&vm_lock);
 
     return pclass;
 }
@@ -982,19 +1105,42 @@ Class* systemLoadClass(CONSTANT_Utf8_info* class_utf8_info)
 method_info* findClinitMethod(Class *pclass);
 void runClinitMethod(OPENV *env, Class *clinit_class, method_info *method);
 
+/* set by the zygote while it preloads, the <clinit> of the jdk classes are run too (see zygote.c) */
+int jdk_clinit = 0;
+
+/**
+ * @brief initializeClass runs the <clinit> of the parents and then of the class if they have not run,
+ * the <clinit> of the jdk classes are not run unless jdk_clinit is set
+ * @param env
+ * @param pclass
+ */
+void initializeClass(OPENV *env, Class *pclass)
+{
+    method_info *method;
+
+    if (__atomic_load_n(&pclass->clinit_runned, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    if (NULL != pclass->parent_class) {
+        initializeClass(env, pclass->parent_class);
+    }
+    if (NULL != (method = findClinitMethod(pclass)) && (jdk_clinit || strncmp(get_this_class_name(pclass), "java", 4) != 0)) {
+        runClinitMethod(env, pclass, method);
+    } else {
+        __atomic_store_n(&pclass->clinit_runned, 1, __ATOMIC_RELEASE);
+    }
+}
+
 Class* loadClassFromDiskRecursive(OPENV* env, const char* class_name)
 {
     CONSTANT_Class_info *class_info;
     CONSTANT_Utf8_info *class_utf8_info;
-    method_info *method;
     Class *parent_class;
     Class *pclass = NULL;
 
-    char filename[512]; // caution this the class path if too long
-    memset(filename, 0, 256);
-    strcpy(filename, class_dir);
-    strcat(filename, class_name);
-    strcat(filename, ".class");
+    char filename[CLASS_PATH_SIZE];
+
+    classPath(filename, class_name);
 
     printf("%s\n", filename);
 
@@ -1014,27 +1160,160 @@ Class* loadClassFromDiskRecursive(OPENV* env, const char* class_name)
         pclass->parent_class = parent_class;
     }
 
-    if (NULL != env && NULL != (method = findClinitMethod(pclass))) {
-        if (strncmp(class_name, "java", 4) != 0) {
-            // only run non jdk's <clinit> method
-            runClinitMethod(env, pclass, method);
-        }
-    }
-
     storeLoadedClass(pclass);
     return pclass;
 }
 
+/**
+ * @brief systemLoadClassRecursive loads a class and its parents, then runs their <clinit> if env is not NULL.
+ * the <clinit> are run after vm_lock is released, another thread may load classes meanwhile
+ */
 Class* systemLoadClassRecursive(OPENV* env, CONSTANT_Utf8_info* class_utf8_info)
 {
     Class* pclass = NULL;
+    pthread_mutex_lock(&vm_lock);
     if (NULL == (pclass = findLoadedClass(class_utf8_info->bytes, class_utf8_info->length))) {
         pclass = loadClassFromDiskRecursive(env, class_utf8_info->bytes);
     }
+    pthread_mutex_unlock(&vm_lock);
+    if (NULL != env) {
+        initializeClass(env, pclass);
+    }
 
     return pclass;
 }
 
+static void freeAttributes(attribute_info **attributes, ushort count)
+{
+    ushort i;
+
+    for (i = 0; i < count; i++) {
+        free(attributes[i]->info);
+        free(attributes[i]);
+    }
+    free(attributes);
+}
+
+static void freeCodeAttribute(Code_attribute *code_attr)
+{
+    LineNumberTable_attribute *table;
+    EscapeInfo *escape = code_attr->escape;
+    ushort i;
+
+    if (code_attr->exception_table_length > 0) {
+        free(code_attr->exceptions);
+    }
+    if (code_attr->attributes_count > 0) {
+        // the line number and the local variable tables have the same layout, the other attributes are skipped
+        for (i = 0; i < code_attr->attributes_count; i++) {
+            if (NULL != (table = (LineNumberTable_attribute*)code_attr->attributes[i])) {
+                if (table->table_length > 0) {
+                    free(table->tables);
+                }
+                free(table);
+            }
+        }
+        free(code_attr->attributes);
+    }
+    if (NULL != code_attr->reg_code) {
+        free(code_attr->reg_code->insns);
+        free(code_attr->reg_code);
+    }
+    if (NULL != escape) {
+        if (NULL != escape->candidates) {
+            for (i = 0; i < escape->candidate_count; i++) {
+                free(escape->candidates[i].uses);
+            }
+            free(escape->candidates);
+        }
+        free(escape->sites);
+        free(escape->replaced_code);
+        free(escape);
+    }
+    free(code_attr->code);
+    free(code_attr);
+}
+
+/**
+ * @brief freeClass frees a class of a destroyed vm: its fields, methods, attributes and constant pool, the
+ * names are freed last. nothing may run its code or read its objects anymore
+ */
+void freeClass(Class *pclass)
+{
+    CONSTANT_Methodref_info *m_info;
+    MethodEntry *mte, *next;
+    method_info *method;
+    attribute_info *attr;
+    ushort i, j;
+    void *info;
+
+    free(pclass->interfaces);
+
+    for (i = 0; i < pclass->fields_count; i++) {
+        freeAttributes(pclass->fields[i]->attributes, pclass->fields[i]->attributes_count);
+        free(pclass->fields[i]);
+    }
+    free(pclass->fields);
+
+    for (i = 0; i < pclass->methods_count; i++) {
+        method = pclass->methods[i];
+        for (j = 0; j < method->attributes_count; j++) {
+            attr = method->attributes[j];
+            if ((void*)attr->info == (void*)method->code_attribute_addr) {
+                freeCodeAttribute(method->code_attribute_addr);
+            } else {
+                free(attr->info);
+            }
+            free(attr);
+        }
+        free(method->attributes);
+        free(method);
+    }
+    free(pclass->methods);
+
+    for (i = 0; i < pclass->attributes_count; i++) {
+        attr = pclass->attributes[i];
+        if (strcmp(get_utf8(pclass->constant_pool[attr->attribute_name_index]), "Code") == 0) {
+            freeCodeAttribute((Code_attribute*)attr->info);
+        } else {
+            free(attr->info);
+        }
+        free(attr);
+    }
+    free(pclass->attributes);
+
+    for (i = 1; i < pclass->constant_pool_count; i++) {
+        if (NULL == (info = pclass->constant_pool[i])) {
+            continue;
+        }
+        switch (*(uchar*)info) {
+            case CONSTANT_Utf8:
+                free(((CONSTANT_Utf8_info*)info)->bytes);
+                break;
+            case CONSTANT_Methodref:
+            case CONSTANT_InterfaceMethodref:
+                m_info = (CONSTANT_Methodref_info*)info;
+                if (NULL != m_info->mtable) {
+                    for (mte = m_info->mtable->head; NULL != mte; mte = next) {
+                        next = mte->next;
+                        free(mte);
+                    }
+                    free(m_info->mtable);
+                }
+                break;
+            case CONSTANT_InvokeDynamic:
+                free(((CONSTANT_InvokeDynamic_info*)info)->call_site);
+                break;
+        }
+        free(info);
+    }
+    free(pclass->constant_pool);
+    free(pclass->ref_map);
+    free(pclass->static_fields);
+    pthread_mutex_destroy(&pclass->init_lock);
+    free(pclass);
+}
+
 int getMethodrefArgsLen(Class* pclass, ushort descriptor_index)
 {
     short args_len = 0, args_count=0;
@@ -1060,7 +1339,7 @@ int getMethodrefArgsLen(Class* pclass, ushort descriptor_index)
                 ++args_desc;
                 break;
             case 'L':
-                args_len+=SZ_INT;
+                args_len+=SZ_REF;
                 args_desc++;
                 while(*args_desc != ';') {
                     args_desc++;
@@ -1069,7 +1348,7 @@ int getMethodrefArgsLen(Class* pclass, ushort descriptor_index)
                 args_count++;
                 break;
             case '[':
-                args_len+=SZ_INT;
+                args_len+=SZ_REF;
                 while(*args_desc == '[') {
                     args_desc++;
                 }
@@ -0,0 +1,806 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef REG_IR_C
+#define REG_IR_C
+
+#include <limits.h>
+#include <math.h>
+
+#include "opcode.h"
+#include "op_core.h"
+
+/**
+  * this file implements the register engine.
+  * When a method is loaded, its bytecode is translated into three-address
+  * instructions working on virtual registers: the local variable slot n is
+  * register n, and the operand stack slot n is register (max_locals + n).
+  * Loads of locals and constants do not generate any instruction, the
+  * translator just remembers which register holds the value, so
+  * `iload_1; iload_2; iadd; istore_3` becomes a single `iadd r3, r1, r2`.
+  *
+  * Only the methods doing int/long/float/double computation without calling
+  * other methods are translated, the others are run by the stack interpreter.
+  */
+
+#define ENGINE_STACK 0
+#define ENGINE_REGISTER 1
+
+/* the engine used for the translated methods, selected in main.c */
+int jvm_engine = ENGINE_STACK;
+
+enum {
+    REG_MOV, REG_MOVL, REG_CONST, REG_CONSTL,
+    REG_IADD, REG_ISUB, REG_IMUL, REG_IDIV, REG_IREM, REG_INEG,
+    REG_ISHL, REG_ISHR, REG_IUSHR, REG_IAND, REG_IOR, REG_IXOR, REG_IINC,
+    REG_LADD, REG_LSUB, REG_LMUL, REG_LDIV, REG_LREM, REG_LNEG,
+    REG_LSHL, REG_LSHR, REG_LUSHR, REG_LAND, REG_LOR, REG_LXOR,
+    REG_FADD, REG_FSUB, REG_FMUL, REG_FDIV, REG_FNEG,
+    REG_DADD, REG_DSUB, REG_DMUL, REG_DDIV, REG_DNEG,
+    REG_I2L, REG_I2F, REG_I2D, REG_L2I, REG_L2F, REG_L2D,
+    REG_F2I, REG_F2L, REG_F2D, REG_D2I, REG_D2L, REG_D2F,
+    REG_I2B, REG_I2C, REG_I2S,
+    REG_LCMP, REG_FCMPL, REG_FCMPG, REG_DCMPL, REG_DCMPG,
+    /* intrinsics of java/lang/Math, see intrinsics.c */
+    REG_IABS, REG_LABS, REG_FABS, REG_DABS, REG_DSQRT,
+    REG_IMAX, REG_IMIN, REG_LMAX, REG_LMIN,
+    /* the following instructions do not write the dst register */
+    REG_IFEQ, REG_IFNE, REG_IFLT, REG_IFGE, REG_IFGT, REG_IFLE,
+    REG_IF_ICMPEQ, REG_IF_ICMPNE, REG_IF_ICMPLT, REG_IF_ICMPGE, REG_IF_ICMPGT, REG_IF_ICMPLE,
+    REG_GOTO, REG_RET, REG_RETL, REG_RETV
+};
+
+#define REG_WRITES_DST(op) ((op) < REG_IFEQ)
+#define NO_REG_OP 0xff
+
+int findIntrinsicRegOp(Class *pclass, ushort mindex);
+
+typedef struct _RegInsn {
+    uchar op;
+    ushort dst;
+    ushort src1;
+    ushort src2;
+    int target; // index of the target instruction, [for branch]
+    union {
+        int i;
+        float f;
+        long l;
+        double d;
+    } k; // the immediate value, [for const and iinc]
+} RegInsn;
+
+typedef struct _RegCode {
+    ushort nregs;
+    ushort insn_count;
+    char ret_type; // 'V', 'I', 'J', 'F' or 'D'
+    RegInsn *insns;
+} RegCode;
+
+typedef struct _RegStackEntry {
+    ushort reg;
+    uchar slots;
+} RegStackEntry;
+
+typedef struct _RegTranslator {
+    Code_attribute *code_attr;
+    RegInsn *insns;
+    int count;
+    int capacity;
+    RegStackEntry *entries;
+    int nentries;
+    int depth;   // operand stack depth in slots
+    ushort base; // register of the operand stack slot 0
+    char ret_type;
+} RegTranslator;
+
+static RegInsn* regEmit(RegTranslator *rt, uchar op, ushort dst, ushort src1, ushort src2)
+{
+    RegInsn *insn;
+    if (rt->count == rt->capacity) {
+        rt->capacity = rt->capacity == 0 ? 32 : (rt->capacity << 1);
+        rt->insns = (RegInsn*)realloc(rt->insns, sizeof(RegInsn) * rt->capacity);
+    }
+    insn = rt->insns + rt->count++;
+    memset(insn, 0, sizeof(RegInsn));
+    insn->op = op;
+    insn->dst = dst;
+    insn->src1 = src1;
+    insn->src2 = src2;
+
+    return insn;
+}
+
+static void regPush(RegTranslator *rt, ushort reg, uchar slots)
+{
+    rt->entries[rt->nentries].reg = reg;
+    rt->entries[rt->nentries].slots = slots;
+    rt->nentries++;
+    rt->depth += slots;
+}
+
+static RegStackEntry regPop(RegTranslator *rt)
+{
+    RegStackEntry e = rt->entries[--rt->nentries];
+    rt->depth -= e.slots;
+    return e;
+}
+
+#define REG_TOP(rt) ((rt)->base + (rt)->depth)
+
+/**
+ * @brief regMaterialize moves every value still living in another register to its own stack register,
+ * this is needed before a branch, since the code at the target expects the values there
+ */
+static void regMaterialize(RegTranslator *rt)
+{
+    int i, depth = 0;
+    RegStackEntry *e;
+    for (i = 0; i < rt->nentries; i++) {
+        e = rt->entries + i;
+        if (e->reg != rt->base + depth) {
+            regEmit(rt, e->slots == 2 ? REG_MOVL : REG_MOV, rt->base + depth, e->reg, 0);
+            e->reg = rt->base + depth;
+        }
+        depth += e->slots;
+    }
+}
+
+/**
+ * @brief regMaterializeLocal the local variable will be overwritten, the pending loads of it must be done first
+ */
+static void regMaterializeLocal(RegTranslator *rt, ushort local, uchar slots)
+{
+    int i, depth = 0;
+    RegStackEntry *e;
+    for (i = 0; i < rt->nentries; i++) {
+        e = rt->entries + i;
+        if (e->reg + e->slots > local && e->reg < local + slots) {
+            regEmit(rt, e->slots == 2 ? REG_MOVL : REG_MOV, rt->base + depth, e->reg, 0);
+            e->reg = rt->base + depth;
+        }
+        depth += e->slots;
+    }
+}
+
+static void regBinary(RegTranslator *rt, uchar op, uchar result_slots)
+{
+    RegStackEntry v2 = regPop(rt);
+    RegStackEntry v1 = regPop(rt);
+    regEmit(rt, op, REG_TOP(rt), v1.reg, v2.reg);
+    regPush(rt, REG_TOP(rt), result_slots);
+}
+
+static void regUnary(RegTranslator *rt, uchar op, uchar result_slots)
+{
+    RegStackEntry v = regPop(rt);
+    regEmit(rt, op, REG_TOP(rt), v.reg, 0);
+    regPush(rt, REG_TOP(rt), result_slots);
+}
+
+/**
+ * @brief regIntrinsic translates an invokestatic of an intrinsic having a register instruction
+ */
+static int regIntrinsic(RegTranslator *rt, int op)
+{
+    switch (op) {
+        case REG_IABS:
+        case REG_FABS:
+            regUnary(rt, op, 1);
+            return 1;
+        case REG_LABS:
+        case REG_DABS:
+        case REG_DSQRT:
+            regUnary(rt, op, 2);
+            return 1;
+        case REG_IMAX:
+        case REG_IMIN:
+            regBinary(rt, op, 1);
+            return 1;
+        case REG_LMAX:
+        case REG_LMIN:
+            regBinary(rt, op, 2);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static RegInsn* regConst(RegTranslator *rt, uchar slots)
+{
+    RegInsn *insn = regEmit(rt, slots == 2 ? REG_CONSTL : REG_CONST, REG_TOP(rt), 0, 0);
+    regPush(rt, REG_TOP(rt), slots);
+    return insn;
+}
+
+static int regLoad(RegTranslator *rt, int local, uchar slots)
+{
+    if (local + slots > rt->code_attr->max_locals) {
+        return 0;
+    }
+    regPush(rt, local, slots);
+    return 1;
+}
+
+static int regStore(RegTranslator *rt, int local, uchar slots, int is_target)
+{
+    int i;
+    RegInsn *last;
+    RegStackEntry v;
+
+    if (local + slots > rt->code_attr->max_locals) {
+        return 0;
+    }
+    v = regPop(rt);
+    regMaterializeLocal(rt, local, slots);
+
+    // let the instruction computing the value write the local directly
+    last = rt->count > 0 ? rt->insns + rt->count - 1 : NULL;
+    if (NULL != last && !is_target && REG_WRITES_DST(last->op) && last->dst == v.reg && v.reg >= rt->base) {
+        for (i = 0; i < rt->nentries; i++) {
+            if (rt->entries[i].reg == v.reg) {
+                break;
+            }
+        }
+        if (i == rt->nentries) {
+            last->dst = local;
+            return 1;
+        }
+    }
+    regEmit(rt, slots == 2 ? REG_MOVL : REG_MOV, local, v.reg, 0);
+    return 1;
+}
+
+static int regLdc(RegTranslator *rt, Class *pclass, ushort index)
+{
+    void *cp_entry = pclass->constant_pool[index];
+    uchar tag = NULL == cp_entry ? 0 : *(uchar*)cp_entry;
+    switch (tag) {
+        case CONSTANT_Integer:
+            regConst(rt, 1)->k.i = ((CONSTANT_Integer_info*)cp_entry)->value;
+            return 1;
+        case CONSTANT_Float:
+            regConst(rt, 1)->k.f = ((CONSTANT_Float_info*)cp_entry)->value;
+            return 1;
+        case CONSTANT_Long:
+            regConst(rt, 2)->k.l = ((CONSTANT_Long_info*)cp_entry)->value;
+            return 1;
+        case CONSTANT_Double:
+            regConst(rt, 2)->k.d = ((CONSTANT_Double_info*)cp_entry)->value;
+            return 1;
+        default:
+            // string and class constants are objects
+            return 0;
+    }
+}
+
+static int regReturn(RegTranslator *rt, char ret_type)
+{
+    RegStackEntry v;
+    if (rt->ret_type != 0 && rt->ret_type != ret_type) {
+        return 0;
+    }
+    rt->ret_type = ret_type;
+    if ('V' == ret_type) {
+        regEmit(rt, REG_RETV, 0, 0, 0);
+    } else {
+        v = regPop(rt);
+        regEmit(rt, v.slots == 2 ? REG_RETL : REG_RET, 0, v.reg, 0);
+    }
+    return 1;
+}
+
+/**
+ * @brief regBranchTarget checks the stack depth expected at the target of a branch
+ */
+static int regBranchTarget(RegTranslator *rt, int *target_depth, int target)
+{
+    int i;
+    for (i = 0; i < rt->nentries; i++) {
+        if (rt->entries[i].slots != 1) {
+            return 0;
+        }
+    }
+    if (target_depth[target] == -1) {
+        target_depth[target] = rt->depth;
+    }
+    return target_depth[target] == rt->depth;
+}
+
+static int regTranslateFail(RegTranslator *rt, const char *reason, int pc)
+{
+    debug("register translate failed at #%d: %s", pc, reason);
+    free(rt->insns);
+    free(rt->entries);
+    return 0;
+}
+
+/**
+ * @brief translateRegCode translates the bytecode of a method into register code
+ * @param pclass the class the method belongs to, its constant pool must be parsed
+ * @param code_attr the code attribute, the operands must be converted to little endian by the pre_action walk
+ * @param insn_start insn_start[pc] is not 0 if an instruction begins at pc, recorded by the pre_action walk
+ * @return the register code, NULL if the method uses an instruction not supported by the register engine
+ */
+RegCode* translateRegCode(Class *pclass, Code_attribute *code_attr, uchar *insn_start)
+{
+    RegTranslator rt;
+    RegCode *rc;
+    RegInsn *insn;
+    uchar *code = code_attr->code;
+    int code_length = code_attr->code_length;
+    int *pc2ir, *target_depth;
+    uchar *is_target;
+    int pc, target, reachable = 1, ok = 1, i;
+    const char *reason = "no return";
+    uchar op;
+
+    memset(&rt, 0, sizeof(RegTranslator));
+    rt.code_attr = code_attr;
+    rt.base = code_attr->max_locals;
+    rt.entries = (RegStackEntry*)malloc(sizeof(RegStackEntry) * (code_attr->max_stack + 1));
+
+    pc2ir = (int*)malloc(sizeof(int) * (code_length + 1));
+    target_depth = (int*)malloc(sizeof(int) * (code_length + 1));
+    is_target = (uchar*)malloc(code_length + 1);
+    memset(is_target, 0, code_length + 1);
+    for (pc = 0; pc <= code_length; pc++) {
+        pc2ir[pc] = -1;
+        target_depth[pc] = -1;
+    }
+
+    // 1. find the branch targets
+    for (pc = 0; pc < code_length; pc++) {
+        op = code[pc];
+        if (insn_start[pc] && ((op >= OPC_IFEQ && op <= OPC_IF_ICMPLE) || op == OPC_GOTO)) {
+            target = pc + TO_SHORT(code + pc + 1);
+            if (target < 0 || target >= code_length) {
+                reason = "branch target out of the code";
+                ok = 0;
+                break;
+            }
+            is_target[target] = 1;
+        }
+    }
+
+    // 2. translate instruction by instruction
+    for (pc = 0; ok && pc < code_length; pc++) {
+        if (!insn_start[pc]) {
+            continue;
+        }
+        op = code[pc];
+
+        if (is_target[pc]) {
+            if (reachable) {
+                regMaterialize(&rt);
+                if (!regBranchTarget(&rt, target_depth, pc)) {
+                    reason = "stack differs at a branch target";
+                    ok = 0;
+                    break;
+                }
+            } else {
+                // only reached by jumps, the values are in their stack registers
+                rt.nentries = rt.depth = 0;
+                for (i = 0; i < (target_depth[pc] == -1 ? 0 : target_depth[pc]); i++) {
+                    regPush(&rt, REG_TOP(&rt), 1);
+                }
+                target_depth[pc] = rt.depth;
+                reachable = 1;
+            }
+        } else if (!reachable) {
+            continue;
+        }
+        pc2ir[pc] = rt.count;
+
+        if (op >= OPC_ICONST_M1 && op <= OPC_ICONST_5) {
+            regConst(&rt, 1)->k.i = op - OPC_ICONST_M1 - 1;
+        } else if (op == OPC_LCONST_0 || op == OPC_LCONST_1) {
+            regConst(&rt, 2)->k.l = op - OPC_LCONST_0;
+        } else if (op >= OPC_FCONST_0 && op <= OPC_FCONST_2) {
+            regConst(&rt, 1)->k.f = (float)(op - OPC_FCONST_0);
+        } else if (op == OPC_DCONST_0 || op == OPC_DCONST_1) {
+            regConst(&rt, 2)->k.d = (double)(op - OPC_DCONST_0);
+        } else if (op >= OPC_ILOAD && op <= OPC_DLOAD) {
+            ok = regLoad(&rt, code[pc+1], (op == OPC_LLOAD || op == OPC_DLOAD) ? 2 : 1);
+        } else if (op >= OPC_ILOAD_0 && op < OPC_DLOAD_0 + 4) {
+            ok = regLoad(&rt, (op - OPC_ILOAD_0) & 3, (op >= OPC_LLOAD_0 && op < OPC_FLOAD_0) || op >= OPC_DLOAD_0 ? 2 : 1);
+        } else if (op >= OPC_ISTORE && op <= OPC_DSTORE) {
+            ok = regStore(&rt, code[pc+1], (op == OPC_LSTORE || op == OPC_DSTORE) ? 2 : 1, is_target[pc]);
+        } else if (op >= OPC_ISTORE_0 && op < OPC_DSTORE_0 + 4) {
+            ok = regStore(&rt, (op - OPC_ISTORE_0) & 3, (op >= OPC_LSTORE_0 && op < OPC_FSTORE_0) || op >= OPC_DSTORE_0 ? 2 : 1, is_target[pc]);
+        } else if (op >= OPC_IADD && op <= OPC_LXOR && op != 0x72 && op != 0x73) {
+            // 0x72 frem and 0x73 drem are left to the stack interpreter
+            switch (op) {
+                case OPC_IADD: regBinary(&rt, REG_IADD, 1); break;
+                case OPC_ISUB: regBinary(&rt, REG_ISUB, 1); break;
+                case OPC_IMUL: regBinary(&rt, REG_IMUL, 1); break;
+                case OPC_IDIV: regBinary(&rt, REG_IDIV, 1); break;
+                case OPC_IREM: regBinary(&rt, REG_IREM, 1); break;
+                case OPC_INEG: regUnary(&rt, REG_INEG, 1); break;
+                case OPC_ISHL: regBinary(&rt, REG_ISHL, 1); break;
+                case OPC_ISHR: regBinary(&rt, REG_ISHR, 1); break;
+                case OPC_IUSHR: regBinary(&rt, REG_IUSHR, 1); break;
+                case OPC_IAND: regBinary(&rt, REG_IAND, 1); break;
+                case OPC_IOR: regBinary(&rt, REG_IOR, 1); break;
+                case OPC_IXOR: regBinary(&rt, REG_IXOR, 1); break;
+                case OPC_LADD: regBinary(&rt, REG_LADD, 2); break;
+                case OPC_LSUB: regBinary(&rt, REG_LSUB, 2); break;
+                case OPC_LMUL: regBinary(&rt, REG_LMUL, 2); break;
+                case OPC_LDIV: regBinary(&rt, REG_LDIV, 2); break;
+                case OPC_LREM: regBinary(&rt, REG_LREM, 2); break;
+                case OPC_LNEG: regUnary(&rt, REG_LNEG, 2); break;
+                case OPC_LSHL: regBinary(&rt, REG_LSHL, 2); break;
+                case OPC_LSHR: regBinary(&rt, REG_LSHR, 2); break;
+                case OPC_LUSHR: regBinary(&rt, REG_LUSHR, 2); break;
+                case OPC_LAND: regBinary(&rt, REG_LAND, 2); break;
+                case OPC_LOR: regBinary(&rt, REG_LOR, 2); break;
+                case OPC_LXOR: regBinary(&rt, REG_LXOR, 2); break;
+                case OPC_FADD: regBinary(&rt, REG_FADD, 1); break;
+                case OPC_FSUB: regBinary(&rt, REG_FSUB, 1); break;
+                case OPC_FMUL: regBinary(&rt, REG_FMUL, 1); break;
+                case OPC_FDIV: regBinary(&rt, REG_FDIV, 1); break;
+                case OPC_FNEG: regUnary(&rt, REG_FNEG, 1); break;
+                case OPC_DADD: regBinary(&rt, REG_DADD, 2); break;
+                case OPC_DSUB: regBinary(&rt, REG_DSUB, 2); break;
+                case OPC_DMUL: regBinary(&rt, REG_DMUL, 2); break;
+                case OPC_DDIV: regBinary(&rt, REG_DDIV, 2); break;
+                case OPC_DNEG: regUnary(&rt, REG_DNEG, 2); break;
+                default: ok = 0; break;
+            }
+        } else if (op >= OPC_I2L && op <= OPC_I2S) {
+            static const uchar cast_ops[] = {
+                REG_I2L, REG_I2F, REG_I2D, REG_L2I, REG_L2F, REG_L2D,
+                REG_F2I, REG_F2L, REG_F2D, REG_D2I, REG_D2L, REG_D2F,
+                REG_I2B, REG_I2C, REG_I2S
+            };
+            static const uchar cast_slots[] = {2, 1, 2, 1, 1, 2, 1, 2, 2, 1, 2, 1, 1, 1, 1};
+            regUnary(&rt, cast_ops[op - OPC_I2L], cast_slots[op - OPC_I2L]);
+        } else if (op >= OPC_LCMP && op <= OPC_DCMPG) {
+            regBinary(&rt, REG_LCMP + (op - OPC_LCMP), 1);
+        } else if (op >= OPC_IFEQ && op <= OPC_IFLE) {
+            RegStackEntry v = regPop(&rt);
+            regMaterialize(&rt);
+            target = pc + TO_SHORT(code + pc + 1);
+            ok = regBranchTarget(&rt, target_depth, target);
+            insn = regEmit(&rt, REG_IFEQ + (op - OPC_IFEQ), 0, v.reg, 0);
+            insn->target = target;
+        } else if (op >= OPC_IF_ICMPEQ && op <= OPC_IF_ICMPLE) {
+            RegStackEntry v2 = regPop(&rt);
+            RegStackEntry v1 = regPop(&rt);
+            regMaterialize(&rt);
+            target = pc + TO_SHORT(code + pc + 1);
+            ok = regBranchTarget(&rt, target_depth, target);
+            insn = regEmit(&rt, REG_IF_ICMPEQ + (op - OPC_IF_ICMPEQ), 0, v1.reg, v2.reg);
+            insn->target = target;
+        } else if (op == OPC_GOTO) {
+            regMaterialize(&rt);
+            target = pc + TO_SHORT(code + pc + 1);
+            ok = regBranchTarget(&rt, target_depth, target);
+            insn = regEmit(&rt, REG_GOTO, 0, 0, 0);
+            insn->target = target;
+            reachable = 0;
+        } else {
+            switch (op) {
+                case OPC_NOP:
+                    break;
+                case OPC_BIPUSH:
+                    regConst(&rt, 1)->k.i = (signed char)code[pc+1];
+                    break;
+                case OPC_SIPUSH:
+                    regConst(&rt, 1)->k.i = TO_SHORT(code + pc + 1);
+                    break;
+                case OPC_LDC:
+                case OPC_LDC_W:
+                case OPC_LDC2_W:
+                    ok = regLdc(&rt, pclass, op == OPC_LDC ? code[pc+1] : (ushort)TO_SHORT(code + pc + 1));
+                    break;
+                case OPC_IINC:
+                    if (code[pc+1] >= code_attr->max_locals) {
+                        ok = 0;
+                        break;
+                    }
+                    regMaterializeLocal(&rt, code[pc+1], 1);
+                    insn = regEmit(&rt, REG_IINC, code[pc+1], code[pc+1], 0);
+                    insn->k.i = (signed char)code[pc+2];
+                    break;
+                case OPC_POP:
+                case OPC_POP2:
+                    if (regPop(&rt).slots == 1 && op == OPC_POP2) {
+                        regPop(&rt);
+                    }
+                    break;
+                case OPC_DUP:
+                    regPush(&rt, rt.entries[rt.nentries-1].reg, 1);
+                    break;
+                case OPC_INVOKESTATIC:
+                    ok = regIntrinsic(&rt, findIntrinsicRegOp(pclass, (ushort)TO_SHORT(code + pc + 1)));
+                    break;
+                case OPC_IRETURN: ok = regReturn(&rt, 'I'); reachable = 0; break;
+                case OPC_LRETURN: ok = regReturn(&rt, 'J'); reachable = 0; break;
+                case OPC_FRETURN: ok = regReturn(&rt, 'F'); reachable = 0; break;
+                case OPC_DRETURN: ok = regReturn(&rt, 'D'); reachable = 0; break;
+                case OPC_RETURN: ok = regReturn(&rt, 'V'); reachable = 0; break;
+                default:
+                    ok = 0;
+                    break;
+            }
+        }
+        if (!ok) {
+            reason = jvm_instructions[op].code_name;
+            break;
+        }
+    }
+
+    // 3. bind the branch targets to instruction indexes
+    for (i = 0; ok && i < rt.count; i++) {
+        insn = rt.insns + i;
+        if (insn->op >= REG_IFEQ && insn->op <= REG_GOTO) {
+            if (-1 == pc2ir[insn->target]) {
+                reason = "branch into an unreachable or unsupported instruction";
+                pc = insn->target;
+                ok = 0;
+                break;
+            }
+            insn->target = pc2ir[insn->target];
+        }
+    }
+
+    free(pc2ir);
+    free(target_depth);
+    free(is_target);
+    if (!ok || 0 == rt.ret_type) {
+        regTranslateFail(&rt, reason, pc);
+        return NULL;
+    }
+    free(rt.entries);
+
+    rc = (RegCode*)malloc(sizeof(RegCode));
+    rc->nregs = code_attr->max_locals + code_attr->max_stack + 1;
+    rc->insn_count = rt.count;
+    rc->ret_type = rt.ret_type;
+    rc->insns = rt.insns;
+    debug("register translate success: %d bytes -> %d instructions", code_length, rt.count);
+
+    return rc;
+}
+
+#define R_I(r) (regs[r])
+#define R_F(r) (*(float*)(regs+(r)))
+#define R_L(r) (*(long*)(regs+(r)))
+#define R_D(r) (*(double*)(regs+(r)))
+
+/* the backward jumps poll the safepoints, the registers hold no reference so the thread may stop there */
+#define REG_JUMP() if (ip->target <= ip - rc->insns) {\
+        SAFEPOINT_POLL(NULL);\
+    }\
+    ip = rc->insns + ip->target;\
+    continue
+
+#define REG_BRANCH(cond) if (cond) {\
+        REG_JUMP();\
+    }\
+    break
+
+static int regF2I(double v)
+{
+    if (v != v) {
+        return 0;
+    }
+    if (v >= (double)INT_MAX) {
+        return INT_MAX;
+    }
+    if (v <= (double)INT_MIN) {
+        return INT_MIN;
+    }
+    return (int)v;
+}
+
+static long regF2L(double v)
+{
+    if (v != v) {
+        return 0;
+    }
+    if (v >= (double)LONG_MAX) {
+        return LONG_MAX;
+    }
+    if (v <= (double)LONG_MIN) {
+        return LONG_MIN;
+    }
+    return (long)v;
+}
+
+#define REG_FCMP(v1, v2, nan) ((v1) > (v2) ? 1 : ((v1) == (v2) ? 0 : ((v1) < (v2) ? -1 : (nan))))
+
+static void regDivideByZero()
+{
+    printf("Error: java.lang.ArithmeticException: / by zero\n");
+    exit(1);
+}
+
+/**
+ * @brief runRegCode the execute loop of the register engine
+ * @param rc the register code of the method
+ * @param args the arguments, copied to the first registers like the local variables
+ * @param args_len length of the arguments in bytes
+ * @param result the returned value is written here (two slots for long and double)
+ */
+void runRegCode(RegCode *rc, int *args, int args_len, int *result)
+{
+    int regs[rc->nregs];
+    RegInsn *ip = rc->insns;
+
+    memcpy(regs, args, args_len);
+
+    for (;;) {
+        switch (ip->op) {
+            case REG_MOV: R_I(ip->dst) = R_I(ip->src1); break;
+            case REG_MOVL: R_L(ip->dst) = R_L(ip->src1); break;
+            case REG_CONST: R_I(ip->dst) = ip->k.i; break;
+            case REG_CONSTL: R_L(ip->dst) = ip->k.l; break;
+
+            case REG_IADD: R_I(ip->dst) = (int)((uint)R_I(ip->src1) + (uint)R_I(ip->src2)); break;
+            case REG_ISUB: R_I(ip->dst) = (int)((uint)R_I(ip->src1) - (uint)R_I(ip->src2)); break;
+            case REG_IMUL: R_I(ip->dst) = (int)((uint)R_I(ip->src1) * (uint)R_I(ip->src2)); break;
+            case REG_IDIV:
+                if (0 == R_I(ip->src2)) {
+                    regDivideByZero();
+                }
+                R_I(ip->dst) = -1 == R_I(ip->src2) ? (int)(0u - (uint)R_I(ip->src1)) : R_I(ip->src1) / R_I(ip->src2);
+                break;
+            case REG_IREM:
+                if (0 == R_I(ip->src2)) {
+                    regDivideByZero();
+                }
+                R_I(ip->dst) = -1 == R_I(ip->src2) ? 0 : R_I(ip->src1) % R_I(ip->src2);
+                break;
+            case REG_INEG: R_I(ip->dst) = (int)(0u - (uint)R_I(ip->src1)); break;
+            case REG_ISHL: R_I(ip->dst) = (int)((uint)R_I(ip->src1) << (R_I(ip->src2) & 0x1f)); break;
+            case REG_ISHR: R_I(ip->dst) = R_I(ip->src1) >> (R_I(ip->src2) & 0x1f); break;
+            case REG_IUSHR: R_I(ip->dst) = (int)((uint)R_I(ip->src1) >> (R_I(ip->src2) & 0x1f)); break;
+            case REG_IAND: R_I(ip->dst) = R_I(ip->src1) & R_I(ip->src2); break;
+            case REG_IOR: R_I(ip->dst) = R_I(ip->src1) | R_I(ip->src2); break;
+            case REG_IXOR: R_I(ip->dst) = R_I(ip->src1) ^ R_I(ip->src2); break;
+            case REG_IINC: R_I(ip->dst) = (int)((uint)R_I(ip->src1) + (uint)ip->k.i); break;
+
+            case REG_LADD: R_L(ip->dst) = (long)((unsigned long)R_L(ip->src1) + (unsigned long)R_L(ip->src2)); break;
+            case REG_LSUB: R_L(ip->dst) = (long)((unsigned long)R_L(ip->src1) - (unsigned long)R_L(ip->src2)); break;
+            case REG_LMUL: R_L(ip->dst) = (long)((unsigned long)R_L(ip->src1) * (unsigned long)R_L(ip->src2)); break;
+            case REG_LDIV:
+                if (0 == R_L(ip->src2)) {
+                    regDivideByZero();
+                }
+                R_L(ip->dst) = -1 == R_L(ip->src2) ? (long)(0ul - (unsigned long)R_L(ip->src1)) : R_L(ip->src1) / R_L(ip->src2);
+                break;
+            case REG_LREM:
+                if (0 == R_L(ip->src2)) {
+                    regDivideByZero();
+                }
+                R_L(ip->dst) = -1 == R_L(ip->src2) ? 0 : R_L(ip->src1) % R_L(ip->src2);
+                break;
+            case REG_LNEG: R_L(ip->dst) = (long)(0ul - (unsigned long)R_L(ip->src1)); break;
+            case REG_LSHL: R_L(ip->dst) = (long)((unsigned long)R_L(ip->src1) << (R_I(ip->src2) & 0x3f)); break;
+            case REG_LSHR: R_L(ip->dst) = R_L(ip->src1) >> (R_I(ip->src2) & 0x3f); break;
+            case REG_LUSHR: R_L(ip->dst) = (long)((unsigned long)R_L(ip->src1) >> (R_I(ip->src2) & 0x3f)); break;
+            case REG_LAND: R_L(ip->dst) = R_L(ip->src1) & R_L(ip->src2); break;
+            case REG_LOR: R_L(ip->dst) = R_L(ip->src1) | R_L(ip->src2); break;
+            case REG_LXOR: R_L(ip->dst) = R_L(ip->src1) ^ R_L(ip->src2); break;
+
+            case REG_FADD: R_F(ip->dst) = R_F(ip->src1) + R_F(ip->src2); break;
+            case REG_FSUB: R_F(ip->dst) = R_F(ip->src1) - R_F(ip->src2); break;
+            case REG_FMUL: R_F(ip->dst) = R_F(ip->src1) * R_F(ip->src2); break;
+            case REG_FDIV: R_F(ip->dst) = R_F(ip->src1) / R_F(ip->src2); break;
+            case REG_FNEG: R_F(ip->dst) = -R_F(ip->src1); break;
+            case REG_DADD: R_D(ip->dst) = R_D(ip->src1) + R_D(ip->src2); break;
+            case REG_DSUB: R_D(ip->dst) = R_D(ip->src1) - R_D(ip->src2); break;
+            case REG_DMUL: R_D(ip->dst) = R_D(ip->src1) * R_D(ip->src2); break;
+            case REG_DDIV: R_D(ip->dst) = R_D(ip->src1) / R_D(ip->src2); break;
+            case REG_DNEG: R_D(ip->dst) = -R_D(ip->src1); break;
+
+            case REG_I2L: R_L(ip->dst) = (long)R_I(ip->src1); break;
+            case REG_I2F: R_F(ip->dst) = (float)R_I(ip->src1); break;
+            case REG_I2D: R_D(ip->dst) = (double)R_I(ip->src1); break;
+            case REG_L2I: R_I(ip->dst) = (int)R_L(ip->src1); break;
+            case REG_L2F: R_F(ip->dst) = (float)R_L(ip->src1); break;
+            case REG_L2D: R_D(ip->dst) = (double)R_L(ip->src1); break;
+            case REG_F2I: R_I(ip->dst) = regF2I(R_F(ip->src1)); break;
+            case REG_F2L: R_L(ip->dst) = regF2L(R_F(ip->src1)); break;
+            case REG_F2D: R_D(ip->dst) = (double)R_F(ip->src1); break;
+            case REG_D2I: R_I(ip->dst) = regF2I(R_D(ip->src1)); break;
+            case REG_D2L: R_L(ip->dst) = regF2L(R_D(ip->src1)); break;
+            case REG_D2F: R_F(ip->dst) = (float)R_D(ip->src1); break;
+            case REG_I2B: R_I(ip->dst) = (signed char)R_I(ip->src1); break;
+            case REG_I2C: R_I(ip->dst) = (ushort)R_I(ip->src1); break;
+            case REG_I2S: R_I(ip->dst) = (short)R_I(ip->src1); break;
+
+            case REG_LCMP: R_I(ip->dst) = R_L(ip->src1) > R_L(ip->src2) ? 1 : (R_L(ip->src1) == R_L(ip->src2) ? 0 : -1); break;
+            case REG_FCMPL: R_I(ip->dst) = REG_FCMP(R_F(ip->src1), R_F(ip->src2), -1); break;
+            case REG_FCMPG: R_I(ip->dst) = REG_FCMP(R_F(ip->src1), R_F(ip->src2), 1); break;
+            case REG_DCMPL: R_I(ip->dst) = REG_FCMP(R_D(ip->src1), R_D(ip->src2), -1); break;
+            case REG_DCMPG: R_I(ip->dst) = REG_FCMP(R_D(ip->src1), R_D(ip->src2), 1); break;
+
+            case REG_IABS: R_I(ip->dst) = R_I(ip->src1) < 0 ? (int)(0u - (uint)R_I(ip->src1)) : R_I(ip->src1); break;
+            case REG_LABS: R_L(ip->dst) = R_L(ip->src1) < 0 ? (long)(0ul - (unsigned long)R_L(ip->src1)) : R_L(ip->src1); break;
+            case REG_FABS: R_F(ip->dst) = fabsf(R_F(ip->src1)); break;
+            case REG_DABS: R_D(ip->dst) = fabs(R_D(ip->src1)); break;
+            case REG_DSQRT: R_D(ip->dst) = sqrt(R_D(ip->src1)); break;
+            case REG_IMAX: R_I(ip->dst) = R_I(ip->src1) > R_I(ip->src2) ? R_I(ip->src1) : R_I(ip->src2); break;
+            case REG_IMIN: R_I(ip->dst) = R_I(ip->src1) < R_I(ip->src2) ? R_I(ip->src1) : R_I(ip->src2); break;
+            case REG_LMAX: R_L(ip->dst) = R_L(ip->src1) > R_L(ip->src2) ? R_L(ip->src1) : R_L(ip->src2); break;
+            case REG_LMIN: R_L(ip->dst) = R_L(ip->src1) < R_L(ip->src2) ? R_L(ip->src1) : R_L(ip->src2); break;
+
+            case REG_IFEQ: REG_BRANCH(R_I(ip->src1) == 0);
+            case REG_IFNE: REG_BRANCH(R_I(ip->src1) != 0);
+            case REG_IFLT: REG_BRANCH(R_I(ip->src1) < 0);
+            case REG_IFGE: REG_BRANCH(R_I(ip->src1) >= 0);
+            case REG_IFGT: REG_BRANCH(R_I(ip->src1) > 0);
+            case REG_IFLE: REG_BRANCH(R_I(ip->src1) <= 0);
+            case REG_IF_ICMPEQ: REG_BRANCH(R_I(ip->src1) == R_I(ip->src2));
+            case REG_IF_ICMPNE: REG_BRANCH(R_I(ip->src1) != R_I(ip->src2));
+            case REG_IF_ICMPLT: REG_BRANCH(R_I(ip->src1) < R_I(ip->src2));
+            case REG_IF_ICMPGE: REG_BRANCH(R_I(ip->src1) >= R_I(ip->src2));
+            case REG_IF_ICMPGT: REG_BRANCH(R_I(ip->src1) > R_I(ip->src2));
+            case REG_IF_ICMPLE: REG_BRANCH(R_I(ip->src1) <= R_I(ip->src2));
+            case REG_GOTO:
+                REG_JUMP();
+
+            case REG_RET:
+                result[0] = R_I(ip->src1);
+                return;
+            case REG_RETL:
+                result[0] = R_I(ip->src1);
+                result[1] = R_I(ip->src1 + 1);
+                return;
+            case REG_RETV:
+                return;
+            default:
+                printf("Error: register instruction %d\n", ip->op);
+                exit(1);
+        }
+        ip++;
+    }
+}
+
+/**
+ * @brief callRegisterMethod runs a translated method, the arguments are taken from the operand stack
+ * of the caller and the returned value is pushed back, no stack frame is created.
+ * the function compiled ahead of time is run instead of the register code if it is bound
+ * @param env
+ * @param method
+ */
+void callRegisterMethod(OPENV *env, method_info *method)
+{
+    RegCode *rc = ((Code_attribute*)(method->code_attribute_addr))->reg_code;
+    StackFrame *stack = env->current_stack;
+    int result[2];
+
+    stack->sp -= method->args_len;
+    if (NULL != method->aot_code) {
+        // the aot code does not poll, it runs in native state
+        enterNative();
+        ((void (*)(int*, int, int*))method->aot_code)((int*)(stack->sp), method->args_len, result);
+        leaveNative();
+    } else {
+        runRegCode(rc, (int*)(stack->sp), method->args_len, result);
+    }
+
+    switch (rc->ret_type) {
+        case 'I':
+        case 'F':
+            *(int*)(stack->sp) = result[0];
+            SP_UP(stack);
+            break;
+        case 'J':
+        case 'D':
+            memcpy(stack->sp, result, SZ_LONG);
+            SP_UPL(stack);
+            break;
+        default:
+            break;
+    }
+}
+
+#endif // REG_IR_C
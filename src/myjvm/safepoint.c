@@ -0,0 +1,382 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef SAFEPOINT_C
+#define SAFEPOINT_C
+
+#include <time.h>
+
+/**
+  * safepoints, to run an operation (gc, deoptimization...) while every java thread is stopped at a
+  * known state. a thread running java code is stopped only where it polls safepoint_requested: on the
+  * invoke instructions and the backward jumps of the interpreter and of the register engine. a thread
+  * blocked in a monitor, a join or a sleep, or running aot code, is in native state: it is already
+  * safe, and waits for the operation to end before it goes back to java code.
+  *
+  *     safepointBegin("reason");  // returns once the other threads are stopped
+  *     ...
+  *     safepointEnd();
+  *
+  * the time to safepoint is measured for each operation, -Xlog:safepoint logs it with the place the
+  * last thread stopped at, which points to the long stretches of code without a poll.
+  * a thread records where its C stack ends and its registers when it stops or goes native, the collector
+  * scans them with its java frames, see gc.c
+  */
+
+#define THREAD_IN_JAVA      0
+#define THREAD_IN_NATIVE    1
+#define THREAD_AT_SAFEPOINT 2
+
+#define SATB_BUFFER_SIZE 256
+#define SAVED_REGS 12
+
+typedef struct _SafepointThread {
+    int state;
+    OPENV *env; // the innermost env of the thread, the others are linked by env->outer
+    char *stack_base;
+    char *stack_top; // where the C stack ended when the thread stopped or went native
+    void *regs[SAVED_REGS]; // the callee-saved registers then, see saveThreadStack
+    int satb_count;
+    NarrowRef satb[SATB_BUFFER_SIZE]; // the references logged by GC_PRE_WRITE_BARRIER
+    struct _SafepointThread *prev;
+    struct _SafepointThread *next;
+} SafepointThread;
+
+/* polled by the java threads, set while an operation stops them */
+int safepoint_requested = 0;
+/* -Xlog:safepoint */
+int safepoint_log = 0;
+/* -Xsafepoint:interval=<ms>, a safepoint is run every interval if > 0 */
+long safepoint_interval = 0;
+
+static pthread_mutex_t safepoint_lock = PTHREAD_MUTEX_INITIALIZER;
+/* signaled when a thread stops, goes native or ends */
+static pthread_cond_t safepoint_arrive_cond = PTHREAD_COND_INITIALIZER;
+/* broadcast when the operation ends */
+static pthread_cond_t safepoint_resume_cond = PTHREAD_COND_INITIALIZER;
+/* one operation at a time */
+static pthread_mutex_t safepoint_op_lock = PTHREAD_MUTEX_INITIALIZER;
+static SafepointThread *safepoint_threads = NULL;
+static __thread SafepointThread *safepoint_self = NULL;
+
+/* statistics, guarded by safepoint_lock */
+static const char *safepoint_reason;
+static struct timespec safepoint_start;
+static char safepoint_last_place[256];
+static long safepoint_count = 0;
+static double safepoint_ttsp_total = 0, safepoint_ttsp_max = 0, safepoint_pause_total = 0;
+
+#define SAFEPOINT_POLL(env) if (__atomic_load_n(&safepoint_requested, __ATOMIC_RELAXED)) {\
+        safepointBlock(env);\
+    }
+/* a jump by offset polls if it goes backward */
+#define SAFEPOINT_BACKEDGE(env, offset) if ((offset) <= 0) {\
+        SAFEPOINT_POLL(env);\
+    }
+
+static double elapsedMillis(struct timespec *from)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - from->tv_sec) * 1e3 + (now.tv_nsec - from->tv_nsec) / 1e6;
+}
+
+/**
+ * @brief threadStackBase the highest address of the C stack of the current thread
+ */
+static char* threadStackBase()
+{
+    pthread_attr_t attr;
+    void *addr;
+    size_t size;
+
+    pthread_getattr_np(pthread_self(), &attr);
+    pthread_attr_getstack(&attr, &addr, &size);
+    pthread_attr_destroy(&attr);
+
+    return (char*)addr + size;
+}
+
+/**
+ * @brief saveThreadStack records the callee-saved registers and the end of the C stack, the frames of the
+ * caller are above the frame of this function. the registers are copied as they are: a jmp_buf holds the
+ * frame and stack pointers mangled, a reference kept only in one of them would not be seen. the copy is the
+ * first thing the function does, before the compiler may use one of them; the frame pointer of the caller
+ * is the one its prologue saved
+ */
+static void __attribute__((noinline)) saveThreadStack(SafepointThread *t)
+{
+#if defined(__x86_64__)
+    __asm__ volatile("movq %%rbx, 0(%0)\n\t"
+                     "movq %%r12, 16(%0)\n\t"
+                     "movq %%r13, 24(%0)\n\t"
+                     "movq %%r14, 32(%0)\n\t"
+                     "movq %%r15, 40(%0)"
+                     : : "D"(t->regs) : "memory");
+    t->regs[1] = *(void**)__builtin_frame_address(0);
+#elif defined(__aarch64__)
+    register void **regs __asm__("x0") = t->regs;
+    __asm__ volatile("stp x19, x20, [%0, #0]\n\t"
+                     "stp x21, x22, [%0, #16]\n\t"
+                     "stp x23, x24, [%0, #32]\n\t"
+                     "stp x25, x26, [%0, #48]\n\t"
+                     "stp x27, x28, [%0, #64]"
+                     : : "r"(regs) : "memory");
+    t->regs[10] = *(void**)__builtin_frame_address(0);
+#else
+#error "saveThreadStack: the callee-saved registers of this machine are not known"
+#endif
+    t->stack_top = (char*)__builtin_frame_address(0);
+}
+
+/**
+ * @brief attachSafepointThread registers the current thread as running java code, it waits for an
+ * operation going on to end first
+ * @param env the env the thread runs
+ */
+void attachSafepointThread(OPENV *env)
+{
+    SafepointThread *t = (SafepointThread*)calloc(1, sizeof(SafepointThread));
+
+    t->env = env;
+    t->stack_base = threadStackBase();
+    pthread_mutex_lock(&safepoint_lock);
+    while (safepoint_requested) {
+        pthread_cond_wait(&safepoint_resume_cond, &safepoint_lock);
+    }
+    t->state = THREAD_IN_JAVA;
+    t->next = safepoint_threads;
+    if (NULL != safepoint_threads) {
+        safepoint_threads->prev = t;
+    }
+    safepoint_threads = t;
+    pthread_mutex_unlock(&safepoint_lock);
+    safepoint_self = t;
+}
+
+/**
+ * @brief detachSafepointThread called when the java code of the thread has ended
+ */
+void detachSafepointThread()
+{
+    SafepointThread *t = safepoint_self;
+
+    if (NULL == t) {
+        return;
+    }
+    pthread_mutex_lock(&safepoint_lock);
+    if (NULL != t->prev) {
+        t->prev->next = t->next;
+    } else {
+        safepoint_threads = t->next;
+    }
+    if (NULL != t->next) {
+        t->next->prev = t->prev;
+    }
+    pthread_cond_signal(&safepoint_arrive_cond);
+    pthread_mutex_unlock(&safepoint_lock);
+    safepoint_self = NULL;
+    free(t);
+}
+
+/**
+ * @brief safepointBlock the slow path of SAFEPOINT_POLL, the thread stops until the operation ends
+ * @param env the place of the thread, NULL in the register engine
+ */
+void safepointBlock(OPENV *env)
+{
+    SafepointThread *t = safepoint_self;
+
+    if (NULL == t) {
+        return;
+    }
+    saveThreadStack(t);
+    pthread_mutex_lock(&safepoint_lock);
+    if (safepoint_requested) {
+        t->state = THREAD_AT_SAFEPOINT;
+        if (NULL != env && NULL != env->current_stack && NULL != env->current_stack->method) {
+            snprintf(safepoint_last_place, sizeof(safepoint_last_place), "%s.%s #%d",
+                     get_this_class_name(env->current_class),
+                     get_utf8(env->current_class->constant_pool[env->current_stack->method->name_index]),
+                     (int)(env->pc - env->pc_start) - 1);
+        } else {
+            strcpy(safepoint_last_place, "register code");
+        }
+        pthread_cond_signal(&safepoint_arrive_cond);
+        while (safepoint_requested) {
+            pthread_cond_wait(&safepoint_resume_cond, &safepoint_lock);
+        }
+        t->state = THREAD_IN_JAVA;
+    }
+    pthread_mutex_unlock(&safepoint_lock);
+}
+
+/**
+ * @brief enterNative the thread is about to block or to run code that does not touch the java heap
+ * and stack, an operation may run meanwhile
+ */
+static inline void enterNative()
+{
+    SafepointThread *t = safepoint_self;
+
+    if (NULL == t) {
+        return;
+    }
+    saveThreadStack(t);
+    __atomic_store_n(&t->state, THREAD_IN_NATIVE, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&safepoint_requested, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&safepoint_lock);
+        strcpy(safepoint_last_place, "native");
+        pthread_cond_signal(&safepoint_arrive_cond);
+        pthread_mutex_unlock(&safepoint_lock);
+    }
+}
+
+/**
+ * @brief leaveNative back to java code, waits for an operation going on to end
+ */
+static inline void leaveNative()
+{
+    SafepointThread *t = safepoint_self;
+
+    if (NULL == t) {
+        return;
+    }
+    // the state is set before the flag is read: an operation starting meanwhile either sees the thread
+    // in java and waits for it, or is seen here
+    __atomic_store_n(&t->state, THREAD_IN_JAVA, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&safepoint_requested, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&safepoint_lock);
+        t->state = THREAD_IN_NATIVE;
+        pthread_cond_signal(&safepoint_arrive_cond);
+        while (safepoint_requested) {
+            pthread_cond_wait(&safepoint_resume_cond, &safepoint_lock);
+        }
+        t->state = THREAD_IN_JAVA;
+        pthread_mutex_unlock(&safepoint_lock);
+    }
+}
+
+/**
+ * @brief setThreadEnv the env the current thread runs from now on, a <clinit> is run in an env of its own
+ */
+static inline void setThreadEnv(OPENV *env)
+{
+    if (NULL != safepoint_self) {
+        safepoint_self->env = env;
+    }
+}
+
+/**
+ * @brief safepointBegin stops the other java threads, the caller counts as native meanwhile
+ * @param reason logged by -Xlog:safepoint
+ */
+void safepointBegin(const char *reason)
+{
+    SafepointThread *t;
+    int running;
+    double ttsp;
+
+    enterNative();
+    pthread_mutex_lock(&safepoint_op_lock);
+    pthread_mutex_lock(&safepoint_lock);
+    clock_gettime(CLOCK_MONOTONIC, &safepoint_start);
+    safepoint_reason = reason;
+    strcpy(safepoint_last_place, "none");
+    __atomic_store_n(&safepoint_requested, 1, __ATOMIC_SEQ_CST);
+    do {
+        running = 0;
+        for (t = safepoint_threads; NULL != t; t = t->next) {
+            if (THREAD_IN_JAVA == __atomic_load_n(&t->state, __ATOMIC_SEQ_CST)) {
+                running++;
+            }
+        }
+        if (running > 0) {
+            pthread_cond_wait(&safepoint_arrive_cond, &safepoint_lock);
+        }
+    } while (running > 0);
+
+    ttsp = elapsedMillis(&safepoint_start);
+    safepoint_count++;
+    safepoint_ttsp_total += ttsp;
+    if (ttsp > safepoint_ttsp_max) {
+        safepoint_ttsp_max = ttsp;
+    }
+    if (safepoint_log) {
+        fprintf(stderr, "safepoint #%ld %s: time to safepoint %.3f ms, last thread at %s\n",
+                safepoint_count, reason, ttsp, safepoint_last_place);
+    }
+    pthread_mutex_unlock(&safepoint_lock);
+}
+
+/**
+ * @brief safepointEnd resumes the threads stopped by safepointBegin
+ */
+void safepointEnd()
+{
+    double pause;
+
+    pthread_mutex_lock(&safepoint_lock);
+    pause = elapsedMillis(&safepoint_start);
+    safepoint_pause_total += pause;
+    if (safepoint_log) {
+        fprintf(stderr, "safepoint #%ld %s: total pause %.3f ms\n", safepoint_count, safepoint_reason, pause);
+    }
+    __atomic_store_n(&safepoint_requested, 0, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&safepoint_resume_cond);
+    pthread_mutex_unlock(&safepoint_lock);
+    pthread_mutex_unlock(&safepoint_op_lock);
+    leaveNative();
+}
+
+static void* periodicSafepointMain(void *arg)
+{
+    struct timespec ts;
+
+    ts.tv_sec = safepoint_interval / 1000;
+    ts.tv_nsec = (safepoint_interval % 1000) * 1000000;
+    for (;;) {
+        nanosleep(&ts, NULL);
+        safepointBegin("periodic");
+        safepointEnd();
+    }
+    return NULL;
+}
+
+static void dumpSafepointStat()
+{
+    pthread_mutex_lock(&safepoint_lock);
+    fprintf(stderr, "safepoints: %ld, time to safepoint total %.3f ms max %.3f ms, pause total %.3f ms\n",
+            safepoint_count, safepoint_ttsp_total, safepoint_ttsp_max, safepoint_pause_total);
+    pthread_mutex_unlock(&safepoint_lock);
+}
+
+/**
+ * @brief startPeriodicSafepoints starts the thread of -Xsafepoint:interval
+ */
+void startPeriodicSafepoints()
+{
+    pthread_t tid;
+
+    if (safepoint_interval > 0 && 0 == pthread_create(&tid, NULL, periodicSafepointMain, NULL)) {
+        pthread_detach(tid);
+    }
+}
+
+/**
+ * @brief startSafepoints called once the options are parsed
+ */
+void startSafepoints()
+{
+    if (safepoint_log) {
+        atexit(dumpSafepointStat);
+    }
+    startPeriodicSafepoints();
+}
+
+#endif // SAFEPOINT_C
@@ -0,0 +1,565 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef STRING_CONCAT_C
+#define STRING_CONCAT_C
+
+#include "op_core.h"
+
+/**
+  * the native string concatenation. javac compiles `a + b` into an invokedynamic of
+  * StringConcatFactory.makeConcatWithConstants (target 9+) or into a StringBuilder chain (target 8).
+  * the invokedynamic is linked once into a ConcatRecipe, the list of the constants and the arguments
+  * of the result; a call turns every part into a StringPiece, sums the lengths and writes the result
+  * into one value array. the StringBuilder methods are intrinsics working on the value and count
+  * fields of the builder (see the registry in intrinsics.c).
+  * an object other than a String is shown as Object.toString does, its own toString is not run.
+  */
+
+/* a part of a result: chars of a value array or of the buffer, Latin-1 or UTF-16 */
+typedef struct _StringPiece {
+    const void *chars;
+    int length;
+    int latin1;
+    char buf[32];
+} StringPiece;
+
+#define CONCAT_CONSTANT 0
+
+typedef struct _ConcatPart {
+    char kind; // CONCAT_CONSTANT or the descriptor char of the argument
+    short offset; // byte offset of the argument from the first argument on the stack
+    Object *constant;
+} ConcatPart;
+
+typedef struct _ConcatRecipe {
+    int count;
+    int args_len;
+    ConcatPart parts[];
+} ConcatRecipe;
+
+static void pieceOfValue(StringPiece *piece, CArray_char *value)
+{
+    piece->chars = value->elements;
+    piece->length = value->length;
+    piece->latin1 = IS_LATIN1(value);
+}
+
+static void pieceOfText(StringPiece *piece, const char *text)
+{
+    piece->length = strlen(text);
+    memcpy(piece->buf, text, piece->length);
+    piece->chars = piece->buf;
+    piece->latin1 = 1;
+}
+
+static void pieceOfLong(StringPiece *piece, long v)
+{
+    piece->length = snprintf(piece->buf, sizeof(piece->buf), "%ld", v);
+    piece->chars = piece->buf;
+    piece->latin1 = 1;
+}
+
+static void pieceOfChar(StringPiece *piece, ushort c)
+{
+    if (c <= 0xff) {
+        piece->buf[0] = (char)c;
+    } else {
+        memcpy(piece->buf, &c, sizeof(c));
+    }
+    piece->chars = piece->buf;
+    piece->length = 1;
+    piece->latin1 = c <= 0xff;
+}
+
+/**
+ * @brief formatJavaDouble formats as Double.toString (Float.toString if is_float): the shortest digits
+ * that read back the same value, but at least two of them, so when one digit is enough the closest
+ * two are kept (Double.MIN_VALUE is 4.9E-324, not 5.0E-324). Plain between 10^-3 and 10^7,
+ * otherwise as d.dddE<n>
+ * @return the length of the text
+ */
+int formatJavaDouble(double v, int is_float, char *buf)
+{
+    char sci[32], digits[24], *p = buf;
+    int prec, ndigits = 0, exp, i;
+
+    if (v != v) {
+        return sprintf(buf, "NaN");
+    }
+    if (isinf(v)) {
+        return sprintf(buf, v > 0 ? "Infinity" : "-Infinity");
+    }
+    if (0 == v) {
+        return sprintf(buf, signbit(v) ? "-0.0" : "0.0");
+    }
+    for (prec = 2; prec <= 17; prec++) {
+        snprintf(sci, sizeof(sci), "%.*e", prec - 1, v);
+        if (is_float ? strtof(sci, NULL) == (float)v : strtod(sci, NULL) == v) {
+            break;
+        }
+    }
+    if (v < 0) {
+        *p++ = '-';
+    }
+    for (i = v < 0; sci[i] != 'e'; i++) {
+        if ('.' != sci[i]) {
+            digits[ndigits++] = sci[i];
+        }
+    }
+    exp = atoi(sci + i + 1);
+    while (ndigits > 1 && '0' == digits[ndigits - 1]) {
+        ndigits--;
+    }
+
+    if (fabs(v) >= 1e-3 && fabs(v) < 1e7) {
+        if (exp < 0) {
+            *p++ = '0';
+            *p++ = '.';
+            for (i = -1; i > exp; i--) {
+                *p++ = '0';
+            }
+            memcpy(p, digits, ndigits);
+            p += ndigits;
+        } else {
+            for (i = 0; i <= exp; i++) {
+                *p++ = i < ndigits ? digits[i] : '0';
+            }
+            *p++ = '.';
+            if (ndigits > exp + 1) {
+                memcpy(p, digits + exp + 1, ndigits - exp - 1);
+                p += ndigits - exp - 1;
+            } else {
+                *p++ = '0';
+            }
+        }
+    } else {
+        *p++ = digits[0];
+        *p++ = '.';
+        if (ndigits > 1) {
+            memcpy(p, digits + 1, ndigits - 1);
+            p += ndigits - 1;
+        } else {
+            *p++ = '0';
+        }
+        p += sprintf(p, "E%d", exp);
+    }
+    *p = '\0';
+
+    return p - buf;
+}
+
+static void pieceOfDouble(StringPiece *piece, double v, int is_float)
+{
+    piece->length = formatJavaDouble(v, is_float, piece->buf);
+    piece->chars = piece->buf;
+    piece->latin1 = 1;
+}
+
+/* the offsets are the same in every vm, current_vm->builder_class is set once they are known */
+static int builder_value_offset, builder_count_offset;
+
+/**
+ * @brief pieceOfObject the chars of a String or a StringBuilder, "null", or the text of Object.toString
+ */
+static void pieceOfObject(StringPiece *piece, Object *obj)
+{
+    const char *name;
+    int i;
+
+    if (NULL == obj) {
+        pieceOfText(piece, "null");
+    } else if (obj->pclass == current_vm->string_class) {
+        pieceOfValue(piece, STRING_VALUE(obj));
+    } else if (obj->pclass == current_vm->builder_class) {
+        pieceOfValue(piece, GET_FIELD_REF(obj, builder_value_offset, CArray_char*));
+        piece->length = GET_FIELD(obj, builder_count_offset, int);
+    } else {
+        name = get_this_class_name(obj->pclass);
+        piece->length = snprintf(piece->buf, sizeof(piece->buf), "%s@%x", name, encodeRef(obj));
+        if (piece->length >= (int)sizeof(piece->buf)) {
+            // the class name is long, keep its tail as it holds the simple name
+            piece->length = snprintf(piece->buf, sizeof(piece->buf), "%s@%x", name + strlen(name) - 20, encodeRef(obj));
+        }
+        for (i = 0; i < piece->length; i++) {
+            if ('/' == piece->buf[i]) {
+                piece->buf[i] = '.';
+            }
+        }
+        piece->chars = piece->buf;
+        piece->latin1 = 1;
+    }
+}
+
+/**
+ * @brief copyPiece writes the chars of a piece at index at of a value, inflating Latin-1 into UTF-16
+ */
+static void copyPiece(CArray_char *value, int at, StringPiece *piece)
+{
+    const uchar *src;
+    ushort *dst;
+    int i;
+
+    if (IS_LATIN1(value)) {
+        memcpy(LATIN1_CHARS(value) + at, piece->chars, piece->length);
+    } else if (!piece->latin1) {
+        memcpy(UTF16_CHARS(value) + at, piece->chars, (size_t)piece->length << 1);
+    } else {
+        src = (const uchar*)piece->chars;
+        dst = UTF16_CHARS(value) + at;
+        for (i = 0; i < piece->length; i++) {
+            dst[i] = src[i];
+        }
+    }
+}
+
+/**
+ * @brief concatPieces the String of the pieces, its value is allocated once at its final size
+ */
+Object* concatPieces(OPENV *env, StringPiece *pieces, int count)
+{
+    CArray_char *value;
+    int i, length = 0, latin1 = 1;
+
+    for (i = 0; i < count; i++) {
+        length += pieces[i].length;
+        latin1 &= pieces[i].latin1;
+    }
+    value = latin1 ? newCArray_char(length, 8, 1) : (CArray_char*)newCArray_ushort(length, 5, 1);
+    for (i = 0, length = 0; i < count; i++) {
+        copyPiece(value, length, &pieces[i]);
+        length += pieces[i].length;
+    }
+    return newStringOfValue(env, value);
+}
+
+/**
+ * @brief pieceOfArgument reads an argument of the type kind at p, the slots of the operand stack
+ */
+static void pieceOfArgument(StringPiece *piece, char kind, char *p)
+{
+    switch (kind) {
+        case 'Z': pieceOfText(piece, *(int*)p ? "true" : "false"); break;
+        case 'C': pieceOfChar(piece, (ushort)*(int*)p); break;
+        case 'B':
+        case 'S':
+        case 'I': pieceOfLong(piece, *(int*)p); break;
+        case 'J': pieceOfLong(piece, *(long*)p); break;
+        case 'F': pieceOfDouble(piece, *(float*)p, 1); break;
+        case 'D': pieceOfDouble(piece, *(double*)p, 0); break;
+        case '[':
+            // an array has no class pointer, it is shown by its type and its reference
+            if (0 == *(NarrowRef*)p) {
+                pieceOfText(piece, "null");
+            } else {
+                piece->length = snprintf(piece->buf, sizeof(piece->buf), "[@%x", *(NarrowRef*)p);
+                piece->chars = piece->buf;
+                piece->latin1 = 1;
+            }
+            break;
+        default: pieceOfObject(piece, (Object*)decodeRef(*(NarrowRef*)p)); break;
+    }
+}
+
+/**
+ * @brief callStringConcat runs a linked string concat, the arguments are replaced by the result
+ */
+void callStringConcat(OPENV *env, ConcatRecipe *recipe)
+{
+    StringPiece buf[16], *pieces = buf;
+    char *args = env->current_stack->sp - recipe->args_len;
+    Object *result;
+    int i;
+
+    if (recipe->count > 16) {
+        pieces = (StringPiece*)malloc(sizeof(StringPiece) * recipe->count);
+    }
+    for (i = 0; i < recipe->count; i++) {
+        if (CONCAT_CONSTANT == recipe->parts[i].kind) {
+            pieceOfValue(&pieces[i], STRING_VALUE(recipe->parts[i].constant));
+        } else {
+            pieceOfArgument(&pieces[i], recipe->parts[i].kind, args + recipe->parts[i].offset);
+        }
+    }
+    result = concatPieces(env, pieces, recipe->count);
+    if (pieces != buf) {
+        free(pieces);
+    }
+    env->current_stack->sp = args;
+    PUSH_STACKR(env->current_stack, result, Reference);
+}
+
+/**
+ * @brief constantString the text of a static argument of the bootstrap method, as its String
+ */
+static Object* constantString(OPENV *env, Class *pclass, ushort index)
+{
+    StringPiece piece;
+    void *info = pclass->constant_pool[index];
+
+    switch (*(uchar*)info) {
+        case CONSTANT_String: return resolveConstString(env, pclass, index);
+        case CONSTANT_Integer: pieceOfLong(&piece, ((CONSTANT_Integer_info*)info)->value); break;
+        case CONSTANT_Long: pieceOfLong(&piece, ((CONSTANT_Long_info*)info)->value); break;
+        case CONSTANT_Float: pieceOfDouble(&piece, ((CONSTANT_Float_info*)info)->value, 1); break;
+        case CONSTANT_Double: pieceOfDouble(&piece, ((CONSTANT_Double_info*)info)->value, 0); break;
+        default:
+            printf("Error: StringConcatFactory: unsupported constant, tag=%d\n", *(uchar*)info);
+            exit(1);
+    }
+    return internString(env, newStringUTF8(env, piece.buf, piece.length));
+}
+
+/**
+ * @brief addConstantPart appends the literal bytes of a recipe as a constant part, an empty one is dropped
+ */
+static void addConstantPart(OPENV *env, ConcatRecipe *recipe, const char *bytes, int length)
+{
+    if (length > 0) {
+        recipe->parts[recipe->count].kind = CONCAT_CONSTANT;
+        recipe->parts[recipe->count++].constant = internString(env, newStringUTF8(env, bytes, length));
+    }
+}
+
+/**
+ * @brief linkStringConcat links an invokedynamic of StringConcatFactory.makeConcat or
+ * makeConcatWithConstants, the recipe marks an argument by \1 and a further constant by \2
+ * @param env
+ * @param pclass
+ * @param descriptor the descriptor of the call site
+ * @param name the name of the bootstrap method
+ * @param bsm_args the static arguments of the bootstrap method
+ * @param bsm_argc
+ * @return
+ */
+ConcatRecipe* linkStringConcat(OPENV *env, Class *pclass, const char *descriptor, const char *name, ushort *bsm_args, int bsm_argc)
+{
+    ConcatRecipe *recipe;
+    CONSTANT_Utf8_info *utf8_info;
+    const char *p, *desc, *seg;
+    char kinds[256];
+    short offsets[256];
+    int nargs = 0, args_len = 0, arg = 0, constant = 1, max_parts;
+
+    loadStringClass(env);
+    for (desc = descriptor + 1; ')' != *desc; desc++) {
+        kinds[nargs] = *desc;
+        offsets[nargs++] = args_len;
+        args_len += ('J' == *desc || 'D' == *desc) ? SZ_LONG : SZ_INT;
+        while ('[' == *desc) {
+            desc++;
+        }
+        if ('L' == *desc) {
+            while (';' != *desc) {
+                desc++;
+            }
+        }
+    }
+
+    if (strcmp(name, "makeConcat") == 0) {
+        recipe = (ConcatRecipe*)malloc(sizeof(ConcatRecipe) + sizeof(ConcatPart) * nargs);
+        for (recipe->count = 0; recipe->count < nargs; recipe->count++) {
+            recipe->parts[recipe->count].kind = kinds[recipe->count];
+            recipe->parts[recipe->count].offset = offsets[recipe->count];
+        }
+        recipe->args_len = args_len;
+        return recipe;
+    }
+    if (strcmp(name, "makeConcatWithConstants") != 0 || bsm_argc < 1 ||
+            CONSTANT_String != *(uchar*)(pclass->constant_pool[bsm_args[0]])) {
+        printf("Error: unsupported string concat bootstrap: %s\n", name);
+        exit(1);
+    }
+    utf8_info = (CONSTANT_Utf8_info*)(pclass->constant_pool[((CONSTANT_String_info*)(pclass->constant_pool[bsm_args[0]]))->string_index]);
+
+    // a literal run lies between two tags, so there are at most twice the tags plus one parts
+    max_parts = 1;
+    for (p = utf8_info->bytes; p < utf8_info->bytes + utf8_info->length; p++) {
+        max_parts += (1 == *p || 2 == *p) ? 2 : 0;
+    }
+    recipe = (ConcatRecipe*)malloc(sizeof(ConcatRecipe) + sizeof(ConcatPart) * max_parts);
+    recipe->count = 0;
+    recipe->args_len = args_len;
+    for (seg = p = utf8_info->bytes; p < utf8_info->bytes + utf8_info->length; p++) {
+        if (1 == *p) {
+            addConstantPart(env, recipe, seg, p - seg);
+            if (arg >= nargs) {
+                printf("Error: string concat recipe has more arguments than %s\n", descriptor);
+                exit(1);
+            }
+            recipe->parts[recipe->count].kind = kinds[arg];
+            recipe->parts[recipe->count++].offset = offsets[arg++];
+            seg = p + 1;
+        } else if (2 == *p) {
+            addConstantPart(env, recipe, seg, p - seg);
+            if (constant >= bsm_argc) {
+                printf("Error: string concat recipe has more constants than the bootstrap arguments\n");
+                exit(1);
+            }
+            recipe->parts[recipe->count].kind = CONCAT_CONSTANT;
+            recipe->parts[recipe->count++].constant = constantString(env, pclass, bsm_args[constant++]);
+            seg = p + 1;
+        }
+    }
+    addConstantPart(env, recipe, seg, p - seg);
+
+    return recipe;
+}
+
+/** java/lang/StringBuilder **/
+
+/**
+ * @brief builderOf checks a StringBuilder and finds the offsets of its value and count once
+ */
+static Object* builderOf(Object *obj)
+{
+    field_info *value_field, *count_field;
+
+    if (NULL == obj) {
+        printf("Error: java.lang.NullPointerException in StringBuilder\n");
+        exit(1);
+    }
+    if (NULL == current_vm->builder_class) {
+        value_field = findInstanceField(obj->pclass, "value");
+        count_field = findInstanceField(obj->pclass, "count");
+        if (NULL == value_field || NULL == count_field) {
+            printf("Error: StringBuilder has no value or count field\n");
+            exit(1);
+        }
+        builder_value_offset = value_field->findex;
+        builder_count_offset = count_field->findex;
+        current_vm->builder_class = obj->pclass;
+    }
+    return obj;
+}
+
+/**
+ * @brief builderAppend appends a piece, the value grows to twice its capacity plus 2 (or to the
+ * length needed) and is inflated to UTF-16 when the piece is not Latin-1
+ */
+static void builderAppend(Object *builder, StringPiece *piece)
+{
+    CArray_char *value = GET_FIELD_REF(builder, builder_value_offset, CArray_char*), *grown;
+    int count = GET_FIELD(builder, builder_count_offset, int);
+    int capacity, latin1 = IS_LATIN1(value) && piece->latin1;
+    StringPiece old;
+
+    if (count + piece->length > value->length || latin1 != IS_LATIN1(value)) {
+        capacity = value->length;
+        if (count + piece->length > capacity) {
+            capacity = (capacity << 1) + 2;
+            if (capacity < count + piece->length) {
+                capacity = count + piece->length;
+            }
+        }
+        grown = latin1 ? newCArray_char(capacity, 8, 1) : (CArray_char*)newCArray_ushort(capacity, 5, 1);
+        pieceOfValue(&old, value);
+        old.length = count;
+        copyPiece(grown, 0, &old);
+        PUT_FIELD_REF(builder, builder_value_offset, grown);
+        value = grown;
+    }
+    copyPiece(value, count, piece);
+    PUT_FIELD(builder, builder_count_offset, count + piece->length, int);
+}
+
+static void builderInit(Object *builder, int capacity)
+{
+    if (capacity < 0) {
+        printf("Error: java.lang.NegativeArraySizeException: %d\n", capacity);
+        exit(1);
+    }
+    builderOf(builder);
+    PUT_FIELD_REF(builder, builder_value_offset, newCArray_char(capacity, 8, 1));
+    PUT_FIELD(builder, builder_count_offset, 0, int);
+}
+
+void intrinsic_builder_init(OPENV *env)
+{
+    Object *builder;
+    GET_STACKR(env->current_stack, builder, Reference);
+    builderInit(builder, 16);
+}
+
+void intrinsic_builder_init_capacity(OPENV *env)
+{
+    Object *builder;
+    int capacity;
+    GET_STACK(env->current_stack, capacity, int);
+    GET_STACKR(env->current_stack, builder, Reference);
+    builderInit(builder, capacity);
+}
+
+void intrinsic_builder_init_string(OPENV *env)
+{
+    Object *builder, *str;
+    StringPiece piece;
+    GET_STACKR(env->current_stack, str, Reference);
+    GET_STACKR(env->current_stack, builder, Reference);
+    if (NULL == str) {
+        printf("Error: java.lang.NullPointerException in StringBuilder.<init>\n");
+        exit(1);
+    }
+    pieceOfObject(&piece, str);
+    builderInit(builder, piece.length + 16);
+    builderAppend(builder, &piece);
+}
+
+/* append(x) pops x, appends it and leaves the builder on the stack */
+#define BUILDER_APPEND_INTRINSIC(name, xtype, GET, MAKE_PIECE) void intrinsic_builder_append_##name(OPENV *env) {\
+    xtype v;\
+    Object *builder;\
+    StringPiece piece;\
+    GET(env->current_stack, v, xtype);\
+    builder = builderOf((Object*)decodeRef(PICK_STACK(env->current_stack, NarrowRef)));\
+    MAKE_PIECE;\
+    builderAppend(builder, &piece);\
+}
+
+BUILDER_APPEND_INTRINSIC(object, Reference, GET_STACKR, pieceOfObject(&piece, v))
+BUILDER_APPEND_INTRINSIC(int, int, GET_STACK, pieceOfLong(&piece, v))
+BUILDER_APPEND_INTRINSIC(long, long, GET_STACKL, pieceOfLong(&piece, v))
+BUILDER_APPEND_INTRINSIC(char, int, GET_STACK, pieceOfChar(&piece, (ushort)v))
+BUILDER_APPEND_INTRINSIC(boolean, int, GET_STACK, pieceOfText(&piece, v ? "true" : "false"))
+BUILDER_APPEND_INTRINSIC(float, float, GET_STACK, pieceOfDouble(&piece, v, 1))
+BUILDER_APPEND_INTRINSIC(double, double, GET_STACKL, pieceOfDouble(&piece, v, 0))
+
+void intrinsic_builder_length(OPENV *env)
+{
+    Object *builder;
+    GET_STACKR(env->current_stack, builder, Reference);
+    PUSH_STACK(env->current_stack, GET_FIELD(builderOf(builder), builder_count_offset, int), int);
+}
+
+void intrinsic_builder_charAt(OPENV *env)
+{
+    Object *builder;
+    CArray_char *value;
+    int index, count;
+    GET_STACK(env->current_stack, index, int);
+    GET_STACKR(env->current_stack, builder, Reference);
+    value = GET_FIELD_REF(builderOf(builder), builder_value_offset, CArray_char*);
+    count = GET_FIELD(builder, builder_count_offset, int);
+    if ((uint)index >= (uint)count) {
+        printf("Error: java.lang.StringIndexOutOfBoundsException: %d, length=%d\n", index, count);
+        exit(1);
+    }
+    PUSH_STACK(env->current_stack, (int)STRING_CHAR_AT(value, index), int);
+}
+
+/* the String is a copy of exactly count chars, so the builder can go on */
+void intrinsic_builder_toString(OPENV *env)
+{
+    Object *builder;
+    StringPiece piece;
+    GET_STACKR(env->current_stack, builder, Reference);
+    pieceOfObject(&piece, builderOf(builder));
+    PUSH_STACKR(env->current_stack, concatPieces(env, &piece, 1), Reference);
+}
+
+#endif // STRING_CONCAT_C
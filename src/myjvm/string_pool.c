@@ -0,0 +1,147 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef STRING_POOL_C
+#define STRING_POOL_C
+
+#include <pthread.h>
+
+/**
+  * the string pool. every string literal and every String.intern() result is the one String of its chars
+  * kept in the hash table of the vm. ldc resolves a CONSTANT_String once, the String is then stored in the
+  * constant pool entry and later executions just push it. lookups take the lock, an entry is never removed
+  */
+
+#define STRING_POOL_INIT_SIZE 1024
+
+typedef struct _internEntry {
+    uint hash;
+    NarrowRef str;
+    struct _internEntry *next;
+} InternEntry;
+
+typedef struct _stringPool {
+    int count;
+    int size;
+    InternEntry **buckets;
+    pthread_mutex_t lock;
+} StringPool;
+
+/**
+ * @brief newStringPool the empty pool of a new vm
+ */
+StringPool* newStringPool()
+{
+    StringPool *pool = (StringPool*)calloc(1, sizeof(StringPool));
+
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+/**
+ * @brief freeStringPool frees the pool of a destroyed vm, the Strings are left to the collector
+ */
+void freeStringPool(StringPool *pool)
+{
+    InternEntry *entry, *next;
+    int i;
+
+    for (i = 0; i < pool->size; i++) {
+        for (entry = pool->buckets[i]; NULL != entry; entry = next) {
+            next = entry->next;
+            free(entry);
+        }
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->buckets);
+    free(pool);
+}
+
+static void growStringPool(StringPool *pool)
+{
+    int new_size = pool->size ? pool->size << 1 : STRING_POOL_INIT_SIZE;
+    InternEntry **buckets = (InternEntry**)calloc(new_size, sizeof(InternEntry*));
+    InternEntry *entry, *next;
+    int i;
+
+    for (i = 0; i < pool->size; i++) {
+        for (entry = pool->buckets[i]; NULL != entry; entry = next) {
+            next = entry->next;
+            entry->next = buckets[entry->hash & (new_size - 1)];
+            buckets[entry->hash & (new_size - 1)] = entry;
+        }
+    }
+    free(pool->buckets);
+    pool->buckets = buckets;
+    pool->size = new_size;
+}
+
+/**
+ * @brief internString String.intern(): the pooled String equal to str, str itself is pooled if there is none
+ */
+Object* internString(OPENV *env, Object *str)
+{
+    uint h = (uint)stringHashCode(str);
+    CArray_char *value = STRING_VALUE(str);
+    InternEntry *entry;
+    Object *obj = NULL;
+    StringPool *pool = current_vm->string_pool;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->size) {
+        for (entry = pool->buckets[h & (pool->size - 1)]; NULL != entry; entry = entry->next) {
+            if (entry->hash == h && stringEquals(STRING_VALUE((Object*)decodeRef(entry->str)), value)) {
+                obj = (Object*)decodeRef(entry->str);
+                break;
+            }
+        }
+    }
+    if (NULL == obj) {
+        if (pool->count >= pool->size - (pool->size >> 2)) {
+            growStringPool(pool);
+        }
+        obj = str;
+        entry = (InternEntry*)malloc(sizeof(InternEntry));
+        entry->hash = h;
+        entry->str = encodeRef(obj);
+        entry->next = pool->buckets[h & (pool->size - 1)];
+        pool->buckets[h & (pool->size - 1)] = entry;
+        pool->count++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return obj;
+}
+
+/**
+ * @brief resolveConstString the String of a CONSTANT_String, it is interned on the first ldc and kept in
+ * the constant pool entry
+ * @param env
+ * @param pclass
+ * @param string_info_index
+ * @return
+ */
+Object* resolveConstString(OPENV *env, Class *pclass, int string_info_index)
+{
+    CONSTANT_String_info* str_info = (CONSTANT_String_info*)(pclass->constant_pool[string_info_index]);
+    CONSTANT_Utf8_info* utf8_info;
+    NarrowRef ref = __atomic_load_n(&str_info->string_ref, __ATOMIC_ACQUIRE);
+    Object *obj;
+
+    if (ref) {
+        return (Object*)decodeRef(ref);
+    }
+    utf8_info = (CONSTANT_Utf8_info*)(pclass->constant_pool[str_info->string_index]);
+    obj = internString(env, newStringUTF8(env, utf8_info->bytes, utf8_info->length));
+    // racing resolvers get the same pooled String, so a plain store of it is enough
+    __atomic_store_n(&str_info->string_ref, encodeRef(obj), __ATOMIC_RELEASE);
+
+    return obj;
+}
+
+#endif // STRING_POOL_C
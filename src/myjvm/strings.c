@@ -0,0 +1,487 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef STRINGS_C
+#define STRINGS_C
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+  * the native representation of java/lang/String. String.value is a byte[] (atype 8) holding one
+  * Latin-1 char per byte when every char fits, otherwise a char[] (atype 5) of UTF-16 chars, so the
+  * coder is known from the array alone. a String is always compressed when it can be, so a Latin-1
+  * String never equals a UTF-16 one. the hash is cached in String.hash and the coder copied to
+  * String.coder when the class has those fields.
+  * the kernels below (compare, search, hash and the UTF-8 conversions) use SSE2/AVX2 when the
+  * compiler targets them and are run by the String intrinsics (see intrinsics.c).
+  */
+
+#define STRING_LATIN1 0
+#define STRING_UTF16 1
+
+#define IS_LATIN1(value) (8 == (value)->atype)
+#define LATIN1_CHARS(value) ((uchar*)(value)->elements)
+#define UTF16_CHARS(value) ((ushort*)(value)->elements)
+#define STRING_CHAR_AT(value, i) (IS_LATIN1(value) ? LATIN1_CHARS(value)[i] : UTF16_CHARS(value)[i])
+
+/* the offsets are the same in every vm, the vms load the same jdk classes */
+int string_hash_offset = -1;
+int string_coder_offset = -1;
+
+/**
+ * @brief loadStringClass loads and links java/lang/String once and finds the offsets of its fields
+ */
+Class* loadStringClass(OPENV *env)
+{
+    CONSTANT_Utf8_info utf8_info;
+    field_info *field;
+    Class *pclass;
+
+    // the offsets are set before string_class, the other threads use them once they see the class
+    if (NULL != (pclass = __atomic_load_n(&current_vm->string_class, __ATOMIC_ACQUIRE))) {
+        return pclass;
+    }
+    utf8_info.bytes = "java/lang/String";
+    utf8_info.length = strlen(utf8_info.bytes);
+    utf8_info.tag = CONSTANT_Utf8;
+    pclass = systemLoadClassRecursive(env, &utf8_info);
+    linkClassFields(env, pclass);
+    if (NULL != (field = findInstanceField(pclass, "value"))) {
+        string_value_offset = field->findex;
+    }
+    if (NULL != (field = findInstanceField(pclass, "hash"))) {
+        string_hash_offset = field->findex;
+    }
+    if (NULL != (field = findInstanceField(pclass, "coder"))) {
+        string_coder_offset = field->findex;
+    }
+    __atomic_store_n(&current_vm->string_class, pclass, __ATOMIC_RELEASE);
+
+    return pclass;
+}
+
+/**
+ * @brief newStringOfValue creates a String of a value made by newStringValue, the hash is 0 as the
+ * fields are zeroed
+ */
+Object* newStringOfValue(OPENV *env, CArray_char *value)
+{
+    Object *obj = allocObject(loadStringClass(env));
+
+    PUT_FIELD_REF(obj, string_value_offset, value);
+    if (string_coder_offset >= 0) {
+        PUT_FIELD(obj, string_coder_offset, IS_LATIN1(value) ? STRING_LATIN1 : STRING_UTF16, char);
+    }
+    return obj;
+}
+
+/**
+ * @brief isLatin1 whether all of the UTF-16 chars fit in one byte
+ */
+static int isLatin1(const ushort *chars, int length)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i high = _mm_set1_epi16((short)0xff00);
+    for (; i + 8 <= length; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(chars + i));
+        if (0xffff != _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, high), _mm_setzero_si128()))) {
+            return 0;
+        }
+    }
+#endif
+    for (; i < length; i++) {
+        if (chars[i] > 0xff) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief newStringValue the value array of UTF-16 chars, compressed to Latin-1 when they all fit
+ */
+CArray_char* newStringValue(const ushort *chars, int length)
+{
+    CArray_char *latin1;
+    CArray_ushort *utf16;
+    int i = 0;
+
+    if (!isLatin1(chars, length)) {
+        utf16 = newCArray_ushort(length, 5, 1);
+        memcpy(utf16->elements, chars, (size_t)length << 1);
+        return (CArray_char*)utf16;
+    }
+    latin1 = newCArray_char(length, 8, 1);
+#if defined(__SSE2__)
+    for (; i + 16 <= length; i += 16) {
+        __m128i lo = _mm_loadu_si128((const __m128i*)(chars + i));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(chars + i + 8));
+        _mm_storeu_si128((__m128i*)(latin1->elements + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < length; i++) {
+        latin1->elements[i] = (char)chars[i];
+    }
+    return latin1;
+}
+
+/**
+ * @brief asciiPrefix the number of leading bytes below 0x80
+ */
+static int asciiPrefix(const uchar *bytes, int length)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    int mask;
+    for (; i + 16 <= length; i += 16) {
+        mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(bytes + i)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    while (i < length && bytes[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+/**
+ * @brief decodeUTF8 decodes (modified) UTF-8 into UTF-16 chars, a malformed sequence gives U+FFFD
+ * @param bytes
+ * @param length
+ * @param chars room for length chars
+ * @return the number of chars
+ */
+int decodeUTF8(const uchar *bytes, int length, ushort *chars)
+{
+    int i, n = 0, ascii;
+    uint c;
+
+    for (i = 0; i < length; ) {
+        // a run of ascii is widened 16 bytes at a time
+        ascii = asciiPrefix(bytes + i, length - i);
+#if defined(__SSE2__)
+        for (; ascii >= 16; ascii -= 16, i += 16, n += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(bytes + i));
+            _mm_storeu_si128((__m128i*)(chars + n), _mm_unpacklo_epi8(v, _mm_setzero_si128()));
+            _mm_storeu_si128((__m128i*)(chars + n + 8), _mm_unpackhi_epi8(v, _mm_setzero_si128()));
+        }
+#endif
+        for (; ascii > 0; ascii--) {
+            chars[n++] = bytes[i++];
+        }
+        if (i >= length) {
+            break;
+        }
+        c = bytes[i];
+        if (0xc0 == (c & 0xe0) && i + 1 < length && 0x80 == (bytes[i+1] & 0xc0)) {
+            chars[n++] = (ushort)(((c & 0x1f) << 6) | (bytes[i+1] & 0x3f));
+            i += 2;
+        } else if (0xe0 == (c & 0xf0) && i + 2 < length && 0x80 == (bytes[i+1] & 0xc0) && 0x80 == (bytes[i+2] & 0xc0)) {
+            chars[n++] = (ushort)(((c & 0x0f) << 12) | ((bytes[i+1] & 0x3f) << 6) | (bytes[i+2] & 0x3f));
+            i += 3;
+        } else if (0xf0 == (c & 0xf8) && i + 3 < length && 0x80 == (bytes[i+1] & 0xc0) && 0x80 == (bytes[i+2] & 0xc0) && 0x80 == (bytes[i+3] & 0xc0)) {
+            c = (((c & 0x07) << 18) | ((bytes[i+1] & 0x3f) << 12) | ((bytes[i+2] & 0x3f) << 6) | (bytes[i+3] & 0x3f)) - 0x10000;
+            chars[n++] = (ushort)(0xd800 + (c >> 10));
+            chars[n++] = (ushort)(0xdc00 + (c & 0x3ff));
+            i += 4;
+        } else {
+            chars[n++] = 0xfffd;
+            i++;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief newStringUTF8 creates a String of (modified) UTF-8 bytes, as a constant pool Utf8 holds
+ */
+Object* newStringUTF8(OPENV *env, const char *bytes, int length)
+{
+    CArray_char *value;
+    ushort buf[256], *chars = buf;
+    int n;
+
+    // the value of an ascii string is the bytes themselves
+    if (asciiPrefix((const uchar*)bytes, length) == length) {
+        value = newCArray_char(length, 8, 1);
+        memcpy(value->elements, bytes, length);
+        return newStringOfValue(env, value);
+    }
+    if (length > 256) {
+        chars = (ushort*)malloc(sizeof(ushort) * length);
+    }
+    n = decodeUTF8((const uchar*)bytes, length, chars);
+    value = newStringValue(chars, n);
+    if (chars != buf) {
+        free(chars);
+    }
+    return newStringOfValue(env, value);
+}
+
+/**
+ * @brief encodeUTF8 encodes a String value as UTF-8, a lone surrogate gives '?'
+ * @param value
+ * @param bytes room for 3 bytes a char, or NULL to only count them
+ * @return the number of bytes
+ */
+int encodeUTF8(CArray_char *value, char *bytes)
+{
+    int i = 0, n = 0, ascii;
+    uint c, c2;
+
+    if (IS_LATIN1(value)) {
+        while (i < value->length) {
+            ascii = asciiPrefix(LATIN1_CHARS(value) + i, value->length - i);
+            if (NULL != bytes) {
+                memcpy(bytes + n, LATIN1_CHARS(value) + i, ascii);
+            }
+            i += ascii;
+            n += ascii;
+            if (i < value->length) {
+                c = LATIN1_CHARS(value)[i++];
+                if (NULL != bytes) {
+                    bytes[n] = (char)(0xc0 | (c >> 6));
+                    bytes[n+1] = (char)(0x80 | (c & 0x3f));
+                }
+                n += 2;
+            }
+        }
+        return n;
+    }
+    for (i = 0; i < value->length; i++) {
+        c = UTF16_CHARS(value)[i];
+        if (c < 0x80) {
+            if (NULL != bytes) {
+                bytes[n] = (char)c;
+            }
+            n++;
+        } else if (c < 0x800) {
+            if (NULL != bytes) {
+                bytes[n] = (char)(0xc0 | (c >> 6));
+                bytes[n+1] = (char)(0x80 | (c & 0x3f));
+            }
+            n += 2;
+        } else if (c >= 0xd800 && c < 0xdc00 && i + 1 < value->length &&
+                   (c2 = UTF16_CHARS(value)[i+1]) >= 0xdc00 && c2 < 0xe000) {
+            c = 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+            if (NULL != bytes) {
+                bytes[n] = (char)(0xf0 | (c >> 18));
+                bytes[n+1] = (char)(0x80 | ((c >> 12) & 0x3f));
+                bytes[n+2] = (char)(0x80 | ((c >> 6) & 0x3f));
+                bytes[n+3] = (char)(0x80 | (c & 0x3f));
+            }
+            n += 4;
+            i++;
+        } else if (c >= 0xd800 && c < 0xe000) {
+            if (NULL != bytes) {
+                bytes[n] = '?';
+            }
+            n++;
+        } else {
+            if (NULL != bytes) {
+                bytes[n] = (char)(0xe0 | (c >> 12));
+                bytes[n+1] = (char)(0x80 | ((c >> 6) & 0x3f));
+                bytes[n+2] = (char)(0x80 | (c & 0x3f));
+            }
+            n += 3;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief mismatchBytes the index of the first different byte, length if there is none
+ */
+static int mismatchBytes(const uchar *a, const uchar *b, int length)
+{
+    int i = 0, mask;
+#if defined(__AVX2__)
+    for (; i + 32 <= length; i += 32) {
+        mask = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i))));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= length; i += 16) {
+        mask = 0xffff ^ _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i))));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i < length && a[i] == b[i]; i++);
+    return i;
+}
+
+/**
+ * @brief mismatchLatin1UTF16 the index of the first different char of a Latin-1 and a UTF-16 string
+ */
+static int mismatchLatin1UTF16(const uchar *a, const ushort *b, int length)
+{
+    int i = 0, mask;
+#if defined(__SSE2__)
+    for (; i + 8 <= length; i += 8) {
+        __m128i wide = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(a + i)), _mm_setzero_si128());
+        mask = 0xffff ^ _mm_movemask_epi8(_mm_cmpeq_epi16(wide, _mm_loadu_si128((const __m128i*)(b + i))));
+        if (mask) {
+            return i + (__builtin_ctz(mask) >> 1);
+        }
+    }
+#endif
+    for (; i < length && a[i] == b[i]; i++);
+    return i;
+}
+
+/**
+ * @brief stringMismatch the index of the first different char of two values in their common length
+ */
+int stringMismatch(CArray_char *v1, CArray_char *v2)
+{
+    int length = v1->length < v2->length ? v1->length : v2->length;
+
+    if (IS_LATIN1(v1) && IS_LATIN1(v2)) {
+        return mismatchBytes(LATIN1_CHARS(v1), LATIN1_CHARS(v2), length);
+    }
+    if (!IS_LATIN1(v1) && !IS_LATIN1(v2)) {
+        return mismatchBytes((const uchar*)v1->elements, (const uchar*)v2->elements, length << 1) >> 1;
+    }
+    return IS_LATIN1(v1) ? mismatchLatin1UTF16(LATIN1_CHARS(v1), UTF16_CHARS(v2), length)
+                         : mismatchLatin1UTF16(LATIN1_CHARS(v2), UTF16_CHARS(v1), length);
+}
+
+/**
+ * @brief stringEquals String.equals of two values, a compressed one never equals an uncompressed one
+ */
+int stringEquals(CArray_char *v1, CArray_char *v2)
+{
+    if (v1 == v2) {
+        return 1;
+    }
+    if (v1->length != v2->length || IS_LATIN1(v1) != IS_LATIN1(v2)) {
+        return 0;
+    }
+    return stringMismatch(v1, v2) == v1->length;
+}
+
+/**
+ * @brief stringCompare String.compareTo, the difference of the first different chars or of the lengths
+ */
+int stringCompare(CArray_char *v1, CArray_char *v2)
+{
+    int i = stringMismatch(v1, v2);
+
+    if (i < v1->length && i < v2->length) {
+        return (int)STRING_CHAR_AT(v1, i) - (int)STRING_CHAR_AT(v2, i);
+    }
+    return v1->length - v2->length;
+}
+
+/**
+ * @brief stringIndexOf String.indexOf(int ch, int fromIndex) of a char of the BMP
+ */
+int stringIndexOf(CArray_char *value, int ch, int from)
+{
+    int i = from < 0 ? 0 : from, mask;
+
+    if (IS_LATIN1(value)) {
+        const uchar *p = LATIN1_CHARS(value);
+        if (ch < 0 || ch > 0xff) {
+            return -1;
+        }
+#if defined(__SSE2__)
+        __m128i c = _mm_set1_epi8((char)ch);
+        for (; i + 16 <= value->length; i += 16) {
+            if ((mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + i)), c)))) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+#endif
+        for (; i < value->length; i++) {
+            if (p[i] == ch) {
+                return i;
+            }
+        }
+    } else {
+        const ushort *p = UTF16_CHARS(value);
+        if (ch < 0 || ch > 0xffff) {
+            return -1;
+        }
+#if defined(__SSE2__)
+        __m128i c = _mm_set1_epi16((short)ch);
+        for (; i + 8 <= value->length; i += 8) {
+            if ((mask = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)(p + i)), c)))) {
+                return i + (__builtin_ctz(mask) >> 1);
+            }
+        }
+#endif
+        for (; i < value->length; i++) {
+            if (p[i] == ch) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief hashChars the polynomial hash h = 31*h + c over the chars. 8 chars are folded at a time with
+ * the powers of 31, so the multiplications do not wait on each other
+ */
+static uint hashChars(CArray_char *value)
+{
+    static const uint p[9] = {1u, 31u, 961u, 29791u, 923521u, 28629151u, 887503681u, 1742810335u, 2487512833u};
+    uint h = 0;
+    int i = 0, n = value->length;
+
+    if (IS_LATIN1(value)) {
+        const uchar *s = LATIN1_CHARS(value);
+        for (; i + 8 <= n; i += 8) {
+            h = h * p[8] + s[i] * p[7] + s[i+1] * p[6] + s[i+2] * p[5] + s[i+3] * p[4]
+                    + s[i+4] * p[3] + s[i+5] * p[2] + s[i+6] * p[1] + s[i+7];
+        }
+        for (; i < n; i++) {
+            h = 31 * h + s[i];
+        }
+    } else {
+        const ushort *s = UTF16_CHARS(value);
+        for (; i + 8 <= n; i += 8) {
+            h = h * p[8] + s[i] * p[7] + s[i+1] * p[6] + s[i+2] * p[5] + s[i+3] * p[4]
+                    + s[i+4] * p[3] + s[i+5] * p[2] + s[i+6] * p[1] + s[i+7];
+        }
+        for (; i < n; i++) {
+            h = 31 * h + s[i];
+        }
+    }
+    return h;
+}
+
+/**
+ * @brief stringHashCode String.hashCode, cached in String.hash, 0 is computed again as the JDK does
+ */
+int stringHashCode(Object *str)
+{
+    uint h;
+
+    if (string_hash_offset >= 0 && 0 != (h = GET_FIELD(str, string_hash_offset, uint))) {
+        return (int)h;
+    }
+    h = hashChars(STRING_VALUE(str));
+    if (string_hash_offset >= 0) {
+        PUT_FIELD(str, string_hash_offset, h, uint);
+    }
+    return (int)h;
+}
+
+#endif // STRINGS_C
@@ -9,6 +9,8 @@
 #ifndef STRUCTS_H
 #define STRUCTS_H
 
+#include <pthread.h>
+
 #include "constants.h"
 
 typedef struct _CONSTANT_Utf8_info {
@@ -20,6 +22,7 @@ typedef struct _CONSTANT_Utf8_info {
 typedef struct _CONSTANT_String_info {
     uchar tag;
     ushort string_index;
+    uint string_ref; // the interned String once ldc has resolved it, a NarrowRef
 } CONSTANT_String_info;
 typedef struct _CONSTANT_Integer_info {
     uchar tag;
@@ -57,6 +60,7 @@ typedef struct _CONSTANT_InvokeDynamic_info {
     uchar tag;
     ushort bootstrap_method_attr_index;
     ushort name_and_type_index;
+    void *call_site; // what the call site is linked to, a ConcatRecipe for the string concat
 } CONSTANT_InvokeDynamic_info;
 
 typedef void** cp_info;
@@ -73,16 +77,60 @@ typedef struct _field_info{
     ushort descriptor_index;
     ushort attributes_count;
     attribute_info **attributes;
-    ushort findex; // field index, [for fieldref]
+    ushort findex; // field index, byte offset from the object for an instance field of a linked class
     uchar ftype; // field type [for fieldref]
 } field_info;
 
+/* call kinds of a method, found when the code is loaded */
+#define CALL_NORMAL 0 // invoked with a new stack frame
+#define CALL_LEAF   1 // small, no invoke and no exception handler, runs in the reused leaf frame
+#define CALL_GETTER 2 // aload_0; getfield; xreturn, runs without a stack frame
+#define CALL_SETTER 3 // aload_0; xload_1; putfield; return, runs without a stack frame
+
 typedef struct _exception_table {
     ushort start_pc;
     ushort end_pc;
     ushort handler_pc;
     ushort catch_type;
 } exception_table;
+/* a use of a scalar replaced object: aload; getfield or aload; <push>; putfield */
+typedef struct _ScalarUse {
+    ushort load_pc;
+    ushort field_pc;
+} ScalarUse;
+
+/* an allocation site found not to escape: new; dup; <push>...; invokespecial <init>; astore */
+typedef struct _ScalarCandidate {
+    ushort new_pc;
+    ushort init_pc;
+    ushort store_pc;
+    ushort local;
+    ushort use_count;
+    ScalarUse *uses;
+} ScalarCandidate;
+
+/* what scalar_init does at a replaced site: zero the field locals, then store the arguments */
+typedef struct _ScalarSite {
+    ushort first_local;
+    ushort local_count;
+    ushort args_len;
+    uchar param_count;
+    struct {
+        uchar size; // slots of the parameter, 1 or 2
+        short local; // the field local it is stored into, -1 if the constructor drops it
+    } params[16];
+} ScalarSite;
+
+typedef struct _EscapeInfo {
+    struct _ClassFile *pclass; // the class of the method
+    ushort candidate_count;
+    ushort tries; // the method entries waiting for the classes to be loaded
+    ScalarCandidate *candidates;
+    ushort site_count;
+    ScalarSite *sites;
+    uchar *replaced_code; // the code before the rewrite, kept for the frames running it until the class is freed
+} EscapeInfo;
+
 typedef struct _Code_attribute {
     ushort attribute_type;
     ushort max_stack;
@@ -93,6 +141,11 @@ typedef struct _Code_attribute {
     exception_table *exceptions;
     ushort attributes_count;
     attribute_info **attributes;
+    struct _RegCode *reg_code; // register code translated at load time, NULL if not translatable
+    uchar call_kind; // CALL_NORMAL, CALL_LEAF, CALL_GETTER or CALL_SETTER, see analyseCallKind
+    ushort accessor_field; // fieldref index of a getter or setter
+    ushort frame_size; // size of the stack frame in bytes
+    EscapeInfo *escape; // the non-escaping allocations to be scalar replaced, NULL if none, see escape.c
 } Code_attribute;
 
 typedef struct _method_info{
@@ -103,8 +156,17 @@ typedef struct _method_info{
     attribute_info **attributes;
     Code_attribute* code_attribute_addr; // address of code attribute
     ushort args_len;
+    void *aot_code; // function compiled ahead of time, see aot.c, NULL if not compiled
+    struct _ClassFile *pclass; // the class declaring the method
 } method_info;
 
+/* a run of unused bytes between the fields of an object */
+typedef struct _FieldHole {
+    ushort offset;
+    ushort size;
+} FieldHole;
+#define MAX_FIELD_HOLES 8
+
 typedef struct _ClassFile{
     uint magic;
     ushort minor_version;
@@ -123,22 +185,44 @@ typedef struct _ClassFile{
     ushort attributes_count;
     attribute_info **attributes;
     struct _ClassFile *parent_class;
-    int parent_fields_size;
-    int fields_size;
+    int parent_fields_size; // bytes of the object used by the parents, -1 until the class is linked
+    int fields_size; // number of instance fields
+    int instance_size; // size of an object in bytes, header included, set by linkClassFields
+    FieldHole field_holes[MAX_FIELD_HOLES]; // bytes left unused in an object by the alignment of the fields
+    uchar field_hole_count;
+    uint *ref_map; // bit n is set if the n-th reference sized word of an object is a reference field
     ushort static_field_size;
     char *static_fields;
     char clinit_runned;
+    char clinit_running; // set while the thread holding init_lock runs the <clinit>
+    pthread_mutex_t init_lock; // held while the <clinit> runs, see runClinitMethod
+    uint lock_mark; // lock of the static synchronized methods, see monitor.c
+    struct _VM *vm; // the vm that loaded the class, see vm.h
 } ClassFile;
 
 typedef ClassFile Class;
 
+/**
+  * the resolution of a constant pool entry is published once: the first thread to resolve it sets the
+  * field with release, after the data it points to is written, and the threads losing the race drop their
+  * result and acquire the one of the winner. a reader takes the entry as resolved with an acquire load, a plain load on x86, and reads the
+  * rest without ordering as it is never written again
+  */
+#define CP_RESOLVED(field) __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+#define CP_PUBLISH(field, value) ({__typeof__(field) _unresolved = 0;\
+    __atomic_compare_exchange_n(&(field), &_unresolved, (value), 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE);})
+
+/* ftype of a fieldref while the thread resolving it writes findex, see publishFieldref */
+#define FIELDREF_RESOLVING 1
+#define FIELDREF_RESOLVED(fieldref) (__atomic_load_n(&(fieldref)->ftype, __ATOMIC_ACQUIRE) > FIELDREF_RESOLVING)
+
 #include "method_table.h"
 
 typedef struct _CONSTANT_Fieldref_info {
     uchar tag;
     ushort class_index;
     ushort name_and_type_index;
-    ushort findex; // field index, [for fieldref]
+    ushort findex; // field index, byte offset from the object for an instance field [for fieldref]
     uchar ftype; // field type [for fieldref]
 } CONSTANT_Fieldref_info;
 
@@ -147,9 +231,9 @@ typedef struct _CONSTANT_Methodref_info {
     ushort class_index;
     ushort name_and_type_index;
     void* ref_addr; //real address, [for methodref]
-    ushort args_len;
     Class *pclass;
     MethodTable *mtable;
+    void *intrinsic; // native implementation bound at resolution, see intrinsics.c, NULL if none
 } CONSTANT_Methodref_info;
 
 typedef CONSTANT_Methodref_info CONSTANT_InterfaceMethodref_info;
@@ -0,0 +1,96 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#define _GNU_SOURCE // pthread_getattr_np, see safepoint.c
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "jvm.c"
+
+/**
+  * the test of the aot cache: test/TestAot.scale is compiled into a shared object, and is bound to it again
+  * only while its bytecode and the constants of its ldc are those it was compiled from.
+  *   gcc -I. -o test_aot test_aot.c -lm -ldl -lpthread && ./test_aot [class_dir]
+  */
+
+static int failures = 0;
+
+#define CHECK(cond) if (!(cond)) { fprintf(stderr, "test_aot: %s:%d: %s failed\n", __FILE__, __LINE__, #cond); failures++; }
+
+/**
+ * @brief findConstInsn the register instruction loading the constant v
+ */
+static RegInsn* findConstInsn(RegCode *rc, int v)
+{
+    int i;
+    for (i = 0; i < rc->insn_count; i++) {
+        if (REG_CONST == rc->insns[i].op && v == rc->insns[i].k.i) {
+            return rc->insns + i;
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    char dir[] = "/tmp/myjvm_aot_XXXXXX", so_name[64];
+    MyJVM *vm = myjvm_create(argc > 1 ? argv[1] : NULL);
+    Class *pclass, *declaring;
+    method_info *method;
+    Code_attribute *code_attr;
+    RegInsn *insn;
+    int args[1] = {3}, result = 0;
+    uchar op;
+
+    current_vm = vm;
+    pclass = myjvm_load_class(vm, "test/TestAot");
+    method = findStaticMethod(pclass, "scale", "(I)I", &declaring);
+    CHECK(NULL != method);
+    code_attr = GET_CODE_FROM_METHOD(method);
+    CHECK(NULL != code_attr->reg_code);
+    insn = findConstInsn(code_attr->reg_code, 1000003);
+    CHECK(NULL != insn);
+    if (failures) {
+        return 1;
+    }
+
+    // 1. compiled and bound
+    CHECK(NULL != mkdtemp(dir));
+    snprintf(so_name, sizeof(so_name), "%s/test_aot.so", dir);
+    CHECK(0 == aotCompileLoadedClasses(so_name));
+    CHECK(0 == openAotLibrary(so_name));
+    bindAotMethods(pclass);
+    CHECK(NULL != method->aot_code);
+    CHECK(0 == myjvm_invoke(vm, pclass, "scale", "(I)I", args, sizeof(args), &result));
+    CHECK(3 * 1000003 + 77777 == result);
+
+    // 2. a constant changed, the bytecode is the same
+    insn->k.i = 1000005;
+    bindAotMethods(pclass);
+    CHECK(NULL == method->aot_code);
+    insn->k.i = 1000003;
+    bindAotMethods(pclass);
+    CHECK(NULL != method->aot_code);
+
+    // 3. the bytecode changed: iadd -> isub
+    op = code_attr->code[code_attr->code_length - 2];
+    code_attr->code[code_attr->code_length - 2] = 0x64;
+    bindAotMethods(pclass);
+    CHECK(NULL == method->aot_code);
+    code_attr->code[code_attr->code_length - 2] = op;
+
+    snprintf(so_name, sizeof(so_name), "%s/test_aot.so", dir);
+    unlink(so_name);
+    snprintf(so_name, sizeof(so_name), "%s/test_aot.c", dir);
+    unlink(so_name);
+    rmdir(dir);
+
+    fprintf(stderr, "test_aot: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,82 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#define _GNU_SOURCE // pthread_getattr_np, see safepoint.c
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "jvm.c"
+
+/**
+  * the test of the embedding api: vms are created, run test/TestEmbed and are destroyed with their classes
+  * again and again, two at a time, the statics of a vm are its own.
+  *   gcc -I. -o test_embed test_embed.c -lm -ldl -lpthread && ./test_embed [class_dir]
+  */
+
+#define EMBED_CYCLES 50
+
+static int failures = 0;
+
+#define CHECK(cond) if (!(cond)) { fprintf(stderr, "test_embed: %s:%d: %s failed\n", __FILE__, __LINE__, #cond); failures++; }
+
+int main(int argc, char *argv[])
+{
+    const char *dir = argc > 1 ? argv[1] : NULL;
+    char long_dir[CLASS_PATH_SIZE];
+    MyJVM *vm, *other;
+    MyJVMClass *pclass, *other_class;
+    int args[3], result, k;
+    long l;
+
+    initHeap(4 << 20);
+
+    memset(long_dir, 'a', sizeof(long_dir) - 1);
+    long_dir[sizeof(long_dir) - 1] = 0;
+    CHECK(NULL == myjvm_create(long_dir));
+
+    for (k = 0; k < EMBED_CYCLES && 0 == failures; k++) {
+        vm = myjvm_create(dir);
+        other = myjvm_create(dir);
+        pclass = myjvm_load_class(vm, "test/TestEmbed");
+        other_class = myjvm_load_class(other, "test/TestEmbed");
+        CHECK(NULL != pclass && NULL != other_class && pclass != other_class);
+
+        args[0] = 40;
+        args[1] = 2;
+        CHECK(0 == myjvm_invoke(vm, pclass, "add", "(II)I", args, 2 * sizeof(int), &result));
+        CHECK(42 == result);
+
+        l = 3000000000L;
+        memcpy(args, &l, sizeof(long));
+        args[2] = 3;
+        CHECK(0 == myjvm_invoke(vm, pclass, "mul", "(JI)J", args, sizeof(long) + sizeof(int), (int*)&l));
+        CHECK(9000000000L == l);
+
+        // the <clinit> runs in each vm, the counter of one does not move the other
+        CHECK(0 == myjvm_invoke(vm, pclass, "next", "()I", args, 0, &result));
+        CHECK(101 == result);
+        CHECK(0 == myjvm_invoke(vm, pclass, "next", "()I", args, 0, &result));
+        CHECK(102 == result);
+        CHECK(0 == myjvm_invoke(other, other_class, "next", "()I", args, 0, &result));
+        CHECK(101 == result);
+
+        args[0] = 20000;
+        CHECK(0 == myjvm_invoke(other, other_class, "churn", "(I)I", args, sizeof(int), &result));
+        CHECK(20000 * 19999 / 2 == result);
+
+        CHECK(-1 == myjvm_invoke(vm, pclass, "nope", "()V", args, 0, &result));
+        CHECK(-1 == myjvm_invoke(vm, pclass, "add", "(II)I", args, sizeof(int), &result));
+
+        myjvm_destroy(vm);
+        myjvm_destroy(other);
+    }
+
+    fprintf(stderr, "test_embed: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,136 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#define _GNU_SOURCE // pthread_getattr_np, see safepoint.c
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "jvm.c"
+
+/**
+  * the test of the roots of the C stack: an object referenced only from a callee-saved register survives a
+  * collection, one not referenced at all does not. the references are kept hidden (xor HIDE) on the C stack
+  * so that the register is the only place the collector can find them.
+  *   gcc -I. -o test_gc_roots test_gc_roots.c -lm -ldl -lpthread && ./test_gc_roots [class_dir]
+  */
+
+#define HIDE 0x5a5a5a5a5a5a5a5aUL
+
+/* the places of r15 (x28) and of the frame pointer in SafepointThread.regs */
+#if defined(__x86_64__)
+#define SAVED_R15 5
+#define SAVED_FP 1
+#else
+#define SAVED_R15 9
+#define SAVED_FP 10
+#endif
+
+static int failures = 0;
+
+#define CHECK(cond) if (!(cond)) { fprintf(stderr, "test_gc_roots: %s:%d: %s failed\n", __FILE__, __LINE__, #cond); failures++; }
+
+/**
+ * @brief hiddenObject a new object, its address is returned hidden
+ */
+static unsigned long __attribute__((noinline)) hiddenObject(Class *pclass)
+{
+    return (unsigned long)newObject(NULL, pclass) ^ HIDE;
+}
+
+/**
+ * @brief wipeStack clears the dead frames below the caller, the address of an object may be left there
+ */
+static void __attribute__((noinline)) wipeStack()
+{
+    volatile char buf[16384];
+    int i;
+
+    for (i = 0; i < sizeof(buf); i++) {
+        buf[i] = 0;
+    }
+}
+
+/**
+ * @brief saveHolding saves the registers while HIDE is in r15 (x28)
+ * @return the frame pointer, glibc keeps it mangled in a jmp_buf
+ */
+static void* __attribute__((noinline, optimize("no-omit-frame-pointer"))) saveHolding(SafepointThread *t)
+{
+#if defined(__x86_64__)
+    __asm__ volatile("movq %0, %%r15" : : "r"(HIDE) : "r15");
+#elif defined(__aarch64__)
+    __asm__ volatile("mov x28, %0" : : "r"(HIDE) : "x28");
+#endif
+    saveThreadStack(t);
+
+    return __builtin_frame_address(0);
+}
+
+/**
+ * @brief collectHolding runs a collection while the object is held only by r15 (x28)
+ * @return the object, read back from the register
+ */
+static Object* __attribute__((noinline)) collectHolding(unsigned long hidden)
+{
+    unsigned long obj;
+
+#if defined(__x86_64__)
+    __asm__ volatile("movq %0, %%r15\n\t"
+                     "xorq %1, %%r15" : : "r"(hidden), "r"(HIDE) : "r15");
+    gcCollect(gc_count, 1);
+    __asm__ volatile("movq %%r15, %0" : "=r"(obj) : : "r15");
+#elif defined(__aarch64__)
+    __asm__ volatile("eor x28, %0, %1" : : "r"(hidden), "r"(HIDE) : "x28");
+    gcCollect(gc_count, 1);
+    __asm__ volatile("mov %0, x28" : "=r"(obj) : : "x28");
+#endif
+
+    return (Object*)obj;
+}
+
+int main(int argc, char *argv[])
+{
+    MyJVM *vm;
+    Class *pclass;
+    SafepointThread t;
+    Object *obj;
+    void *fp;
+    volatile unsigned long held, dropped; // the compiler keeps no unhidden copy
+    long count;
+
+    // 1. the registers are saved as they are
+    memset(&t, 0, sizeof(t));
+    fp = saveHolding(&t);
+    CHECK(fp == t.regs[SAVED_FP]);
+    CHECK((void*)HIDE == t.regs[SAVED_R15]);
+
+    // 2. a collection keeps the object in a register, frees the other
+    initHeap(4 << 20);
+    vm = myjvm_create(argc > 1 ? argv[1] : NULL);
+    current_vm = vm;
+    pclass = myjvm_load_class(vm, "test/Point");
+    CHECK(NULL != pclass);
+    if (failures) {
+        return 1;
+    }
+    held = hiddenObject(pclass);
+    dropped = hiddenObject(pclass);
+    wipeStack();
+    count = gc_count;
+    obj = collectHolding(held);
+    CHECK(gc_count > count);
+    CHECK((Object*)(held ^ HIDE) == obj);
+    CHECK(pclass == obj->pclass);
+    CHECK(NULL == ((Object*)(dropped ^ HIDE))->pclass);
+
+    myjvm_destroy(vm);
+
+    fprintf(stderr, "test_gc_roots: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -17,12 +17,12 @@ void testArray()
     OPENV* env = newOPENV(NULL);
     env->current_stack = stf;
     env->dbg = newDebugType(10, 20);
-    PUSH_STACK(stf, arr, Reference);
+    PUSH_STACKR(stf, arr, Reference);
     PUSH_STACK(stf, 0, int);
     PUSH_STACK(stf, 6, int);
     XASTORE(env, int);
 
-    PUSH_STACK(stf, arr, Reference);
+    PUSH_STACKR(stf, arr, Reference);
     PUSH_STACK(stf, 1, int);
     PUSH_STACK(stf, 9, int);
     XASTORE(env, int);
@@ -30,12 +30,12 @@ void testArray()
     debug("%d", arr->elements[0]);
     debug("%d", arr->elements[1]);
 
-    PUSH_STACK(stf, arr, Reference);
+    PUSH_STACKR(stf, arr, Reference);
     PUSH_STACK(stf, 0, int);
     XALOAD(env, int);
     debug("%d", PICK_STACK(stf, int));
 
-    PUSH_STACK(stf, arr, ArrayRef);
+    PUSH_STACKR(stf, arr, ArrayRef);
     OP_ARRAY_LENGTH(env);
     debug("%d", PICK_STACK(stf, int));
 }
@@ -110,10 +110,10 @@ void testGetField(Class* pclass)
     PUSH_STACK(env->current_stack, 1234567, int);
     POP_STACK(env->current_stack);
     PUSH_STACK(env->current_stack, -126, byte);
-    OP_PUT_FIELDI(obj, 8, byte);
-    printf("byte: %d\n", GET_FIELD(obj, 8, int));
+    OP_PUT_FIELDI(obj, OBJECT_HEADER_SIZE, byte);
+    printf("byte: %d\n", GET_FIELD(obj, OBJECT_HEADER_SIZE, int));
 
-    OP_GET_FIELDI(obj, 8, byte);
+    OP_GET_FIELDI(obj, OBJECT_HEADER_SIZE, byte);
     printf("byte: %d\n", PICK_STACK(env->current_stack, byte));
 }
 
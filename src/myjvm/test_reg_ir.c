@@ -0,0 +1,134 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#define _GNU_SOURCE // pthread_getattr_np, see safepoint.c
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "jvm.c"
+
+/**
+  * the test of the register translation: the methods of test/TestRegIR are translated when loaded, the
+  * register code gives the same results as the stack interpreter, the method calling another is not translated.
+  *   gcc -I. -o test_reg_ir test_reg_ir.c -lm -ldl -lpthread && ./test_reg_ir [class_dir]
+  */
+
+static int failures = 0;
+
+#define CHECK(cond) if (!(cond)) { fprintf(stderr, "test_reg_ir: %s:%d: %s failed\n", __FILE__, __LINE__, #cond); failures++; }
+
+static MyJVM *vm;
+static Class *pclass;
+
+/**
+ * @brief regCodeOf the register code of a static method of test/TestRegIR
+ */
+static RegCode* regCodeOf(const char *name, const char *descriptor)
+{
+    Class *declaring;
+    method_info *method = findStaticMethod(pclass, name, descriptor, &declaring);
+
+    CHECK(NULL != method);
+    return NULL == method ? NULL : GET_CODE_FROM_METHOD(method)->reg_code;
+}
+
+/**
+ * @brief runBoth runs the method by the register engine and by the stack interpreter
+ * @return 1 if both returned expected (size bytes)
+ */
+static int runBoth(const char *name, const char *descriptor, int *args, int args_len, const void *expected, int size)
+{
+    RegCode *rc = regCodeOf(name, descriptor);
+    int reg_result[2] = {0, 0}, stack_result[2] = {0, 0};
+
+    if (NULL == rc) {
+        return 0;
+    }
+    runRegCode(rc, args, args_len, reg_result);
+    if (0 != myjvm_invoke(vm, pclass, name, descriptor, args, args_len, stack_result)) {
+        return 0;
+    }
+
+    return 0 == memcmp(reg_result, expected, size) && 0 == memcmp(stack_result, expected, size);
+}
+
+int main(int argc, char *argv[])
+{
+    RegCode *rc;
+    int args[3], n, a, b, r;
+    uint s;
+    long l, f;
+    double d;
+    float x;
+
+    initHeap(4 << 20);
+    vm = myjvm_create(argc > 1 ? argv[1] : NULL);
+    current_vm = vm;
+    pclass = myjvm_load_class(vm, "test/TestRegIR");
+    CHECK(NULL != pclass);
+    if (failures) {
+        return 1;
+    }
+
+    // 1. c = a + b; return c; is iadd r2, r0, r1; ret r2
+    rc = regCodeOf("add", "(II)I");
+    CHECK(NULL != rc);
+    if (NULL != rc) {
+        CHECK(2 == rc->insn_count);
+        CHECK(REG_IADD == rc->insns[0].op && 2 == rc->insns[0].dst && 0 == rc->insns[0].src1 && 1 == rc->insns[0].src2);
+        CHECK(REG_RET == rc->insns[1].op && 2 == rc->insns[1].src1);
+        CHECK('I' == rc->ret_type);
+    }
+
+    // 2. a call is left to the stack interpreter
+    CHECK(NULL == regCodeOf("calls", "(I)I"));
+    CHECK(NULL != regCodeOf("sum", "(I)I"));
+
+    // 3. the engines agree
+    args[0] = 40;
+    args[1] = 2;
+    r = 42;
+    CHECK(runBoth("add", "(II)I", args, 2 * sizeof(int), &r, sizeof(int)));
+
+    for (n = 0; n <= 100000; n = n * 10 + 1) {
+        for (s = 0, a = 0; a < n; a++) {
+            s += (uint)a * (uint)a;
+        }
+        args[0] = n;
+        r = (int)s;
+        CHECK(runBoth("sum", "(I)I", args, sizeof(int), &r, sizeof(int)));
+    }
+
+    for (n = 0, f = 1; n <= 20; n++) {
+        f *= n > 1 ? n : 1;
+        args[0] = n;
+        CHECK(runBoth("fact", "(I)J", args, sizeof(int), &f, sizeof(long)));
+    }
+
+    for (a = -3; a <= 3; a++) {
+        for (b = -3; b <= 3; b++) {
+            args[0] = a;
+            args[1] = b;
+            r = a > b ? a - b : b - a;
+            CHECK(runBoth("dist", "(II)I", args, 2 * sizeof(int), &r, sizeof(int)));
+        }
+    }
+
+    d = 7.75;
+    x = 1.5f;
+    memcpy(args, &d, sizeof(double));
+    memcpy(args + 2, &x, sizeof(float));
+    d = 7.75 * (double)1.5f - 7.0;
+    CHECK(runBoth("mix", "(DF)D", args, sizeof(double) + sizeof(float), &d, sizeof(double)));
+
+    myjvm_destroy(vm);
+
+    fprintf(stderr, "test_reg_ir: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
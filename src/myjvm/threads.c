@@ -0,0 +1,436 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef THREADS_C
+#define THREADS_C
+
+#include <sched.h>
+#include <time.h>
+
+#include "threads.h"
+
+/**
+  * java.lang.Thread on native threads. the methods of Thread are intrinsics: the constructor registers
+  * the thread object here, start() creates a pthread that runs the run() method of the object in an
+  * OPENV and a java stack of its own. run() is looked up from the class of the object, the run() of
+  * java/lang/Thread itself is replaced by the run() of the Runnable given to the constructor.
+  * the process exits when main and all the non daemon threads have ended, see FUNC_RETURN.
+  * the threads are those of current_vm, a started thread runs for the vm of the thread starting it.
+  * the virtual threads are java.lang.Thread objects too, yield, sleep, join and isAlive go to vthreads.c.
+  * the records are found by their thread object in a table of the vm, an ended one is kept while its thread
+  * object lives and is freed by gc.c, see sweepJavaThreads
+  */
+
+typedef struct _JavaThread {
+    Object *thread; // the java.lang.Thread object
+    Object *target; // the Runnable of the constructor, NULL if none
+    pthread_t tid;
+    char started;
+    char alive;
+    char daemon;
+    VM *vm;
+    OPENV env;
+    struct _JavaThread *hash_next; // in the table of the vm, see findJavaThread
+} JavaThread;
+
+#define JT_HASH(obj, size) ((((size_t)(obj)) >> 3) & ((size) - 1))
+
+/* the virtual threads, see vthreads.c */
+int virtualThreadYield(OPENV *env);
+int virtualThreadSleep(OPENV *env, long millis);
+int virtualThreadJoin(OPENV *env, Object *obj);
+int virtualThreadAlive(Object *obj);
+
+/* start() and setDaemon() of a virtual thread, started when it is created */
+static void notStartableThread(Object *obj)
+{
+    if (virtualThreadAlive(obj) >= 0) {
+        printf("Error: java.lang.IllegalThreadStateException: virtual thread already started\n");
+        exit(1);
+    }
+}
+
+/**
+ * @brief registerJavaThread adds the thread to the table of current_vm, called with threads_lock held
+ */
+static void registerJavaThread(JavaThread *jthread)
+{
+    JavaThread **buckets, *p, *next;
+    long size, i;
+
+    if (current_vm->java_threads_count >= current_vm->java_threads_size) {
+        size = current_vm->java_threads_size ? current_vm->java_threads_size << 1 : 64;
+        buckets = (JavaThread**)calloc(size, sizeof(JavaThread*));
+        for (i = 0; i < current_vm->java_threads_size; i++) {
+            for (p = current_vm->java_threads[i]; NULL != p; p = next) {
+                next = p->hash_next;
+                p->hash_next = buckets[JT_HASH(p->thread, size)];
+                buckets[JT_HASH(p->thread, size)] = p;
+            }
+        }
+        free(current_vm->java_threads);
+        current_vm->java_threads = buckets;
+        current_vm->java_threads_size = size;
+    }
+    i = JT_HASH(jthread->thread, current_vm->java_threads_size);
+    jthread->hash_next = current_vm->java_threads[i];
+    current_vm->java_threads[i] = jthread;
+    current_vm->java_threads_count++;
+}
+
+/**
+ * @brief findJavaThread finds the thread of the object, called with the threads_lock of current_vm held
+ * @param create registers the object if it is not found
+ */
+static JavaThread* findJavaThread(Object *obj, int create)
+{
+    JavaThread *jthread = NULL;
+
+    if (current_vm->java_threads_size > 0) {
+        for (jthread = current_vm->java_threads[JT_HASH(obj, current_vm->java_threads_size)];
+             NULL != jthread && jthread->thread != obj; jthread = jthread->hash_next);
+    }
+    if (NULL != jthread) {
+        return jthread;
+    }
+    if (!create) {
+        printf("Error: java.lang.IllegalThreadStateException: thread not constructed\n");
+        exit(1);
+    }
+    jthread = (JavaThread*)calloc(1, sizeof(JavaThread));
+    jthread->thread = obj;
+    jthread->vm = current_vm;
+    registerJavaThread(jthread);
+
+    return jthread;
+}
+
+/**
+ * @brief findRunMethod looks up run()V from pclass to its parents
+ * @param pdeclaring set to the class declaring the method
+ */
+static method_info* findRunMethod(Class *pclass, Class **pdeclaring)
+{
+    method_info *method;
+    int i;
+
+    for (; NULL != pclass; pclass = pclass->parent_class) {
+        for (i = 0; i < pclass->methods_count; i++) {
+            method = pclass->methods[i];
+            if (NULL != method && !IS_ACC_STATIC(method->access_flags) &&
+                    strcmp(get_utf8(pclass->constant_pool[method->name_index]), "run") == 0 &&
+                    strcmp(get_utf8(pclass->constant_pool[method->descriptor_index]), "()V") == 0) {
+                *pdeclaring = pclass;
+                return method;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void* threadMain(void *arg)
+{
+    JavaThread *jthread = (JavaThread*)arg;
+    OPENV *env = &jthread->env;
+
+    current_vm = jthread->vm;
+    attachSafepointThread(env);
+    // a synchronized run() is locked by the thread running it
+    enterSynchronizedMethod(env->current_stack, env->method);
+    runUntilReturn(env, NULL);
+    detachSafepointThread();
+    free(env->leaf_frame);
+    env->leaf_frame = NULL;
+    env->current_obj = NULL;
+
+    pthread_mutex_lock(&current_vm->threads_lock);
+    jthread->alive = 0;
+    jthread->target = NULL;
+    if (!jthread->daemon) {
+        current_vm->java_threads_alive--;
+    }
+    pthread_cond_broadcast(&current_vm->threads_cond);
+    pthread_mutex_unlock(&current_vm->threads_lock);
+
+    return NULL;
+}
+
+/**
+ * @brief startJavaThread sets up the env to run run() of the receiver and starts the native thread
+ */
+static void startJavaThread(OPENV *current_env, JavaThread *jthread)
+{
+    OPENV *env = &jthread->env;
+    Object *receiver = jthread->thread;
+    Class *pclass;
+    method_info *method;
+    Code_attribute *code_attr;
+    StackFrame *stf;
+    pthread_attr_t attr;
+
+    method = findRunMethod(receiver->pclass, &pclass);
+    if (NULL == method || strcmp(get_this_class_name(pclass), "java/lang/Thread") == 0) {
+        receiver = jthread->target;
+        method = NULL == receiver ? NULL : findRunMethod(receiver->pclass, &pclass);
+    }
+    if (NULL == method || NULL == method->code_attribute_addr) {
+        // nothing to run, the thread ends at once
+        jthread->alive = 0;
+        return;
+    }
+
+    code_attr = (Code_attribute*)(method->code_attribute_addr);
+    stf = newStackFrame(NULL, code_attr);
+    *(NarrowRef*)(stf->localvars) = encodeRef(receiver);
+    stf->method = method;
+
+    memset(env, 0, sizeof(OPENV));
+    env->pc = env->pc_start = stf->code;
+    env->pc_end = stf->code + code_attr->code_length;
+    env->current_stack = stf;
+    env->current_class = pclass;
+    env->current_obj = receiver;
+    env->method = method;
+    env->is_thread = 1;
+#ifdef DEBUG
+    env->dbg = newDebugType(code_attr->max_locals, STACK_FRAME_SIZE);
+#endif
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (0 != pthread_create(&jthread->tid, &attr, threadMain, jthread)) {
+        printf("Error: java.lang.OutOfMemoryError: unable to create new native thread\n");
+        exit(1);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+/**
+ * @brief waitJavaThreads waits for the non daemon threads to end, called when main returns or the vm is destroyed
+ */
+void waitJavaThreads()
+{
+    enterNative();
+    pthread_mutex_lock(&current_vm->threads_lock);
+    while (current_vm->java_threads_alive > 0) {
+        pthread_cond_wait(&current_vm->threads_cond, &current_vm->threads_lock);
+    }
+    pthread_mutex_unlock(&current_vm->threads_lock);
+    leaveNative();
+}
+
+/**
+ * @brief anyJavaThreadAlive a thread of the vm has not ended, a daemon or not, called with threads_lock held
+ */
+static int anyJavaThreadAlive(VM *vm)
+{
+    JavaThread *jthread;
+    long i;
+
+    for (i = 0; i < vm->java_threads_size; i++) {
+        for (jthread = vm->java_threads[i]; NULL != jthread; jthread = jthread->hash_next) {
+            if (jthread->alive) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief forEachJavaThreadObject calls fn on the thread object of the threads of the vm that run and on the target
+ * of those that have not ended, roots of gc.c
+ */
+void forEachJavaThreadObject(VM *vm, void (*fn)(Object*, void*), void *arg)
+{
+    JavaThread *jthread;
+    long i;
+
+    pthread_mutex_lock(&vm->threads_lock);
+    for (i = 0; i < vm->java_threads_size; i++) {
+        for (jthread = vm->java_threads[i]; NULL != jthread; jthread = jthread->hash_next) {
+            if (jthread->alive) {
+                fn(jthread->thread, arg);
+            }
+            // the target is dropped when the thread ends
+            if (NULL != jthread->target) {
+                fn(jthread->target, arg);
+            }
+        }
+    }
+    pthread_mutex_unlock(&vm->threads_lock);
+}
+
+/**
+ * @brief sweepJavaThreads frees the records of the threads not running whose thread object is not live, called
+ * by gc.c before the sweep while the java threads are stopped. a join() holds the thread object in its frame
+ */
+void sweepJavaThreads(VM *vm, int (*is_live)(Object*))
+{
+    JavaThread **pjthread, *jthread;
+    long i;
+
+    pthread_mutex_lock(&vm->threads_lock);
+    for (i = 0; i < vm->java_threads_size; i++) {
+        for (pjthread = &vm->java_threads[i]; NULL != (jthread = *pjthread); ) {
+            if (!jthread->alive && !is_live(jthread->thread)) {
+                *pjthread = jthread->hash_next;
+                free(jthread);
+                vm->java_threads_count--;
+            } else {
+                pjthread = &jthread->hash_next;
+            }
+        }
+    }
+    pthread_mutex_unlock(&vm->threads_lock);
+}
+
+/**
+ * @brief freeJavaThreads frees the records of the threads of a destroyed vm, they have all ended
+ */
+void freeJavaThreads(VM *vm)
+{
+    JavaThread *jthread, *next;
+    long i;
+
+    for (i = 0; i < vm->java_threads_size; i++) {
+        for (jthread = vm->java_threads[i]; NULL != jthread; jthread = next) {
+            next = jthread->hash_next;
+            free(jthread);
+        }
+    }
+    free(vm->java_threads);
+    vm->java_threads = NULL;
+    vm->java_threads_size = vm->java_threads_count = 0;
+}
+
+void intrinsic_thread_init(OPENV *env)
+{
+    Object *obj;
+    GET_STACKR(env->current_stack, obj, Reference);
+    pthread_mutex_lock(&current_vm->threads_lock);
+    findJavaThread(obj, 1);
+    pthread_mutex_unlock(&current_vm->threads_lock);
+}
+
+void intrinsic_thread_init_target(OPENV *env)
+{
+    Object *obj, *target;
+    GET_STACKR(env->current_stack, target, Reference);
+    GET_STACKR(env->current_stack, obj, Reference);
+    pthread_mutex_lock(&current_vm->threads_lock);
+    findJavaThread(obj, 1)->target = target;
+    pthread_mutex_unlock(&current_vm->threads_lock);
+}
+
+void intrinsic_thread_start(OPENV *env)
+{
+    Object *obj;
+    JavaThread *jthread;
+    GET_STACKR(env->current_stack, obj, Reference);
+
+    notStartableThread(obj);
+    pthread_mutex_lock(&current_vm->threads_lock);
+    jthread = findJavaThread(obj, 0);
+    if (jthread->started) {
+        printf("Error: java.lang.IllegalThreadStateException: thread already started\n");
+        exit(1);
+    }
+    jthread->started = jthread->alive = 1;
+    if (!jthread->daemon) {
+        current_vm->java_threads_alive++;
+    }
+    startJavaThread(env, jthread);
+    if (!jthread->alive && !jthread->daemon) {
+        current_vm->java_threads_alive--;
+    }
+    pthread_mutex_unlock(&current_vm->threads_lock);
+}
+
+void intrinsic_thread_join(OPENV *env)
+{
+    Object *obj;
+    JavaThread *jthread;
+    GET_STACKR(env->current_stack, obj, Reference);
+
+    if (virtualThreadJoin(env, obj)) {
+        return;
+    }
+    enterNative();
+    pthread_mutex_lock(&current_vm->threads_lock);
+    jthread = findJavaThread(obj, 0);
+    while (jthread->alive) {
+        pthread_cond_wait(&current_vm->threads_cond, &current_vm->threads_lock);
+    }
+    pthread_mutex_unlock(&current_vm->threads_lock);
+    leaveNative();
+}
+
+void intrinsic_thread_isAlive(OPENV *env)
+{
+    Object *obj;
+    int alive;
+    GET_STACKR(env->current_stack, obj, Reference);
+
+    if ((alive = virtualThreadAlive(obj)) >= 0) {
+        PUSH_STACK(env->current_stack, alive, int);
+        return;
+    }
+    pthread_mutex_lock(&current_vm->threads_lock);
+    alive = findJavaThread(obj, 0)->alive;
+    pthread_mutex_unlock(&current_vm->threads_lock);
+    PUSH_STACK(env->current_stack, alive, int);
+}
+
+void intrinsic_thread_setDaemon(OPENV *env)
+{
+    Object *obj;
+    int on;
+    JavaThread *jthread;
+    GET_STACK(env->current_stack, on, int);
+    GET_STACKR(env->current_stack, obj, Reference);
+
+    notStartableThread(obj);
+    pthread_mutex_lock(&current_vm->threads_lock);
+    jthread = findJavaThread(obj, 0);
+    if (jthread->started) {
+        printf("Error: java.lang.IllegalThreadStateException: setDaemon of a started thread\n");
+        exit(1);
+    }
+    jthread->daemon = (char)(0 != on);
+    pthread_mutex_unlock(&current_vm->threads_lock);
+}
+
+void intrinsic_thread_sleep(OPENV *env)
+{
+    long millis;
+    struct timespec ts;
+    GET_STACKL(env->current_stack, millis, long);
+
+    if (millis < 0) {
+        printf("Error: java.lang.IllegalArgumentException: timeout value is negative\n");
+        exit(1);
+    }
+    if (virtualThreadSleep(env, millis)) {
+        return;
+    }
+    ts.tv_sec = millis / 1000;
+    ts.tv_nsec = (millis % 1000) * 1000000;
+    enterNative();
+    while (nanosleep(&ts, &ts) != 0);
+    leaveNative();
+}
+
+void intrinsic_thread_yield(OPENV *env)
+{
+    if (!virtualThreadYield(env)) {
+        sched_yield();
+    }
+}
+
+#endif // THREADS_C
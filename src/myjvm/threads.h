@@ -0,0 +1,42 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef THREADS_H
+#define THREADS_H
+
+#include <pthread.h>
+
+/**
+  * the locks of the state shared by the java threads, see threads.c for the threads themselves.
+  * vm_lock is taken to load, define and link a class; it is recursive as loading a class loads its
+  * parents. a <clinit> is never run while holding it, the init_lock of the class is taken instead,
+  * see runClinitMethod
+  */
+
+pthread_mutex_t vm_lock;
+
+/**
+ * @brief initRecursiveMutex initializes a mutex the owner thread may lock again
+ */
+static inline void initRecursiveMutex(pthread_mutex_t *lock)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+/* vm_lock is ready before main, there is no portable static initializer of a recursive mutex */
+__attribute__((constructor)) static void initVmLock()
+{
+    initRecursiveMutex(&vm_lock);
+}
+
+#endif // THREADS_H
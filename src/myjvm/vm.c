@@ -0,0 +1,219 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef VM_C
+#define VM_C
+
+#include "myjvm.h"
+
+/**
+  * the embedding api. a host runs workloads in vms of their own, without a process each:
+  *
+  *     MyJVM *vm = myjvm_create("classes/");
+  *     MyJVMClass *pclass = myjvm_load_class(vm, "test/Fib");
+  *     int args[1] = {30}, result;
+  *     myjvm_invoke(vm, pclass, "fib", "(I)I", args, sizeof(args), &result);
+  *     myjvm_destroy(vm);
+  *
+  * a vm has the state of vm.h, the threads calling the api switch current_vm to it while they run.
+  * the heap, the collector and the options (-Xmx, -Xgc...) are of the process and started by the first
+  * myjvm_create. the vms may use different class directories, but the jdk classes in them must be the
+  * same: the offsets of the fields of String and StringBuilder are shared. an error in java code still
+  * ends the process, as in main.c
+  */
+
+static pthread_once_t vm_services_once = PTHREAD_ONCE_INIT;
+
+/* the frame of the host calling myjvm_invoke, the method returns its value there */
+static Code_attribute host_code = {.max_stack = 2};
+
+static void startVmServices()
+{
+    startAllocationProfile();
+    startLockStat();
+    startSafepoints();
+    startGarbageCollector();
+}
+
+MyJVM* myjvm_create(const char *dir)
+{
+    VM *vm;
+
+    if (NULL == dir) {
+        dir = class_dir;
+    }
+    // a class path is the directory and the class name, see classPath
+    if (strlen(dir) >= CLASS_PATH_SIZE / 2) {
+        return NULL;
+    }
+    vm = (VM*)calloc(1, sizeof(VM));
+    pthread_once(&vm_services_once, startVmServices);
+    vm->class_dir = strdup(dir);
+    vm->class_table = newLoadedClassTable();
+    pthread_mutex_init(&vm->class_table_lock, NULL);
+    vm->string_pool = newStringPool();
+    pthread_mutex_init(&vm->threads_lock, NULL);
+    pthread_cond_init(&vm->threads_cond, NULL);
+
+    pthread_mutex_lock(&vms_lock);
+    vm->next = vms;
+    if (NULL != vms) {
+        vms->prev = vm;
+    }
+    vms = vm;
+    pthread_mutex_unlock(&vms_lock);
+
+    return vm;
+}
+
+MyJVMClass* myjvm_load_class(MyJVM *vm, const char *class_name)
+{
+    VM *saved_vm = current_vm;
+    CONSTANT_Utf8_info utf8_info;
+    Class *pclass;
+
+    utf8_info.tag = CONSTANT_Utf8;
+    utf8_info.bytes = (char*)class_name;
+    utf8_info.length = strlen(class_name);
+    current_vm = vm;
+    pclass = systemLoadClassRecursive(NULL, &utf8_info);
+    current_vm = saved_vm;
+
+    return pclass;
+}
+
+/**
+ * @brief findStaticMethod looks up a static method with code from pclass to its parents
+ * @param pdeclaring set to the class declaring the method
+ */
+static method_info* findStaticMethod(Class *pclass, const char *name, const char *descriptor, Class **pdeclaring)
+{
+    method_info *method;
+    int i;
+
+    for (; NULL != pclass; pclass = pclass->parent_class) {
+        for (i = 0; i < pclass->methods_count; i++) {
+            method = pclass->methods[i];
+            if (NULL != method && IS_ACC_STATIC(method->access_flags) && NULL != method->code_attribute_addr &&
+                    strcmp(get_utf8(pclass->constant_pool[method->name_index]), name) == 0 &&
+                    strcmp(get_utf8(pclass->constant_pool[method->descriptor_index]), descriptor) == 0) {
+                *pdeclaring = pclass;
+                return method;
+            }
+        }
+    }
+    return NULL;
+}
+
+int myjvm_invoke(MyJVM *vm, MyJVMClass *pclass, const char *name, const char *descriptor,
+                 const int *args, int args_len, int *result)
+{
+    VM *saved_vm = current_vm;
+    OPENV env;
+    StackFrame *host, *stf;
+    Code_attribute *code_attr;
+    method_info *method;
+    Class *declaring;
+    char rtype = *(strchr(descriptor, ')') + 1);
+
+    if ('L' == rtype || '[' == rtype) {
+        return -1;
+    }
+    method = findStaticMethod(pclass, name, descriptor, &declaring);
+    if (NULL == method || args_len != method->args_len) {
+        return -1;
+    }
+
+    current_vm = vm;
+    code_attr = GET_CODE_FROM_METHOD(method);
+    host = newStackFrame(NULL, &host_code);
+    stf = newStackFrame(host, code_attr);
+    memcpy(stf->localvars, args, args_len);
+    stf->method = method;
+
+    memset(&env, 0, sizeof(OPENV));
+    env.pc = env.pc_start = stf->code;
+    env.pc_end = stf->code + code_attr->code_length;
+    env.current_stack = stf;
+    env.current_class = declaring;
+    env.method = method;
+#ifdef DEBUG
+    env.dbg = newDebugType(code_attr->max_locals, STACK_FRAME_SIZE);
+#endif
+
+    attachSafepointThread(&env);
+    initializeClass(&env, declaring);
+    enterSynchronizedMethod(stf, method);
+    // the method returns to the frame of the host, its last_pc is NULL
+    runUntilReturn(&env, NULL);
+    detachSafepointThread();
+
+    if ('J' == rtype || 'D' == rtype) {
+        memcpy(result, host->sp - SZ_LONG, SZ_LONG);
+    } else if ('V' != rtype) {
+        memcpy(result, host->sp - SZ_INT, SZ_INT);
+    }
+    free(env.leaf_frame);
+    free(host);
+    current_vm = saved_vm;
+
+    return 0;
+}
+
+/**
+ * @brief waitAllJavaThreads waits for the threads of the vm to end, the daemon and the virtual ones too
+ */
+static void waitAllJavaThreads(VM *vm)
+{
+    pthread_mutex_lock(&vm->threads_lock);
+    while (vm->vthreads_alive > 0 || anyJavaThreadAlive(vm)) {
+        pthread_cond_wait(&vm->threads_cond, &vm->threads_lock);
+    }
+    pthread_mutex_unlock(&vm->threads_lock);
+}
+
+static void freeLoadedClass(Class *pclass, void *arg)
+{
+    freeClass(pclass);
+}
+
+void myjvm_destroy(MyJVM *vm)
+{
+    waitAllJavaThreads(vm);
+    freeForkJoinPools(vm);
+
+    // the collector does not see the vm anymore, its objects are garbage
+    pthread_mutex_lock(&vms_lock);
+    if (NULL != vm->prev) {
+        vm->prev->next = vm->next;
+    } else {
+        vms = vm->next;
+    }
+    if (NULL != vm->next) {
+        vm->next->prev = vm->prev;
+    }
+    pthread_mutex_unlock(&vms_lock);
+
+    gcWaitForCollection();
+
+    freeJavaThreads(vm);
+    freeVirtualThreads(vm);
+    freeStringPool(vm->string_pool);
+    forgetAllocationSites(vm);
+    forgetMonitors(vm);
+    __atomic_add_fetch(&vms_freed, 1, __ATOMIC_RELEASE);
+    forEachLoadedClass(vm, freeLoadedClass, NULL);
+    freeLoadedClassTable(vm->class_table);
+    pthread_mutex_destroy(&vm->class_table_lock);
+    pthread_mutex_destroy(&vm->threads_lock);
+    pthread_cond_destroy(&vm->threads_cond);
+    free(vm->class_dir);
+    free(vm);
+}
+
+#endif // VM_C
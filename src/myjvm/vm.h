@@ -0,0 +1,55 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef VM_H
+#define VM_H
+
+#include <pthread.h>
+
+/**
+  * the state of a vm instance, see vm.c for the embedding api. each vm has its class registry, so its
+  * classes, static fields and constant pools, its string pool and its java threads. a thread runs java
+  * code for one vm at a time, current_vm. the heap, the collector and the safepoints are of the process:
+  * a vm never gets a reference to an object of another vm, and the collector takes the roots of all of them
+  */
+
+typedef struct _VM {
+    char *class_dir; // the directory of the classes, the jdk classes included
+    struct _classHashTable *class_table; // see class_hash.h
+    pthread_mutex_t class_table_lock; // serializes the writers of class_table
+    struct _stringPool *string_pool; // see string_pool.c
+    Class *string_class; // java/lang/String, see loadStringClass
+    Class *builder_class; // java/lang/StringBuilder once seen by string_concat.c
+    struct _JavaThread **java_threads; // the threads by thread object, see threads.c, guarded by threads_lock
+    long java_threads_size;
+    long java_threads_count;
+    int java_threads_alive; // the non daemon threads alive
+    pthread_mutex_t threads_lock;
+    pthread_cond_t threads_cond; // signaled when a thread ends
+    struct _FjPool *fj_pools; // the ForkJoinPools, see forkjoin.c, guarded by threads_lock
+    struct _FjPool *fj_common_pool;
+    struct _FjPool *fj_retired_pools; // shut down by gc.c, freed once their workers have exited
+    struct _VirtualThread **vthreads; // the virtual threads by thread object, see vthreads.c, guarded by threads_lock
+    long vthreads_size;
+    long vthreads_count;
+    long vthreads_alive;
+    struct _VM *prev;
+    struct _VM *next;
+} VM;
+
+/* the vm the current thread runs java code for */
+static __thread VM *current_vm = NULL;
+
+/* counts the vms whose classes were freed, a cache of a class by its address is dropped when it changes */
+static long vms_freed = 0;
+
+/* the vms created and not destroyed, walked by the collector with vms_lock held */
+static VM *vms = NULL;
+static pthread_mutex_t vms_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#endif // VM_H
@@ -0,0 +1,870 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef VTHREADS_C
+#define VTHREADS_C
+
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+  * virtual threads, Thread.startVirtualThread(Runnable), multiplexed on a few carrier pthreads. all the
+  * state of a thread running java code is its OPENV and its chain of frames, malloc'ed one per call: a
+  * virtual thread is an OPENV, a carrier mounts it by running the interpreter loop on it and unmounts it
+  * by leaving the loop, a switch is the change of the env. a virtual thread costs its record and its
+  * frames, a few hundred bytes. the record of an ended virtual thread is freed by the collector with its thread
+  * object, see sweepVirtualThreads.
+  * Thread.yield, Thread.sleep, Thread.join, LockSupport.park and parkNanos and the i/o waits of aio.c unmount
+  * the virtual thread: the intrinsic sets vt_switch and returns, the carrier leaves the loop after the invoke
+  * and takes the next virtual thread of the run queue. the monitors are owned by the lock id of the virtual
+  * thread and not of its carrier, so it may leave holding some (see monitors_held); a contended monitorenter
+  * leaves the carrier too and is run again when the thread is mounted, see virtualThreadMonitorEnter. a
+  * virtual thread is pinned to its carrier, blocking it instead, in a <clinit> or any other nested loop, in
+  * Object.wait and entering a contended synchronized method.
+  * the virtual threads are daemons, the carriers (-Xvthreads:carriers=<n>, one per cpu by default) are
+  * started with the first one and there is no time slicing: a virtual thread runs until it switches
+  */
+
+/* the states of a virtual thread, guarded by vt_lock */
+#define VT_RUNNABLE   0 // in the run queue
+#define VT_RUNNING    1 // mounted on a carrier
+#define VT_PARKED     2 // park(), woken by unpark() or its deadline
+#define VT_SLEEPING   3 // sleep(), woken by its deadline
+#define VT_JOINING    4 // join(), woken when the joined thread ends
+#define VT_IO         5 // waiting for an i/o of aio.c, woken when it completes
+#define VT_TERMINATED 6
+
+/* the state is read without vt_lock by gc.c, isAlive() and join() */
+#define vtSetState(vt, s) __atomic_store_n(&(vt)->state, (s), __ATOMIC_RELEASE)
+
+/* why the virtual thread leaves its carrier, set by the intrinsic running in it */
+#define VT_SWITCH_NONE  0
+#define VT_SWITCH_YIELD 1
+#define VT_SWITCH_PARK  2
+#define VT_SWITCH_SLEEP 3
+#define VT_SWITCH_JOIN  4
+#define VT_SWITCH_IO    5
+
+typedef struct _VirtualThread {
+    Object *thread; // the java.lang.Thread object
+    Object *target; // the Runnable, NULL once ended
+    VM *vm;
+    OPENV env;
+    int state;
+    int permit; // unpark() before park()
+    int pinned; // parked on its carrier, see virtualThreadPark
+    int mounted; // has run on a carrier, its synchronized run() is locked
+    long deadline; // of sleep() and parkNanos() in nanoseconds, 0 if none
+    int timer_index; // in vt_timers, -1 if not there
+    uint lock_id; // the lock thread id of monitor.c, given back when it ends
+    int monitors_held; // of monitor.c, kept while off the carrier
+    int io_done; // the i/o completed before the virtual thread left its carrier
+    int waiters; // the platform threads in join(), the record is kept while there are
+    struct _VirtualThread *joining; // the thread this one joins
+    struct _VirtualThread *joiners; // the virtual threads joining this one, linked by join_next
+    struct _VirtualThread *join_next;
+    struct _VirtualThread *run_next; // in the run queue
+    struct _VirtualThread *hash_next; // in the table of the vm, see findVirtualThread
+} VirtualThread;
+
+/* -Xvthreads:carriers=<n>, one per cpu if 0 */
+int vthread_carriers = 0;
+
+/* the run queue, the timers and the states of the virtual threads of every vm */
+static pthread_mutex_t vt_lock = PTHREAD_MUTEX_INITIALIZER;
+/* signaled when a virtual thread is queued and a carrier is idle, the clock is CLOCK_MONOTONIC */
+static pthread_cond_t vt_work_cond;
+/* broadcast by unpark() for the pinned virtual threads */
+static pthread_cond_t vt_pinned_cond;
+static VirtualThread *vt_run_head = NULL, *vt_run_tail = NULL;
+/* a binary heap of the virtual threads with a deadline, the earliest first */
+static VirtualThread **vt_timers = NULL;
+static int vt_timer_count = 0, vt_timer_size = 0;
+static int vt_carriers_started = 0;
+static int vt_idle = 0;
+
+/* the virtual thread mounted on the current carrier */
+static __thread VirtualThread *vt_self = NULL;
+static __thread int vt_switch = VT_SWITCH_NONE;
+
+static long monotonicNanos()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+static void vtInitConds()
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&vt_work_cond, &attr);
+    pthread_cond_init(&vt_pinned_cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/* the carriers are not in a child of fork, the next virtual thread started starts them again */
+static void vtPrepareFork()
+{
+    pthread_mutex_lock(&vt_lock);
+}
+
+static void vtParentAfterFork()
+{
+    pthread_mutex_unlock(&vt_lock);
+}
+
+static void vtChildAfterFork()
+{
+    vt_carriers_started = 0;
+    vt_idle = 0;
+    vtInitConds();
+    pthread_mutex_unlock(&vt_lock);
+}
+
+__attribute__((constructor)) static void initVirtualThreads()
+{
+    vtInitConds();
+    pthread_atfork(vtPrepareFork, vtParentAfterFork, vtChildAfterFork);
+}
+
+/** 1. the run queue and the timers, called with vt_lock held **/
+
+static void vtEnqueue(VirtualThread *vt)
+{
+    vtSetState(vt, VT_RUNNABLE);
+    vt->run_next = NULL;
+    if (NULL == vt_run_tail) {
+        vt_run_head = vt;
+    } else {
+        vt_run_tail->run_next = vt;
+    }
+    vt_run_tail = vt;
+    if (vt_idle > 0) {
+        pthread_cond_signal(&vt_work_cond);
+    }
+}
+
+static void vtTimerSwap(int i, int j)
+{
+    VirtualThread *vt = vt_timers[i];
+
+    vt_timers[i] = vt_timers[j];
+    vt_timers[j] = vt;
+    vt_timers[i]->timer_index = i;
+    vt_timers[j]->timer_index = j;
+}
+
+static void vtTimerSiftUp(int i)
+{
+    for (; i > 0 && vt_timers[(i - 1) >> 1]->deadline > vt_timers[i]->deadline; i = (i - 1) >> 1) {
+        vtTimerSwap(i, (i - 1) >> 1);
+    }
+}
+
+static void vtTimerSiftDown(int i)
+{
+    int child;
+
+    for (; (child = (i << 1) + 1) < vt_timer_count; i = child) {
+        if (child + 1 < vt_timer_count && vt_timers[child + 1]->deadline < vt_timers[child]->deadline) {
+            child++;
+        }
+        if (vt_timers[i]->deadline <= vt_timers[child]->deadline) {
+            break;
+        }
+        vtTimerSwap(i, child);
+    }
+}
+
+static void vtTimerAdd(VirtualThread *vt)
+{
+    if (vt_timer_count == vt_timer_size) {
+        vt_timer_size = vt_timer_size ? vt_timer_size << 1 : 256;
+        vt_timers = (VirtualThread**)realloc(vt_timers, vt_timer_size * sizeof(VirtualThread*));
+    }
+    vt->timer_index = vt_timer_count;
+    vt_timers[vt_timer_count++] = vt;
+    vtTimerSiftUp(vt->timer_index);
+}
+
+static void vtTimerRemove(VirtualThread *vt)
+{
+    int i = vt->timer_index;
+
+    if (i < 0) {
+        return;
+    }
+    vt->timer_index = -1;
+    if (i == --vt_timer_count) {
+        return;
+    }
+    vt_timers[i] = vt_timers[vt_timer_count];
+    vt_timers[i]->timer_index = i;
+    vtTimerSiftDown(i);
+    vtTimerSiftUp(i);
+}
+
+/**
+ * @brief vtWakeTimers queues the virtual threads whose deadline has passed
+ */
+static void vtWakeTimers(long now)
+{
+    VirtualThread *vt;
+
+    while (vt_timer_count > 0 && vt_timers[0]->deadline <= now) {
+        vt = vt_timers[0];
+        vtTimerRemove(vt);
+        vt->deadline = 0;
+        vtEnqueue(vt);
+    }
+}
+
+/**
+ * @brief vtUnpark unpark() of a virtual thread, the permit is kept if it is not parked
+ */
+static void vtUnpark(VirtualThread *vt)
+{
+    if (VT_PARKED == vt->state) {
+        vtTimerRemove(vt);
+        vt->deadline = 0;
+        vtEnqueue(vt);
+    } else if (VT_TERMINATED != vt->state) {
+        vt->permit = 1;
+        if (vt->pinned) {
+            pthread_cond_broadcast(&vt_pinned_cond);
+        }
+    }
+}
+
+/** 2. the carriers **/
+
+/**
+ * @brief vtTake waits for a virtual thread to run, the carrier is idle meanwhile
+ */
+static VirtualThread* vtTake()
+{
+    VirtualThread *vt;
+    struct timespec deadline;
+
+    enterNative();
+    pthread_mutex_lock(&vt_lock);
+    for (;;) {
+        if (vt_timer_count > 0) {
+            vtWakeTimers(monotonicNanos());
+        }
+        if (NULL != (vt = vt_run_head)) {
+            if (NULL == (vt_run_head = vt->run_next)) {
+                vt_run_tail = NULL;
+            }
+            vtSetState(vt, VT_RUNNING);
+            break;
+        }
+        vt_idle++;
+        if (vt_timer_count > 0) {
+            deadline.tv_sec = vt_timers[0]->deadline / 1000000000L;
+            deadline.tv_nsec = vt_timers[0]->deadline % 1000000000L;
+            pthread_cond_timedwait(&vt_work_cond, &vt_lock, &deadline);
+        } else {
+            pthread_cond_wait(&vt_work_cond, &vt_lock);
+        }
+        vt_idle--;
+    }
+    pthread_mutex_unlock(&vt_lock);
+    leaveNative();
+
+    return vt;
+}
+
+/**
+ * @brief vtTerminate the run() of the virtual thread has returned, its joiners are woken
+ */
+static void vtTerminate(VirtualThread *vt)
+{
+    VirtualThread *joiner;
+    VM *vm = vt->vm;
+
+    free(vt->env.leaf_frame);
+    vt->env.leaf_frame = NULL;
+    vt->env.current_obj = NULL;
+    if (0 == vt->monitors_held) {
+        freeLockThreadId(vt->lock_id);
+    }
+
+    pthread_mutex_lock(&vt_lock);
+    vtSetState(vt, VT_TERMINATED);
+    vt->target = NULL;
+    for (joiner = vt->joiners; NULL != joiner; joiner = joiner->join_next) {
+        joiner->joining = NULL;
+        if (VT_JOINING == joiner->state) {
+            vtEnqueue(joiner);
+        }
+    }
+    vt->joiners = NULL;
+    pthread_mutex_unlock(&vt_lock);
+
+    // the platform threads joining it and myjvm_destroy, the vm may be freed once the lock is released
+    pthread_mutex_lock(&vm->threads_lock);
+    vm->vthreads_alive--;
+    pthread_cond_broadcast(&vm->threads_cond);
+    pthread_mutex_unlock(&vm->threads_lock);
+}
+
+/**
+ * @brief vtAfterSwitch puts the unmounted virtual thread where its switch asked
+ */
+static void vtAfterSwitch(VirtualThread *vt, int kind)
+{
+    pthread_mutex_lock(&vt_lock);
+    switch (kind) {
+    case VT_SWITCH_PARK:
+        if (vt->permit) {
+            vt->permit = 0;
+            vt->deadline = 0;
+            vtEnqueue(vt);
+            break;
+        }
+        vtSetState(vt, VT_PARKED);
+        if (vt->deadline > 0) {
+            vtTimerAdd(vt);
+        }
+        break;
+    case VT_SWITCH_SLEEP:
+        vtSetState(vt, VT_SLEEPING);
+        vtTimerAdd(vt);
+        break;
+    case VT_SWITCH_JOIN:
+        // the joined thread may have ended since the join
+        if (NULL == vt->joining) {
+            vtEnqueue(vt);
+        } else {
+            vtSetState(vt, VT_JOINING);
+        }
+        break;
+    case VT_SWITCH_IO:
+        if (vt->io_done) {
+            vt->io_done = 0;
+            vtEnqueue(vt);
+        } else {
+            vtSetState(vt, VT_IO);
+        }
+        break;
+    default:
+        vtEnqueue(vt);
+        break;
+    }
+    pthread_mutex_unlock(&vt_lock);
+}
+
+/**
+ * @brief vtRun mounts the virtual thread on the carrier and runs it until it switches or ends
+ */
+static void vtRun(VirtualThread *vt, OPENV *carrier_env)
+{
+    OPENV *env = &vt->env;
+    uint carrier_lock_id = lock_thread_id;
+    int kind;
+
+    vt_self = vt;
+    vt_switch = VT_SWITCH_NONE;
+    current_vm = vt->vm;
+    lock_thread_id = vt->lock_id;
+    monitors_held = vt->monitors_held;
+    setThreadEnv(env);
+    if (!vt->mounted) {
+        // a synchronized run() is locked by the virtual thread running it
+        vt->mounted = 1;
+        enterSynchronizedMethod(env->current_stack, env->method);
+    }
+    runUntilReturn(env, &vt_switch);
+
+    kind = vt_switch;
+    vt->lock_id = lock_thread_id;
+    vt->monitors_held = monitors_held;
+    lock_thread_id = carrier_lock_id;
+    monitors_held = 0;
+    setThreadEnv(carrier_env);
+    vt_self = NULL;
+    vt_switch = VT_SWITCH_NONE;
+
+    if (NULL == env->pc) {
+        vtTerminate(vt);
+    } else {
+        vtAfterSwitch(vt, kind);
+    }
+    current_vm = NULL;
+}
+
+static void* carrierMain(void *arg)
+{
+    OPENV carrier_env;
+
+    memset(&carrier_env, 0, sizeof(OPENV));
+    attachSafepointThread(&carrier_env);
+    for (;;) {
+        vtRun(vtTake(), &carrier_env);
+    }
+    return NULL;
+}
+
+/**
+ * @brief vtStartCarriers starts the carriers once, called with vt_lock held
+ */
+static void vtStartCarriers()
+{
+    pthread_t tid;
+    int i, n = vthread_carriers;
+
+    if (vt_carriers_started) {
+        return;
+    }
+    if (n <= 0 && (n = (int)sysconf(_SC_NPROCESSORS_ONLN)) < 1) {
+        n = 1;
+    }
+    for (i = 0; i < n; i++) {
+        if (0 != pthread_create(&tid, NULL, carrierMain, NULL)) {
+            printf("Error: java.lang.OutOfMemoryError: unable to create new native thread\n");
+            exit(1);
+        }
+        pthread_detach(tid);
+    }
+    vt_carriers_started = 1;
+}
+
+/** 3. the virtual threads of a vm **/
+
+#define VT_HASH(obj, size) ((((size_t)(obj)) >> 3) & ((size) - 1))
+
+/**
+ * @brief findVirtualThread the virtual thread of the java.lang.Thread object, NULL if it is not one
+ */
+static VirtualThread* findVirtualThread(Object *obj)
+{
+    VirtualThread *vt = NULL;
+
+    pthread_mutex_lock(&current_vm->threads_lock);
+    if (current_vm->vthreads_size > 0) {
+        for (vt = current_vm->vthreads[VT_HASH(obj, current_vm->vthreads_size)]; NULL != vt && vt->thread != obj; vt = vt->hash_next);
+    }
+    pthread_mutex_unlock(&current_vm->threads_lock);
+
+    return vt;
+}
+
+/**
+ * @brief registerVirtualThread adds the virtual thread to the table of current_vm, called with threads_lock held.
+ * the ended ones are kept while their thread object lives, a join() or an isAlive() may come later
+ */
+static void registerVirtualThread(VirtualThread *vt)
+{
+    VirtualThread **buckets, *p, *next;
+    long size, i;
+
+    if (current_vm->vthreads_count >= current_vm->vthreads_size) {
+        size = current_vm->vthreads_size ? current_vm->vthreads_size << 1 : 1024;
+        buckets = (VirtualThread**)calloc(size, sizeof(VirtualThread*));
+        for (i = 0; i < current_vm->vthreads_size; i++) {
+            for (p = current_vm->vthreads[i]; NULL != p; p = next) {
+                next = p->hash_next;
+                p->hash_next = buckets[VT_HASH(p->thread, size)];
+                buckets[VT_HASH(p->thread, size)] = p;
+            }
+        }
+        free(current_vm->vthreads);
+        current_vm->vthreads = buckets;
+        current_vm->vthreads_size = size;
+    }
+    i = VT_HASH(vt->thread, current_vm->vthreads_size);
+    vt->hash_next = current_vm->vthreads[i];
+    current_vm->vthreads[i] = vt;
+    current_vm->vthreads_count++;
+    current_vm->vthreads_alive++;
+}
+
+/**
+ * @brief startVirtualThread queues a virtual thread running run() of the target
+ * @param thread the java.lang.Thread object of the virtual thread
+ */
+static void startVirtualThread(Object *thread, Object *target)
+{
+    VirtualThread *vt = (VirtualThread*)calloc(1, sizeof(VirtualThread));
+    OPENV *env = &vt->env;
+    Class *pclass;
+    method_info *method;
+    Code_attribute *code_attr;
+    StackFrame *stf;
+
+    vt->thread = thread;
+    vt->target = target;
+    vt->vm = current_vm;
+    vt->timer_index = -1;
+    vt->lock_id = newLockThreadId();
+    method = NULL == target ? NULL : findRunMethod(target->pclass, &pclass);
+    if (NULL != method && NULL != method->code_attribute_addr) {
+        code_attr = (Code_attribute*)(method->code_attribute_addr);
+        stf = newStackFrame(NULL, code_attr);
+        *(NarrowRef*)(stf->localvars) = encodeRef(target);
+        stf->method = method;
+
+        env->pc = env->pc_start = stf->code;
+        env->pc_end = stf->code + code_attr->code_length;
+        env->current_stack = stf;
+        env->current_class = pclass;
+        env->current_obj = target;
+        env->method = method;
+        env->is_thread = 1;
+#ifdef DEBUG
+        env->dbg = newDebugType(code_attr->max_locals, STACK_FRAME_SIZE);
+#endif
+    }
+
+    pthread_mutex_lock(&current_vm->threads_lock);
+    registerVirtualThread(vt);
+    pthread_mutex_unlock(&current_vm->threads_lock);
+
+    if (NULL == env->current_stack) {
+        // nothing to run, the thread ends at once
+        vtTerminate(vt);
+        return;
+    }
+    pthread_mutex_lock(&vt_lock);
+    vtStartCarriers();
+    vtEnqueue(vt);
+    pthread_mutex_unlock(&vt_lock);
+}
+
+/**
+ * @brief vtCanUnmount the intrinsic runs in a virtual thread that may leave its carrier: in the env of the
+ * virtual thread itself, not in a nested loop
+ */
+static inline int vtCanUnmount(OPENV *env)
+{
+    return NULL != vt_self && env == &vt_self->env;
+}
+
+/**
+ * @brief forEachVirtualThreadObject calls fn on the thread and target objects of the virtual threads of the vm
+ * that have not ended, roots of gc.c
+ */
+void forEachVirtualThreadObject(VM *vm, void (*fn)(Object*, void*), void *arg)
+{
+    VirtualThread *vt;
+    long i;
+
+    // the target is dropped by vtTerminate under vt_lock
+    pthread_mutex_lock(&vm->threads_lock);
+    pthread_mutex_lock(&vt_lock);
+    for (i = 0; i < vm->vthreads_size; i++) {
+        for (vt = vm->vthreads[i]; NULL != vt; vt = vt->hash_next) {
+            if (NULL != vt->target) {
+                fn(vt->thread, arg);
+                fn(vt->target, arg);
+            }
+        }
+    }
+    pthread_mutex_unlock(&vt_lock);
+    pthread_mutex_unlock(&vm->threads_lock);
+}
+
+/**
+ * @brief forEachVirtualThreadEnv calls fn on the envs of the virtual threads of the vm that have not ended,
+ * mounted or not, called by gc.c while the java threads are stopped
+ */
+void forEachVirtualThreadEnv(VM *vm, void (*fn)(OPENV*))
+{
+    VirtualThread *vt;
+    long i;
+
+    pthread_mutex_lock(&vm->threads_lock);
+    for (i = 0; i < vm->vthreads_size; i++) {
+        for (vt = vm->vthreads[i]; NULL != vt; vt = vt->hash_next) {
+            if (VT_TERMINATED != __atomic_load_n(&vt->state, __ATOMIC_ACQUIRE)) {
+                fn(&vt->env);
+            }
+        }
+    }
+    pthread_mutex_unlock(&vm->threads_lock);
+}
+
+/**
+ * @brief sweepVirtualThreads frees the records of the ended virtual threads whose thread object is not live, called by
+ * gc.c before the sweep while the java threads are stopped
+ */
+void sweepVirtualThreads(VM *vm, int (*is_live)(Object*))
+{
+    VirtualThread **pvt, *vt;
+    long i;
+
+    pthread_mutex_lock(&vm->threads_lock);
+    for (i = 0; i < vm->vthreads_size; i++) {
+        for (pvt = &vm->vthreads[i]; NULL != (vt = *pvt); ) {
+            if (VT_TERMINATED == __atomic_load_n(&vt->state, __ATOMIC_ACQUIRE) && 0 == vt->waiters && !is_live(vt->thread)) {
+                *pvt = vt->hash_next;
+                free(vt);
+                vm->vthreads_count--;
+            } else {
+                pvt = &vt->hash_next;
+            }
+        }
+    }
+    pthread_mutex_unlock(&vm->threads_lock);
+}
+
+/**
+ * @brief freeVirtualThreads frees the records of the virtual threads of a destroyed vm, they have all ended
+ */
+void freeVirtualThreads(VM *vm)
+{
+    VirtualThread *vt, *next;
+    long i;
+
+    for (i = 0; i < vm->vthreads_size; i++) {
+        for (vt = vm->vthreads[i]; NULL != vt; vt = next) {
+            next = vt->hash_next;
+            free(vt);
+        }
+    }
+    free(vm->vthreads);
+    vm->vthreads = NULL;
+    vm->vthreads_size = vm->vthreads_count = 0;
+}
+
+/** 4. the switches, called by the intrinsics of threads.c **/
+
+/**
+ * @brief virtualThreadYield Thread.yield() in a virtual thread
+ * @return 0 if the thread cannot leave its carrier
+ */
+int virtualThreadYield(OPENV *env)
+{
+    if (!vtCanUnmount(env)) {
+        return 0;
+    }
+    vt_switch = VT_SWITCH_YIELD;
+    return 1;
+}
+
+/**
+ * @brief virtualThreadMonitorEnter monitorenter in a virtual thread: a lock held by another thread, which may be
+ * a virtual thread off its carrier, is not waited for on the carrier. the virtual thread goes to the end of
+ * the run queue and runs the monitorenter again when it is mounted
+ * @return 0 if the thread cannot leave its carrier, the caller blocks in monitorEnter
+ */
+int virtualThreadMonitorEnter(OPENV *env, Object *obj)
+{
+    if (!vtCanUnmount(env)) {
+        return 0;
+    }
+    if (!monitorTryEnter(&obj->mark, obj->pclass)) {
+        PUSH_STACKR(env->current_stack, obj, Reference);
+        env->pc--;
+        vt_switch = VT_SWITCH_YIELD;
+    }
+    return 1;
+}
+
+/**
+ * @brief virtualThreadSleep Thread.sleep() in a virtual thread
+ * @return 0 if the thread cannot leave its carrier
+ */
+int virtualThreadSleep(OPENV *env, long millis)
+{
+    if (!vtCanUnmount(env)) {
+        return 0;
+    }
+    vt_self->deadline = monotonicNanos() + millis * 1000000L;
+    vt_switch = VT_SWITCH_SLEEP;
+    return 1;
+}
+
+/**
+ * @brief virtualThreadJoin Thread.join() of a virtual thread, from any thread
+ * @return 0 if obj is not a virtual thread
+ */
+int virtualThreadJoin(OPENV *env, Object *obj)
+{
+    VirtualThread *vt = findVirtualThread(obj);
+
+    if (NULL == vt) {
+        return 0;
+    }
+    if (vtCanUnmount(env)) {
+        pthread_mutex_lock(&vt_lock);
+        if (VT_TERMINATED != vt->state && vt != vt_self) {
+            vt_self->joining = vt;
+            vt_self->join_next = vt->joiners;
+            vt->joiners = vt_self;
+            vt_switch = VT_SWITCH_JOIN;
+        }
+        pthread_mutex_unlock(&vt_lock);
+        return 1;
+    }
+
+    // the record is held before the safepoint of enterNative, the collector may free it once it has ended
+    pthread_mutex_lock(&current_vm->threads_lock);
+    vt->waiters++;
+    enterNative();
+    while (VT_TERMINATED != __atomic_load_n(&vt->state, __ATOMIC_ACQUIRE)) {
+        pthread_cond_wait(&current_vm->threads_cond, &current_vm->threads_lock);
+    }
+    vt->waiters--;
+    pthread_mutex_unlock(&current_vm->threads_lock);
+    leaveNative();
+    return 1;
+}
+
+/**
+ * @brief virtualThreadAlive isAlive() of a virtual thread
+ * @return -1 if obj is not a virtual thread
+ */
+int virtualThreadAlive(Object *obj)
+{
+    VirtualThread *vt = findVirtualThread(obj);
+
+    if (NULL == vt) {
+        return -1;
+    }
+    return VT_TERMINATED != __atomic_load_n(&vt->state, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief virtualThreadPark parks the current virtual thread until unpark() or the deadline, 0 for none.
+ * a pinned virtual thread parks on its carrier, another thread does not park: park() may return at once
+ */
+static void virtualThreadPark(OPENV *env, long deadline)
+{
+    struct timespec ts;
+
+    if (NULL == vt_self) {
+        sched_yield();
+        return;
+    }
+    pthread_mutex_lock(&vt_lock);
+    if (vt_self->permit) {
+        vt_self->permit = 0;
+        pthread_mutex_unlock(&vt_lock);
+        return;
+    }
+    if (vtCanUnmount(env)) {
+        vt_self->deadline = deadline;
+        vt_switch = VT_SWITCH_PARK;
+        pthread_mutex_unlock(&vt_lock);
+        return;
+    }
+    pthread_mutex_unlock(&vt_lock);
+
+    enterNative();
+    pthread_mutex_lock(&vt_lock);
+    vt_self->pinned = 1;
+    while (!vt_self->permit && (0 == deadline || monotonicNanos() < deadline)) {
+        if (0 == deadline) {
+            pthread_cond_wait(&vt_pinned_cond, &vt_lock);
+        } else {
+            ts.tv_sec = deadline / 1000000000L;
+            ts.tv_nsec = deadline % 1000000000L;
+            pthread_cond_timedwait(&vt_pinned_cond, &vt_lock, &ts);
+        }
+    }
+    vt_self->pinned = 0;
+    vt_self->permit = 0;
+    pthread_mutex_unlock(&vt_lock);
+    leaveNative();
+}
+
+/**
+ * @brief virtualThreadIoWait the current virtual thread leaves its carrier after the intrinsic until
+ * virtualThreadIoDone, for an i/o of aio.c
+ * @return the virtual thread, NULL if the thread cannot leave its carrier
+ */
+static VirtualThread* virtualThreadIoWait(OPENV *env)
+{
+    if (!vtCanUnmount(env)) {
+        return NULL;
+    }
+    vt_switch = VT_SWITCH_IO;
+    return vt_self;
+}
+
+/**
+ * @brief virtualThreadIoDone wakes the virtual thread waiting for an i/o, called by the thread completing it
+ */
+static void virtualThreadIoDone(VirtualThread *vt)
+{
+    pthread_mutex_lock(&vt_lock);
+    if (VT_IO == vt->state) {
+        vtEnqueue(vt);
+    } else {
+        vt->io_done = 1;
+    }
+    pthread_mutex_unlock(&vt_lock);
+}
+
+/** 5. the intrinsics **/
+
+void intrinsic_thread_startVirtualThread(OPENV *env)
+{
+    CONSTANT_Utf8_info utf8_info;
+    Class *pclass;
+    Object *obj, *target;
+
+    utf8_info.tag = CONSTANT_Utf8;
+    utf8_info.bytes = "java/lang/Thread";
+    utf8_info.length = strlen(utf8_info.bytes);
+    pclass = systemLoadClassRecursive(env, &utf8_info);
+    linkClassFields(env, pclass);
+    // the target stays on the operand stack while the thread object is allocated
+    obj = allocObject(pclass);
+    GET_STACKR(env->current_stack, target, Reference);
+    if (NULL == target) {
+        printf("Error: java.lang.NullPointerException: startVirtualThread(null)\n");
+        exit(1);
+    }
+    startVirtualThread(obj, target);
+    PUSH_STACKR(env->current_stack, obj, Reference);
+}
+
+void intrinsic_thread_isVirtual(OPENV *env)
+{
+    Object *obj;
+    GET_STACKR(env->current_stack, obj, Reference);
+    PUSH_STACK(env->current_stack, NULL != findVirtualThread(obj), int);
+}
+
+void intrinsic_locksupport_park(OPENV *env)
+{
+    virtualThreadPark(env, 0);
+}
+
+void intrinsic_locksupport_parkNanos(OPENV *env)
+{
+    long nanos;
+    GET_STACKL(env->current_stack, nanos, long);
+    if (nanos > 0) {
+        virtualThreadPark(env, monotonicNanos() + nanos);
+    }
+}
+
+void intrinsic_locksupport_unpark(OPENV *env)
+{
+    Object *obj;
+    VirtualThread *vt;
+    GET_STACKR(env->current_stack, obj, Reference);
+
+    // unpark(null) and the platform threads, which do not park, are no-ops
+    if (NULL == obj || NULL == (vt = findVirtualThread(obj))) {
+        return;
+    }
+    pthread_mutex_lock(&vt_lock);
+    vtUnpark(vt);
+    pthread_mutex_unlock(&vt_lock);
+}
+
+#endif // VTHREADS_C
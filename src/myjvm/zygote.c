@@ -0,0 +1,288 @@
+/**
+ * +-----------------------------------------------------------------+
+ * |  myjvm writing a Java virtual machine step by step (C version)  |
+ * +-----------------------------------------------------------------+
+ * |  Author: springlchy <sisbeau@126.com>  All Rights Reserved      |
+ * +-----------------------------------------------------------------+
+ */
+
+#ifndef ZYGOTE_C
+#define ZYGOTE_C
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+  * the zygote, a server that pays the loading, the linking and the <clinit> of the classes once:
+  *   myjvm -Xzygote:listen=/tmp/myjvm.sock [-Xzygote:preload=classes.txt] [class...]
+  * loads the core jdk classes, the classes of the preload file (one per line) and the classes given, runs
+  * their <clinit>, the jdk ones too, and then forks a child per request on the unix socket. the children
+  * share the classes, the statics and the heap with the zygote until they write them (copy on write), a
+  * request costs a fork:
+  *   myjvm -Xzygote:connect=/tmp/myjvm.sock test/Point
+  * sends its stdin, stdout and stderr and the class to run, and exits with the status of the child, 1 if
+  * the child was killed. the children run with the options of the zygote.
+  * fork keeps the calling thread only, so the zygote runs without the concurrent collector and the periodic
+  * safepoints, the children start them; the gc workers are dropped in the child (see gcChildAfterFork)
+  */
+
+#define ZYGOTE_NAME_SIZE 512
+
+/* the classes preloaded before the ones of the preload file */
+static const char *zygote_core_classes[] = {
+    "java/lang/Object",
+    "java/lang/String",
+    "java/lang/StringBuilder",
+    NULL
+};
+
+static void zygoteSocketAddress(struct sockaddr_un *addr, const char *path)
+{
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        printf("Error: the zygote socket path is too long: %s\n", path);
+        exit(1);
+    }
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+}
+
+/**
+ * @brief zygotePreloadClass loads, links and initializes a class in the vm of the zygote
+ */
+static void zygotePreloadClass(OPENV *env, const char *class_name)
+{
+    CONSTANT_Utf8_info utf8_info;
+    Class *pclass;
+
+    utf8_info.tag = CONSTANT_Utf8;
+    utf8_info.bytes = (char*)class_name;
+    utf8_info.length = strlen(class_name);
+    pclass = systemLoadClassRecursive(NULL, &utf8_info);
+    linkClassFields(env, pclass);
+    env->current_class = pclass;
+    initializeClass(env, pclass);
+}
+
+static void zygotePreload(const char *preload_file, int argc, char *argv[])
+{
+    StackFrame *host = newStackFrame(NULL, &host_code);
+    char line[ZYGOTE_NAME_SIZE];
+    OPENV env;
+    FILE *fp;
+    int i, len;
+
+    memset(&env, 0, sizeof(OPENV));
+    env.current_stack = host;
+    env.current_class = NULL;
+#ifdef DEBUG
+    env.dbg = newDebugType(0, STACK_FRAME_SIZE);
+#endif
+    attachSafepointThread(&env);
+    jdk_clinit = 1;
+    for (i = 0; NULL != zygote_core_classes[i]; i++) {
+        zygotePreloadClass(&env, zygote_core_classes[i]);
+    }
+    loadStringClass(&env);
+    if (NULL != preload_file) {
+        if (NULL == (fp = fopen(preload_file, "r"))) {
+            printf("Error: cannot open the zygote preload file %s\n", preload_file);
+            exit(1);
+        }
+        while (NULL != fgets(line, sizeof(line), fp)) {
+            len = strcspn(line, "\r\n# \t");
+            line[len] = '\0';
+            if (len > 0) {
+                zygotePreloadClass(&env, line);
+            }
+        }
+        fclose(fp);
+    }
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            zygotePreloadClass(&env, argv[i]);
+        }
+    }
+    jdk_clinit = 0;
+    detachSafepointThread();
+    free(host);
+}
+
+/**
+ * @brief zygoteReadRequest reads the class name and the three descriptors of a request
+ * @return 0, or -1 if the client went away or sent something else
+ */
+static int zygoteReadRequest(int conn, char *class_name, int fds[3])
+{
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    struct iovec iov;
+    ssize_t n;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = class_name;
+    iov.iov_len = ZYGOTE_NAME_SIZE - 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if ((n = recvmsg(conn, &msg, 0)) <= 0) {
+        return -1;
+    }
+    class_name[n] = '\0';
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (NULL == cmsg || SOL_SOCKET != cmsg->cmsg_level || SCM_RIGHTS != cmsg->cmsg_type ||
+            cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int))) {
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+
+    return 0;
+}
+
+/* the child ends with exit, when main returns too: the status is sent to the client on the way out */
+static void zygoteSendStatus(int status, void *arg)
+{
+    char byte = (char)status;
+
+    fflush(NULL);
+    write((int)(long)arg, &byte, 1);
+}
+
+/**
+ * @brief zygoteRunChild runs the main method of the class in the child, with the stdio of the client
+ */
+static void zygoteRunChild(int conn, const char *class_name, int fds[3], int concurrent, long interval)
+{
+    CONSTANT_Utf8_info utf8_info;
+    Class *pclass;
+    int i;
+
+    signal(SIGCHLD, SIG_DFL);
+    on_exit(zygoteSendStatus, (void*)(long)conn);
+    for (i = 0; i < 3; i++) {
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+    gc_concurrent = concurrent;
+    safepoint_interval = interval;
+    startConcurrentCollector();
+    startPeriodicSafepoints();
+
+    utf8_info.tag = CONSTANT_Utf8;
+    utf8_info.bytes = (char*)class_name;
+    utf8_info.length = strlen(class_name);
+    pclass = systemLoadClass(&utf8_info);
+    storeLoadedClass(pclass);
+    runMainMethod(pclass);
+    exit(0);
+}
+
+/**
+ * @brief runZygote preloads the classes and serves the requests on the socket, it does not return
+ * @param preload_file the classes to preload, one per line, or NULL
+ */
+int runZygote(const char *path, const char *preload_file, int argc, char *argv[])
+{
+    struct sockaddr_un addr;
+    char class_name[ZYGOTE_NAME_SIZE];
+    int concurrent = gc_concurrent, fds[3], listen_fd, conn, i;
+    long interval = safepoint_interval;
+    pid_t pid;
+
+    gc_concurrent = 0;
+    safepoint_interval = 0;
+    current_vm = myjvm_create(NULL);
+    zygotePreload(preload_file, argc, argv);
+
+    zygoteSocketAddress(&addr, path);
+    unlink(path);
+    if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+            bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, 64) < 0) {
+        printf("Error: the zygote cannot listen on %s\n", path);
+        exit(1);
+    }
+    // the children are not waited for
+    signal(SIGCHLD, SIG_IGN);
+    fprintf(stderr, "zygote: listening on %s\n", path);
+
+    for (;;) {
+        if ((conn = accept(listen_fd, NULL, NULL)) < 0) {
+            continue;
+        }
+        if (zygoteReadRequest(conn, class_name, fds) < 0) {
+            close(conn);
+            continue;
+        }
+        // the buffers of the zygote must not be written again by the child
+        fflush(NULL);
+        if (0 == (pid = fork())) {
+            close(listen_fd);
+            zygoteRunChild(conn, class_name, fds, concurrent, interval);
+        }
+        if (pid < 0) {
+            fprintf(stderr, "zygote: cannot fork for %s\n", class_name);
+        }
+        for (i = 0; i < 3; i++) {
+            close(fds[i]);
+        }
+        close(conn);
+    }
+    return 0;
+}
+
+/**
+ * @brief zygoteConnect asks the zygote to run the class with the stdio of this process
+ * @return the status of the run
+ */
+int zygoteConnect(const char *path, const char *class_name)
+{
+    struct sockaddr_un addr;
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    int fds[3] = {0, 1, 2}, sock;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    struct iovec iov;
+    char status;
+
+    zygoteSocketAddress(&addr, path);
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        printf("Error: cannot connect to the zygote on %s\n", path);
+        exit(1);
+    }
+    if (strlen(class_name) >= ZYGOTE_NAME_SIZE) {
+        printf("Error: the class name is too long: %s\n", class_name);
+        exit(1);
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    iov.iov_base = (char*)class_name;
+    iov.iov_len = strlen(class_name);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, 3 * sizeof(int));
+    if (sendmsg(sock, &msg, 0) < 0) {
+        printf("Error: cannot send the request to the zygote\n");
+        exit(1);
+    }
+
+    // the connection is closed without a status if the child was killed
+    if (1 != read(sock, &status, 1)) {
+        status = 1;
+    }
+    close(sock);
+
+    return status;
+}
+
+#endif // ZYGOTE_C
@@ -0,0 +1,12 @@
+package test;
+
+class TestAot {
+	// the constants are loaded by ldc, the aot code has them built in
+	static int scale(int x) {
+		return x * 1000003 + 77777;
+	}
+
+	public static void main(String[] args) {
+		int r = scale(3);
+	}
+}
@@ -0,0 +1,160 @@
+package test;
+
+import java.util.Arrays;
+
+// an Object is copied to an int[][], the run ends with java.lang.ArrayStoreException and exit code 1
+class TestArrayStore {
+	public static void main(String[] args) {
+		int[][] a = new int[2][3];
+		Object[] os = { new int[4], new Object() };
+		// an int[] is stored
+		System.arraycopy(os, 0, a, 0, 1);
+		TestArrays.check(a[0] == os[0]);
+		System.arraycopy(os, 0, a, 0, 2);
+		TestArrays.check(false);
+	}
+}
+
+class TestArrays {
+	static void check(boolean ok) {
+		if (!ok) {
+			int z = 0;
+			int y = 1 / z;
+		}
+	}
+
+	// the lengths are not multiples of the vector widths, the elements around the range are not touched
+	static void fillBytes(int n) {
+		byte[] a = new byte[n + 2];
+		Arrays.fill(a, 1, n + 1, (byte) 90);
+		check(a[0] == 0 && a[n + 1] == 0);
+		for (int i = 0; i < n; i++) {
+			check(a[i + 1] == 90);
+		}
+	}
+
+	static void fillShorts(int n) {
+		short[] a = new short[n + 2];
+		Arrays.fill(a, 1, n + 1, (short) -12345);
+		check(a[0] == 0 && a[n + 1] == 0);
+		for (int i = 0; i < n; i++) {
+			check(a[i + 1] == -12345);
+		}
+	}
+
+	static void fillInts(int n) {
+		int[] a = new int[n + 2];
+		Arrays.fill(a, 1, n + 1, 0xdeadbeef);
+		check(a[0] == 0 && a[n + 1] == 0);
+		for (int i = 0; i < n; i++) {
+			check(a[i + 1] == 0xdeadbeef);
+		}
+	}
+
+	static void fillLongs(int n) {
+		long[] a = new long[n + 2];
+		Arrays.fill(a, 1, n + 1, 0x0123456789abcdefL);
+		check(a[0] == 0L && a[n + 1] == 0L);
+		for (int i = 0; i < n; i++) {
+			check(a[i + 1] == 0x0123456789abcdefL);
+		}
+	}
+
+	static void fillDoubles(int n) {
+		double[] a = new double[n + 2];
+		Arrays.fill(a, 1, n + 1, -1.5);
+		check(a[0] == 0.0 && a[n + 1] == 0.0);
+		for (int i = 0; i < n; i++) {
+			check(a[i + 1] == -1.5);
+		}
+	}
+
+	public static void main(String[] args) {
+		// 1. overlapping copies in both directions
+		int[] a = new int[100];
+		for (int i = 0; i < 100; i++) {
+			a[i] = i;
+		}
+		System.arraycopy(a, 0, a, 3, 90);
+		for (int i = 0; i < 100; i++) {
+			check(a[i] == (i < 3 || i >= 93 ? i : i - 3));
+		}
+		System.arraycopy(a, 3, a, 0, 90);
+		for (int i = 0; i < 90; i++) {
+			check(a[i] == i);
+		}
+
+		byte[] b = new byte[1000];
+		for (int i = 0; i < 1000; i++) {
+			b[i] = (byte) i;
+		}
+		System.arraycopy(b, 1, b, 0, 999);
+		for (int i = 0; i < 999; i++) {
+			check(b[i] == (byte) (i + 1));
+		}
+		System.arraycopy(b, 0, b, 33, 900);
+		for (int i = 0; i < 900; i++) {
+			check(b[i + 33] == (byte) (i + 1));
+		}
+
+		long[] l = new long[50];
+		for (int i = 0; i < 50; i++) {
+			l[i] = i * 1000000007L;
+		}
+		System.arraycopy(l, 0, l, 1, 49);
+		for (int i = 0; i < 49; i++) {
+			check(l[i + 1] == i * 1000000007L);
+		}
+
+		Object[] o = new Object[10];
+		Object[] saved = new Object[10];
+		for (int i = 0; i < 10; i++) {
+			o[i] = new Object();
+		}
+		System.arraycopy(o, 0, saved, 0, 10);
+		System.arraycopy(o, 0, o, 2, 8);
+		for (int i = 0; i < 8; i++) {
+			check(o[i + 2] == saved[i]);
+		}
+
+		// the arrays of arrays: an int[][] is an Object[], an Object[] of int[] may be copied to an int[][]
+		int[][] m = new int[3][4];
+		Object[] om = new Object[3];
+		System.arraycopy(m, 0, om, 0, 3);
+		check(om[1] == m[1]);
+		int[][] m2 = new int[3][2];
+		System.arraycopy(om, 0, m2, 0, 3);
+		check(m2[2] == m[2] && m2[2].length == 4);
+
+		// 2. range fills
+		int[] lengths = { 1, 3, 7, 13, 33, 67 };
+		for (int k = 0; k < lengths.length; k++) {
+			fillBytes(lengths[k]);
+			fillShorts(lengths[k]);
+			fillInts(lengths[k]);
+			fillLongs(lengths[k]);
+			fillDoubles(lengths[k]);
+		}
+
+		// 3. equals compares the doubles by their bits, with one NaN
+		double[] x = { 1.0, Double.NaN, 0.0 };
+		double[] y = { 1.0, Double.NaN, 0.0 };
+		check(Arrays.equals(x, y));
+		y[2] = -0.0;
+		check(!Arrays.equals(x, y));
+		double z = 0.0;
+		y[2] = 0.0;
+		y[1] = z / z;
+		check(Arrays.equals(x, y));
+		float[] fx = { Float.NaN, -0.0f };
+		float[] fy = { Float.NaN, 0.0f };
+		check(!Arrays.equals(fx, fy));
+		fy[1] = -0.0f;
+		check(Arrays.equals(fx, fy));
+		int[] c = new int[100];
+		System.arraycopy(a, 0, c, 0, 100);
+		check(Arrays.equals(a, c));
+		c[99]++;
+		check(!Arrays.equals(a, c));
+	}
+}
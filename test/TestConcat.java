@@ -0,0 +1,41 @@
+package test;
+
+class TestConcat {
+	static void check(boolean ok) {
+		if (!ok) {
+			int z = 0;
+			int y = 1 / z;
+		}
+	}
+
+	static String f(float v) {
+		return new StringBuilder().append(v).toString();
+	}
+
+	static String d(double v) {
+		return new StringBuilder().append(v).toString();
+	}
+
+	public static void main(String[] args) {
+		// 1. the floats have the shortest digits of Float.toString, not those of the double they widen to
+		float third = 1.0f / 3;
+		check(f(0.1f).equals("0.1") && f(third).equals("0.33333334") && f(100.0f).equals("100.0"));
+		check(f(-1.5f).equals("-1.5") && f(0.001f).equals("0.001") && f(1.0E-4f).equals("1.0E-4"));
+		check(f(1.0E10f).equals("1.0E10") && f(Float.MAX_VALUE).equals("3.4028235E38"));
+		// one digit reads back as Float.MIN_VALUE, but the closest of two digits is printed
+		check(f(Float.MIN_VALUE).equals("1.4E-45"));
+		check(f(Float.NaN).equals("NaN") && f(Float.NEGATIVE_INFINITY).equals("-Infinity") && f(-0.0f).equals("-0.0"));
+
+		// 2. the doubles, plain from 10^-3 up to 10^7
+		double dthird = 1.0 / 3;
+		check(d(0.1).equals("0.1") && d(dthird).equals("0.3333333333333333") && d(100.0).equals("100.0"));
+		check(d(9999999.0).equals("9999999.0") && d(1.0E7).equals("1.0E7") && d(123456789.0).equals("1.23456789E8"));
+		check(d(0.001).equals("0.001") && d(1.0E-5).equals("1.0E-5") && d(2.0E23).equals("2.0E23"));
+		check(d(Double.MIN_VALUE).equals("4.9E-324") && d(Double.MAX_VALUE).equals("1.7976931348623157E308"));
+		check(d(Double.POSITIVE_INFINITY).equals("Infinity") && d(-0.0).equals("-0.0") && d(0.0).equals("0.0"));
+
+		// 3. the numbers between other pieces
+		String s = new StringBuilder().append("f=").append(0.5f).append(',').append(-2.5E-7).toString();
+		check(s.equals("f=0.5,-2.5E-7"));
+	}
+}
@@ -0,0 +1,36 @@
+package test;
+
+class TestEmbed {
+	static int counter;
+
+	static {
+		counter = 100;
+	}
+
+	static int add(int a, int b) {
+		return a + b;
+	}
+
+	static long mul(long a, int b) {
+		return a * b;
+	}
+
+	// the statics are of the vm, a new vm starts again from its <clinit>
+	static synchronized int next() {
+		return ++counter;
+	}
+
+	static int churn(int n) {
+		int s = 0;
+		for (int i = 0; i < n; i++) {
+			int[] a = new int[8];
+			a[0] = i;
+			s += a[0];
+		}
+		return s;
+	}
+
+	public static void main(String[] args) {
+		int r = next();
+	}
+}
@@ -0,0 +1,33 @@
+package test;
+
+class Cell {
+	int v;
+
+	Cell(int v) {
+		this.v = v;
+	}
+}
+
+class TestEscapeParam {
+	// the parameter c is read before the new object is stored into its slot, so it is not scalar replaced
+	static int swap(Cell c) {
+		int a = c.v;
+		c = new Cell(5);
+		return a * 10 + c.v;
+	}
+
+	// a local of its own, scalar replaced
+	static int local(int x) {
+		Cell c = new Cell(x);
+		return c.v + 1;
+	}
+
+	public static void main(String[] args) {
+		for (int i = 0; i < 8; i++) {
+			if (swap(new Cell(i)) != i * 10 + 5 || local(i) != i + 1) {
+				int z = 0;
+				int y = 1 / z;
+			}
+		}
+	}
+}
@@ -0,0 +1,92 @@
+package test;
+
+import java.util.concurrent.ForkJoinPool;
+import java.util.concurrent.RecursiveAction;
+import java.util.concurrent.RecursiveTask;
+
+// the value is an int[1], the class path of myjvm has no Integer to box it
+class FibTask extends RecursiveTask<int[]> {
+	final int n;
+
+	FibTask(int n) {
+		this.n = n;
+	}
+
+	// n - 1 is forked for another worker to steal, n - 2 is computed here
+	protected int[] compute() {
+		if (n < 2) {
+			return new int[] { n };
+		}
+		FibTask f1 = new FibTask(n - 1);
+		f1.fork();
+		int[] r2 = new FibTask(n - 2).compute();
+		int[] r1 = f1.join();
+		return new int[] { r1[0] + r2[0] };
+	}
+}
+
+class DoubleAction extends RecursiveAction {
+	final int[] a;
+	final int lo, hi;
+
+	DoubleAction(int[] a, int lo, int hi) {
+		this.a = a;
+		this.lo = lo;
+		this.hi = hi;
+	}
+
+	protected void compute() {
+		if (hi - lo <= 512) {
+			for (int i = lo; i < hi; i++) {
+				a[i] *= 2;
+			}
+			return;
+		}
+		int mid = (lo + hi) >>> 1;
+		DoubleAction left = new DoubleAction(a, lo, mid);
+		left.fork();
+		new DoubleAction(a, mid, hi).compute();
+		left.join();
+	}
+}
+
+class TestForkJoin {
+	static void check(boolean ok) {
+		if (!ok) {
+			int z = 0;
+			int y = 1 / z;
+		}
+	}
+
+	public static void main(String[] args) {
+		// 1. a pool of 4 workers, the forked halves are stolen and joined
+		ForkJoinPool pool = new ForkJoinPool(4);
+		check(pool.getParallelism() == 4);
+		FibTask fib = new FibTask(18);
+		check(pool.invoke(fib)[0] == 2584 && fib.isDone());
+
+		int[] a = new int[4096];
+		for (int i = 0; i < a.length; i++) {
+			a[i] = i;
+		}
+		DoubleAction d = new DoubleAction(a, 0, a.length);
+		pool.invoke(d);
+		check(d.isDone());
+		for (int i = 0; i < a.length; i++) {
+			check(a[i] == 2 * i);
+		}
+		pool.shutdown();
+		pool.close();
+
+		// 2. the common pool, and a task invoked by a thread out of any pool
+		check(ForkJoinPool.commonPool().invoke(new FibTask(12))[0] == 144);
+		check(new FibTask(10).invoke()[0] == 55);
+
+		// 3. the pools dropped without a shutdown are retired by the gc, with -Xmx4m the garbage makes a few
+		for (int i = 0; i < 60; i++) {
+			ForkJoinPool p = new ForkJoinPool(2);
+			check(p.invoke(new FibTask(8))[0] == 21);
+			int[] garbage = new int[40000];
+		}
+	}
+}
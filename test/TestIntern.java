@@ -0,0 +1,71 @@
+package test;
+
+class InternOther {
+	static String hello() {
+		return "hello";
+	}
+}
+
+class Interner implements Runnable {
+	final String[] got = new String[50];
+
+	public void run() {
+		for (int i = 0; i < 50; i++) {
+			got[i] = new StringBuilder().append("key").append(i).toString().intern();
+		}
+	}
+}
+
+class TestIntern {
+	static void check(boolean ok) {
+		if (!ok) {
+			int z = 0;
+			int y = 1 / z;
+		}
+	}
+
+	static String literal() {
+		return "late literal";
+	}
+
+	public static void main(String[] args) throws InterruptedException {
+		// 1. the literals of all the classes are one String, intern() finds it for equal chars
+		String a = "hello";
+		check(a == InternOther.hello());
+		String b = new String(a.getBytes());
+		check(b != a && b.equals(a) && b.intern() == a);
+		String c = new StringBuilder().append("hel").append("lo").toString();
+		check(c != a && c.intern() == a);
+
+		// 2. a String interned before any ldc of its chars is the String of the literal
+		String late = new StringBuilder().append("late ").append("literal").toString();
+		check(late.intern() == late);
+		check(literal() == late);
+
+		// 3. the pooled Strings are roots of the gc, with -Xmx4m the garbage makes a gc every few rounds
+		for (int i = 0; i < 20; i++) {
+			int[] garbage = new int[200000];
+			check(literal() == late && InternOther.hello() == a);
+		}
+		check(a.equals("hello") && late.length() == 12);
+
+		// 4. threads interning the same chars at once get the same Strings
+		Interner[] ts = new Interner[4];
+		Thread[] th = new Thread[4];
+		for (int t = 0; t < 4; t++) {
+			ts[t] = new Interner();
+			th[t] = new Thread(ts[t]);
+			th[t].start();
+		}
+		for (int t = 0; t < 4; t++) {
+			th[t].join();
+		}
+		for (int i = 0; i < 50; i++) {
+			String k = ts[0].got[i];
+			check(k.equals(new StringBuilder().append("key").append(i).toString()));
+			for (int t = 1; t < 4; t++) {
+				check(ts[t].got[i] == k);
+			}
+		}
+	}
+}
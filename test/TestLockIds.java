@@ -0,0 +1,145 @@
+package test;
+
+// holds the lock until released, so its lock id is in the mark word of the lock all along
+class LockHolder implements Runnable {
+	public void run() {
+		synchronized (TestLockIds.lock) {
+			TestLockIds.held = true;
+			while (!TestLockIds.release) {
+				Thread.yield();
+			}
+		}
+	}
+}
+
+// a short thread taking a lock id of its own, given again when it ends
+class LockChurn implements Runnable {
+	int r;
+
+	public void run() {
+		synchronized (this) {
+			r = 1;
+		}
+	}
+}
+
+// must not get in while the holder holds the lock, whatever id it was given
+class LockEntrant implements Runnable {
+	public void run() {
+		synchronized (TestLockIds.lock) {
+			if (!TestLockIds.release) {
+				TestLockIds.early++;
+			}
+			TestLockIds.entered++;
+		}
+	}
+}
+
+class LockWaiter implements Runnable {
+	public void run() {
+		synchronized (TestLockIds.lock2) {
+			TestLockIds.waiting = true;
+			while (!TestLockIds.go) {
+				try {
+					TestLockIds.lock2.wait();
+				} catch (InterruptedException e) {
+				}
+			}
+			TestLockIds.woken = true;
+		}
+	}
+}
+
+// yield() unmounts the virtual thread with the lock held, the others mounted meanwhile leave the carrier
+// again at the contended monitorenter
+class LockAdder implements Runnable {
+	public void run() {
+		synchronized (TestLockIds.vlock) {
+			int v = TestLockIds.vcount;
+			Thread.yield();
+			TestLockIds.vcount = v + 1;
+		}
+	}
+}
+
+class TestLockIds {
+	static Object lock = new Object();
+	static Object lock2 = new Object();
+	static Object vlock = new Object();
+	static volatile boolean held;
+	static volatile boolean release;
+	static int early;
+	static int entered;
+	static boolean waiting;
+	static boolean go;
+	static boolean woken;
+	static int vcount;
+
+	static void check(boolean ok) {
+		if (!ok) {
+			int z = 0;
+			int y = 1 / z;
+		}
+	}
+
+	public static void main(String[] args) throws InterruptedException {
+		Thread holder = new Thread(new LockHolder());
+		holder.start();
+		while (!held) {
+			Thread.yield();
+		}
+		Thread waiter = new Thread(new LockWaiter());
+		waiter.start();
+		boolean w = false;
+		while (!w) {
+			synchronized (lock2) {
+				w = waiting;
+			}
+			Thread.yield();
+		}
+
+		// 1. 300 threads end, their ids are given again while the holder and the waiter keep theirs
+		for (int round = 0; round < 15; round++) {
+			Thread[] ts = new Thread[20];
+			for (int i = 0; i < 20; i++) {
+				ts[i] = new Thread(new LockChurn());
+				ts[i].start();
+			}
+			for (int i = 0; i < 20; i++) {
+				ts[i].join();
+			}
+		}
+
+		// 2. the new threads wait for the holder, none is taken for its owner
+		Thread[] entrants = new Thread[20];
+		for (int i = 0; i < 20; i++) {
+			entrants[i] = new Thread(new LockEntrant());
+			entrants[i].start();
+		}
+		Thread.sleep(50);
+		release = true;
+		holder.join();
+		for (int i = 0; i < 20; i++) {
+			entrants[i].join();
+		}
+		check(early == 0 && entered == 20);
+
+		// 3. the waiter is woken and takes the monitor back under its own id
+		synchronized (lock2) {
+			go = true;
+			lock2.notifyAll();
+		}
+		waiter.join();
+		check(woken);
+
+		// 4. 200 virtual threads, most unmounted holding vlock or waiting for it, their ids given again as they end
+		Thread[] vts = new Thread[200];
+		for (int i = 0; i < 200; i++) {
+			vts[i] = Thread.startVirtualThread(new LockAdder());
+		}
+		for (int i = 0; i < 200; i++) {
+			vts[i].join();
+		}
+		check(vcount == 200);
+	}
+}
@@ -0,0 +1,136 @@
+package test;
+
+class Counter {
+	int count;
+
+	// deeper than the 63 recursions a thin lock counts, so the lock is inflated on the way down
+	synchronized void add(int n) {
+		if (n > 0) {
+			count++;
+			add(n - 1);
+		}
+	}
+}
+
+class Adder implements Runnable {
+	final Counter c;
+	final Object lock;
+
+	Adder(Counter c, Object lock) {
+		this.c = c;
+		this.lock = lock;
+	}
+
+	public void run() {
+		for (int i = 0; i < 2000; i++) {
+			synchronized (lock) {
+				c.count++;
+			}
+			if ((i & 63) == 0) {
+				int[] garbage = new int[10000];
+			}
+		}
+	}
+}
+
+class Waiter implements Runnable {
+	final Object lock;
+
+	Waiter(Object lock) {
+		this.lock = lock;
+	}
+
+	public void run() {
+		synchronized (lock) {
+			TestMonitors.waiting++;
+			while (!TestMonitors.go) {
+				try {
+					lock.wait();
+				} catch (InterruptedException e) {
+				}
+			}
+			TestMonitors.woken++;
+		}
+	}
+}
+
+class TestMonitors {
+	static int waiting;
+	static boolean go;
+	static int woken;
+
+	static void check(boolean ok) {
+		if (!ok) {
+			int z = 0;
+			int y = 1 / z;
+		}
+	}
+
+	public static void main(String[] args) throws InterruptedException {
+		// 1. recursion, in a synchronized method and in nested blocks
+		Counter c = new Counter();
+		c.add(100);
+		check(c.count == 100);
+		synchronized (c) {
+			synchronized (c) {
+				synchronized (c) {
+					c.count++;
+				}
+			}
+		}
+		check(c.count == 101);
+
+		// 2. contended blocks, with -Xmx4m the garbage makes gcs that deflate the idle monitors between them
+		Object lock = new Object();
+		Counter shared = new Counter();
+		Thread[] adders = new Thread[4];
+		for (int i = 0; i < 4; i++) {
+			adders[i] = new Thread(new Adder(shared, lock));
+			adders[i].start();
+		}
+		for (int i = 0; i < 4; i++) {
+			adders[i].join();
+		}
+		check(shared.count == 8000);
+
+		// 3. the threads in wait() across gcs, their monitor is not deflated under them
+		Thread[] waiters = new Thread[3];
+		for (int i = 0; i < 3; i++) {
+			waiters[i] = new Thread(new Waiter(lock));
+			waiters[i].start();
+		}
+		int n = 0;
+		while (n < 3) {
+			synchronized (lock) {
+				n = waiting;
+			}
+			Thread.yield();
+		}
+		for (int i = 0; i < 10; i++) {
+			int[] garbage = new int[200000];
+		}
+		synchronized (lock) {
+			go = true;
+			lock.notifyAll();
+		}
+		for (int i = 0; i < 3; i++) {
+			waiters[i].join();
+		}
+		check(woken == 3);
+
+		// 4. wait() gives up all the recursions and takes them back, notify() checks the owner after each exit
+		synchronized (lock) {
+			synchronized (lock) {
+				lock.wait(1);
+				lock.notify();
+			}
+			lock.notify();
+		}
+		for (int i = 0; i < 10; i++) {
+			int[] garbage = new int[200000];
+		}
+		synchronized (lock) {
+			lock.notify();
+		}
+	}
+}
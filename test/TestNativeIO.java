@@ -0,0 +1,225 @@
+package test;
+
+import myjvm.io.NativeIO;
+
+// compiled with -sourcepath src/myjvm/java for the declarations of NativeIO
+
+// writes a file of 4 blocks, reads it back in reads across the blocks, then grows it by a pwrite
+class FileWorker implements Runnable {
+	final String path;
+	final int seed;
+	int written;
+	int read;
+	int diff;
+	long size;
+	long grown;
+
+	FileWorker(String path, int seed) {
+		this.path = path;
+		this.seed = seed;
+	}
+
+	public void run() {
+		byte[] b = new byte[2048];
+		for (int i = 0; i < 2048; i++) {
+			b[i] = (byte) (i * seed);
+		}
+		int fd = NativeIO.open(path, 1);
+		for (int k = 0; k < 4; k++) {
+			written += NativeIO.write(fd, b, 0, 2048);
+			// with -Xmx4m a gc runs while the i/o of the other threads is in flight
+			int[] garbage = new int[100000];
+		}
+		NativeIO.close(fd);
+
+		fd = NativeIO.open(path, 3);
+		size = NativeIO.size(fd);
+		byte[] r = new byte[3000];
+		int n;
+		while ((n = NativeIO.read(fd, r, 0, 3000)) != -1) {
+			for (int i = 0; i < n; i++) {
+				diff |= r[i] ^ b[(read + i) & 2047];
+			}
+			read += n;
+		}
+		NativeIO.pwrite(fd, b, 100, 50, 8192L);
+		grown = NativeIO.size(fd);
+		NativeIO.pread(fd, r, 0, 50, 8192L);
+		for (int i = 0; i < 50; i++) {
+			diff |= r[i] ^ b[100 + i];
+		}
+		NativeIO.close(fd);
+	}
+
+	boolean ok() {
+		return written == 8192 && read == 8192 && diff == 0 && size == 8192L && grown == 8242L;
+	}
+}
+
+// sends what it reads back until the client closes the connection
+class Echo implements Runnable {
+	final int fd;
+
+	Echo(int fd) {
+		this.fd = fd;
+	}
+
+	public void run() {
+		byte[] b = new byte[700];
+		int n;
+		while ((n = NativeIO.read(fd, b, 0, 700)) != -1) {
+			int o = 0;
+			while (o < n) {
+				o += NativeIO.write(fd, b, o, n - o);
+			}
+		}
+		NativeIO.close(fd);
+	}
+}
+
+class EchoServer implements Runnable {
+	final int listener;
+	final int clients;
+
+	EchoServer(int listener, int clients) {
+		this.listener = listener;
+		this.clients = clients;
+	}
+
+	public void run() {
+		Thread[] echoes = new Thread[clients];
+		for (int k = 0; k < clients; k++) {
+			echoes[k] = Thread.startVirtualThread(new Echo(NativeIO.accept(listener)));
+		}
+		try {
+			for (int k = 0; k < clients; k++) {
+				echoes[k].join();
+			}
+		} catch (InterruptedException e) {
+		}
+	}
+}
+
+class EchoClient implements Runnable {
+	final int seed;
+	int got;
+	int diff;
+
+	EchoClient(int seed) {
+		this.seed = seed;
+	}
+
+	public void run() {
+		byte[] b = new byte[3000];
+		for (int i = 0; i < 3000; i++) {
+			b[i] = (byte) (i * seed);
+		}
+		int fd = NativeIO.connect("/tmp/myjvm_nio.sock");
+		int o = 0;
+		while (o < 3000) {
+			o += NativeIO.write(fd, b, o, 3000 - o);
+		}
+		byte[] r = new byte[3000];
+		while (got < 3000) {
+			int n = NativeIO.read(fd, r, got, 3000 - got);
+			if (n == -1) {
+				break;
+			}
+			got += n;
+		}
+		for (int i = 0; i < 3000; i++) {
+			diff |= r[i] ^ b[i];
+		}
+		NativeIO.close(fd);
+	}
+}
+
+// a read waiting for the socket in the poller, ended by data and then by the close of the peer
+class EchoReader implements Runnable {
+	final int fd;
+	int first;
+	int second;
+
+	EchoReader(int fd) {
+		this.fd = fd;
+	}
+
+	public void run() {
+		byte[] b = new byte[10];
+		first = NativeIO.read(fd, b, 0, 10);
+		second = NativeIO.read(fd, b, 0, 10);
+		NativeIO.close(fd);
+	}
+}
+
+class TestNativeIO {
+	static void check(boolean ok) {
+		if (!ok) {
+			int z = 0;
+			int y = 1 / z;
+		}
+	}
+
+	public static void main(String[] args) throws InterruptedException {
+		// 1. the main thread blocks in the system calls
+		FileWorker f = new FileWorker("/tmp/myjvm_nio0", 3);
+		f.run();
+		check(f.ok());
+		int in = NativeIO.open("/tmp/myjvm_nio0", 0);
+		int out = NativeIO.open("/tmp/myjvm_nio1", 1);
+		check(NativeIO.transfer(in, 2048L, 4096L, out) == 4096L);
+		NativeIO.close(in);
+		NativeIO.close(out);
+		in = NativeIO.open("/tmp/myjvm_nio1", 0);
+		check(NativeIO.size(in) == 4096L);
+		byte[] r = new byte[4096];
+		check(NativeIO.read(in, r, 0, 4096) == 4096 && NativeIO.read(in, r, 0, 1) == -1);
+		check(r[5] == 15 && r[4095] == -3);
+		NativeIO.close(in);
+
+		// 2. the virtual threads leave their carriers, the files are read and written by io_uring
+		String[] paths = { "/tmp/myjvm_nio2", "/tmp/myjvm_nio3", "/tmp/myjvm_nio4", "/tmp/myjvm_nio5" };
+		FileWorker[] ws = new FileWorker[4];
+		Thread[] vs = new Thread[4];
+		for (int i = 0; i < 4; i++) {
+			ws[i] = new FileWorker(paths[i], i + 5);
+			vs[i] = Thread.startVirtualThread(ws[i]);
+		}
+		for (int i = 0; i < 4; i++) {
+			vs[i].join();
+			check(ws[i].ok());
+		}
+
+		// 3. an echo server in virtual threads, three virtual clients and one platform thread client
+		int listener = NativeIO.listen("/tmp/myjvm_nio.sock");
+		Thread server = Thread.startVirtualThread(new EchoServer(listener, 4));
+		EchoClient[] cs = new EchoClient[4];
+		Thread[] ct = new Thread[4];
+		for (int i = 0; i < 4; i++) {
+			cs[i] = new EchoClient(i + 7);
+			if (i < 3) {
+				ct[i] = Thread.startVirtualThread(cs[i]);
+			} else {
+				ct[i] = new Thread(cs[i]);
+				ct[i].start();
+			}
+		}
+		for (int i = 0; i < 4; i++) {
+			ct[i].join();
+			check(cs[i].got == 3000 && cs[i].diff == 0);
+		}
+		server.join();
+
+		// 4. the reads of a virtual thread completed by the poller
+		int c = NativeIO.connect("/tmp/myjvm_nio.sock");
+		EchoReader reader = new EchoReader(NativeIO.accept(listener));
+		Thread rt = Thread.startVirtualThread(reader);
+		Thread.sleep(20);
+		NativeIO.write(c, r, 0, 5);
+		Thread.sleep(20);
+		NativeIO.close(c);
+		rt.join();
+		check(reader.first == 5 && reader.second == -1);
+		NativeIO.close(listener);
+	}
+}
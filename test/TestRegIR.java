@@ -0,0 +1,44 @@
+package test;
+
+class TestRegIR {
+	// iload; iload; iadd; istore; is a single iadd writing the local
+	static int add(int a, int b) {
+		int c = a + b;
+		return c;
+	}
+
+	static int sum(int n) {
+		int s = 0;
+		for (int i = 0; i < n; i++) {
+			s += i * i;
+		}
+		return s;
+	}
+
+	// the old value of n is on the stack when iinc changes it
+	static long fact(int n) {
+		long r = 1;
+		while (n > 1) {
+			r *= n--;
+		}
+		return r;
+	}
+
+	// the branches meet with a value on the stack
+	static int dist(int a, int b) {
+		return a > b ? a - b : b - a;
+	}
+
+	static double mix(double x, float y) {
+		return x * y - (double)(int)x;
+	}
+
+	// calls another method, not translated
+	static int calls(int n) {
+		return sum(n) + 1;
+	}
+
+	public static void main(String[] args) {
+		int r = calls(10);
+	}
+}
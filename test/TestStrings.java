@@ -0,0 +1,71 @@
+package test;
+
+class TestStrings {
+	static void check(boolean ok) {
+		if (!ok) {
+			int z = 0;
+			int y = 1 / z;
+		}
+	}
+
+	// the hash of the JDK, computed over charAt
+	static int hash(String s) {
+		int h = 0;
+		for (int i = 0; i < s.length(); i++) {
+			h = 31 * h + s.charAt(i);
+		}
+		return h;
+	}
+
+	// 100 letters with c at position at, longer than the vector loops so their tails run too
+	static String letters(int at, char c) {
+		StringBuilder sb = new StringBuilder();
+		for (int i = 0; i < at; i++) {
+			sb.append((char) ('a' + i % 26));
+		}
+		sb.append(c);
+		for (int i = at + 1; i < 100; i++) {
+			sb.append((char) ('a' + i % 26));
+		}
+		return sb.toString();
+	}
+
+	public static void main(String[] args) {
+		String s = letters(70, 's');
+		String s2 = letters(70, 's');
+		// a char above 0xff makes a UTF-16 String, 0xe9 is still Latin-1
+		String u = letters(70, '€');
+		String u2 = letters(70, '€');
+		String e = letters(70, 'é');
+
+		// 1. equals and compareTo of the Latin-1 and the UTF-16 Strings, with each other too
+		check(s != s2 && s.equals(s2) && s.compareTo(s2) == 0);
+		check(u != u2 && u.equals(u2) && u.compareTo(u2) == 0);
+		check(!s.equals(u) && !u.equals(s) && !s.equals(e));
+		check(s.compareTo(u) == 's' - 0x20ac && u.compareTo(s) == 0x20ac - 's');
+		check(e.compareTo(s) == 0xe9 - 's' && u.compareTo(e) == 0x20ac - 0xe9);
+		check(letters(9, '€').compareTo(u) == 0x20ac - 'j');
+		check(s.compareTo(letters(99, '!')) == 'v' - '!');
+		check("abc".compareTo(s) == 3 - 100);
+
+		// 2. indexOf in both coders, from inside and past the end
+		check(u.indexOf(0x20ac) == 70 && s.indexOf(0x20ac) == -1 && e.indexOf(0xe9) == 70);
+		check(s.indexOf('z') == 25 && s.indexOf('z', 26) == 51 && s.indexOf('v', 96) == 99 && s.indexOf('a', 100) == -1);
+		check(u.indexOf('a', 71) == 78 && u.indexOf('s') == 18);
+
+		// 3. hashCode is the one of the JDK for both coders
+		check(s.hashCode() == hash(s) && u.hashCode() == hash(u) && e.hashCode() == hash(e));
+		check(s.hashCode() == s2.hashCode() && u.hashCode() == u2.hashCode());
+
+		// 4. the UTF-8 encode and decode keep the chars and the coder
+		byte[] ub = u.getBytes();
+		check(ub.length == 102 && new String(ub).equals(u));
+		byte[] eb = e.getBytes();
+		check(eb.length == 101 && new String(eb).equals(e));
+		check(new String(s.getBytes()).equals(s));
+
+		// 5. the literals are decoded from the modified UTF-8 of the class file
+		check("café".equals(new StringBuilder().append("caf").append('é').toString()) && "café".length() == 4);
+		check("€".equals(new StringBuilder().append('€').toString()) && "€".hashCode() == 0x20ac);
+	}
+}
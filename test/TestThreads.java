@@ -0,0 +1,109 @@
+package test;
+
+class Square implements Runnable {
+	final int n;
+	int result;
+
+	Square(int n) {
+		this.n = n;
+	}
+
+	public void run() {
+		// garbage made by the threads while the main thread collects
+		int[] a = new int[256];
+		a[255] = n;
+		result = a[255] * n;
+	}
+}
+
+// a subclass with run() of its own, not a Runnable
+class Cube extends Thread {
+	final int n;
+	int result;
+
+	Cube(int n) {
+		this.n = n;
+	}
+
+	public void run() {
+		int[] a = new int[256];
+		a[255] = n;
+		result = a[255] * n * n;
+	}
+}
+
+class Spinner implements Runnable {
+	volatile boolean started;
+	volatile boolean stop;
+
+	public void run() {
+		started = true;
+		while (!stop) {
+			Thread.yield();
+		}
+	}
+}
+
+class TestThreads {
+	static Thread[] first;
+	static Square[] firstSquares;
+	static Cube[] firstCubes;
+
+	static void check(boolean ok) {
+		if (!ok) {
+			int z = 0;
+			int y = 1 / z;
+		}
+	}
+
+	public static void main(String[] args) throws InterruptedException {
+		// a thread alive across all the gcs below
+		Spinner s = new Spinner();
+		Thread spin = new Thread(s);
+		spin.start();
+		while (!s.started) {
+			Thread.yield();
+		}
+
+		// 20 rounds of 40 short threads, with -Xmx4m the garbage makes a gc every few rounds
+		for (int round = 0; round < 20; round++) {
+			Thread[] ts = new Thread[20];
+			Square[] squares = new Square[20];
+			Cube[] cubes = new Cube[20];
+			for (int i = 0; i < 20; i++) {
+				squares[i] = new Square(round * 20 + i);
+				ts[i] = new Thread(squares[i]);
+				ts[i].start();
+				cubes[i] = new Cube(i);
+				cubes[i].start();
+			}
+			for (int i = 0; i < 20; i++) {
+				ts[i].join();
+				cubes[i].join();
+			}
+			for (int i = 0; i < 20; i++) {
+				int n = round * 20 + i;
+				check(!ts[i].isAlive() && squares[i].result == n * n);
+				check(!cubes[i].isAlive() && cubes[i].result == i * i * i);
+			}
+			if (round == 0) {
+				first = ts;
+				firstSquares = squares;
+				firstCubes = cubes;
+			}
+			int[] garbage = new int[200000];
+		}
+
+		// the gcs freed the records of the other rounds, whose thread objects were garbage; the first round is
+		// still reachable and reads as ended, and no new thread took its records
+		for (int i = 0; i < 20; i++) {
+			check(!first[i].isAlive() && firstSquares[i].result == i * i);
+			check(!firstCubes[i].isAlive() && firstCubes[i].result == i * i * i);
+		}
+
+		check(spin.isAlive());
+		s.stop = true;
+		spin.join();
+		check(!spin.isAlive());
+	}
+}